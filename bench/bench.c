@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include "../src/smacs.h"
+#include "../src/headless.h"
+#include "../src/common.h"
+#include "../src/profiler.h"
+
+/*
+ * Replays keystroke traces against the Editor API on synthetic files and
+ * reports latency percentiles of every phase of a frame:
+ *   edit      the editor call itself without its line index zones
+ *   lines     line index zones of the edit (lines patch, determine lines)
+ *             and the visual line index and arena (editor_recognize_arena)
+ *   tokenize  highlighting of the visible text, the tokenize zone of the profiler
+ *   layout    render_update_glyph without its tokenize zone
+ *   draw      render_draw_smacs by the software renderer
+ *
+ * Usage: bench <ttf> <size>... where size is like 1K, 1M, 100M, 1G
+ */
+
+#define BENCH_DIR  ".build/bench"
+#define BENCH_KEYS 200
+#define BENCH_PATH_LEN 256
+#define BENCH_NEEDLE "needle"
+
+typedef enum {
+	PHASE_EDIT,
+	PHASE_LINES,
+	PHASE_TOKENIZE,
+	PHASE_LAYOUT,
+	PHASE_DRAW,
+	PHASES_LEN,
+} BenchPhase;
+
+static const char *BenchPhaseNames[PHASES_LEN] = {"edit", "lines", "tokenize", "layout", "draw"};
+
+typedef struct {
+	double *data;
+	size_t len;
+	size_t cap;
+} Samples;
+
+typedef struct {
+	char *name;
+	void (*setup)(Smacs *smacs);
+	void (*key)(Smacs *smacs, size_t i);
+} BenchTrace;
+
+static char BenchNotification[RENDER_NOTIFICATION_LEN];
+
+void bench_goto_middle(Smacs *smacs)
+{
+	Buffer *buffer = smacs->editor.pane->buffer;
+
+	editor_goto_point(&smacs->editor, buffer->len > 0 ? buffer->data[buffer->len / 2].start : 0);
+	editor_recognize_arena(&smacs->editor);
+}
+
+void bench_typing_key(Smacs *smacs, size_t i)
+{
+	static char *text = "the quick brown fox ";
+	char ch[2] = {0};
+
+	if (i % 40 == 39) {
+		editor_new_line(&smacs->editor);
+		return;
+	}
+
+	ch[0] = text[i % strlen(text)];
+	editor_insert(&smacs->editor, ch);
+}
+
+void bench_kill_line_key(Smacs *smacs, size_t i)
+{
+	(void) i;
+	editor_kill_line(&smacs->editor);
+}
+
+void bench_paste_setup(Smacs *smacs)
+{
+	bench_goto_middle(smacs);
+	editor_move_begginning_of_line(&smacs->editor);
+	editor_set_mark(&smacs->editor);
+	editor_move_end_of_line(&smacs->editor);
+	editor_copy_to_clipboard(&smacs->editor);
+	smacs->editor.state = NONE;
+}
+
+void bench_paste_key(Smacs *smacs, size_t i)
+{
+	(void) i;
+	editor_paste(&smacs->editor);
+}
+
+void bench_move_line_key(Smacs *smacs, size_t i)
+{
+	//half of the keys go down, the rest back up
+	if (i < BENCH_KEYS / 2) editor_move_line_down(&smacs->editor);
+	else editor_move_line_up(&smacs->editor);
+}
+
+void bench_search_setup(Smacs *smacs)
+{
+	editor_goto_point(&smacs->editor, 0);
+	editor_user_search_forward(&smacs->editor);
+	editor_user_input_insert(&smacs->editor, BENCH_NEEDLE);
+}
+
+void bench_search_key(Smacs *smacs, size_t i)
+{
+	(void) i;
+
+	//the search is cleared when nothing is found, start from the top again
+	if (!editor_user_search_next(&smacs->editor, BenchNotification, RENDER_NOTIFICATION_LEN)) {
+		bench_search_setup(smacs);
+	}
+}
+
+void bench_cursors_setup(Smacs *smacs)
+{
+	//every needle gets a cursor
+	bench_search_setup(smacs);
+	editor_search_matches_update(&smacs->editor);
+	editor_cursors_from_matches(&smacs->editor);
+}
+
+void bench_cursors_key(Smacs *smacs, size_t i)
+{
+	char ch[2] = {0};
+
+	ch[0] = "cursor"[i % 6];
+	editor_cursors_insert(&smacs->editor, ch);
+}
+
+void bench_find_file_key(Smacs *smacs, size_t i)
+{
+	char ch[2] = {0};
+
+	editor_find_file(&smacs->editor, true);
+	ch[0] = "smacs"[i % 5];
+	editor_user_input_insert(&smacs->editor, ch);
+	editor_completion_actualize(&smacs->editor);
+
+	editor_user_input_clear(&smacs->editor);
+	editor_completor_clean(&smacs->editor);
+}
+
+static const BenchTrace BenchTraces[] = {
+	{"typing", bench_goto_middle, bench_typing_key},
+	{"kill-line", bench_goto_middle, bench_kill_line_key},
+	{"paste", bench_paste_setup, bench_paste_key},
+	{"move-line", bench_goto_middle, bench_move_line_key},
+	{"search", bench_search_setup, bench_search_key},
+	{"find-file", bench_goto_middle, bench_find_file_key},
+	{"cursors", bench_cursors_setup, bench_cursors_key},
+};
+
+#define BENCH_TRACES_LEN (sizeof(BenchTraces) / sizeof(BenchTraces[0]))
+
+double bench_now_us(void)
+{
+	return (double) SDL_GetPerformanceCounter() * 1000000.0 / (double) SDL_GetPerformanceFrequency();
+}
+
+size_t bench_parse_size(char *str)
+{
+	char *end;
+	size_t size;
+
+	size = (size_t) strtoul(str, &end, 10);
+	switch (toupper((unsigned char) *end)) {
+	case 'K': return size << 10;
+	case 'M': return size << 20;
+	case 'G': return size << 30;
+	default: return size;
+	}
+}
+
+/**
+ * C-like text with comments, strings and numbers, a needle every 97 lines
+ */
+int bench_generate_file(char *path, size_t size)
+{
+	struct stat st;
+	FILE *out;
+	char line[BENCH_PATH_LEN];
+	size_t written, line_num;
+	int len;
+
+	if (stat(path, &st) == 0 && (size_t) st.st_size == size) return 0;
+
+	out = fopen(path, "w");
+	if (out == NULL) {
+		fprintf(stderr, "Could not create bench file %s\n", path);
+		return 1;
+	}
+
+	written = 0;
+	for (line_num = 0; written < size; ++line_num) {
+		switch (line_num % 4) {
+		case 0:
+			len = snprintf(line, sizeof(line), "/* comment of the block %ld */\n", line_num);
+			break;
+		case 1:
+			len = snprintf(line, sizeof(line), "\tint value_%ld = %ld; // trailing comment\n", line_num, line_num * 31);
+			break;
+		case 2:
+			len = snprintf(line, sizeof(line), "\tstatic char *name_%ld = \"%s\";\n", line_num, line_num % 97 == 2 ? BENCH_NEEDLE : "string literal");
+			break;
+		default:
+			len = snprintf(line, sizeof(line), "\tif (value_%ld > 0) return value_%ld + 1;\n", line_num - 2, line_num - 2);
+			break;
+		}
+
+		len = (int) MIN((size_t) len, size - written);
+		fwrite(line, sizeof(char), (size_t) len, out);
+		written += (size_t) len;
+	}
+
+	fclose(out);
+	return 0;
+}
+
+/**
+ * Time of the zone in the frame which is just finished (see profiler_frame_end)
+ */
+double bench_zone_us(ProfileZone zone)
+{
+	return profiler_ticks_to_ms(profiler.frame_ticks[zone]) * 1000.0;
+}
+
+int bench_compare(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+double bench_percentile(Samples *samples, size_t percent)
+{
+	if (samples->len == 0) return 0.0;
+
+	return samples->data[MIN(samples->len * percent / 100, samples->len - 1)];
+}
+
+void bench_report(char *size, const char *trace, Samples *samples)
+{
+	for (size_t phase = 0; phase < PHASES_LEN; ++phase) {
+		qsort(samples[phase].data, samples[phase].len, sizeof(double), bench_compare);
+
+		printf("%-6s %-10s %-9s %10.1f %10.1f %10.1f %10.1f\n",
+			   size, trace, BenchPhaseNames[phase],
+			   bench_percentile(&samples[phase], 50),
+			   bench_percentile(&samples[phase], 90),
+			   bench_percentile(&samples[phase], 99),
+			   bench_percentile(&samples[phase], 100));
+	}
+}
+
+int bench_run(char *fallback_ttf_path, char *size_str)
+{
+	Smacs smacs = {0};
+	Samples samples[PHASES_LEN] = {0};
+	SDL_Surface *surface;
+	char path[BENCH_PATH_LEN];
+	double t[PHASES_LEN + 1], lines_us, tokenize_us, load;
+
+	snprintf(path, sizeof(path), "%s/bench_%s.c", BENCH_DIR, size_str);
+	if (bench_generate_file(path, bench_parse_size(size_str)) != 0) return 1;
+
+	surface = SDL_CreateSurface(HEADLESS_WIDTH, HEADLESS_HEIGHT, SDL_PIXELFORMAT_ARGB8888);
+	if (surface == NULL) {
+		fprintf(stderr, "Could not create surface: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	load = bench_now_us();
+	if (smacs_init(&smacs, "", fallback_ttf_path, path, surface) != 0) return 1;
+	load = bench_now_us() - load;
+	printf("%-6s %-10s %-9s %10.1f\n", size_str, "open", "load", load);
+
+	for (size_t trace = 0; trace < BENCH_TRACES_LEN; ++trace) {
+		smacs_layout_panes(&smacs);
+		render_update_glyph(&smacs);
+		BenchTraces[trace].setup(&smacs);
+		//the zones of the setup are not a part of the first key
+		profiler_frame_end();
+
+		for (size_t phase = 0; phase < PHASES_LEN; ++phase) samples[phase].len = 0;
+
+		for (size_t i = 0; i < BENCH_KEYS; ++i) {
+			t[PHASE_EDIT] = bench_now_us();
+			BenchTraces[trace].key(&smacs, i);
+			t[PHASE_LINES] = bench_now_us();
+			editor_recognize_arena(&smacs.editor);
+			t[PHASE_LAYOUT] = bench_now_us();
+			smacs_layout_panes(&smacs);
+			render_update_glyph(&smacs);
+			t[PHASE_DRAW] = bench_now_us();
+			render_draw_smacs(&smacs);
+			t[PHASES_LEN] = bench_now_us();
+
+			//the edit indexes the lines and the layout tokenizes the visible text, their zones split those times
+			profiler_frame_end();
+			lines_us = bench_zone_us(PROFILE_LINES_PATCH) + bench_zone_us(PROFILE_DETERMINE_LINES);
+			tokenize_us = bench_zone_us(PROFILE_TOKENIZE);
+
+			gb_append(&samples[PHASE_EDIT], MAX(t[PHASE_LINES] - t[PHASE_EDIT] - lines_us, 0.0));
+			gb_append(&samples[PHASE_LINES], t[PHASE_LAYOUT] - t[PHASE_LINES] + lines_us);
+			gb_append(&samples[PHASE_TOKENIZE], tokenize_us);
+			gb_append(&samples[PHASE_LAYOUT], MAX(t[PHASE_DRAW] - t[PHASE_LAYOUT] - tokenize_us, 0.0));
+			gb_append(&samples[PHASE_DRAW], t[PHASES_LEN] - t[PHASE_DRAW]);
+		}
+
+		bench_report(size_str, BenchTraces[trace].name, samples);
+		smacs.editor.state = NONE;
+		editor_cursors_clear(smacs.editor.pane);
+	}
+
+	for (size_t phase = 0; phase < PHASES_LEN; ++phase) gb_free(&samples[phase]);
+
+	smacs_destroy(&smacs);
+	SDL_DestroySurface(surface);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <ttf> <size>...\n", argv[0]);
+		return 1;
+	}
+
+	mkdir(".build", 0755);
+	mkdir(BENCH_DIR, 0755);
+
+	printf("%-6s %-10s %-9s %10s %10s %10s %10s\n", "size", "trace", "phase", "p50_us", "p90_us", "p99_us", "max_us");
+
+	for (int i = 2; i < argc; ++i) {
+		if (bench_run(argv[1], argv[i]) != 0) return 1;
+	}
+
+	return 0;
+}
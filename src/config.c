@@ -21,7 +21,8 @@ Config config_load(const char *config_path, char *fallback_font_path)
 		.tab_size = 8,
 		.leading = 1,
 		.theme_name = "jblow_nastalgia",
-		.line_number_format = HIDE};
+		.line_number_format = HIDE,
+		.truncate_lines = false};
 
 	FILE *config_file = fopen(config_path, "r");
 	if (config_file == NULL) {
@@ -50,6 +51,10 @@ Config config_load(const char *config_path, char *fallback_font_path)
 				else if (0 == strcmp(value, CONFIG_LINE_NUMBER_FORMAT_ABSOLUTE)) config.line_number_format = ABSOLUTE;
 				else if (0 == strcmp(value, CONFIG_LINE_NUMBER_FORMAT_HIDE)) config.line_number_format = HIDE;
 				else config_mismatch(CONFIG_LINE_NUMBER_FORMAT, CONFIG_LINE_NUMBER_FORMAT_POSSIBLE_VALUES);
+			} else if (0 == strcmp(key, CONFIG_TRUNCATE_LINES)) {
+				if (0 == strcmp(value, "true")) config.truncate_lines = true;
+				else if (0 == strcmp(value, "false")) config.truncate_lines = false;
+				else config_mismatch(CONFIG_TRUNCATE_LINES, "[true, false]");
 			}
 		}
 	}
@@ -11,6 +11,7 @@ typedef struct {
 	int leading;
 	char *theme_name;
 	enum LineNumberFormat line_number_format;
+	bool truncate_lines;
 } Config;
 
 Config config_load(const char *config_path, char *fallback_font_path);
@@ -25,6 +26,7 @@ void config_apply_theme(Smacs *smacs, const char *theme_name);
 #define CONFIG_LEADING             "leading"
 #define CONFIG_THEME               "theme"
 #define CONFIG_LINE_NUMBER_FORMAT  "line_number_format"
+#define CONFIG_TRUNCATE_LINES      "truncate_lines"
 
 #define CONFIG_LINE_NUMBER_FORMAT_RELATIVE  "relative"
 #define CONFIG_LINE_NUMBER_FORMAT_ABSOLUTE  "absolute"
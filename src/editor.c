@@ -1,6 +1,13 @@
+#ifndef _DEFAULT_SOURCE
+//st_mtim is not in C11
+#define _DEFAULT_SOURCE
+#endif
+
 #include <assert.h>
 #include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +20,8 @@
 #include "editor.h"
 #include "utf8.h"
 #include "common.h"
+#include "profiler.h"
+#include "search.h"
 
 void append_char(Content *content, char ch, size_t pos)
 {
@@ -51,12 +60,10 @@ void editor_goto_point(Editor *editor, size_t pos)
 	editor->pane->position = pos;
 
     if (editor->pane->buffer->update_column) {
-        size_t current_line = editor_get_current_line_number(editor->pane);
-        if (current_line < editor->pane->buffer->len) {
-            Line *line = &editor->pane->buffer->data[current_line];
-            if (line != NULL) {
-                editor->pane->buffer->column = pos - line->start;
-            }
+        VisualLines *visual = editor_visual_lines(editor, editor->pane);
+        if (visual->len > 0) {
+            Line *row = &visual->data[editor_visual_row_by_position(visual, pos)];
+            editor->pane->buffer->column = pos - row->start;
         }
     }
 
@@ -74,17 +81,22 @@ size_t editor_reg_end(Editor *editor)
 	return MIN(editor->pane->buffer->content.len, MAX(editor->mark, editor->pane->position));
 }
 
-void editor_store_event(Editor *editor, char *str, size_t len, ChangeEventType event_type)
+static ChangeEvent *editor_buffer_next_event(Buffer *buffer)
 {
-	ChangeEvent *curr_event;
-
-	if ((editor->pane->buffer->events_len+1) > CHANGE_EVENT_HISTORY_SIZE) {
-		editor->pane->buffer->events_len = 0;
+	if ((buffer->events_len+1) > CHANGE_EVENT_HISTORY_SIZE) {
+		buffer->events_len = 0;
 	}
 
-	curr_event = &editor->pane->buffer->events[editor->pane->buffer->events_len++];
+	return &buffer->events[buffer->events_len++];
+}
+
+static void editor_buffer_store_event(Buffer *buffer, size_t point, char *str, size_t len, ChangeEventType event_type)
+{
+	ChangeEvent *curr_event;
+
+	curr_event = editor_buffer_next_event(buffer);
 	curr_event->type = event_type;
-	curr_event->point = editor->pane->position;
+	curr_event->point = point;
 
 	sb_clean(&curr_event->string);
 	for (size_t i = 0; i < len; ++i) {
@@ -92,692 +104,3211 @@ void editor_store_event(Editor *editor, char *str, size_t len, ChangeEventType e
 	}
 }
 
-void editor_delete_forward_len(Editor *editor, size_t delete_len)
+void editor_store_event(Editor *editor, char *str, size_t len, ChangeEventType event_type)
 {
-	Content *content;
-	content = &editor->pane->buffer->content;
+	editor_buffer_store_event(editor->pane->buffer, editor->pane->position, str, len, event_type);
+}
 
-	if (editor->pane->position >= content->len) return;
+/**
+ * One undo step which puts [beg, end) back as it is now, stored before its bytes are moved in place
+ */
+static void editor_store_span(Buffer *buffer, size_t point, size_t beg, size_t end)
+{
+	ChangeEvent *event;
 
-	memmove(&content->data[editor->pane->position],
-			&content->data[editor->pane->position + delete_len],
-			content->len - editor->pane->position);
+	event = editor_buffer_next_event(buffer);
+	event->type = REPLACEMENT;
+	event->point = point;
 
-	content->len -= delete_len;
+	event->replacements.len = 0;
+	sb_clean(&event->replacements.text);
+	gb_append(&event->replacements, ((Replacement) {beg, end, 0, end - beg}));
+	sb_append_manyl(&event->replacements.text, &buffer->content.data[beg], end - beg);
 }
 
-void editor_delete_backward(Editor *editor)
+static KillText *editor_kill_text_alloc(size_t len)
 {
-	Content *content;
-	size_t reg_beg, reg_end, delete_len;
+	KillText *text;
 
-	content = &editor->pane->buffer->content;
+	text = malloc(sizeof(*text) + len + 1);
+	if (text == NULL) {
+		fprintf(stderr, "No more free space\n");
+		exit(EXIT_FAILURE);
+	}
 
-	if (editor->state == SELECTION) {
-		reg_beg = editor_reg_beg(editor);
-		reg_end = editor_reg_end(editor);
-		delete_len = reg_end - reg_beg;
+	text->refs = 1;
+	text->len = len;
+	text->data[len] = '\0';
 
-		memmove(&content->data[reg_beg], &content->data[reg_end], content->len - reg_end);
-		content->len -= delete_len;
-		editor_goto_point(editor, reg_beg);
-	} else {
-		if (editor->pane->position == 0) return;
+	return text;
+}
 
-		delete_len = utf8_size_char_backward(content->data, editor->pane->position - 1);
-		memmove(&content->data[editor->pane->position - delete_len],
-				&content->data[editor->pane->position],
-				content->len - editor->pane->position + delete_len);
-		content->len -= delete_len;
-		editor_goto_point(editor, editor->pane->position - delete_len);
-	}
+static KillText *editor_kill_text(char *data, size_t len)
+{
+	KillText *text = editor_kill_text_alloc(len);
 
-	memset(&content->data[content->len], 0, content->capacity - content->len);
+	memcpy(text->data, data, len);
+	return text;
+}
 
-	editor_determine_lines(editor);
-	editor->state = NONE;
-	editor->pane->buffer->need_to_save = true;
+static void editor_kill_text_release(KillText *text)
+{
+	if (text != NULL && --text->refs == 0) free(text);
 }
 
-void editor_delete_forward(Editor *editor)
+void editor_content_reserve(Content *content, size_t len)
 {
-	int8_t char_len;
+	size_t capacity;
 
-	if (editor->state == SELECTION) {
-		editor_delete_backward(editor);
-		return;
+	//one extra byte keeps the content null terminated
+	if (len < content->capacity) return;
+
+	if (content->capacity == 0) {
+		capacity = MAX(EDITOR_CONTENT_CAP, len + 1);
+	} else {
+		capacity = content->capacity;
+		while (capacity <= len) capacity *= 2;
 	}
 
-	char_len = utf8_size_char(editor->pane->buffer->content.data[editor->pane->position]);
-	editor_delete_forward_len(editor, char_len);
+	content->data = realloc(content->data, capacity * sizeof(*content->data));
+	if (content->data == NULL) {
+		fprintf(stderr, "No more free space\n");
+		exit(EXIT_FAILURE);
+	}
 
-	editor_determine_lines(editor);
-	editor->state = NONE;
-	editor->pane->buffer->need_to_save = true;
+	memset(&content->data[content->len], 0, capacity - content->len);
+	content->capacity = capacity;
 }
 
-void editor_insert(Editor *editor, char *str)
+size_t editor_char_columns(char ch, size_t tab_size)
 {
-	Buffer *buf = editor->pane->buffer;
-	register size_t i;
+	return ch == '\t' ? tab_size : 1;
+}
 
-	if (str == NULL) return;
+void editor_visual_wrap_line(VisualLines *rows, char *data, size_t start, size_t end, size_t wrap_cols, size_t tab_size)
+{
+	size_t i, col, width, row_start, prev;
 
-	Content *content = &buf->content;
+	row_start = start;
+	prev = start;
+	col = 0;
 
-	if (content == NULL) {
-		fprintf(stderr, "Content is null\n");
-		return;
-	}
+	if (wrap_cols > 0) {
+		for (i = start; i < end; i += utf8_size_char(data[i])) {
+			width = editor_char_columns(data[i], tab_size);
 
-	if (editor->state == SELECTION) {
-		editor_delete_backward(editor);
-	}
+			if (col > 0 && col + width > wrap_cols) {
+				gb_append(rows, ((Line) {row_start, prev}));
+				row_start = i;
+				col = 0;
+			}
 
-	size_t str_size = strlen(str);
-	for (i = 0; i < str_size; ++i) {
-		append_char(content, str[i], editor->pane->position + i);
+			col += width;
+			prev = i;
+		}
 	}
 
-	editor_store_event(editor, str, str_size, INSERTION);
-	editor->pane->position += str_size;
-	editor->pane->buffer->need_to_save = true;
-	editor_determine_lines(editor);
-	editor->state = NONE;
+	gb_append(rows, ((Line) {row_start, end}));
 }
 
-size_t editor_get_current_line_number(Pane *pane)
+size_t editor_visual_row_by_position(VisualLines *visual, size_t pos)
 {
-	register size_t i;
-	Line *line;
-
-	if (pane->buffer->len == 0) return 0;
-
-	for (i = 0; i < pane->buffer->len; ++i) {
-		line = &pane->buffer->data[i];
-		if (line->start <= pane->position && pane->position <= line->end) {
-			return i;
-		}
+	size_t lo, hi, mid;
+
+	lo = 0;
+	hi = visual->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (visual->data[mid].start <= pos) lo = mid + 1;
+		else hi = mid;
 	}
 
-	return 0;
+	return lo > 0 ? lo - 1 : 0;
 }
 
-bool editor_is_mini_buffer_active(Editor *editor)
+/**
+ * Which index is built again for another width: the outdated one of the
+ * same width, then an unused one, then the least recently used
+ */
+static size_t editor_visual_rank(VisualLines *visual, size_t wrap_cols, size_t tab_size)
 {
-	bool mini_buffer_is_active = false;
-	if (editor->state & SEARCH) mini_buffer_is_active = true;
-	if (editor->state & EXTEND_COMMAND) mini_buffer_is_active = true;
-	if (editor->state & COMPLETION) mini_buffer_is_active = true;
+	if (!visual->valid && visual->wrap_cols == wrap_cols && visual->tab_size == tab_size) return 0;
+	if (!visual->valid) return 1;
 
-	return mini_buffer_is_active;
+	return 2 + visual->used;
 }
 
-void editor_recognize_arena(Editor *editor)
+/**
+ * Rows of the buffer wrapped by the width of the pane. The buffer keeps an
+ * index for each of EDITOR_VISUAL_WIDTHS widths, so panes of different widths
+ * showing the same buffer do not re-wrap it on every frame.
+ */
+VisualLines *editor_visual_lines(Editor *editor, Pane *pane)
 {
-	size_t line_num;
-	register size_t pane_i, line_padded;
-	Arena *arena;
-	Pane *pane;
+	static size_t clock = 0;
+	Buffer *buffer;
+	VisualLines *visual;
+	size_t tops[PANES_MAX_SIZE];
+	bool same_width;
+	register size_t i;
 
-	line_padded = editor_is_mini_buffer_active(editor) ? 2 : 1;
+	buffer = pane->buffer;
 
-	for (pane_i = 0; pane_i < editor->panes_len; ++pane_i) {
-		pane = &editor->panes[pane_i];
-		line_num = editor_get_current_line_number(pane);
-		arena = &pane->arena;
+	visual = &buffer->visual[0];
+	for (i = 0; i < EDITOR_VISUAL_WIDTHS; ++i) {
+		if (buffer->visual[i].valid && buffer->visual[i].wrap_cols == pane->wrap_cols && buffer->visual[i].tab_size == editor->tab_size) {
+			buffer->visual[i].used = ++clock;
+			return &buffer->visual[i];
+		}
 
-		if (line_num >= (arena->start + arena->show_lines - line_padded)) {
-			arena->start = MIN(pane->buffer->len - 1, line_num - arena->show_lines / 2);
-		} else if (line_num < arena->start) {
-			arena->start = line_num;
+		if (editor_visual_rank(&buffer->visual[i], pane->wrap_cols, editor->tab_size) < editor_visual_rank(visual, pane->wrap_cols, editor->tab_size)) {
+			visual = &buffer->visual[i];
 		}
 	}
-}
-
-void editor_next_line(Editor *editor)
-{
-	size_t next_pos, line_num;
-	Line *line;
 
-	line_num = editor_get_current_line_number(editor->pane);
+	//keep the first visible row of every pane of this width on the same text
+	same_width = visual->wrap_cols == pane->wrap_cols && visual->tab_size == editor->tab_size;
+	for (i = 0; i < editor->panes_len; ++i) {
+		tops[i] = 0;
+		if (same_width && editor->panes[i].buffer == buffer && editor->panes[i].wrap_cols == pane->wrap_cols && editor->panes[i].arena.start < visual->len) {
+			tops[i] = MIN(visual->data[editor->panes[i].arena.start].start, buffer->content.len);
+		}
+	}
 
-	if (editor->pane->buffer->len > 0) {
-		line = &editor->pane->buffer->data[line_num];
+	visual->len = 0;
+	for (i = 0; i < buffer->len; ++i) {
+		editor_visual_wrap_line(visual, buffer->content.data, buffer->data[i].start, buffer->data[i].end, pane->wrap_cols, editor->tab_size);
+	}
 
-		++line_num;
-		if (editor->pane->buffer->len > line_num) {
-			line = &editor->pane->buffer->data[line_num];
-			next_pos = MIN(line->start + editor->pane->buffer->column, line->end);
+	visual->wrap_cols = pane->wrap_cols;
+	visual->tab_size = editor->tab_size;
+	visual->valid = true;
+	visual->used = ++clock;
 
-            editor->pane->buffer->update_column = false;
-			editor_goto_point(editor, MIN(next_pos, line->end));
-			editor_recognize_arena(editor);
+	for (i = 0; same_width && i < editor->panes_len; ++i) {
+		if (editor->panes[i].buffer == buffer && editor->panes[i].wrap_cols == pane->wrap_cols) {
+			editor->panes[i].arena.start = editor_visual_row_by_position(visual, tops[i]);
 		}
 	}
+
+	return visual;
 }
 
-void editor_previous_line(Editor *editor)
+void editor_pane_wrap(Editor *editor, Pane *pane, size_t wrap_cols)
 {
-	size_t next_pos, line_num;
-	Line *line;
-
-	line_num = editor_get_current_line_number(editor->pane);
-	line = &editor->pane->buffer->data[line_num];
+	VisualLines *visual;
+	size_t top;
 
-	if (line_num != 0) {
-		line_num--;
-		line = &editor->pane->buffer->data[line_num];
+	if (pane->wrap_cols == wrap_cols) return;
 
-		next_pos = MIN(line->start + editor->pane->buffer->column, line->end);
-        editor->pane->buffer->update_column = false;
-		editor_goto_point(editor, MIN(next_pos, line->end));
+	visual = editor_visual_lines(editor, pane);
+	top = pane->arena.start < visual->len ? visual->data[pane->arena.start].start : 0;
 
-		editor_recognize_arena(editor);
-	}
+	pane->wrap_cols = wrap_cols;
+	visual = editor_visual_lines(editor, pane);
+	pane->arena.start = editor_visual_row_by_position(visual, top);
 }
 
-void editor_char_forward(Editor *editor)
+/**
+ * Replaces rows of old text [old_beg, old_end] by the rows of the new lines,
+ * rows after the change are only shifted
+ */
+void editor_visual_patch(Buffer *buffer, size_t old_beg, size_t old_end, Line *lines, size_t lines_len, long delta)
 {
-	uint8_t char_len;
+	static VisualLines rows = {0};
+	VisualLines *visual;
+	size_t row_beg, row_end, new_len, width;
+	register size_t i;
 
-	char_len = utf8_size_char(editor->pane->buffer->content.data[editor->pane->position]);
-	editor_goto_point(editor, MIN(editor->pane->position + char_len, editor->pane->buffer->content.len));
+	for (width = 0; width < EDITOR_VISUAL_WIDTHS; ++width) {
+		visual = &buffer->visual[width];
+		if (!visual->valid) continue;
+
+		rows.len = 0;
+		for (i = 0; i < lines_len; ++i) {
+			editor_visual_wrap_line(&rows, buffer->content.data, lines[i].start, lines[i].end, visual->wrap_cols, visual->tab_size);
+		}
+
+		row_beg = editor_visual_row_by_position(visual, old_beg);
+		row_end = editor_visual_row_by_position(visual, old_end) + 1;
+		new_len = visual->len - (row_end - row_beg) + rows.len;
+
+		while (visual->cap < new_len) {
+			visual->data = gb_append_(visual->data, &visual->cap, sizeof(*visual->data));
+		}
+
+		if (rows.len != row_end - row_beg) {
+			memmove(&visual->data[row_beg + rows.len], &visual->data[row_end], (visual->len - row_end) * sizeof(*visual->data));
+		}
+		memcpy(&visual->data[row_beg], rows.data, rows.len * sizeof(*visual->data));
+		visual->len = new_len;
+
+		//bytes moved in place (line moves) keep the rows after them as they are
+		for (i = row_beg + rows.len; delta != 0 && i < visual->len; ++i) {
+			visual->data[i].start += delta;
+			visual->data[i].end += delta;
+		}
+	}
 }
 
-void editor_char_backward(Editor *editor)
+/**
+ * First line which ends at or after the position
+ */
+size_t editor_line_by_position(Buffer *buffer, size_t pos)
 {
-	uint8_t char_len;
+	size_t lo, hi, mid;
 
-	char_len = utf8_size_char_backward(editor->pane->buffer->content.data, editor->pane->position - 1);
-	if (editor->pane->buffer->column > 0) {
-		editor->pane->buffer->column--;
+	if (buffer->len == 0) return 0;
+
+	lo = 0;
+	hi = buffer->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (buffer->data[mid].end < pos) lo = mid + 1;
+		else hi = mid;
 	}
 
-	editor_goto_point(editor, (size_t) MAX(((int)editor->pane->position) - char_len, 0));
+	return MIN(lo, buffer->len - 1);
 }
 
-void editor_move_end_of_line(Editor *editor)
+/**
+ * First checkpoint at or after the position
+ */
+size_t editor_columns_lower_bound(ColumnCheckpoints *columns, size_t pos)
 {
-	register size_t i;
-	Line *line;
-
-	for (i = 0; i < editor->pane->buffer->len; ++i) {
-		line = &editor->pane->buffer->data[i];
-		if (line->start <= editor->pane->position && editor->pane->position <= line->end) {
-			editor_goto_point(editor, line->end);
-			return;
-		}
+	size_t lo, hi, mid;
+
+	lo = 0;
+	hi = columns->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (columns->data[mid].pos < pos) lo = mid + 1;
+		else hi = mid;
 	}
+
+	return lo;
 }
 
-void editor_move_begginning_of_line(Editor *editor)
+/**
+ * Checkpoints of the edited text [old_beg, old_end] are dropped, the later ones are shifted
+ */
+void editor_columns_patch(ColumnCheckpoints *columns, size_t old_beg, size_t old_end, long delta)
 {
+	size_t beg, end;
 	register size_t i;
-	Line *line;
 
-	for (i = 0; i < editor->pane->buffer->len; ++i) {
-		line = &editor->pane->buffer->data[i];
-		if (line->start <= editor->pane->position && editor->pane->position <= line->end) {
-			editor_goto_point(editor, line->start);
-			editor->pane->buffer->column = 0;
-			return;
-		}
+	if (columns->len == 0) return;
+
+	beg = editor_columns_lower_bound(columns, old_beg);
+	end = editor_columns_lower_bound(columns, old_end + 1);
+
+	memmove(&columns->data[beg], &columns->data[end], (columns->len - end) * sizeof(*columns->data));
+	columns->len -= end - beg;
+
+	for (i = beg; delta != 0 && i < columns->len; ++i) {
+		columns->data[i].pos += delta;
 	}
 }
 
-void editor_determine_lines(Editor *editor)
+/**
+ * Nearest checkpoint of the line which is not after the position (or the column when by_column)
+ */
+ColumnCheckpoint editor_column_checkpoint(Editor *editor, Buffer *buffer, Line *line, bool by_column, size_t value)
 {
+	static ColumnCheckpoints built = {0};
+	ColumnCheckpoints *columns;
+	ColumnCheckpoint *cp;
+	size_t beg, end, lo, hi, mid, col, last;
 	register size_t i;
-	size_t beg;
-	Buffer *buffer;
 
-	buffer = editor->pane->buffer;
-	buffer->len = 0;
+	if (line->end - line->start < EDITOR_COLUMN_CHECKPOINT_STEP) {
+		return (ColumnCheckpoint) {line->start, 0};
+	}
 
-	if (buffer->content.len == 0) return;
+	columns = &buffer->columns;
+	if (columns->tab_size != editor->tab_size) {
+		columns->len = 0;
+		columns->tab_size = editor->tab_size;
+	}
 
-	beg = 0;
-	for (i = 0; i < buffer->content.len; ++i) {
-		if (buffer->content.data[i] == '\n') {
-			gb_append(buffer, ((Line) {beg, i}));
-			beg = i + 1;
+	beg = editor_columns_lower_bound(columns, line->start);
+	if (beg == columns->len || columns->data[beg].pos != line->start) {
+		built.len = 0;
+		col = 0;
+		last = line->start;
+		gb_append(&built, ((ColumnCheckpoint) {line->start, 0}));
+
+		for (i = line->start; i < line->end; i += utf8_size_char(buffer->content.data[i])) {
+			if (i - last >= EDITOR_COLUMN_CHECKPOINT_STEP) {
+				gb_append(&built, ((ColumnCheckpoint) {i, col}));
+				last = i;
+			}
+			col += editor_char_columns(buffer->content.data[i], editor->tab_size);
+		}
+
+		while (columns->cap < columns->len + built.len) {
+			columns->data = gb_append_(columns->data, &columns->cap, sizeof(*columns->data));
 		}
+		memmove(&columns->data[beg + built.len], &columns->data[beg], (columns->len - beg) * sizeof(*columns->data));
+		memcpy(&columns->data[beg], built.data, built.len * sizeof(*columns->data));
+		columns->len += built.len;
 	}
 
-	gb_append(buffer, ((Line) {beg, i}));
+	end = editor_columns_lower_bound(columns, line->end + 1);
+
+	//last checkpoint in [beg, end) which is not after the value
+	lo = beg + 1;
+	hi = end;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cp = &columns->data[mid];
+		if ((by_column ? cp->col : cp->pos) <= value) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return columns->data[lo - 1];
 }
 
-int editor_save(Editor* editor)
+size_t editor_column_by_position(Editor *editor, Buffer *buffer, size_t pos)
 {
-	FILE *out;
-	Content *content;
-	Buffer *buf;
+	ColumnCheckpoint cp;
+	Line *line;
+	register size_t i;
 
-	buf = editor->pane->buffer;
+	if (buffer->len == 0) return 0;
 
-	if (buf->file_path == NULL) {
-		fprintf(stderr, "No file_path\n");
-		return 1;
-	}
+	line = &buffer->data[editor_line_by_position(buffer, pos)];
+	cp = editor_column_checkpoint(editor, buffer, line, false, pos);
 
-	if (buf->file_path_len <= 0) {
-		fprintf(stderr, "file_path is invalid\n");
-		return 1;
+	for (i = cp.pos; i < pos && i < line->end; i += utf8_size_char(buffer->content.data[i])) {
+		cp.col += editor_char_columns(buffer->content.data[i], editor->tab_size);
 	}
 
-	out = fopen(buf->file_path, "w+");
-	if (out == NULL) {
-		fprintf(stderr, "Could not save file %s\n", buf->file_path);
-		return 1;
-	}
+	return cp.col;
+}
 
-	content = &buf->content;
-	if (content->len > 0) {
-		content->len = editor_cleanup_whitespaces(content->data, content->len);
-		if (content->data[content->len - 1] != '\n') {
-			append_char(content, '\n', content->len);
-			editor_determine_lines(editor);
-		}
-		fwrite(content->data, sizeof(char), content->len, out);
-	}
+/**
+ * First position of the line which starts at or after the column,
+ * the line end when the line is shorter
+ */
+size_t editor_position_by_column(Editor *editor, Buffer *buffer, Line *line, size_t column, size_t *found_column)
+{
+	ColumnCheckpoint cp;
+	register size_t i;
 
-	editor_determine_lines(editor);
+	cp = editor_column_checkpoint(editor, buffer, line, true, column);
 
-	fclose(out);
-	editor->pane->buffer->need_to_save = false;
+	for (i = cp.pos; cp.col < column && i < line->end; i += utf8_size_char(buffer->content.data[i])) {
+		cp.col += editor_char_columns(buffer->content.data[i], editor->tab_size);
+	}
 
-	return 0;
+	*found_column = cp.col;
+	return MIN(i, line->end);
 }
 
-Buffer* editor_create_buffer(Editor *editor, char *file_path)
+/**
+ * Keeps the cursor column inside of the visible slice of truncated lines
+ */
+void editor_hscroll_recognize(Editor *editor, Pane *pane, size_t cols)
 {
-	register size_t i;
-	size_t new_file_path_len = strlen(file_path);
+	size_t col;
 
-	for (i = 0; i < editor->buffer_list.len; ++i) {
-		if (strncmp(editor->buffer_list.data[i].file_path, file_path, new_file_path_len) == 0) {
-			return &editor->buffer_list.data[i];
-		}
+	if (!editor->truncate_lines) {
+		pane->hscroll = 0;
+		return;
 	}
 
-	gb_append((&editor->buffer_list), ((Buffer) {0}));
-	return &editor->buffer_list.data[editor->buffer_list.len - 1];
+	col = editor_column_by_position(editor, pane->buffer, pane->position);
+	if (col < pane->hscroll || col >= pane->hscroll + cols) {
+		pane->hscroll = col > cols / 2 ? col - cols / 2 : 0;
+	}
 }
 
-//TODO(ivan): we need to open only text file ignore executable and everything that might broker the editor :D
-int editor_read_file(Editor *editor, char *file_path)
+void editor_toggle_truncate_lines(Editor *editor)
 {
-	if (file_path == NULL) return 0;
-	if (strlen(file_path) == 0) return 0;
+	editor->truncate_lines = !editor->truncate_lines;
+}
 
-	FILE *in;
-	Content content;
-	char next;
-	size_t len, file_path_len;
-	Pane *pane;
+/**
+ * Updates lines after the content [pos, pos + removed) was replaced by
+ * inserted bytes. Only the touched lines are scanned again, the rest is shifted.
+ */
+void editor_lines_patch(Buffer *buffer, size_t pos, size_t removed, size_t inserted)
+{
+	static Buffer lines = {0};
+	size_t line_beg, line_end, old_beg, old_end, new_end, beg, new_len;
+	long delta;
+	register size_t i;
+	ProfileScope scope;
 
-	in = fopen(file_path, "r");
-	content = (Content) {0};
-	len = 0;
+	if (buffer->len == 0 || buffer->content.len == 0) {
+		editor_buffer_determine_lines(buffer);
+		return;
+	}
 
-	if (in != NULL) {
-		while ((next = fgetc(in)) != EOF) {
-			append_char(&content, next, len);
-			++len;
+	scope = profiler_begin(PROFILE_LINES_PATCH);
+	++buffer->version;
+
+	line_beg = editor_line_by_position(buffer, pos);
+	line_end = editor_line_by_position(buffer, pos + removed) + 1;
+	old_beg = buffer->data[line_beg].start;
+	old_end = buffer->data[line_end - 1].end;
+	delta = (long) inserted - (long) removed;
+	new_end = old_end + delta;
+
+	lines.len = 0;
+	beg = old_beg;
+	for (i = old_beg; i <= new_end; ++i) {
+		if (i == buffer->content.len || buffer->content.data[i] == '\n') {
+			gb_append(&lines, ((Line) {beg, i}));
+			beg = i + 1;
 		}
-		fclose(in);
 	}
 
-	pane = editor->pane;
+	editor_visual_patch(buffer, old_beg, old_end, lines.data, lines.len, delta);
+	editor_columns_patch(&buffer->columns, old_beg, old_end, delta);
 
-	pane->buffer = editor_create_buffer(editor, file_path);
-	pane->buffer->content = content;
-	file_path_len = strlen(file_path);
-	pane->buffer->file_path = (char*) calloc(file_path_len + 1, sizeof(char));
-	editor_goto_point(editor, 0);
+	new_len = buffer->len - (line_end - line_beg) + lines.len;
+	while (buffer->cap < new_len) {
+		buffer->data = gb_append_(buffer->data, &buffer->cap, sizeof(*buffer->data));
+	}
 
-	strcpy(pane->buffer->file_path, file_path);
-	pane->buffer->file_path_len = file_path_len;
+	if (lines.len != line_end - line_beg) {
+		memmove(&buffer->data[line_beg + lines.len], &buffer->data[line_end], (buffer->len - line_end) * sizeof(*buffer->data));
+	}
+	memcpy(&buffer->data[line_beg], lines.data, lines.len * sizeof(*buffer->data));
+	buffer->len = new_len;
 
-	editor_determine_lines(editor);
-	editor_recognize_arena(editor);
+	for (i = line_beg + lines.len; delta != 0 && i < buffer->len; ++i) {
+		buffer->data[i].start += delta;
+		buffer->data[i].end += delta;
+	}
 
-	return 0;
+	profiler_end(scope);
 }
 
-void editor_kill_line(Editor *editor)
+/**
+ * Rows of the changed lines are wrapped again, the rows between them are shifted
+ */
+static void editor_visual_patch_many(Buffer *buffer, LinesChanges *changes)
 {
-	register size_t i;
-	size_t del_count;
-	Line *line;
+	static VisualLines rows = {0};
+	VisualLines *visual;
+	LinesChange *change;
+	Line *swap;
+	size_t row_beg, row_end, copied, swap_cap, width, i;
+	long delta;
+
+	for (width = 0; width < EDITOR_VISUAL_WIDTHS; ++width) {
+		visual = &buffer->visual[width];
+		if (!visual->valid) continue;
+
+		rows.len = 0;
+		copied = 0;
+		delta = 0;
+		for (i = 0; i < changes->len; ++i) {
+			change = &changes->data[i];
+			row_beg = editor_visual_row_by_position(visual, change->old_beg);
+			row_end = editor_visual_row_by_position(visual, change->old_end) + 1;
+
+			for (; copied < row_beg; ++copied) {
+				gb_append(&rows, ((Line) {visual->data[copied].start + change->delta_before, visual->data[copied].end + change->delta_before}));
+			}
+			copied = row_end;
 
-	for (i = 0; i < editor->pane->buffer->len; ++i) {
-		line = &editor->pane->buffer->data[i];
-		if (line->start <= editor->pane->position && editor->pane->position <= line->end) {
-			del_count = (size_t) line->end - editor->pane->position;
-			if (del_count > 0) {
-				editor_set_mark(editor);
-				editor_move_end_of_line(editor);
-				editor_cut(editor);
-			} else {
-				editor_delete_forward(editor);
+			for (size_t line = change->new_line_beg; line < change->new_line_end; ++line) {
+				editor_visual_wrap_line(&rows, buffer->content.data, buffer->data[line].start, buffer->data[line].end, visual->wrap_cols, visual->tab_size);
 			}
+			delta = change->delta_before + change->delta;
 		}
-	}
 
-	editor_determine_lines(editor);
-	editor->state = NONE;
+		for (; copied < visual->len; ++copied) {
+			gb_append(&rows, ((Line) {visual->data[copied].start + delta, visual->data[copied].end + delta}));
+		}
+
+		swap = visual->data;
+		swap_cap = visual->cap;
+		visual->data = rows.data;
+		visual->cap = rows.cap;
+		visual->len = rows.len;
+		rows.data = swap;
+		rows.cap = swap_cap;
+	}
 }
 
-void editor_destory_buffer(Buffer *buf)
+/**
+ * Checkpoints of the changed lines are dropped, the others are shifted
+ */
+static void editor_columns_patch_many(ColumnCheckpoints *columns, LinesChanges *changes)
 {
-	if (buf->content.len > 0) {
-		free(buf->file_path);
-		buf->file_path = NULL;
-
-		free(buf->content.data);
-		buf->content.data = NULL;
-		buf->content.len = 0;
-		buf->content.capacity = 0;
+	LinesChange *change;
+	size_t len, next;
+	long delta;
 
-		for (size_t i = 0; i < CHANGE_EVENT_HISTORY_SIZE; ++i) {
-			sb_free(&buf->events[i].string);
+	len = 0;
+	next = 0;
+	delta = 0;
+	for (size_t i = 0; i < columns->len; ++i) {
+		while (next < changes->len && changes->data[next].old_end < columns->data[i].pos) {
+			delta = changes->data[next].delta_before + changes->data[next].delta;
+			++next;
 		}
 
-		gb_free(buf);
+		change = next < changes->len ? &changes->data[next] : NULL;
+		if (change != NULL && change->old_beg <= columns->data[i].pos) continue;
+
+		columns->data[len] = columns->data[i];
+		columns->data[len++].pos += delta;
 	}
+	columns->len = len;
 }
 
-void editor_destroy(Editor *editor)
+/**
+ * editor_lines_patch for all the replacements of editor_buffer_replace at once, their
+ * positions are in the old content. Only the touched lines are scanned again, the
+ * lines between them are shifted in one pass, the text between them is not read.
+ */
+void editor_lines_patch_many(Buffer *buffer, Replacements *replacements)
 {
-	register size_t i;
+	static LinesChanges changes = {0};
+	static Buffer lines = {0};
+	Replacement *replacement;
+	LinesChange *change;
+	Content *content;
+	Line *swap;
+	size_t line_beg, line_end, copied, new_beg, new_end, beg, swap_cap, i, j;
+	long delta;
+	ProfileScope scope;
 
-	if (editor->pane->buffer->len > 0) {
-		free(editor->pane->buffer->data);
-		editor->pane->buffer->data = NULL;
+	if (buffer->len == 0 || buffer->content.len == 0) {
+		editor_buffer_determine_lines(buffer);
+		return;
 	}
 
-	for (i = 0; i < editor->buffer_list.len; ++i) {
-		editor_destory_buffer(&editor->buffer_list.data[i]);
-	}
+	scope = profiler_begin(PROFILE_LINES_PATCH);
+	++buffer->version;
+	content = &buffer->content;
+
+	//replacements on the same lines are one change
+	changes.len = 0;
+	for (i = 0; i < replacements->len; ++i) {
+		replacement = &replacements->data[i];
+		line_beg = editor_line_by_position(buffer, replacement->start);
+		line_end = editor_line_by_position(buffer, replacement->end) + 1;
+		delta = (long) replacement->text_len - (long) (replacement->end - replacement->start);
+
+		change = changes.len > 0 ? &changes.data[changes.len - 1] : NULL;
+		if (change != NULL && line_beg < change->line_end) {
+			change->line_end = MAX(change->line_end, line_end);
+			change->delta += delta;
+			continue;
+		}
 
-	editor->buffer_list.len = 0;
-	free(editor->buffer_list.data);
-	editor->buffer_list.data = NULL;
+		gb_append(&changes, ((LinesChange) {.line_beg = line_beg, .line_end = line_end, .delta = delta}));
+	}
 
-	editor_completor_clean(editor);
+	lines.len = 0;
+	copied = 0;
+	delta = 0;
+	for (i = 0; i < changes.len; ++i) {
+		change = &changes.data[i];
+		change->old_beg = buffer->data[change->line_beg].start;
+		change->old_end = buffer->data[change->line_end - 1].end;
+		change->delta_before = delta;
+
+		for (; copied < change->line_beg; ++copied) {
+			gb_append(&lines, ((Line) {buffer->data[copied].start + delta, buffer->data[copied].end + delta}));
+		}
+		copied = change->line_end;
+
+		change->new_line_beg = lines.len;
+		new_beg = change->old_beg + delta;
+		new_end = change->old_end + delta + change->delta;
+		beg = new_beg;
+		for (j = new_beg; j <= new_end; ++j) {
+			if (j == content->len || content->data[j] == '\n') {
+				gb_append(&lines, ((Line) {beg, j}));
+				beg = j + 1;
+			}
+		}
+		change->new_line_end = lines.len;
+
+		delta += change->delta;
+	}
+
+	for (; copied < buffer->len; ++copied) {
+		gb_append(&lines, ((Line) {buffer->data[copied].start + delta, buffer->data[copied].end + delta}));
+	}
+
+	swap = buffer->data;
+	swap_cap = buffer->cap;
+	buffer->data = lines.data;
+	buffer->cap = lines.cap;
+	buffer->len = lines.len;
+	lines.data = swap;
+	lines.cap = swap_cap;
+
+	editor_visual_patch_many(buffer, &changes);
+	editor_columns_patch_many(&buffer->columns, &changes);
+
+	profiler_end(scope);
+}
+
+void editor_buffer_insert(Buffer *buffer, size_t pos, char *str, size_t len)
+{
+	Content *content;
+
+	content = &buffer->content;
+
+	if (pos > content->len) {
+		fprintf(stderr, "Out of range insert pos: %ld content_len: %ld\n", pos, content->len);
+		return;
+	}
+
+	if (len == 0) return;
+
+	editor_content_reserve(content, content->len + len);
+	memmove(&content->data[pos + len], &content->data[pos], content->len - pos);
+	memcpy(&content->data[pos], str, len);
+	content->len += len;
+
+	editor_lines_patch(buffer, pos, 0, len);
+	buffer->need_to_save = true;
+}
+
+void editor_buffer_delete(Buffer *buffer, size_t pos, size_t len)
+{
+	Content *content;
+
+	content = &buffer->content;
+
+	if (pos >= content->len) return;
+	len = MIN(len, content->len - pos);
+	if (len == 0) return;
+
+	memmove(&content->data[pos], &content->data[pos + len], content->len - pos - len);
+	content->len -= len;
+	memset(&content->data[content->len], 0, len);
+
+	editor_lines_patch(buffer, pos, len, 0);
+	buffer->need_to_save = true;
+}
+
+/**
+ * Rebuilds the content in one pass and patches the lines once over the replaced span.
+ * The inverse (can be NULL) gets the replacements which restore the content.
+ */
+void editor_buffer_replace(Buffer *buffer, Replacements *replacements, Replacements *inverse)
+{
+	Content *content, rebuilt = {0};
+	Replacement *replacement;
+	size_t new_len, copied;
+
+	if (replacements->len == 0) return;
+
+	content = &buffer->content;
+
+	new_len = content->len;
+	for (size_t i = 0; i < replacements->len; ++i) {
+		replacement = &replacements->data[i];
+		new_len = new_len - (replacement->end - replacement->start) + replacement->text_len;
+	}
+
+	if (inverse != NULL) {
+		inverse->len = 0;
+		sb_clean(&inverse->text);
+	}
+
+	editor_content_reserve(&rebuilt, new_len);
+
+	copied = 0;
+	for (size_t i = 0; i < replacements->len; ++i) {
+		replacement = &replacements->data[i];
+
+		memcpy(&rebuilt.data[rebuilt.len], &content->data[copied], replacement->start - copied);
+		rebuilt.len += replacement->start - copied;
+
+		if (inverse != NULL) {
+			gb_append(inverse, ((Replacement) {rebuilt.len, rebuilt.len + replacement->text_len, inverse->text.len, replacement->end - replacement->start}));
+			sb_append_manyl(&inverse->text, &content->data[replacement->start], replacement->end - replacement->start);
+		}
+
+		//deletions only may have no text at all
+		if (replacement->text_len > 0) memcpy(&rebuilt.data[rebuilt.len], &replacements->text.data[replacement->text_beg], replacement->text_len);
+		rebuilt.len += replacement->text_len;
+		copied = replacement->end;
+	}
+
+	memcpy(&rebuilt.data[rebuilt.len], &content->data[copied], content->len - copied);
+	rebuilt.len += content->len - copied;
+
+	free(content->data);
+	*content = rebuilt;
+
+	editor_lines_patch_many(buffer, replacements);
+	buffer->need_to_save = true;
+}
+
+static void editor_content_reverse(char *data, size_t beg, size_t end)
+{
+	char ch;
+
+	while (beg + 1 < end) {
+		ch = data[beg];
+		data[beg++] = data[--end];
+		data[end] = ch;
+	}
+}
+
+/**
+ * Swaps [beg, first_end) and [second_beg, end) in place, the bytes between them stay.
+ * The length does not change, so only the lines of [beg, end) are scanned again.
+ */
+void editor_buffer_swap(Buffer *buffer, size_t beg, size_t first_end, size_t second_beg, size_t end)
+{
+	char *data;
+	size_t first_len, second_len;
+
+	if (beg >= end || end > buffer->content.len) return;
+
+	data = buffer->content.data;
+	first_len = first_end - beg;
+	second_len = end - second_beg;
+
+	editor_content_reverse(data, beg, end);
+	editor_content_reverse(data, beg, beg + second_len);
+	editor_content_reverse(data, beg + second_len, end - first_len);
+	editor_content_reverse(data, end - first_len, end);
+
+	editor_lines_patch(buffer, beg, end - beg, end - beg);
+	buffer->need_to_save = true;
+}
+
+void editor_delete_forward_len(Editor *editor, size_t delete_len)
+{
+	editor_buffer_delete(editor->pane->buffer, editor->pane->position, delete_len);
+}
+
+void editor_delete_backward(Editor *editor)
+{
+	Content *content;
+	size_t reg_beg, reg_end, delete_len;
+
+	content = &editor->pane->buffer->content;
+
+	if (editor->state == SELECTION) {
+		reg_beg = editor_reg_beg(editor);
+		reg_end = editor_reg_end(editor);
+		delete_len = reg_end - reg_beg;
+
+		editor_buffer_delete(editor->pane->buffer, reg_beg, delete_len);
+		editor_goto_point(editor, reg_beg);
+	} else {
+		if (editor->pane->position == 0) return;
+
+		delete_len = utf8_size_char_backward(content->data, editor->pane->position - 1);
+		editor_buffer_delete(editor->pane->buffer, editor->pane->position - delete_len, delete_len);
+		editor_goto_point(editor, editor->pane->position - delete_len);
+	}
+
+	editor->state = NONE;
+}
+
+void editor_delete_forward(Editor *editor)
+{
+	int8_t char_len;
+
+	if (editor->state == SELECTION) {
+		editor_delete_backward(editor);
+		return;
+	}
+
+	char_len = utf8_size_char(editor->pane->buffer->content.data[editor->pane->position]);
+	editor_delete_forward_len(editor, char_len);
+
+	editor->state = NONE;
+}
+
+void editor_insert(Editor *editor, char *str)
+{
+	if (str == NULL) return;
+
+	if (editor->state == SELECTION) {
+		editor_delete_backward(editor);
+	}
+
+	size_t str_size = strlen(str);
+	editor_buffer_insert(editor->pane->buffer, editor->pane->position, str, str_size);
+
+	editor_store_event(editor, str, str_size, INSERTION);
+	editor->pane->position += str_size;
+	editor->state = NONE;
+}
+
+size_t editor_get_current_line_number(Pane *pane)
+{
+	return editor_line_by_position(pane->buffer, pane->position);
+}
+
+bool editor_is_mini_buffer_active(Editor *editor)
+{
+	bool mini_buffer_is_active = false;
+	if (editor->state & SEARCH) mini_buffer_is_active = true;
+	if (editor->state & EXTEND_COMMAND) mini_buffer_is_active = true;
+	if (editor->state & COMPLETION) mini_buffer_is_active = true;
+	if (editor->state & REPLACE) mini_buffer_is_active = true;
+
+	return mini_buffer_is_active;
+}
+
+void editor_recognize_arena(Editor *editor)
+{
+	size_t row_num;
+	register size_t pane_i, line_padded;
+	Arena *arena;
+	Pane *pane;
+	VisualLines *visual;
+
+	line_padded = editor_is_mini_buffer_active(editor) ? 2 : 1;
+
+	for (pane_i = 0; pane_i < editor->panes_len; ++pane_i) {
+		pane = &editor->panes[pane_i];
+		visual = editor_visual_lines(editor, pane);
+		arena = &pane->arena;
+
+		if (visual->len == 0) {
+			arena->start = 0;
+			continue;
+		}
+
+		row_num = editor_visual_row_by_position(visual, pane->position);
+
+		if (row_num >= (arena->start + arena->show_lines - line_padded)) {
+			arena->start = MIN(visual->len - 1, row_num - MIN(row_num, arena->show_lines / 2));
+		} else if (row_num < arena->start) {
+			arena->start = row_num;
+		}
+	}
+}
+
+void editor_next_line(Editor *editor)
+{
+	size_t next_pos, row_num;
+	Line *row;
+	VisualLines *visual;
+
+	visual = editor_visual_lines(editor, editor->pane);
+	if (visual->len == 0) return;
+
+	row_num = editor_visual_row_by_position(visual, editor->pane->position) + 1;
+	if (visual->len > row_num) {
+		row = &visual->data[row_num];
+		next_pos = MIN(row->start + editor->pane->buffer->column, row->end);
+
+		editor->pane->buffer->update_column = false;
+		editor_goto_point(editor, next_pos);
+		editor_recognize_arena(editor);
+	}
+}
+
+void editor_previous_line(Editor *editor)
+{
+	size_t next_pos, row_num;
+	Line *row;
+	VisualLines *visual;
+
+	visual = editor_visual_lines(editor, editor->pane);
+	if (visual->len == 0) return;
+
+	row_num = editor_visual_row_by_position(visual, editor->pane->position);
+	if (row_num != 0) {
+		row = &visual->data[row_num - 1];
+		next_pos = MIN(row->start + editor->pane->buffer->column, row->end);
+
+		editor->pane->buffer->update_column = false;
+		editor_goto_point(editor, next_pos);
+		editor_recognize_arena(editor);
+	}
+}
+
+void editor_char_forward(Editor *editor)
+{
+	uint8_t char_len;
+
+	char_len = utf8_size_char(editor->pane->buffer->content.data[editor->pane->position]);
+	editor_goto_point(editor, MIN(editor->pane->position + char_len, editor->pane->buffer->content.len));
+}
+
+void editor_char_backward(Editor *editor)
+{
+	uint8_t char_len;
+
+	char_len = utf8_size_char_backward(editor->pane->buffer->content.data, editor->pane->position - 1);
+	if (editor->pane->buffer->column > 0) {
+		editor->pane->buffer->column--;
+	}
+
+	editor_goto_point(editor, (size_t) MAX(((int)editor->pane->position) - char_len, 0));
+}
+
+void editor_move_end_of_line(Editor *editor)
+{
+	Line *line;
+
+	if (editor->pane->buffer->len == 0) return;
+
+	line = &editor->pane->buffer->data[editor_get_current_line_number(editor->pane)];
+	editor_goto_point(editor, line->end);
+}
+
+void editor_move_begginning_of_line(Editor *editor)
+{
+	Line *line;
+
+	if (editor->pane->buffer->len == 0) return;
+
+	line = &editor->pane->buffer->data[editor_get_current_line_number(editor->pane)];
+	editor_goto_point(editor, line->start);
+	editor->pane->buffer->column = 0;
+}
+
+void editor_determine_lines(Editor *editor)
+{
+	editor_buffer_determine_lines(editor->pane->buffer);
+}
+
+void editor_buffer_determine_lines(Buffer *buffer)
+{
+	register size_t i;
+	size_t beg, len;
+	char *data, *newline;
+	ProfileScope scope;
+
+	buffer->len = 0;
+	for (i = 0; i < EDITOR_VISUAL_WIDTHS; ++i) buffer->visual[i].valid = false;
+	buffer->columns.len = 0;
+	++buffer->version;
+
+	if (buffer->content.len == 0) return;
+
+	scope = profiler_begin(PROFILE_DETERMINE_LINES);
+
+	data = buffer->content.data;
+	len = buffer->content.len;
+	beg = 0;
+	for (newline = memchr(data, '\n', len); newline != NULL; newline = memchr(newline + 1, '\n', len - (size_t) (newline + 1 - data))) {
+		i = (size_t) (newline - data);
+		gb_append(buffer, ((Line) {beg, i}));
+		beg = i + 1;
+	}
+
+	gb_append(buffer, ((Line) {beg, len}));
+
+	profiler_end(scope);
+}
+
+/**
+ * Dir of the file path, the current dir for a bare name
+ */
+static const char *editor_file_dir(const char *file_path, char *dir, size_t dir_len)
+{
+	const char *slash;
+
+	slash = strrchr(file_path, EDITOR_DIR_SLASH);
+	if (slash == NULL) {
+		snprintf(dir, dir_len, "%s", EDITOR_DIR_CUR);
+		return file_path;
+	}
+
+	snprintf(dir, dir_len, "%.*s", (int) MAX(slash - file_path, 1), file_path);
+	return slash + 1;
+}
+
+/**
+ * Remembers the file as it is on the disk now and watches its dir
+ */
+static void editor_buffer_disk_sync(Editor *editor, Buffer *buffer)
+{
+	struct stat file_stat;
+	char dir[PATH_MAX];
+
+	buffer->disk_changed = false;
+	buffer->disk_size = 0;
+	buffer->disk_mtime_sec = 0;
+	buffer->disk_mtime_nsec = 0;
+
+	if (stat(buffer->file_path, &file_stat) == 0) {
+		buffer->disk_size = (uint64_t) file_stat.st_size;
+		buffer->disk_mtime_sec = file_stat.st_mtim.tv_sec;
+		buffer->disk_mtime_nsec = file_stat.st_mtim.tv_nsec;
+	}
+
+	if (buffer->watch != 0) return;
+
+	editor_file_dir(buffer->file_path, dir, sizeof(dir));
+	buffer->watch = watch_add(&editor->watch, dir);
+}
+
+/**
+ * Stops watching the dir when no listing and no buffer uses its id anymore
+ */
+static void editor_watch_release(Editor *editor, int id)
+{
+	if (id == 0) return;
+
+	for (size_t i = 0; i < editor->listings.len; ++i) {
+		if (editor->listings.data[i].watch == id) return;
+	}
+	for (size_t i = 0; i < editor->buffer_list.len; ++i) {
+		if (editor->buffer_list.data[i]->watch == id) return;
+	}
+
+	watch_remove(&editor->watch, id);
+}
+
+/**
+ * Appends the rest of the file to the content
+ */
+static void editor_content_read(FILE *in, Content *content)
+{
+	size_t read;
+
+	do {
+		if (content->capacity - content->len <= 1) {
+			editor_content_reserve(content, content->len + EDITOR_READ_CHUNK);
+		}
+		read = fread(&content->data[content->len], sizeof(char), content->capacity - content->len - 1, in);
+		content->len += read;
+	} while (read > 0 && !feof(in));
+}
+
+/**
+ * Appends the bytes of the file from the offset until its end, false when the read fails
+ */
+static bool editor_content_pread(int fd, size_t offset, Content *content)
+{
+	ssize_t read;
+
+	for (;;) {
+		if (content->capacity - content->len <= 1) {
+			editor_content_reserve(content, content->len + EDITOR_READ_CHUNK);
+		}
+		read = pread(fd, &content->data[content->len], content->capacity - content->len - 1, (off_t) offset);
+		if (read == 0) return true;
+		if (read < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+
+		content->len += (size_t) read;
+		offset += (size_t) read;
+	}
+}
+
+int editor_save(Editor* editor)
+{
+	FILE *out;
+	Content *content;
+	Buffer *buf;
+
+	buf = editor->pane->buffer;
+
+	if (buf->file_path == NULL) {
+		fprintf(stderr, "No file_path\n");
+		return 1;
+	}
+
+	if (buf->file_path[0] == '*') {
+		fprintf(stderr, "%s is not a file\n", buf->file_path);
+		return 1;
+	}
+
+	if (buf->file_path_len <= 0) {
+		fprintf(stderr, "file_path is invalid\n");
+		return 1;
+	}
+
+	out = fopen(buf->file_path, "w+");
+	if (out == NULL) {
+		fprintf(stderr, "Could not save file %s\n", buf->file_path);
+		return 1;
+	}
+
+	content = &buf->content;
+	if (content->len > 0) {
+		content->len = editor_cleanup_whitespaces(content->data, content->len);
+		if (content->data[content->len - 1] != '\n') {
+			append_char(content, '\n', content->len);
+			editor_determine_lines(editor);
+		}
+		fwrite(content->data, sizeof(char), content->len, out);
+	}
+
+	editor_determine_lines(editor);
+
+	fclose(out);
+	editor->pane->buffer->need_to_save = false;
+	editor_buffer_disk_sync(editor, buf);
+
+	return 0;
+}
+
+/**
+ * Key of the buffer in the registry: the real path of the file (of its dir
+ * for a new file), buffers which are not files keep their names
+ */
+static void editor_canonical_path(const char *file_path, char *canonical)
+{
+	char dir[PATH_MAX], resolved[PATH_MAX];
+	const char *name;
+
+	if (file_path[0] != '*') {
+		if (realpath(file_path, canonical) != NULL) return;
+
+		name = editor_file_dir(file_path, dir, sizeof(dir));
+		if (realpath(dir, resolved) != NULL &&
+			snprintf(canonical, PATH_MAX, "%s/%s", strcmp(resolved, "/") == 0 ? "" : resolved, name) < PATH_MAX) {
+			return;
+		}
+	}
+
+	snprintf(canonical, PATH_MAX, "%s", file_path);
+}
+
+/**
+ * Slots of killed buffers are reused, otherwise the last slab is filled
+ */
+static Buffer *editor_buffer_alloc(BufferList *list)
+{
+	Buffer *slab;
+
+	if (list->free.len > 0) return list->free.data[--list->free.len];
+
+	if (list->slabs.len == 0 || list->slab_used == EDITOR_BUFFER_SLAB_LEN) {
+		slab = calloc(EDITOR_BUFFER_SLAB_LEN, sizeof(Buffer));
+		if (slab == NULL) {
+			fprintf(stderr, "No more free space\n");
+			exit(EXIT_FAILURE);
+		}
+
+		gb_append(&list->slabs, slab);
+		list->slab_used = 0;
+	}
+
+	return &list->slabs.data[list->slabs.len - 1][list->slab_used++];
+}
+
+Buffer *editor_find_buffer(Editor *editor, const char *file_path)
+{
+	char canonical[PATH_MAX];
+
+	if (!editor->buffer_list.has_by_path) return NULL;
+
+	editor_canonical_path(file_path, canonical);
+	return hashmap_get(&editor->buffer_list.by_path, canonical, (hashmap_uint32_t) strlen(canonical));
+}
+
+/**
+ * Buffer of the file, the open one when there is one
+ */
+Buffer* editor_create_buffer(Editor *editor, char *file_path)
+{
+	BufferList *list = &editor->buffer_list;
+	char canonical[PATH_MAX];
+	Buffer *buffer;
+
+	if (!list->has_by_path) {
+		hashmap_create(EDITOR_BUFFER_SLAB_LEN, &list->by_path);
+		list->has_by_path = true;
+	}
+
+	editor_canonical_path(file_path, canonical);
+	buffer = hashmap_get(&list->by_path, canonical, (hashmap_uint32_t) strlen(canonical));
+	if (buffer != NULL) return buffer;
+
+	buffer = editor_buffer_alloc(list);
+	buffer->key = strdup(canonical);
+	buffer->file_path = strdup(file_path);
+	buffer->file_path_len = strlen(file_path);
+
+	hashmap_put(&list->by_path, buffer->key, (hashmap_uint32_t) strlen(buffer->key), buffer);
+	gb_append(list, buffer);
+
+	return buffer;
+}
+
+static size_t editor_buffer_bytes(Buffer *buffer)
+{
+	size_t lines = buffer->cap;
+
+	for (size_t i = 0; i < EDITOR_VISUAL_WIDTHS; ++i) lines += buffer->visual[i].cap;
+
+	return buffer->content.capacity + lines * sizeof(Line) + buffer->columns.cap * sizeof(ColumnCheckpoint);
+}
+
+static bool editor_buffer_evictable(Editor *editor, Buffer *buffer)
+{
+	if (buffer->evicted || buffer->need_to_save || buffer->disk_changed) return false;
+	//not a file, it can not be read again
+	if (buffer->file_path[0] == '*') return false;
+	if (editor->search_index.owner == buffer || editor->matches.buffer == buffer || editor->replace.buffer == buffer) return false;
+
+	for (size_t i = 0; i < editor->panes_len; ++i) {
+		if (editor->panes[i].buffer == buffer) return false;
+	}
+
+	return true;
+}
+
+/**
+ * Releases the text, the lines and the history of the buffer, the path,
+ * the cursor and the disk state are kept to read it again
+ */
+static void editor_buffer_evict(Buffer *buffer)
+{
+	free(buffer->content.data);
+	buffer->content = (Content) {0};
+
+	for (size_t i = 0; i < CHANGE_EVENT_HISTORY_SIZE; ++i) {
+		sb_free(&buffer->events[i].string);
+		sb_free(&buffer->events[i].replacements.text);
+		gb_free(&buffer->events[i].replacements);
+		buffer->events[i] = (ChangeEvent) {0};
+	}
+	buffer->events_len = 0;
+
+	for (size_t i = 0; i < EDITOR_VISUAL_WIDTHS; ++i) {
+		gb_free(&buffer->visual[i]);
+		buffer->visual[i] = (VisualLines) {0};
+	}
+	gb_free(&buffer->columns);
+	buffer->columns = (ColumnCheckpoints) {0};
+	gb_free(buffer);
+	buffer->data = NULL;
+
+	buffer->evicted = true;
+}
+
+/**
+ * Reads the evicted buffer by one allocation of the file size. When the
+ * file is gone or can not be read it stays evicted and false is returned.
+ */
+static bool editor_buffer_restore(Editor *editor, Buffer *buffer)
+{
+	struct stat file_stat;
+	bool ok;
+	int fd;
+
+	fd = open(buffer->file_path, O_RDONLY);
+	if (fd < 0) return false;
+
+	ok = fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+	if (ok) {
+		editor_content_reserve(&buffer->content, (size_t) file_stat.st_size + 1);
+		ok = editor_content_pread(fd, 0, &buffer->content);
+	}
+	close(fd);
+
+	if (!ok) {
+		free(buffer->content.data);
+		buffer->content = (Content) {0};
+		return false;
+	}
+
+	buffer->evicted = false;
+	editor_buffer_determine_lines(buffer);
+	buffer->last_position = MIN(buffer->last_position, buffer->content.len);
+	editor_buffer_disk_sync(editor, buffer);
+
+	return true;
+}
+
+/**
+ * Evicts the least recently used buffers while more than
+ * EDITOR_RESIDENT_BUFFERS are in memory or they take more than EDITOR_RESIDENT_BYTES
+ */
+static void editor_buffers_evict(Editor *editor)
+{
+	BufferList *list = &editor->buffer_list;
+	Buffer *buffer, *coldest;
+	size_t resident, bytes;
+
+	resident = 0;
+	bytes = 0;
+	for (size_t i = 0; i < list->len; ++i) {
+		if (list->data[i]->evicted) continue;
+
+		++resident;
+		bytes += editor_buffer_bytes(list->data[i]);
+	}
+
+	while (resident > EDITOR_RESIDENT_BUFFERS || bytes > EDITOR_RESIDENT_BYTES) {
+		coldest = NULL;
+		for (size_t i = 0; i < list->len; ++i) {
+			buffer = list->data[i];
+			if (!editor_buffer_evictable(editor, buffer)) continue;
+			if (coldest == NULL || buffer->used < coldest->used) coldest = buffer;
+		}
+		if (coldest == NULL) break;
+
+		--resident;
+		bytes -= editor_buffer_bytes(coldest);
+		editor_buffer_evict(coldest);
+	}
+}
+
+//TODO(ivan): we need to open only text file ignore executable and everything that might broker the editor :D
+int editor_read_file(Editor *editor, char *file_path)
+{
+	if (file_path == NULL) return 0;
+	if (strlen(file_path) == 0) return 0;
+
+	FILE *in;
+	Content content;
+	long size;
+	Pane *pane;
+	Buffer *buffer;
+
+	buffer = editor_find_buffer(editor, file_path);
+	if (buffer != NULL) return editor_switch_buffer(editor, buffer) ? 0 : 1;
+
+	in = fopen(file_path, "r");
+	content = (Content) {0};
+
+	if (in != NULL) {
+		//the size is only a hint to allocate once, the file is read until EOF anyway
+		size = 0;
+		if (fseek(in, 0, SEEK_END) == 0) {
+			size = ftell(in);
+			rewind(in);
+		}
+
+		//one byte more than the size lets the first read hit EOF
+		editor_content_reserve(&content, size > 0 ? (size_t) size + 1 : EDITOR_READ_CHUNK);
+		editor_content_read(in, &content);
+
+		fclose(in);
+	}
+
+	pane = editor->pane;
+	if (pane->buffer != NULL) pane->buffer->last_position = pane->position;
+
+	pane->buffer = editor_create_buffer(editor, file_path);
+	editor_cursors_clear(pane);
+	pane->buffer->content = content;
+	pane->buffer->used = ++editor->buffer_list.clock;
+	editor_goto_point(editor, 0);
+	editor_buffer_disk_sync(editor, pane->buffer);
+
+	editor_determine_lines(editor);
+	editor_recognize_arena(editor);
+	editor_buffers_evict(editor);
+
+	return 0;
+}
+
+static size_t editor_position_patch(size_t position, size_t beg, size_t removed, size_t inserted)
+{
+	if (position >= beg + removed) return position - removed + inserted;
+	return MIN(position, beg + inserted);
+}
+
+/**
+ * Keeps the cursors on the same text after [beg, beg + removed) of the buffer was replaced
+ */
+static void editor_positions_patch(Editor *editor, Buffer *buffer, size_t beg, size_t removed, size_t inserted)
+{
+	Cursor *cursor;
+
+	for (size_t i = 0; i < editor->panes_len; ++i) {
+		if (editor->panes[i].buffer == buffer) {
+			editor->panes[i].position = editor_position_patch(editor->panes[i].position, beg, removed, inserted);
+			for (size_t j = 0; j < editor->panes[i].cursors.len; ++j) {
+				cursor = &editor->panes[i].cursors.data[j];
+				cursor->position = editor_position_patch(cursor->position, beg, removed, inserted);
+				cursor->mark = editor_position_patch(cursor->mark, beg, removed, inserted);
+			}
+			editor->panes[i].cursors.version = buffer->version;
+		}
+	}
+
+	if (editor->pane->buffer == buffer) editor->mark = editor_position_patch(editor->mark, beg, removed, inserted);
+	buffer->last_position = editor_position_patch(buffer->last_position, beg, removed, inserted);
+}
+
+/**
+ * Appends what was written after the old end when the old end is still
+ * the same (a growing log), false when the file has to be read again.
+ * Only the new lines are scanned.
+ */
+static bool editor_buffer_tail(Buffer *buffer, int fd, size_t size)
+{
+	char old_end[EDITOR_TAIL_CHECK];
+	Content *content;
+	size_t old_len, check;
+
+	content = &buffer->content;
+	old_len = content->len;
+	//the same size is not a tail, the text before the checked end may be rewritten
+	if (old_len != buffer->disk_size || size <= old_len) return false;
+
+	check = MIN(old_len, EDITOR_TAIL_CHECK);
+	if (pread(fd, old_end, check, (off_t) (old_len - check)) != (ssize_t) check) return false;
+	if (memcmp(old_end, &content->data[old_len - check], check) != 0) return false;
+
+	editor_content_reserve(content, size + 1);
+	editor_content_pread(fd, old_len, content);
+	if (content->len > old_len) editor_lines_patch(buffer, old_len, 0, content->len - old_len);
+
+	return true;
+}
+
+/**
+ * Brings the buffer up to its file changed on the disk. A grown file is
+ * tailed, otherwise it is read again and only the lines between the
+ * common beginning and end are patched. A buffer with unsaved changes is
+ * only marked. Returns true when there is something to tell.
+ */
+static bool editor_buffer_reload(Editor *editor, Buffer *buffer, char *notification, size_t notification_len)
+{
+	struct stat file_stat;
+	Content fresh = {0}, *content;
+	int fd;
+	size_t old_len, prefix, suffix, common;
+	bool tailed, patched;
+
+	if (stat(buffer->file_path, &file_stat) != 0) {
+		if (buffer->disk_changed) return false;
+
+		buffer->disk_changed = true;
+		snprintf(notification, notification_len, "%s is deleted on the disk", buffer->file_path);
+		return true;
+	}
+
+	if (!S_ISREG(file_stat.st_mode)) return false;
+	if ((uint64_t) file_stat.st_size == buffer->disk_size &&
+		file_stat.st_mtim.tv_sec == buffer->disk_mtime_sec &&
+		file_stat.st_mtim.tv_nsec == buffer->disk_mtime_nsec) {
+		return false;
+	}
+
+	if (buffer->need_to_save || editor->replace.buffer == buffer) {
+		if (buffer->disk_changed) return false;
+
+		buffer->disk_changed = true;
+		snprintf(notification, notification_len, "%s changed on the disk", buffer->file_path);
+		return true;
+	}
+
+	fd = open(buffer->file_path, O_RDONLY);
+	if (fd < 0) return false;
+
+	//the index points to the old content
+	if (editor->search_index.owner == buffer || editor->matches.buffer == buffer) editor_search_matches_clear(editor);
+
+	content = &buffer->content;
+	old_len = content->len;
+	tailed = editor_buffer_tail(buffer, fd, (size_t) file_stat.st_size);
+	patched = false;
+
+	if (tailed && buffer->follow) {
+		//the cursors at the old end follow the new end
+		for (size_t i = 0; i < editor->panes_len; ++i) {
+			if (editor->panes[i].buffer == buffer && editor->panes[i].position == old_len) editor->panes[i].position = content->len;
+		}
+	}
+
+	if (!tailed) {
+		editor_content_reserve(&fresh, (size_t) file_stat.st_size + 1);
+		editor_content_pread(fd, 0, &fresh);
+
+		common = MIN(old_len, fresh.len);
+		for (prefix = 0; prefix < common && content->data[prefix] == fresh.data[prefix]; ++prefix);
+		for (suffix = 0; suffix < common - prefix && content->data[old_len - suffix - 1] == fresh.data[fresh.len - suffix - 1]; ++suffix);
+
+		free(content->data);
+		*content = fresh;
+
+		if (prefix + suffix < MAX(old_len, fresh.len)) {
+			editor_lines_patch(buffer, prefix, old_len - prefix - suffix, fresh.len - prefix - suffix);
+			editor_positions_patch(editor, buffer, prefix, old_len - prefix - suffix, fresh.len - prefix - suffix);
+			//the history does not match the text anymore
+			buffer->events_len = 0;
+			patched = true;
+		}
+	}
+
+	close(fd);
+
+	buffer->disk_changed = false;
+	buffer->disk_size = content->len;
+	buffer->disk_mtime_sec = file_stat.st_mtim.tv_sec;
+	buffer->disk_mtime_nsec = file_stat.st_mtim.tv_nsec;
+
+	editor_recognize_arena(editor);
+
+	if (!patched) return false;
+
+	snprintf(notification, notification_len, "Reverted %s", buffer->file_path);
+	return true;
+}
+
+/**
+ * Frees everything of the buffer, the slot is left empty for the next buffer
+ */
+void editor_destory_buffer(Buffer *buf)
+{
+	free(buf->file_path);
+	free(buf->key);
+	free(buf->content.data);
+
+	for (size_t i = 0; i < CHANGE_EVENT_HISTORY_SIZE; ++i) {
+		sb_free(&buf->events[i].string);
+		sb_free(&buf->events[i].replacements.text);
+		gb_free(&buf->events[i].replacements);
+	}
+
+	for (size_t i = 0; i < EDITOR_VISUAL_WIDTHS; ++i) gb_free(&buf->visual[i]);
+	gb_free(&buf->columns);
+	gb_free(buf);
+
+	*buf = (Buffer) {0};
+}
+
+void editor_destroy(Editor *editor)
+{
+	register size_t i;
+
+	if (editor->pane->buffer->len > 0) {
+		free(editor->pane->buffer->data);
+		editor->pane->buffer->data = NULL;
+	}
+
+	for (i = 0; i < editor->buffer_list.len; ++i) {
+		editor_destory_buffer(editor->buffer_list.data[i]);
+	}
+
+	for (i = 0; i < editor->buffer_list.slabs.len; ++i) {
+		free(editor->buffer_list.slabs.data[i]);
+	}
+	gb_free(&editor->buffer_list.slabs);
+	gb_free(&editor->buffer_list.free);
+	if (editor->buffer_list.has_by_path) hashmap_destroy(&editor->buffer_list.by_path);
+	editor->buffer_list.has_by_path = false;
+	gb_free(&editor->buffer_list);
+
+	editor_completor_clean(editor);
 	gb_free(&(editor->completor.filtered));
+	gb_free(&(editor->completor.keys));
+	gb_free(&(editor->completor.matched));
+	sb_free(&(editor->completor.matched_query));
+	fuzzy_top_free(&(editor->completor.top));
 	gb_free(&(editor->completor));
+	project_free(&editor->project);
+
+	for (i = 0; i < editor->kill_ring.len; ++i) editor_kill_text_release(editor->kill_ring.entries[i]);
+	editor_kill_text_release(editor->kill_ring.clipboard);
+	editor->kill_ring = (KillRing) {0};
+
+	for (i = 0; i < editor->panes_len; ++i) gb_free(&editor->panes[i].cursors);
+
+	for (i = 0; i < editor->listings.len; ++i) {
+		for (size_t j = 0; j < editor->listings.data[i].names.len; ++j) free(editor->listings.data[i].names.data[j]);
+		gb_free(&editor->listings.data[i].names);
+	}
+	gb_free(&editor->listings);
+}
+
+void editor_recenter_top_bottom(Editor *editor)
+{
+	int line_num, center, half_screen;
+	Arena *arena;
+	VisualLines *visual;
+
+	visual = editor_visual_lines(editor, editor->pane);
+	line_num = (int) editor_visual_row_by_position(visual, editor->pane->position);
+	arena = &editor->pane->arena;
+	half_screen = (int) arena->show_lines / 2;
+	center = MIN(visual->len, arena->start + half_screen);
+
+	//top -> bottom
+	if (arena->start == (size_t) line_num) {
+		arena->start = (size_t) MAX(line_num - (int) arena->show_lines + 2, 0);
+	//center -> top
+	} else if (line_num == center) {
+		arena->start = line_num;
+	//any -> center
+	} else {
+		arena->start = (size_t) MAX(line_num - half_screen, 0);
+	}
+}
+
+void editor_scroll_up(Editor *editor)
+{
+	register size_t i;
+	for (i = 0; i < (editor->pane->arena.show_lines / 2); ++i) {
+		editor_next_line(editor);
+	}
+}
+
+void editor_scroll_down(Editor *editor)
+{
+	register size_t i;
+	for (i = 0; i < (editor->pane->arena.show_lines / 2); ++i) {
+		editor_previous_line(editor);
+	}
+}
+
+void editor_beginning_of_buffer(Editor *editor)
+{
+	editor_goto_point(editor, 0);
+	editor_recognize_arena(editor);
+}
+
+void editor_end_of_buffer(Editor *editor)
+{
+	editor_goto_point(editor, editor->pane->buffer->content.len - 1);
+	editor_recognize_arena(editor);
+}
+
+void editor_mwheel_scroll_up(Editor *editor)
+{
+	size_t row_num;
+	size_t row_to_move;
+	Line *next_row;
+	VisualLines *visual;
+
+	visual = editor_visual_lines(editor, editor->pane);
+
+	if (editor->pane->arena.start > 0) {
+		editor->pane->arena.start--;
+
+		row_num = editor_visual_row_by_position(visual, editor->pane->position);
+
+		//out of arena range
+		if (row_num > (editor->pane->arena.start + editor->pane->arena.show_lines)) {
+			row_to_move = editor->pane->arena.start + editor->pane->arena.show_lines;
+			row_to_move = row_to_move > visual->len ? (visual->len - 1) : row_to_move;
+
+			next_row = &visual->data[row_to_move - MIN(row_to_move, 5)];
+			editor_goto_point(editor, next_row->start);
+		}
+	}
+}
+
+void editor_mwheel_scroll_down(Editor *editor)
+{
+	size_t row_num;
+	size_t row_to_move;
+	Line *next_row;
+	VisualLines *visual;
+
+	visual = editor_visual_lines(editor, editor->pane);
+
+	if (editor->pane->arena.start + 1 < visual->len) {
+		++editor->pane->arena.start;
+
+		row_num = editor_visual_row_by_position(visual, editor->pane->position);
+
+		//out of arena range
+		if (row_num < editor->pane->arena.start) {
+			row_to_move = editor->pane->arena.start;
+
+			next_row = &visual->data[row_to_move];
+			editor_goto_point(editor, next_row->start);
+		}
+	}
+}
+
+void editor_mwheel_scroll(Editor *editor, Sint32 y)
+{
+	register Sint32 i;
+
+	if (y > 0) {
+		for (i = 0; i < y; ++i) {
+			editor_mwheel_scroll_up(editor);
+		}
+	} else {
+		for (i = y; i < 0; ++i) {
+			editor_mwheel_scroll_down(editor);
+		}
+	}
+}
+
+void editor_set_mark(Editor *editor)
+{
+	editor->mark = editor->pane->position;
+	editor->state = SELECTION;
+}
+
+void editor_drag_start(Editor *editor, size_t point)
+{
+	editor_cursors_clear(editor->pane);
+	editor_goto_point(editor, point);
+
+	if (editor->state == SELECTION) editor->state = NONE;
+	editor->mark = editor->pane->position;
+}
+
+void editor_drag_to(Editor *editor, size_t point)
+{
+	if (editor->state != NONE && editor->state != SELECTION) return;
+
+	editor_goto_point(editor, point);
+	editor->state = editor->mark == editor->pane->position ? NONE : SELECTION;
+}
+
+static int editor_cursor_compare(const void *a, const void *b)
+{
+	size_t x = ((const Cursor *) a)->position, y = ((const Cursor *) b)->position;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Columns of the cursors after they were moved by an edit, see Buffer.column
+ */
+static void editor_cursors_columns(Editor *editor, Pane *pane)
+{
+	VisualLines *visual;
+	Cursor *cursor;
+
+	visual = editor_visual_lines(editor, pane);
+	if (visual->len == 0) return;
+
+	for (size_t i = 0; i < pane->cursors.len; ++i) {
+		cursor = &pane->cursors.data[i];
+		cursor->column = cursor->position - visual->data[editor_visual_row_by_position(visual, cursor->position)].start;
+	}
+}
+
+/**
+ * Sorts the cursors again after they moved, the ones which met are one cursor
+ */
+static void editor_cursors_normalize(Pane *pane)
+{
+	Cursors *cursors;
+	Cursor cursor;
+	size_t len, max;
+
+	cursors = &pane->cursors;
+	cursors->version = pane->buffer->version;
+	if (cursors->len == 0) return;
+
+	qsort(cursors->data, cursors->len, sizeof(*cursors->data), editor_cursor_compare);
+
+	max = pane->buffer->content.len;
+	len = 0;
+	for (size_t i = 0; i < cursors->len; ++i) {
+		cursor = cursors->data[i];
+		cursor.position = MIN(cursor.position, max);
+		cursor.mark = MIN(cursor.mark, max);
+
+		if (cursor.position == pane->position) continue;
+		if (len > 0 && cursors->data[len - 1].position == cursor.position) continue;
+
+		cursors->data[len++] = cursor;
+	}
+	cursors->len = len;
+}
+
+void editor_cursors_clear(Pane *pane)
+{
+	pane->cursors.len = 0;
+}
+
+/**
+ * The buffer was edited by the main cursor only (kill, paste, undo) or in another pane
+ */
+static void editor_cursors_check(Pane *pane)
+{
+	if (pane->cursors.version != pane->buffer->version) editor_cursors_clear(pane);
+}
+
+void editor_cursor_add_line(Editor *editor, bool down)
+{
+	Pane *pane = editor->pane;
+
+	if (!editor_is_editing_text(editor)) return;
+
+	editor_cursors_check(pane);
+	gb_append(&pane->cursors, ((Cursor) {pane->position, pane->position, pane->buffer->column}));
+	if (down) editor_next_line(editor);
+	else editor_previous_line(editor);
+
+	editor_cursors_normalize(pane);
+}
+
+void editor_cursors_motion(Editor *editor, void (*motion)(Editor *editor))
+{
+	Pane *pane;
+	Buffer *buffer;
+	Cursor *cursor, main;
+	EditorState state;
+	size_t arena_start;
+
+	pane = editor->pane;
+	buffer = pane->buffer;
+	editor_cursors_check(pane);
+	if (pane->cursors.len == 0) {
+		motion(editor);
+		return;
+	}
+
+	//every cursor takes the place of the main one while it moves
+	main = (Cursor) {pane->position, editor->mark, buffer->column};
+	state = editor->state;
+	arena_start = pane->arena.start;
+
+	for (size_t i = 0; i < pane->cursors.len; ++i) {
+		cursor = &pane->cursors.data[i];
+		pane->position = cursor->position;
+		editor->mark = cursor->mark;
+		buffer->column = cursor->column;
+		editor->state = state;
+
+		motion(editor);
+
+		*cursor = (Cursor) {pane->position, editor->mark, buffer->column};
+	}
+
+	//the view follows only the main cursor
+	pane->position = main.position;
+	editor->mark = main.mark;
+	buffer->column = main.column;
+	editor->state = state;
+	pane->arena.start = arena_start;
+
+	motion(editor);
+	editor_cursors_normalize(pane);
+}
+
+/**
+ * All the cursors of the pane by position, main is the index of the main one
+ */
+static Cursors *editor_cursors_all(Editor *editor, size_t *main)
+{
+	static Cursors all = {0};
+	Pane *pane;
+	size_t i;
+
+	pane = editor->pane;
+	all.len = 0;
+
+	for (i = 0; i < pane->cursors.len && pane->cursors.data[i].position < pane->position; ++i) {
+		gb_append(&all, pane->cursors.data[i]);
+	}
+	*main = all.len;
+	gb_append(&all, ((Cursor) {pane->position, editor->mark, pane->buffer->column}));
+	for (; i < pane->cursors.len; ++i) {
+		gb_append(&all, pane->cursors.data[i]);
+	}
+
+	return &all;
+}
+
+/**
+ * The edit of a cursor is cut where the edit of the previous cursor ends, so they do not overlap
+ */
+static void editor_cursor_edit(Replacements *edits, size_t start, size_t end, size_t text_len)
+{
+	size_t prev_end;
+
+	prev_end = edits->len > 0 ? edits->data[edits->len - 1].end : 0;
+	start = MAX(start, prev_end);
+	end = MAX(end, start);
+
+	gb_append(edits, ((Replacement) {start, end, 0, text_len}));
+}
+
+/**
+ * Applies the edits of the cursors (one by cursor, in the same order) as one
+ * replacement of the content and puts every cursor after its text
+ */
+static void editor_cursors_apply(Editor *editor, Cursors *all, size_t main, Replacements *edits)
+{
+	Pane *pane;
+	ChangeEvent *event;
+	Replacements inverse;
+	Replacement *edit;
+	long shift;
+	size_t i;
+
+	pane = editor->pane;
+	event = editor_buffer_next_event(pane->buffer);
+
+	//the memory of the overwritten event is reused
+	inverse = event->replacements;
+	editor_buffer_replace(pane->buffer, edits, &inverse);
+	event->type = REPLACEMENT;
+	event->point = pane->position;
+	event->replacements = inverse;
+
+	shift = 0;
+	pane->cursors.len = 0;
+	for (i = 0; i < all->len; ++i) {
+		edit = &edits->data[i];
+		all->data[i].position = (size_t) ((long) edit->start + shift) + edit->text_len;
+		all->data[i].mark = all->data[i].position;
+		shift += (long) edit->text_len - (long) (edit->end - edit->start);
+
+		if (i != main) gb_append(&pane->cursors, all->data[i]);
+	}
+
+	editor->state = NONE;
+	editor->mark = all->data[main].position;
+	editor_goto_point(editor, all->data[main].position);
+	editor_cursors_normalize(pane);
+	editor_cursors_columns(editor, pane);
+}
+
+void editor_cursors_insert(Editor *editor, char *str)
+{
+	static Replacements edits = {0};
+	Cursors *all;
+	Cursor *cursor;
+	size_t main, text_len;
+	bool selection;
+
+	editor_cursors_check(editor->pane);
+	if (editor->pane->cursors.len == 0) {
+		editor_insert(editor, str);
+		return;
+	}
+	if (str == NULL) return;
+
+	text_len = strlen(str);
+	selection = editor->state == SELECTION;
+	all = editor_cursors_all(editor, &main);
+
+	//every cursor inserts the same text
+	edits.len = 0;
+	sb_clean(&edits.text);
+	sb_append_manyl(&edits.text, str, text_len);
+
+	for (size_t i = 0; i < all->len; ++i) {
+		cursor = &all->data[i];
+		if (selection) {
+			editor_cursor_edit(&edits, MIN(cursor->position, cursor->mark), MAX(cursor->position, cursor->mark), text_len);
+		} else {
+			editor_cursor_edit(&edits, cursor->position, cursor->position, text_len);
+		}
+	}
+
+	editor_cursors_apply(editor, all, main, &edits);
+}
+
+void editor_cursors_delete(Editor *editor, bool forward)
+{
+	static Replacements edits = {0};
+	Content *content;
+	Cursors *all;
+	Cursor *cursor;
+	size_t main, position, deleted;
+	bool selection;
+
+	editor_cursors_check(editor->pane);
+	if (editor->pane->cursors.len == 0) {
+		if (forward) editor_delete_forward(editor);
+		else editor_delete_backward(editor);
+		return;
+	}
+
+	content = &editor->pane->buffer->content;
+	selection = editor->state == SELECTION;
+	all = editor_cursors_all(editor, &main);
+
+	edits.len = 0;
+	deleted = 0;
+	for (size_t i = 0; i < all->len; ++i) {
+		cursor = &all->data[i];
+		position = cursor->position;
+
+		if (selection) {
+			editor_cursor_edit(&edits, MIN(position, cursor->mark), MAX(position, cursor->mark), 0);
+		} else if (forward) {
+			editor_cursor_edit(&edits, position, position < content->len ? MIN(position + utf8_size_char(content->data[position]), content->len) : position, 0);
+		} else {
+			editor_cursor_edit(&edits, position > 0 ? position - utf8_size_char_backward(content->data, position - 1) : 0, position, 0);
+		}
+
+		deleted += edits.data[edits.len - 1].end - edits.data[edits.len - 1].start;
+	}
+
+	if (deleted == 0) {
+		editor->state = NONE;
+		return;
+	}
+
+	editor_cursors_apply(editor, all, main, &edits);
+}
+
+/**
+ * The ring takes the reference of the text, the oldest kill is dropped when it is full
+ */
+static void editor_kill_ring_push(KillRing *ring, KillText *text)
+{
+	if (ring->len > 0) ring->head = (ring->head + 1) % EDITOR_KILL_RING_SIZE;
+
+	if (ring->len == EDITOR_KILL_RING_SIZE) {
+		editor_kill_text_release(ring->entries[ring->head]);
+	} else {
+		++ring->len;
+	}
+
+	ring->entries[ring->head] = text;
+	ring->clipboard_changed = false;
+}
+
+static KillText *editor_kill_ring_get(KillRing *ring, size_t back)
+{
+	return ring->entries[(ring->head + EDITOR_KILL_RING_SIZE - back % ring->len) % EDITOR_KILL_RING_SIZE];
+}
+
+/**
+ * The text copied in another program becomes the latest kill
+ */
+static void editor_kill_ring_sync(KillRing *ring)
+{
+	char *clipboard;
+	size_t len;
+
+	if (!ring->clipboard_changed && ring->len > 0) return;
+	ring->clipboard_changed = false;
+
+	if (!SDL_HasClipboardText()) return;
+
+	clipboard = SDL_GetClipboardText();
+	len = strlen(clipboard);
+	if (len > 0 && (ring->len == 0 || strcmp(editor_kill_ring_get(ring, 0)->data, clipboard) != 0)) {
+		editor_kill_ring_push(ring, editor_kill_text(clipboard, len));
+	}
+
+	SDL_free(clipboard);
+}
+
+static void editor_kill_ring_copy(Editor *editor, bool append)
+{
+	KillRing *ring;
+	KillText *text, *head;
+	size_t reg_beg, reg_end;
+	char *data;
+
+	ring = &editor->kill_ring;
+	reg_beg = editor_reg_beg(editor);
+	reg_end = editor_reg_end(editor);
+	data = &editor->pane->buffer->content.data[reg_beg];
+
+	if (!append || ring->len == 0) {
+		editor_kill_ring_push(ring, editor_kill_text(data, reg_end - reg_beg));
+		return;
+	}
+
+	//the kill texts do not change, the appended one replaces the head
+	head = ring->entries[ring->head];
+	text = editor_kill_text_alloc(head->len + reg_end - reg_beg);
+	memcpy(text->data, head->data, head->len);
+	memcpy(&text->data[head->len], data, reg_end - reg_beg);
+	ring->entries[ring->head] = text;
+	editor_kill_text_release(head);
+}
+
+static void editor_clipboard_set(KillRing *ring)
+{
+	editor_kill_text_release(ring->clipboard);
+	ring->clipboard = ring->entries[ring->head];
+	++ring->clipboard->refs;
+}
+
+void editor_copy_to_clipboard(Editor *editor)
+{
+	if (editor->state != SELECTION) return;
+
+	editor_kill_ring_copy(editor, false);
+	editor_clipboard_set(&editor->kill_ring);
+}
+
+/**
+ * Moves the region to the kill ring, the kill right after the previous
+ * one at the same place is appended to it
+ */
+static void editor_kill_region(Editor *editor)
+{
+	KillRing *ring;
+	Buffer *buffer;
+	bool append;
+
+	ring = &editor->kill_ring;
+	buffer = editor->pane->buffer;
+	append = ring->kill_buffer == buffer && ring->kill_version == buffer->version && ring->kill_position == editor_reg_beg(editor);
+
+	editor_kill_ring_copy(editor, append);
+	editor_delete_backward(editor);
+
+	ring->kill_buffer = buffer;
+	ring->kill_version = buffer->version;
+	ring->kill_position = editor->pane->position;
+}
+
+void editor_cut(Editor *editor)
+{
+	if (editor->state != SELECTION) return;
+
+	editor_kill_region(editor);
+	editor_clipboard_set(&editor->kill_ring);
+}
+
+void editor_kill_line(Editor *editor)
+{
+	Buffer *buffer;
+	Line *line;
+	size_t end;
+
+	buffer = editor->pane->buffer;
+	if (buffer->len == 0) return;
+
+	//at the end of the line its newline is killed
+	line = &buffer->data[editor_get_current_line_number(editor->pane)];
+	end = line->end > editor->pane->position ? line->end : MIN(line->end + 1, buffer->content.len);
+	if (end <= editor->pane->position) return;
+
+	editor->mark = end;
+	editor->state = SELECTION;
+	editor_kill_region(editor);
+
+	editor->state = NONE;
+}
+
+static void editor_yank(Editor *editor, size_t back)
+{
+	KillRing *ring;
+
+	ring = &editor->kill_ring;
+	ring->yank_beg = editor->pane->position;
+	editor_insert(editor, editor_kill_ring_get(ring, back)->data);
+	editor_recognize_arena(editor);
+
+	ring->yank_buffer = editor->pane->buffer;
+	ring->yank_version = editor->pane->buffer->version;
+	ring->yank_end = editor->pane->position;
+	ring->yank_index = back;
+}
+
+void editor_paste(Editor *editor)
+{
+	editor_kill_ring_sync(&editor->kill_ring);
+	if (editor->kill_ring.len == 0) return;
+
+	if (editor->state == SELECTION) {
+		editor_delete_backward(editor);
+	}
+
+	editor_yank(editor, 0);
+}
+
+void editor_yank_pop(Editor *editor)
+{
+	KillRing *ring;
+	Buffer *buffer;
+
+	ring = &editor->kill_ring;
+	buffer = editor->pane->buffer;
+
+	if (ring->len < 2 || editor->state != NONE) return;
+	if (ring->yank_buffer != buffer || ring->yank_version != buffer->version || ring->yank_end != editor->pane->position) return;
+
+	editor->mark = ring->yank_beg;
+	editor->state = SELECTION;
+	editor_delete_backward(editor);
+	editor_yank(editor, ring->yank_index + 1);
+}
+
+void editor_clipboard_changed(Editor *editor)
+{
+	editor->kill_ring.clipboard_changed = true;
+}
+
+void editor_clipboard_flush(Editor *editor)
+{
+	KillRing *ring = &editor->kill_ring;
+
+	if (ring->clipboard == NULL) return;
+
+	if (!SDL_SetClipboardText(ring->clipboard->data)) {
+		fprintf(stderr, "Could not copy to clipboard: %s\n", SDL_GetError());
+	}
+
+	editor_kill_text_release(ring->clipboard);
+	ring->clipboard = NULL;
+}
+
+void editor_duplicate_line(Editor *editor)
+{
+	Buffer *buffer;
+	Content *content;
+	Line line;
+	size_t copy_len;
+
+	buffer = editor->pane->buffer;
+	if (buffer->len == 0) return;
+
+	content = &buffer->content;
+	line = buffer->data[editor_get_current_line_number(editor->pane)];
+	copy_len = line.end - line.start + 1;
+
+	//the copy goes after the line, so the copied bytes stay where they are
+	editor_content_reserve(content, content->len + copy_len);
+	memmove(&content->data[line.end + copy_len], &content->data[line.end], content->len - line.end);
+	content->data[line.end] = '\n';
+	memcpy(&content->data[line.end + 1], &content->data[line.start], copy_len - 1);
+	content->len += copy_len;
+
+	editor_lines_patch(buffer, line.end, 0, copy_len);
+	buffer->need_to_save = true;
+	editor_buffer_store_event(buffer, line.end, &content->data[line.end], copy_len, INSERTION);
+
+	editor_goto_point(editor, editor->pane->position + copy_len);
+}
+
+void editor_user_input_clear(Editor *editor)
+{
+	sb_clean((&editor->user_input));
+	editor_search_matches_clear(editor);
+	editor->state = NONE;
+}
+
+static void editor_user_search_start(Editor *editor, EditorState state, bool is_regexp)
+{
+	editor->state = state;
+	sb_clean((&editor->user_input));
+	editor_search_matches_clear(editor);
+	editor->matches.origin = editor->pane->position;
+	editor->matches.is_regexp = is_regexp;
+}
+
+void editor_user_search_forward(Editor *editor)
+{
+	editor_user_search_start(editor, FORWARD_SEARCH, false);
+}
+
+void editor_user_search_backward(Editor *editor)
+{
+	editor_user_search_start(editor, BACKWARD_SEARCH, false);
+}
+
+void editor_user_search_regexp_forward(Editor *editor)
+{
+	editor_user_search_start(editor, FORWARD_SEARCH, true);
+}
+
+void editor_user_search_regexp_backward(Editor *editor)
+{
+	editor_user_search_start(editor, BACKWARD_SEARCH, true);
+}
+
+void editor_user_extend_command(Editor *editor)
+{
+	editor->state = EXTEND_COMMAND;
+	sb_clean((&editor->user_input));
+}
+
+void editor_user_input_insert(Editor *editor, char *text)
+{
+	sb_append_many(&editor->user_input, text);
+}
+
+void editor_user_input_delete_backward(Editor *editor)
+{
+	StringBuilder *sb;
+	uint8_t char_len;
+
+	if (editor->user_input.len == 0) return;
+
+	sb = &editor->user_input;
+	char_len = utf8_size_char_backward(sb->data, sb->len - 1);
+	sb->len -= char_len;
+	memset(&sb->data[sb->len], 0, char_len);
+}
+
+/**
+ * Regexp matches do not overlap: the next one starts after the end of the match at the position
+ */
+static long editor_search_regexp_next(Regexp *regexp, Content *content, size_t position, bool forward)
+{
+	size_t start, end;
+
+	if (!forward) {
+		if (position == 0 || !regexp_search_backward(regexp, content->data, content->len, position - 1, &start, &end)) return -1;
+		return (long) start;
+	}
+
+	if (!regexp_search_forward(regexp, content->data, content->len, position, &start, &end)) return -1;
+	if (start == position && !regexp_search_forward(regexp, content->data, content->len, MAX(end, position + 1), &start, &end)) return -1;
+
+	return (long) start;
 }
 
-void editor_recenter_top_bottom(Editor *editor)
+bool editor_user_search_next(Editor *editor, char *notification, size_t notification_len)
 {
-	int line_num, center, half_screen;
-	Arena *arena;
+	SearchPattern pattern;
+	Content *content;
+	size_t position;
+	long found;
+	bool forward;
 
-	line_num = (int) editor_get_current_line_number(editor->pane);
-	arena = &editor->pane->arena;
-	half_screen = (int) arena->show_lines / 2;
-	center = MIN(editor->pane->buffer->len, arena->start + half_screen);
+	if (editor->user_input.len == 0) return false;
+	if (editor->state != FORWARD_SEARCH && editor->state != BACKWARD_SEARCH) return false;
 
-	//top -> bottom
-	if (arena->start == (size_t) line_num) {
-		arena->start = (size_t) MAX(line_num - (int) arena->show_lines + 2, 0);
-	//center -> top
-	} else if (line_num == center) {
-		arena->start = line_num;
-	//any -> center
-	} else {
-		arena->start = (size_t) MAX(line_num - half_screen, 0);
+	content = &editor->pane->buffer->content;
+	position = editor->pane->position;
+
+	forward = editor->state == FORWARD_SEARCH;
+
+	if (editor->matches.is_regexp && !editor->matches.compiled) {
+		snprintf(notification, notification_len, "Invalid regexp: %s", editor->matches.regexp.error);
+		return false;
+	}
+
+	//the index is bisected, the text is scanned only when the index has not got there yet
+	if (editor->search_index.owner != editor->pane->buffer || !search_index_next(&editor->search_index, position, forward, &found)) {
+		if (editor->matches.is_regexp) {
+			found = editor_search_regexp_next(&editor->matches.regexp, content, position, forward);
+		} else {
+			search_compile(&pattern, editor->user_input.data, editor->user_input.len);
+			if (!forward) {
+				found = position == 0 ? -1 : search_backward(&pattern, content->data, content->len, position - 1);
+			} else {
+				found = search_forward(&pattern, content->data, content->len, position + 1);
+			}
+			search_free(&pattern);
+		}
+	}
+
+	if (found >= 0) {
+		editor_goto_point(editor, (size_t) found);
+		editor_recognize_arena(editor);
+		//the input typed further is searched from here
+		editor->matches.origin = (size_t) found;
+		return true;
 	}
+
+	snprintf(notification, notification_len, "Not found: %s", editor->user_input.data);
+	editor_user_input_clear(editor);
+
+	return false;
 }
 
-void editor_scroll_up(Editor *editor)
+void editor_search_matches_clear(Editor *editor)
 {
-	register size_t i;
-	for (i = 0; i < (editor->pane->arena.show_lines / 2); ++i) {
-		editor_next_line(editor);
-	}
+	SearchMatches *matches = &editor->matches;
+
+	matches->len = 0;
+	sb_clean(&matches->needle);
+	matches->buffer = NULL;
+	matches->scanned_beg = 0;
+	matches->scanned_end = 0;
+
+	if (matches->compiled) regexp_free(&matches->regexp);
+	matches->compiled = false;
+
+	search_index_cancel(&editor->search_index);
 }
 
-void editor_scroll_down(Editor *editor)
+/**
+ * The first match which ends after the position
+ */
+size_t editor_search_matches_lower_bound(SearchMatches *matches, size_t position)
 {
-	register size_t i;
-	for (i = 0; i < (editor->pane->arena.show_lines / 2); ++i) {
-		editor_previous_line(editor);
+	size_t lo = 0, hi = matches->len, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (matches->data[mid].end <= position) lo = mid + 1;
+		else hi = mid;
 	}
+
+	return lo;
 }
 
-void editor_beginning_of_buffer(Editor *editor)
+/**
+ * Inserts the matches starting in [beg, end) at the index, the range must not overlap the scanned one
+ */
+static void editor_search_matches_scan(SearchMatches *matches, SearchPattern *pattern, Content *content, size_t index, size_t beg, size_t end)
 {
-	editor_goto_point(editor, 0);
-	editor_recognize_arena(editor);
+	static struct {
+		SearchMatch *data;
+		size_t len;
+		size_t cap;
+	} found = {0};
+	size_t text_len;
+	long next;
+
+	//nothing past the end of the range has to be checked
+	text_len = MIN(content->len, end + pattern->len - 1);
+	found.len = 0;
+
+	for (next = search_forward(pattern, content->data, text_len, beg); next >= 0; next = search_forward(pattern, content->data, text_len, (size_t) next + 1)) {
+		gb_append(&found, ((SearchMatch) {(size_t) next, (size_t) next + pattern->len}));
+	}
+
+	if (found.len == 0) return;
+
+	for (size_t i = 0; i < found.len; ++i) gb_append(matches, ((SearchMatch) {0}));
+	memmove(&matches->data[index + found.len], &matches->data[index], (matches->len - found.len - index) * sizeof(SearchMatch));
+	memcpy(&matches->data[index], found.data, found.len * sizeof(SearchMatch));
 }
 
-void editor_end_of_buffer(Editor *editor)
+/**
+ * Appends the regexp matches starting in [beg, end) after the last found one.
+ * The text is cut at the line end (at most EDITOR_MATCHES_VISIBLE_LIMIT further).
+ */
+static void editor_search_matches_scan_regexp(SearchMatches *matches, Content *content, size_t beg, size_t end)
 {
-	editor_goto_point(editor, editor->pane->buffer->content.len - 1);
-	editor_recognize_arena(editor);
+	char *line_end;
+	size_t text_len, from, start, stop;
+
+	text_len = MIN(content->len, end + EDITOR_MATCHES_VISIBLE_LIMIT);
+	if (!matches->regexp.multiline && end < text_len) {
+		line_end = memchr(&content->data[end], '\n', text_len - end);
+		if (line_end != NULL) text_len = (size_t) (line_end - content->data);
+	}
+
+	from = matches->len > 0 ? MAX(beg, matches->data[matches->len - 1].end) : beg;
+	while (from < end && regexp_search_forward(&matches->regexp, content->data, text_len, from, &start, &stop) && start < end) {
+		//empty matches have nothing to highlight
+		if (stop > start) gb_append(matches, ((SearchMatch) {start, stop}));
+		from = stop > start ? stop : start + 1;
+	}
 }
 
-void editor_mwheel_scroll_up(Editor *editor)
+/**
+ * Grows the scanned range to [beg, end), starts it over when the ranges are far apart
+ */
+static void editor_search_matches_extend(Editor *editor, size_t beg, size_t end)
 {
-	size_t line_num;
-	size_t line_to_move;
-	Line *next_line;
+	SearchMatches *matches;
+	SearchPattern pattern;
+	Content *content;
 
-	if (editor->pane->arena.start > 0) {
-		editor->pane->arena.start--;
+	matches = &editor->matches;
+	content = &matches->buffer->content;
 
-		line_num = editor_get_current_line_number(editor->pane);
+	if (matches->scanned_beg == matches->scanned_end
+		|| end + EDITOR_MATCHES_VISIBLE_LIMIT < matches->scanned_beg
+		|| beg > matches->scanned_end + EDITOR_MATCHES_VISIBLE_LIMIT) {
+		matches->len = 0;
+		matches->scanned_beg = beg;
+		matches->scanned_end = beg;
+	}
 
-		//out of arena range
-		if (line_num > (editor->pane->arena.start + editor->pane->arena.show_lines)) {
-			line_to_move = editor->pane->arena.start + editor->pane->arena.show_lines;
-			line_to_move = line_to_move > editor->pane->buffer->len ? (editor->pane->buffer->len - 1) : line_to_move;
+	if (matches->is_regexp) {
+		//the matches before depend on where the scan starts, they are found again
+		if (beg < matches->scanned_beg) {
+			matches->len = 0;
+			matches->scanned_beg = beg;
+			matches->scanned_end = beg;
+		}
 
-			next_line = &editor->pane->buffer->data[line_to_move - 5];
-			editor_goto_point(editor, next_line->start);
+		if (end > matches->scanned_end) {
+			editor_search_matches_scan_regexp(matches, content, matches->scanned_end, end);
+			matches->scanned_end = end;
 		}
+
+		return;
+	}
+
+	search_compile(&pattern, matches->needle.data, matches->needle.len);
+
+	if (beg < matches->scanned_beg) {
+		editor_search_matches_scan(matches, &pattern, content, 0, beg, matches->scanned_beg);
+		matches->scanned_beg = beg;
+	}
+
+	if (end > matches->scanned_end) {
+		editor_search_matches_scan(matches, &pattern, content, matches->len, matches->scanned_end, end);
+		matches->scanned_end = end;
 	}
+
+	search_free(&pattern);
 }
 
-void editor_mwheel_scroll_down(Editor *editor)
+/**
+ * Makes sure the matches of the visible part of the pane are found
+ */
+void editor_search_matches_visible(Editor *editor, Pane *pane)
 {
-	size_t line_num;
-	size_t line_to_move;
-	Line *next_line;
+	VisualLines *visual;
+	size_t arena_end, beg, end, len;
 
-	if (editor->pane->arena.start < (editor->pane->buffer->len - 1)) {
-		++editor->pane->arena.start;
+	if (editor->matches.needle.len == 0 || editor->matches.buffer != pane->buffer) return;
+	if (editor->matches.is_regexp && !editor->matches.compiled) return;
 
-		line_num = editor_get_current_line_number(editor->pane);
+	visual = editor_visual_lines(editor, pane);
+	if (visual->len == 0) return;
 
-		//out of arena range
-		if (line_num < editor->pane->arena.start) {
-			line_to_move = editor->pane->arena.start;
+	arena_end = MIN(pane->arena.start + pane->arena.show_lines, visual->len);
+	len = pane->buffer->content.len;
+	beg = MIN(visual->data[pane->arena.start].start, len);
+	end = MIN(visual->data[arena_end - 1].end + 1, len);
 
-			next_line = &editor->pane->buffer->data[line_to_move];
-			editor_goto_point(editor, next_line->start);
-		}
+	//truncated long lines show only a part around the cursor
+	if (end - beg > EDITOR_MATCHES_VISIBLE_LIMIT) {
+		beg = MAX(beg, pane->position - MIN(pane->position, EDITOR_MATCHES_VISIBLE_LIMIT / 2));
+		end = MIN(end, beg + EDITOR_MATCHES_VISIBLE_LIMIT);
 	}
+
+	editor_search_matches_extend(editor, beg, end);
 }
 
-void editor_mwheel_scroll(Editor *editor, Sint32 y)
+void editor_cursors_from_matches(Editor *editor)
 {
-	register Sint32 i;
+	SearchMatches *matches;
+	SearchMatch main;
+	Pane *pane;
+	size_t main_index;
 
-	if (y > 0) {
-		for (i = 0; i < y; ++i) {
-			editor_mwheel_scroll_up(editor);
+	matches = &editor->matches;
+	pane = editor->pane;
+
+	if ((editor->state & SEARCH) == 0 || matches->buffer != pane->buffer) return;
+	if (matches->needle.len == 0 || (matches->is_regexp && !matches->compiled)) return;
+
+	editor_search_matches_extend(editor, 0, pane->buffer->content.len);
+	if (matches->len == 0) return;
+
+	//the search stands at the start of the current match
+	main_index = MIN(editor_search_matches_lower_bound(matches, pane->position), matches->len - 1);
+	main = matches->data[main_index];
+
+	pane->cursors.len = 0;
+	for (size_t i = 0; i < matches->len; ++i) {
+		if (i != main_index) gb_append(&pane->cursors, ((Cursor) {matches->data[i].end, matches->data[i].start, 0}));
+	}
+
+	editor_user_input_clear(editor);
+	editor_goto_point(editor, main.end);
+	editor->mark = main.start;
+	editor->state = SELECTION;
+
+	editor_cursors_normalize(pane);
+	editor_cursors_columns(editor, pane);
+}
+
+/**
+ * A regexp is compiled again for every input, an invalid one has no matches
+ */
+static void editor_search_matches_update_regexp(Editor *editor)
+{
+	SearchMatches *matches;
+	StringBuilder *input;
+	Content *content;
+	size_t start, end;
+	bool found;
+
+	matches = &editor->matches;
+	input = &editor->user_input;
+	content = &editor->pane->buffer->content;
+
+	if (matches->compiled) regexp_free(&matches->regexp);
+	matches->compiled = regexp_compile(&matches->regexp, input->data, input->len, REGEXP_ICASE);
+
+	matches->len = 0;
+	matches->buffer = editor->pane->buffer;
+	matches->scanned_beg = 0;
+	matches->scanned_end = 0;
+	sb_clean(&matches->needle);
+	sb_append_manyl(&matches->needle, input->data, input->len);
+
+	if (!matches->compiled) {
+		search_index_cancel(&editor->search_index);
+		return;
+	}
+
+	search_index_start_regexp(&editor->search_index, editor->pane->buffer, content->data, content->len, input->data, input->len);
+
+	if (editor->state == BACKWARD_SEARCH) {
+		found = regexp_search_backward(&matches->regexp, content->data, content->len, matches->origin, &start, &end);
+	} else {
+		found = regexp_search_forward(&matches->regexp, content->data, content->len, matches->origin, &start, &end);
+	}
+
+	if (found) {
+		editor_goto_point(editor, start);
+		editor_recognize_arena(editor);
+	}
+}
+
+/**
+ * Follows the changed search input: moves to the first match from the origin
+ * and narrows the previous matches when the input is only extended.
+ */
+void editor_search_matches_update(Editor *editor)
+{
+	SearchMatches *matches;
+	SearchPattern pattern;
+	StringBuilder *input;
+	Content *content;
+	size_t kept;
+	long found;
+	bool narrow;
+
+	matches = &editor->matches;
+	input = &editor->user_input;
+	content = &editor->pane->buffer->content;
+
+	if (input->len == 0) {
+		editor_search_matches_clear(editor);
+		return;
+	}
+
+	if (matches->is_regexp) {
+		editor_search_matches_update_regexp(editor);
+		return;
+	}
+
+	narrow = matches->buffer == editor->pane->buffer
+		&& matches->needle.len > 0
+		&& matches->needle.len <= input->len
+		&& strncasecmp(input->data, matches->needle.data, matches->needle.len) == 0;
+
+	search_compile(&pattern, input->data, input->len);
+
+	if (narrow) {
+		kept = 0;
+		for (size_t i = 0; i < matches->len; ++i) {
+			if (search_match_at(&pattern, content->data, content->len, matches->data[i].start)) {
+				matches->data[kept].start = matches->data[i].start;
+				matches->data[kept++].end = matches->data[i].start + input->len;
+			}
 		}
+		matches->len = kept;
 	} else {
-		for (i = y; i < 0; ++i) {
-			editor_mwheel_scroll_down(editor);
+		matches->len = 0;
+		matches->buffer = editor->pane->buffer;
+		matches->scanned_beg = 0;
+		matches->scanned_end = 0;
+	}
+
+	sb_clean(&matches->needle);
+	sb_append_manyl(&matches->needle, input->data, input->len);
+	search_index_start(&editor->search_index, editor->pane->buffer, content->data, content->len, input->data, input->len);
+
+	if (editor->state == BACKWARD_SEARCH) {
+		found = search_backward(&pattern, content->data, content->len, matches->origin);
+	} else {
+		found = search_forward(&pattern, content->data, content->len, matches->origin);
+	}
+	search_free(&pattern);
+
+	if (found >= 0) {
+		editor_goto_point(editor, (size_t) found);
+		editor_recognize_arena(editor);
+	}
+}
+
+static void editor_replace_free(ReplaceSession *replace)
+{
+	if (replace->compiled) {
+		if (replace->is_regexp) regexp_free(&replace->regexp);
+		else search_free(&replace->pattern);
+	}
+
+	replace->compiled = false;
+	replace->accepted.len = 0;
+	sb_clean(&replace->accepted.text);
+	sb_clean(&replace->from);
+	sb_clean(&replace->to);
+	replace->buffer = NULL;
+}
+
+/**
+ * Starts query-replace (or replace-regexp without the query) from the cursor
+ */
+void editor_user_replace(Editor *editor, bool is_regexp, bool query)
+{
+	ReplaceSession *replace = &editor->replace;
+
+	editor_replace_free(replace);
+	sb_clean((&editor->user_input));
+
+	editor->state = REPLACE;
+	replace->stage = REPLACE_FROM;
+	replace->is_regexp = is_regexp;
+	replace->query = query;
+	replace->buffer = editor->pane->buffer;
+	replace->next = editor->pane->position;
+	replace->after_match = false;
+}
+
+/**
+ * The match at next or after it, empty regexp matches are skipped right after a match
+ */
+static bool editor_replace_find(ReplaceSession *replace, SearchMatch *match)
+{
+	Content *content = &replace->buffer->content;
+	size_t start, end;
+	long found;
+
+	if (replace->next > content->len) return false;
+
+	if (!replace->is_regexp) {
+		found = search_forward(&replace->pattern, content->data, content->len, replace->next);
+		if (found < 0) return false;
+
+		match->start = (size_t) found;
+		match->end = (size_t) found + replace->from.len;
+		return true;
+	}
+
+	if (!regexp_search_forward(&replace->regexp, content->data, content->len, replace->next, &start, &end)) return false;
+	if (start == end && replace->after_match && start == replace->next) {
+		if (start + 1 > content->len || !regexp_search_forward(&replace->regexp, content->data, content->len, start + 1, &start, &end)) return false;
+	}
+
+	match->start = start;
+	match->end = end;
+	return true;
+}
+
+/**
+ * Appends the replacement of the match, \& in a regexp replacement is the whole match
+ */
+static void editor_replace_accept(ReplaceSession *replace, SearchMatch *match)
+{
+	Replacements *accepted = &replace->accepted;
+	Content *content = &replace->buffer->content;
+	size_t text_beg;
+
+	text_beg = accepted->text.len;
+	for (size_t i = 0; i < replace->to.len; ++i) {
+		if (replace->is_regexp && replace->to.data[i] == '\\' && i + 1 < replace->to.len) {
+			if (replace->to.data[i + 1] == '&') {
+				sb_append_manyl(&accepted->text, &content->data[match->start], match->end - match->start);
+				++i;
+				continue;
+			} else if (replace->to.data[i + 1] == '\\') {
+				++i;
+			}
 		}
+
+		sb_append(&accepted->text, replace->to.data[i]);
 	}
+
+	gb_append(accepted, ((Replacement) {match->start, match->end, text_beg, accepted->text.len - text_beg}));
 }
 
-void editor_set_mark(Editor *editor)
+static void editor_replace_skip(ReplaceSession *replace, SearchMatch *match)
 {
-	editor->mark = editor->pane->position;
-	editor->state = SELECTION;
+	replace->next = match->end > match->start ? match->end : match->start + 1;
+	replace->after_match = match->end > match->start;
 }
 
-void editor_copy_to_clipboard(Editor *editor)
+/**
+ * Rebuilds the buffer with the accepted replacements as one undo step and ends the session
+ */
+static void editor_replace_finish(Editor *editor, char *notification, size_t notification_len)
 {
-	char *copy;
-	size_t len, reg_beg, reg_end;
+	ReplaceSession *replace;
+	ChangeEvent *event;
+	Replacements inverse;
+	size_t count, point;
 
-	if (editor->state != SELECTION) return;
+	replace = &editor->replace;
+	count = replace->accepted.len;
 
-	reg_beg = editor_reg_beg(editor);
-	reg_end = editor_reg_end(editor);
-	len = reg_end - reg_beg;
+	if (count > 0) {
+		point = replace->accepted.data[0].start;
+		event = editor_buffer_next_event(replace->buffer);
 
-	copy = calloc(len + 1, sizeof(char));
-	memcpy(copy, &editor->pane->buffer->content.data[reg_beg], len);
+		//the memory of the overwritten event is reused
+		inverse = event->replacements;
+		editor_buffer_replace(replace->buffer, &replace->accepted, &inverse);
+		event->type = REPLACEMENT;
+		event->point = point;
+		event->replacements = inverse;
 
-	if (!SDL_SetClipboardText(copy)) {
-		fprintf(stderr, "Could not copy to clipboard: %s\n", SDL_GetError());
+		if (editor->pane->buffer == replace->buffer) {
+			editor_goto_point(editor, inverse.data[inverse.len - 1].end);
+			editor_recognize_arena(editor);
+		}
 	}
 
-	free(copy);
+	snprintf(notification, notification_len, "Replaced %ld occurrence%s", count, count == 1 ? "" : "s");
+
+	editor_replace_free(replace);
+	editor_user_input_clear(editor);
 }
 
-void editor_cut(Editor *editor)
+/**
+ * The current match is highlighted like a search match
+ */
+static void editor_replace_show(Editor *editor)
 {
-	if (editor->state != SELECTION) return;
+	SearchMatches *matches = &editor->matches;
+	ReplaceSession *replace = &editor->replace;
+
+	editor_search_matches_clear(editor);
+	matches->buffer = replace->buffer;
+	sb_append_manyl(&matches->needle, replace->from.data, replace->from.len);
+	gb_append(matches, replace->current);
+	//nothing else is scanned for the view
+	matches->scanned_beg = 0;
+	matches->scanned_end = replace->buffer->content.len;
+
+	if (editor->pane->buffer == replace->buffer) {
+		editor_goto_point(editor, replace->current.start);
+		editor_recognize_arena(editor);
+	}
+}
 
-	editor_copy_to_clipboard(editor);
-	editor_delete_backward(editor);
+/**
+ * Moves to the next match or finishes the session when there is none
+ */
+static void editor_replace_query_next(Editor *editor, char *notification, size_t notification_len)
+{
+	ReplaceSession *replace = &editor->replace;
+
+	if (!editor_replace_find(replace, &replace->current)) {
+		editor_replace_finish(editor, notification, notification_len);
+		return;
+	}
+
+	editor_replace_show(editor);
 }
 
-void editor_paste(Editor *editor)
+void editor_user_replace_submit(Editor *editor, char *notification, size_t notification_len)
 {
-	char* clipboard;
+	ReplaceSession *replace;
+	StringBuilder *input;
+	SearchMatch match;
+
+	replace = &editor->replace;
+	input = &editor->user_input;
+
+	switch (replace->stage) {
+	case REPLACE_FROM:
+		if (input->len == 0) return;
+
+		if (replace->is_regexp) {
+			replace->compiled = regexp_compile(&replace->regexp, input->data, input->len, REGEXP_ICASE);
+			if (!replace->compiled) {
+				snprintf(notification, notification_len, "Invalid regexp: %s", replace->regexp.error);
+				editor_user_replace_cancel(editor);
+				return;
+			}
+		} else {
+			search_compile(&replace->pattern, input->data, input->len);
+			replace->compiled = true;
+		}
 
-	if (!SDL_HasClipboardText()) return;
+		sb_append_manyl(&replace->from, input->data, input->len);
+		sb_clean(input);
+		replace->stage = REPLACE_TO;
+		break;
+	case REPLACE_TO:
+		sb_append_manyl(&replace->to, input->data, input->len);
+		sb_clean(input);
 
-	if (editor->state == SELECTION) {
-		editor_delete_backward(editor);
+		if (replace->query) {
+			replace->stage = REPLACE_QUERY;
+			editor_replace_query_next(editor, notification, notification_len);
+			return;
+		}
+
+		while (editor_replace_find(replace, &match)) {
+			editor_replace_accept(replace, &match);
+			editor_replace_skip(replace, &match);
+		}
+		editor_replace_finish(editor, notification, notification_len);
+		break;
+	case REPLACE_QUERY:
+		editor_replace_finish(editor, notification, notification_len);
+		break;
+	}
+}
+
+/**
+ * y or SPC replaces, n skips, ! replaces all the rest, . replaces and stops, q stops
+ */
+void editor_user_replace_answer(Editor *editor, char answer, char *notification, size_t notification_len)
+{
+	ReplaceSession *replace = &editor->replace;
+
+	if (replace->stage != REPLACE_QUERY) return;
+
+	switch (answer) {
+	case 'y':
+	case ' ':
+		editor_replace_accept(replace, &replace->current);
+		editor_replace_skip(replace, &replace->current);
+		editor_replace_query_next(editor, notification, notification_len);
+		break;
+	case 'n':
+		editor_replace_skip(replace, &replace->current);
+		editor_replace_query_next(editor, notification, notification_len);
+		break;
+	case '!':
+		do {
+			editor_replace_accept(replace, &replace->current);
+			editor_replace_skip(replace, &replace->current);
+		} while (editor_replace_find(replace, &replace->current));
+		editor_replace_finish(editor, notification, notification_len);
+		break;
+	case '.':
+		editor_replace_accept(replace, &replace->current);
+		editor_replace_finish(editor, notification, notification_len);
+		break;
+	case 'q':
+		editor_replace_finish(editor, notification, notification_len);
+		break;
 	}
+}
 
-	clipboard = SDL_GetClipboardText();
-	editor_insert(editor, clipboard);
-	editor_recognize_arena(editor);
+/**
+ * Drops the session, nothing is replaced
+ */
+void editor_user_replace_cancel(Editor *editor)
+{
+	editor_replace_free(&editor->replace);
+	editor_user_input_clear(editor);
+}
+
+/**
+ * The index worker and the matches point into the content, it is about to be changed (or moved by realloc)
+ */
+static void editor_search_release(Editor *editor, Buffer *buffer)
+{
+	if (editor->search_index.owner == buffer || editor->matches.buffer == buffer) editor_search_matches_clear(editor);
+}
+
+/**
+ * The buffer of the name (created when missing) holds only the text and is
+ * shown in the current pane, the output of a background job is appended to it
+ */
+static Buffer *editor_output_buffer(Editor *editor, char *name, char *text, size_t len)
+{
+	Buffer *buffer;
+
+	buffer = editor_create_buffer(editor, name);
+	editor_search_release(editor, buffer);
+
+	buffer->content.len = 0;
+	editor_content_reserve(&buffer->content, len);
+	memset(buffer->content.data, 0, buffer->content.capacity);
+	memcpy(buffer->content.data, text, len);
+	buffer->content.len = len;
+	buffer->last_position = 0;
+	buffer->events_len = 0;
+	buffer->need_to_save = false;
+	editor_buffer_determine_lines(buffer);
+
+	for (size_t i = 0; i < editor->panes_len; ++i) {
+		if (editor->panes[i].buffer == buffer) editor->panes[i].position = 0;
+	}
+
+	editor_switch_buffer(editor, buffer);
+	editor_goto_point(editor, 0);
+
+	return buffer;
+}
+
+/**
+ * Greps the files under the editor dir, the results stream into the *grep* buffer
+ */
+bool editor_grep(Editor *editor, char *pattern, bool is_regexp, char *notification, size_t notification_len)
+{
+	char header[GREP_PATH_LEN + EDITOR_MINI_BUFFER_CONTENT_LIMIT];
+	size_t header_len;
+
+	if (strlen(pattern) == 0) return false;
+	if (strlen(editor->dir) == 0) editor_set_dir_by_current_file(editor);
+
+	if (!grep_start(&editor->grep, editor->dir, pattern, strlen(pattern), is_regexp, notification, notification_len)) {
+		return false;
+	}
+
+	header_len = (size_t) snprintf(header, sizeof(header), "%s \"%s\" in %s\n\n", is_regexp ? "Grep" : "Fgrep", pattern, editor->dir);
+	editor_output_buffer(editor, EDITOR_GREP_BUFFER, header, MIN(header_len, sizeof(header) - 1));
+
+	return true;
+}
+
+/**
+ * Appends the new results at the end of the *grep* buffer
+ */
+void editor_grep_flush(Editor *editor)
+{
+	static StringBuilder results = {0};
+	char footer[128];
+	Buffer *buffer;
+	bool done;
+
+	results.len = 0;
+	done = grep_take(&editor->grep, &results);
+
+	buffer = editor_find_buffer(editor, EDITOR_GREP_BUFFER);
+	if (buffer == NULL) {
+		//the buffer is killed, nobody waits for the results
+		grep_cancel(&editor->grep);
+		return;
+	}
+
+	if (done) {
+		snprintf(footer, sizeof(footer), "\nGrep finished: %ld matches in %ld files\n", editor->grep.matches, editor->grep.files);
+		sb_append_many(&results, footer);
+
+		//the index is kept up to date by the greps noticing the changes
+		if (editor->grep.stale && !editor->trigram_build.running) trigram_build_start(&editor->trigram_build, editor->grep.root);
+	}
 
-	free(clipboard);
+	if (results.len > 0) editor_search_release(editor, buffer);
+	editor_buffer_insert(buffer, buffer->content.len, results.data, results.len);
+	buffer->need_to_save = false;
 }
 
-void editor_duplicate_line(Editor *editor)
+void editor_grep_cancel(Editor *editor)
 {
-	size_t line_num, line_len, pos;
-	Line *line;
-	char *copy;
+	Buffer *buffer;
+	char *footer = "\nGrep cancelled\n";
 
-	pos = editor->pane->position;
-	line_num = editor_get_current_line_number(editor->pane);
-	line = &editor->pane->buffer->data[line_num];
-	line_len = line->end - line->start;
-	copy = calloc(line_len + 2, sizeof(char));
-	memcpy(copy, &editor->pane->buffer->content.data[line->start], line_len);
-	copy[line_len] = '\n';
-	editor_move_begginning_of_line(editor);
-	editor_insert(editor, copy);
+	if (!editor->grep.running) return;
 
-	editor_goto_point(editor, pos);
-	editor_next_line(editor);
-	editor_recognize_arena(editor);
+	editor_grep_flush(editor);
+	grep_cancel(&editor->grep);
 
-	free(copy);
+	buffer = editor_find_buffer(editor, EDITOR_GREP_BUFFER);
+	if (buffer != NULL) {
+		editor_search_release(editor, buffer);
+		editor_buffer_insert(buffer, buffer->content.len, footer, strlen(footer));
+		buffer->need_to_save = false;
+	}
 }
 
-void editor_user_input_clear(Editor *editor)
+/**
+ * Runs the command in the editor dir, its output streams into the *Async Shell Command*
+ * buffer. The running command is killed, there is one at a time.
+ */
+bool editor_shell_command(Editor *editor, char *command, char *notification, size_t notification_len)
 {
-	sb_clean((&editor->user_input));
-	editor->state = NONE;
-}
+	if (strlen(command) == 0) return false;
+	if (strlen(editor->dir) == 0) editor_set_dir_by_current_file(editor);
 
-void editor_user_search_forward(Editor *editor)
-{
-	editor->state = FORWARD_SEARCH;
-	sb_clean((&editor->user_input));
-}
+	shell_cancel(&editor->shell);
+	if (!shell_start(&editor->shell, editor->dir, command, notification, notification_len)) return false;
 
-void editor_user_search_backward(Editor *editor)
-{
-	editor->state = BACKWARD_SEARCH;
-	sb_clean((&editor->user_input));
+	editor_output_buffer(editor, EDITOR_SHELL_BUFFER, "", 0);
+	snprintf(notification, notification_len, "Running %s", command);
+
+	return true;
 }
 
-void editor_user_extend_command(Editor *editor)
+/**
+ * Appends the new output at the end of the *Async Shell Command* buffer, the cursors
+ * at the end stay at the end. Returns true when the command exited.
+ */
+bool editor_shell_flush(Editor *editor, char *notification, size_t notification_len)
 {
-	editor->state = EXTEND_COMMAND;
-	sb_clean((&editor->user_input));
+	static StringBuilder output = {0};
+	Shell *shell = &editor->shell;
+	Buffer *buffer;
+	size_t old_len;
+	bool done;
+
+	done = shell_take(shell, &output);
+
+	buffer = editor_find_buffer(editor, EDITOR_SHELL_BUFFER);
+	if (buffer == NULL) {
+		//the buffer is killed, nobody reads the output
+		shell_cancel(shell);
+		return false;
+	}
+
+	if (output.len > 0) editor_search_release(editor, buffer);
+
+	old_len = buffer->content.len;
+	editor_buffer_insert(buffer, old_len, output.data, output.len);
+	buffer->need_to_save = false;
+
+	for (size_t i = 0; output.len > 0 && i < editor->panes_len; ++i) {
+		if (editor->panes[i].buffer == buffer && editor->panes[i].position == old_len) editor->panes[i].position = buffer->content.len;
+	}
+	if (output.len > 0) editor_recognize_arena(editor);
+
+	if (!done) return false;
+
+	if (shell->exit_signal != 0) {
+		snprintf(notification, notification_len, "Shell command killed by signal %d", shell->exit_signal);
+	} else if (shell->exit_code != 0) {
+		snprintf(notification, notification_len, "Shell command exited abnormally with code %d", shell->exit_code);
+	} else {
+		snprintf(notification, notification_len, "Shell command finished");
+	}
+
+	return true;
 }
 
-void editor_user_input_insert(Editor *editor, char *text)
+/**
+ * Builds the trigram index of the editor dir in the background, greps use it from then on
+ */
+void editor_trigram_index(Editor *editor, char *notification, size_t notification_len)
 {
-	sb_append_many(&editor->user_input, text);
+	if (strlen(editor->dir) == 0) editor_set_dir_by_current_file(editor);
+
+	trigram_build_start(&editor->trigram_build, editor->dir);
+	snprintf(notification, notification_len, "Indexing %s", editor->dir);
 }
 
-void editor_user_input_delete_backward(Editor *editor)
+/**
+ * Tells about the finished index build, false when nothing is finished
+ */
+bool editor_trigram_index_done(Editor *editor, char *notification, size_t notification_len)
 {
-	StringBuilder *sb;
-	uint8_t char_len;
+	TrigramBuild *build = &editor->trigram_build;
 
-	if (editor->user_input.len == 0) return;
+	if (!trigram_build_take(build)) return false;
 
-	sb = &editor->user_input;
-	char_len = utf8_size_char_backward(sb->data, sb->len - 1);
-	sb->len -= char_len;
+	if (build->ok) {
+		snprintf(notification, notification_len, "Indexed %ld files of %s (%ld read)", build->files, build->root, build->read);
+	} else {
+		snprintf(notification, notification_len, "Could not index %s", build->root);
+	}
+
+	return true;
 }
 
-bool editor_user_search_next(Editor *editor, char *notification, size_t notification_len)
+/**
+ * Opens the file:line of the current *grep* line, false when it is not a result
+ */
+bool editor_grep_visit(Editor *editor, char *notification, size_t notification_len)
 {
-	size_t to_find_len;
-	char *to_find;
-	long i, threshold;
-	bool forward;
+	Buffer *buffer;
+	Line *line;
+	char path[GREP_PATH_LEN], *data, *colon, *end;
+	size_t name_len;
+	long number;
 
-	to_find = editor->user_input.data;
+	buffer = editor->pane->buffer;
+	if (buffer->file_path == NULL || strcmp(buffer->file_path, EDITOR_GREP_BUFFER) != 0) return false;
+	if (editor->state != NONE) return false;
 
-	if (to_find == NULL) return false;
-	if (strlen(to_find) == 0) return false;
+	line = &buffer->data[editor_get_current_line_number(editor->pane)];
+	data = &buffer->content.data[line->start];
 
-	to_find_len = strlen(to_find);
-	forward = true;
+	colon = memchr(data, ':', line->end - line->start);
+	if (colon == NULL) return true;
 
-	switch (editor->state) {
-	case BACKWARD_SEARCH:
-		forward = false;
-		i = (long) editor->pane->position - 1;
-		threshold = 0;
-		break;
-	case FORWARD_SEARCH:
-		i = (long) editor->pane->position + 1;
-		threshold = editor->pane->buffer->content.len;
-		break;
-	default:
-		return false;
-	}
+	number = strtol(colon + 1, &end, 10);
+	if (end == colon + 1 || *end != ':' || number <= 0) return true;
 
-	while (i != threshold) {
-		//Need to rewrite it to more faster search algorithm
-		if (strncasecmp(&editor->pane->buffer->content.data[i], to_find, to_find_len) == 0) {
-			editor_goto_point(editor, i);
-			editor_recognize_arena(editor);
-			return true;
-		}
-		i += forward ? 1 : -1;
-	}
+	name_len = (size_t) (colon - data);
+	if ((size_t) snprintf(path, GREP_PATH_LEN, "%s/%.*s", editor->grep.root, (int) name_len, data) >= GREP_PATH_LEN) return true;
 
-	snprintf(notification, notification_len, "Not found: %s", to_find);
-	editor_user_input_clear(editor);
+	if (editor_read_file(editor, path) != 0) {
+		snprintf(notification, notification_len, "Could not read %s", path);
+		return true;
+	}
+	editor_goto_line(editor, (size_t) number);
 
-	return false;
+	return true;
 }
 
 void editor_goto_line(Editor *editor, size_t line)
@@ -804,81 +3335,132 @@ bool editor_is_editing_text(Editor *editor)
 	return editor->state == NONE;
 }
 
+/**
+ * Swaps the line with the next one by one rotation of their bytes, it is one undo step
+ */
+static void editor_swap_lines(Editor *editor, size_t line_num)
+{
+	Buffer *buffer;
+	Line upper, lower;
+
+	buffer = editor->pane->buffer;
+	upper = buffer->data[line_num];
+	lower = buffer->data[line_num + 1];
+
+	editor_store_span(buffer, editor->pane->position, upper.start, lower.end);
+	editor_buffer_swap(buffer, upper.start, upper.end, lower.start, lower.end);
+}
+
 void editor_move_line_down(Editor *editor)
 {
-	size_t curr_line;
+	size_t curr_line, offset;
+	Line *lines;
 
 	curr_line = editor_get_current_line_number(editor->pane);
 
 	if ((editor->pane->buffer->len - 1) <= curr_line) return;
 	if (!editor_is_editing_text(editor)) return;
 
-	editor_move_begginning_of_line(editor);
-	editor_set_mark(editor);
-	editor_move_end_of_line(editor);
-	editor_cut(editor);
-	editor_next_line(editor);
-	editor_move_begginning_of_line(editor);
-	editor_paste(editor);
-	editor_set_mark(editor);
-	editor_move_end_of_line(editor);
-	editor_cut(editor);
-	editor_previous_line(editor);
-	editor_paste(editor);
-	editor_next_line(editor);
-	editor_move_begginning_of_line(editor);
+	lines = editor->pane->buffer->data;
+	offset = editor->pane->position - lines[curr_line].start;
+	editor_swap_lines(editor, curr_line);
+
+	//the lines are patched, the moved one is the next now
+	lines = editor->pane->buffer->data;
+	editor_goto_point(editor, lines[curr_line + 1].start + offset);
 }
 
 void editor_move_line_up(Editor *editor)
+{
+	size_t curr_line, offset;
+	Line *lines;
+
+	curr_line = editor_get_current_line_number(editor->pane);
+
+	if (curr_line == 0) return;
+	if (!editor_is_editing_text(editor)) return;
+
+	lines = editor->pane->buffer->data;
+	offset = editor->pane->position - lines[curr_line].start;
+	editor_swap_lines(editor, curr_line - 1);
+
+	lines = editor->pane->buffer->data;
+	editor_goto_point(editor, lines[curr_line - 1].start + offset);
+}
+
+/**
+ * The line goes above the previous one and the cursor to the next line like transpose-lines in Emacs
+ */
+void editor_transpose_lines(Editor *editor)
 {
 	size_t curr_line;
+	Buffer *buffer;
 
 	curr_line = editor_get_current_line_number(editor->pane);
 
 	if (curr_line == 0) return;
 	if (!editor_is_editing_text(editor)) return;
 
-	editor_move_begginning_of_line(editor);
-	editor_set_mark(editor);
-	editor_move_end_of_line(editor);
-	editor_cut(editor);
-	editor_previous_line(editor);
-	editor_move_begginning_of_line(editor);
-	editor_paste(editor);
-	editor_set_mark(editor);
-	editor_move_end_of_line(editor);
-	editor_cut(editor);
-	editor_next_line(editor);
-	editor_paste(editor);
-	editor_previous_line(editor);
-	editor_move_begginning_of_line(editor);
+	editor_swap_lines(editor, curr_line - 1);
+
+	buffer = editor->pane->buffer;
+	editor_goto_point(editor, MIN(buffer->data[curr_line].end + 1, buffer->content.len));
 }
 
-void editor_switch_buffer(Editor *editor, size_t buf_index)
+bool editor_switch_buffer(Editor *editor, Buffer *buffer)
 {
-	if (buf_index >= editor->buffer_list.len) return;
+	if (buffer == NULL) return false;
 
-	editor->pane->buffer->last_position = editor->pane->position;
-	editor->pane->buffer = &editor->buffer_list.data[buf_index];
+	//the file is gone or unreadable, an empty buffer would overwrite it on save
+	if (buffer->evicted && !editor_buffer_restore(editor, buffer)) return false;
+	buffer->used = ++editor->buffer_list.clock;
+
+	if (editor->pane->buffer != NULL) editor->pane->buffer->last_position = editor->pane->position;
+	editor->pane->buffer = buffer;
 	editor->pane->position = editor->pane->buffer->last_position;
+	editor_cursors_clear(editor->pane);
 
 	editor_recognize_arena(editor);
+	editor_buffers_evict(editor);
+
+	return true;
 }
 
 void editor_kill_buffer(Editor *editor, size_t buf_index, char *notification, size_t notification_len)
 {
-	register size_t i;
+	BufferList *list = &editor->buffer_list;
+	Buffer *buffer;
+	int watch;
 
-	if (buf_index >= editor->buffer_list.len) return;
-	if (&editor->buffer_list.data[buf_index] == editor->pane->buffer) return;
+	if (buf_index >= list->len) return;
 
-	snprintf(notification, notification_len, "Buffer killed %s", editor->buffer_list.data[buf_index].file_path);
-	editor_destory_buffer(&editor->buffer_list.data[buf_index]);
+	buffer = list->data[buf_index];
+	if (buffer == editor->pane->buffer) return;
 
-	--editor->buffer_list.len;
-	for (i = buf_index; i < editor->buffer_list.len; ++i) {
-		editor->buffer_list.data[i] = editor->buffer_list.data[i+1];
+	//the other panes showing it show the current buffer
+	for (size_t i = 0; i < editor->panes_len; ++i) {
+		if (editor->panes[i].buffer == buffer) {
+			editor->panes[i].buffer = editor->pane->buffer;
+			editor->panes[i].position = editor->pane->position;
+			editor_cursors_clear(&editor->panes[i]);
+		}
 	}
+	//the slot is reused, nothing may point to it
+	if (editor->search_index.owner == buffer || editor->matches.buffer == buffer) editor_search_matches_clear(editor);
+	//its command has nowhere to write
+	if (strcmp(buffer->file_path, EDITOR_SHELL_BUFFER) == 0) shell_cancel(&editor->shell);
+
+	snprintf(notification, notification_len, "Buffer killed %s", buffer->file_path);
+
+	hashmap_remove(&list->by_path, buffer->key, (hashmap_uint32_t) strlen(buffer->key));
+	watch = buffer->watch;
+	editor_destory_buffer(buffer);
+	gb_append(&list->free, buffer);
+
+	memmove(&list->data[buf_index], &list->data[buf_index + 1], (list->len - buf_index - 1) * sizeof(*list->data));
+	--list->len;
+	editor_watch_release(editor, watch);
+	editor_recognize_arena(editor);
 }
 
 void editor_mark_forward_word(Editor *editor)
@@ -998,24 +3580,30 @@ void editor_word_backward(Editor *editor)
 
 void editor_user_input_insert_from_clipboard(Editor *editor)
 {
-	char *clipboard;
+	KillText *text;
 
-	clipboard = SDL_GetClipboardText();
+	editor_kill_ring_sync(&editor->kill_ring);
+	if (editor->kill_ring.len == 0) return;
 
-	if (strlen(clipboard) > EDITOR_MINI_BUFFER_CONTENT_LIMIT) {
+	text = editor_kill_ring_get(&editor->kill_ring, 0);
+	if (text->len > EDITOR_MINI_BUFFER_CONTENT_LIMIT) {
 		fprintf(stderr, "Could not insert clipboard content to mini buffer because limit exceeded\n");
 		return;
 	}
 
-	sb_append_many((&editor->user_input), clipboard);
+	sb_append_manyl(&editor->user_input, text->data, text->len);
 }
 
-void editor_split_pane(Editor *editor)
+void editor_split_pane(Editor *editor, LayoutKind kind)
 {
 	assert(editor->panes_len < PANES_MAX_SIZE && "Exceeded panes size");
 
 	Pane pane = (Pane) {0};
 	pane.buffer = editor->pane->buffer;
+	//the wrap index of the width is already built
+	pane.wrap_cols = editor->pane->wrap_cols;
+
+	if (!layout_split(&editor->layout, (size_t) (editor->pane - editor->panes), editor->panes_len, kind)) return;
 
 	editor->panes[editor->panes_len++] = pane;
 	editor_recognize_arena(editor);
@@ -1040,23 +3628,30 @@ void editor_wrap_region_in_parens(Editor *editor)
 
 void editor_next_pane(Editor *editor)
 {
-	register size_t i;
-
 	editor->state = NONE;
-	for (i = 0; i < editor->panes_len; ++i) {
-		if (&editor->panes[i] == editor->pane) {
-			editor->pane = &editor->panes[(i+1) >= editor->panes_len ? 0 : (i+1)];
-			break;
-		}
-	}
+	editor->pane = &editor->panes[layout_next(&editor->layout, (size_t) (editor->pane - editor->panes))];
 }
 
 void editor_close_pane(Editor *editor)
 {
-	if (editor->panes_len > 1) {
-		--editor->panes_len;
-		editor->pane = &editor->panes[0];
+	size_t closed, next, last;
+
+	if (editor->panes_len <= 1) return;
+
+	closed = (size_t) (editor->pane - editor->panes);
+	next = layout_remove(&editor->layout, closed);
+	gb_free(&editor->panes[closed].cursors);
+
+	//the last pane moves into the place of the closed one, the panes stay contiguous
+	last = editor->panes_len - 1;
+	if (closed != last) {
+		editor->panes[closed] = editor->panes[last];
+		layout_rename(&editor->layout, last, closed);
+		if (next == last) next = closed;
 	}
+
+	--editor->panes_len;
+	editor->pane = &editor->panes[next];
 }
 
 void editor_upper_region(Editor *editor)
@@ -1073,6 +3668,7 @@ void editor_upper_region(Editor *editor)
 	for (i = reg_beg; i < reg_end; ++i) {
 		content->data[i] = (char) toupper((int)content->data[i]);
 	}
+	++editor->pane->buffer->version;
 
 	editor->state = NONE;
 }
@@ -1105,13 +3701,14 @@ void editor_lower_region(Editor *editor)
 	for (i = reg_beg; i < reg_end; ++i) {
 		content->data[i] = (char) tolower((int)content->data[i]);
 	}
+	++editor->pane->buffer->version;
 
 	editor->state = NONE;
 }
 
 void editor_completor_clean(Editor *editor)
 {
-	for (register size_t i = 0; i < editor->completor.len; ++i) {
+	for (register size_t i = 0; i < editor->completor.len && !editor->completor.borrowed; ++i) {
 		if (editor->completor.data[i] != NULL) {
 			free(editor->completor.data[i]);
 			editor->completor.data[i] = NULL;
@@ -1119,6 +3716,11 @@ void editor_completor_clean(Editor *editor)
 	}
 
 	editor->completor.len = 0;
+	editor->completor.borrowed = false;
+	editor->completor.keys.len = 0;
+	editor->completor.filtered.len = 0;
+	editor->completor.selected = 0;
+	editor->completor.matched_valid = false;
 }
 
 void editor_lower(Editor *editor)
@@ -1142,55 +3744,77 @@ void editor_buffer_switch(Editor *editor)
 	editor_completor_clean(editor);
 
 	for (i = 0; i < editor->buffer_list.len; ++i) {
-		gb_append(&(editor->completor), strdup(editor->buffer_list.data[i].file_path));
+		gb_append(&(editor->completor), strdup(editor->buffer_list.data[i]->file_path));
 	}
 
 	editor_completion_actualize(editor);
 }
 
+/**
+ * Fuzzy matches the candidates against the user input, a longer input only
+ * rescans the previous matches
+ */
 void editor_completion_actualize(Editor *editor)
 {
-	register size_t i;
-	char *elem;
-	bool need_append;
+	Completor *completor = &editor->completor;
+	char *query = editor->user_input.data;
+	size_t query_len = editor->user_input.len, i, len, matched_len, candidate;
+	uint64_t query_mask;
+	bool refine;
+	int score;
 
 	if ((editor->state & COMPLETION) == 0) return;
 
-	editor->completor.filtered.len = 0;
+	for (i = completor->keys.len; i < completor->len; ++i) {
+		len = strlen(completor->data[i]);
+		gb_append(&completor->keys, ((CompletorKey) {fuzzy_mask(completor->data[i], len), len}));
+	}
+
+	refine = completor->matched_valid && query_len >= completor->matched_query.len &&
+		(completor->matched_query.len == 0 || memcmp(query, completor->matched_query.data, completor->matched_query.len) == 0);
+	if (!refine) {
+		completor->matched.len = 0;
+		for (i = 0; i < completor->len; ++i) gb_append(&completor->matched, i);
+	}
 
-	for (i = 0; i < editor->completor.len; ++i) {
-		need_append = false;
-		elem = editor->completor.data[i];
+	query_mask = fuzzy_mask(query, query_len);
+	fuzzy_top_reset(&completor->top, COMPLETION_TOP_K);
 
-		if (editor->user_input.len == 0) need_append = true;
-		if (contains_ignore_case(elem, strlen(elem), editor->user_input.data, editor->user_input.len)) need_append = true;
+	matched_len = 0;
+	for (i = 0; i < completor->matched.len; ++i) {
+		candidate = completor->matched.data[i];
+		if ((completor->keys.data[candidate].mask & query_mask) != query_mask) continue;
+		if (!fuzzy_score(completor->data[candidate], completor->keys.data[candidate].len, query, query_len, &score)) continue;
 
-		if (need_append) {
-			gb_append(&(editor->completor.filtered), elem);
-		}
+		completor->matched.data[matched_len++] = candidate;
+		fuzzy_top_push(&completor->top, candidate, score);
+	}
+	completor->matched.len = matched_len;
+
+	sb_clean(&completor->matched_query);
+	sb_append_manyl(&completor->matched_query, query, query_len);
+	completor->matched_valid = true;
+
+	fuzzy_top_sort(&completor->top);
+	completor->filtered.len = 0;
+	for (i = 0; i < completor->top.len; ++i) {
+		gb_append(&completor->filtered, completor->data[completor->top.data[i].index]);
 	}
+	completor->selected = 0;
 }
 
-bool editor_buffer_switch_complete(Editor *editor)
+bool editor_buffer_switch_complete(Editor *editor, char *notification, size_t notification_len)
 {
-	if (editor->completor.filtered.len == 0) return false;
+	Buffer *buffer;
 
-	register size_t i;
-	char *buffer_target, *buffer_name;
-	size_t buffer_name_len;
+	if (editor->completor.filtered.len == 0) return false;
 
-	buffer_target = editor->completor.filtered.data[0];
+	buffer = editor_find_buffer(editor, editor->completor.filtered.data[editor->completor.selected]);
+	if (buffer == NULL) return false;
 
-	for (i = 0; i < editor->buffer_list.len; ++i) {
-		buffer_name = editor->buffer_list.data[i].file_path;
-		buffer_name_len = editor->buffer_list.data[i].file_path_len;
-		if (strncmp(buffer_target, buffer_name, buffer_name_len) == 0) {
-			editor_switch_buffer(editor, i);
-			editor->state = NONE;
-			return true;
-		}
-	}
-	return false;
+	if (!editor_switch_buffer(editor, buffer)) snprintf(notification, notification_len, "Could not read %s", buffer->file_path);
+	editor->state = NONE;
+	return true;
 }
 
 void editor_set_dir_by_current_file(Editor *editor)
@@ -1214,48 +3838,229 @@ void editor_set_dir_by_current_file(Editor *editor)
 
 #define DIRECTORY_NAME_SIZE 256
 #define DIRECTORY_FILE_PATH_SIZE (DIRECTORY_NAME_SIZE * 10)
-void editor_find_file(Editor *editor, bool refresh_dir)
+static void editor_listing_drop(Editor *editor, size_t index)
+{
+	DirListings *listings = &editor->listings;
+	DirListing *listing = &listings->data[index];
+	int watch = listing->watch;
+
+	for (size_t i = 0; i < listing->names.len; ++i) free(listing->names.data[i]);
+	gb_free(&listing->names);
+
+	memmove(listing, listing + 1, (listings->len - index - 1) * sizeof(*listing));
+	--listings->len;
+
+	editor_watch_release(editor, watch);
+}
+
+static bool editor_listing_read(Editor *editor, DirListing *listing)
 {
 	DIR *dp;
 	struct dirent *ep;
-	bool should_add;
 	char directory_name[DIRECTORY_NAME_SIZE] = {0};
 	char directory_file_path[DIRECTORY_FILE_PATH_SIZE] = {0};
-	if (refresh_dir) editor_set_dir_by_current_file(editor);
 
-	dp = opendir(editor->dir);
+	dp = opendir(listing->dir);
 	if (dp == NULL) {
-		fprintf(stderr, "Could not open directory by name %s\n", editor->dir);
-		return;
+		fprintf(stderr, "Could not open directory by name %s\n", listing->dir);
+		return false;
+	}
+
+	//watched before it is read, so no change is missed
+	listing->watch = watch_add(&editor->watch, listing->dir);
+
+	for (size_t i = 0; i < listing->names.len; ++i) free(listing->names.data[i]);
+	listing->names.len = 0;
+
+	while ((ep = readdir(dp)) != NULL) {
+		if (0 == strncmp(ep->d_name, EDITOR_DIR_CUR, DIRECTORY_NAME_SIZE)) continue;
+		if (0 == strncmp(ep->d_name, EDITOR_DIR_PREV, DIRECTORY_NAME_SIZE)) continue;
+
+		snprintf(directory_file_path,
+			 DIRECTORY_FILE_PATH_SIZE,
+			 "%s/%s", listing->dir, ep->d_name);
+
+		snprintf(directory_name,
+			DIRECTORY_NAME_SIZE,
+			"%s%c", ep->d_name,
+			editor_is_directory(directory_file_path) ? '/' : 0);
+
+		gb_append(&listing->names, strdup(directory_name));
+	}
+
+	closedir(dp);
+	return true;
+}
+
+/**
+ * Listing of the dir, read from the disk only when it is not watched
+ */
+static DirListing *editor_dir_listing(Editor *editor, const char *dir)
+{
+	DirListings *listings = &editor->listings;
+	DirListing *listing = NULL;
+	size_t i;
+
+	for (i = 0; i < listings->len; ++i) {
+		if (strcmp(listings->data[i].dir, dir) == 0) {
+			listing = &listings->data[i];
+			if (listing->watch != 0) return listing;
+			break;
+		}
+	}
+
+	if (listing == NULL) {
+		if (listings->len == EDITOR_DIR_LISTINGS_MAX) editor_listing_drop(editor, 0);
+
+		gb_append(listings, ((DirListing) {0}));
+		i = listings->len - 1;
+		listing = &listings->data[i];
+		snprintf(listing->dir, sizeof(listing->dir), "%s", dir);
+	}
+
+	if (!editor_listing_read(editor, listing)) {
+		editor_listing_drop(editor, i);
+		return NULL;
+	}
+
+	return listing;
+}
+
+/**
+ * Adds or removes the created or deleted name of the watched dir
+ */
+static void editor_listing_apply(DirListing *listing, WatchChange *change)
+{
+	char directory_name[DIRECTORY_NAME_SIZE] = {0};
+	size_t name_len;
+	char *name;
+
+	name_len = strlen(change->name);
+	for (size_t i = 0; i < listing->names.len; ++i) {
+		name = listing->names.data[i];
+		if (strncmp(name, change->name, name_len) != 0) continue;
+		if (name[name_len] != '\0' && strcmp(&name[name_len], "/") != 0) continue;
+
+		free(name);
+		memmove(&listing->names.data[i], &listing->names.data[i + 1], (listing->names.len - i - 1) * sizeof(char*));
+		--listing->names.len;
+		break;
+	}
+
+	if (change->kind & WATCH_CREATED) {
+		snprintf(directory_name, DIRECTORY_NAME_SIZE, "%s%c", change->name, change->kind & WATCH_IS_DIR ? '/' : 0);
+		gb_append(&listing->names, strdup(directory_name));
 	}
+}
+
+void editor_find_file(Editor *editor, bool refresh_dir)
+{
+	DirListing *listing;
+
+	if (refresh_dir) editor_set_dir_by_current_file(editor);
+
+	listing = editor_dir_listing(editor, editor->dir);
+	if (listing == NULL) return;
 
 	editor_user_input_clear(editor);
 	editor->state = FILE_SEARCH;
 	editor_completor_clean(editor);
 
 	gb_append(&(editor->completor), strdup(EDITOR_DIR_PREV));
+	for (size_t i = 0; i < listing->names.len; ++i) {
+		gb_append(&(editor->completor), strdup(listing->names.data[i]));
+	}
 
-	while ((ep = readdir(dp)) != NULL) {
-		should_add = true;
-		if (0 == strncmp(ep->d_name, EDITOR_DIR_CUR, DIRECTORY_NAME_SIZE)) should_add = false;
-		if (0 == strncmp(ep->d_name, EDITOR_DIR_PREV, DIRECTORY_NAME_SIZE)) should_add = false;
+	editor_completion_actualize(editor);
+}
+
+static bool editor_watch_matches(Buffer *buffer, WatchChange *change)
+{
+	char *name;
+
+	if (buffer->watch == 0) return false;
+	if (change->kind & WATCH_OVERFLOW) return true;
+	if (buffer->watch != change->dir) return false;
+	if (change->kind & WATCH_GONE) return true;
+
+	name = strrchr(buffer->file_path, EDITOR_DIR_SLASH);
+	name = name == NULL ? buffer->file_path : name + 1;
+
+	return strcmp(name, change->name) == 0;
+}
+
+/**
+ * Applies the changes of the watched dirs to the listings, the buffers of
+ * the changed files are reloaded once. Returns true when there is something to tell.
+ */
+bool editor_watch_flush(Editor *editor, char *notification, size_t notification_len)
+{
+	static WatchChanges changes = {0};
+	WatchChange *change;
+	DirListing *listing;
+	Buffer *buffer;
+	bool changed, gone, told;
+	int watch;
 
-		if (should_add) {
-			snprintf(directory_file_path,
-				 DIRECTORY_FILE_PATH_SIZE,
-				 "%s/%s", editor->dir, ep->d_name);
+	watch_take(&editor->watch, &changes);
 
-			snprintf(directory_name,
-				DIRECTORY_NAME_SIZE,
-				"%s%c", ep->d_name,
-				editor_is_directory(directory_file_path) ? '/' : 0);
+	for (size_t i = 0; i < changes.len; ++i) {
+		change = &changes.data[i];
 
-			gb_append(&(editor->completor), strdup(directory_name));
+		for (size_t j = 0; j < editor->listings.len; ++j) {
+			listing = &editor->listings.data[j];
+
+			//the listing is read again on the next find-file
+			if ((change->kind & WATCH_OVERFLOW) || (listing->watch == change->dir && (change->kind & WATCH_GONE))) {
+				watch = listing->watch;
+				listing->watch = 0;
+				//after an overflow the dir is still watched, the next read adds it again
+				if (change->kind & WATCH_OVERFLOW) editor_watch_release(editor, watch);
+			} else if (listing->watch == change->dir && (change->kind & (WATCH_CREATED | WATCH_DELETED))) {
+				editor_listing_apply(listing, change);
+			}
 		}
 	}
 
-	closedir(dp);
-	editor_completion_actualize(editor);
+	told = false;
+	for (size_t j = 0; j < editor->buffer_list.len; ++j) {
+		buffer = editor->buffer_list.data[j];
+		//it is read from the disk when it is shown again
+		if (buffer->file_path == NULL || buffer->evicted) continue;
+
+		changed = false;
+		gone = false;
+		for (size_t i = 0; i < changes.len; ++i) {
+			if (!editor_watch_matches(buffer, &changes.data[i])) continue;
+
+			changed = true;
+			if (changes.data[i].kind & WATCH_GONE) gone = true;
+		}
+		if (!changed) continue;
+
+		if (gone) buffer->watch = 0;
+		if (editor_buffer_reload(editor, buffer, notification, notification_len)) told = true;
+	}
+
+	return told;
+}
+
+/**
+ * In follow mode the cursor at the end of the buffer stays at the end when the file grows
+ */
+void editor_toggle_follow(Editor *editor, char *notification, size_t notification_len)
+{
+	Buffer *buffer = editor->pane->buffer;
+
+	if (buffer->watch == 0) {
+		snprintf(notification, notification_len, "%s is not watched", buffer->file_path);
+		return;
+	}
+
+	buffer->follow = !buffer->follow;
+	if (buffer->follow) editor_goto_point(editor, buffer->content.len);
+
+	snprintf(notification, notification_len, "Follow mode %s", buffer->follow ? "enabled" : "disabled");
 }
 
 int editor_is_directory(const char *path)
@@ -1266,13 +4071,13 @@ int editor_is_directory(const char *path)
 	return is_directory;
 }
 
-bool editor_find_file_complete(Editor *editor)
+bool editor_find_file_complete(Editor *editor, char *notification, size_t notification_len)
 {
 	size_t dir_len;
 	long dir_i;
 	bool file_is_dir;
 
-	char *file_name = editor->completor.filtered.len == 0 ? editor->user_input.data : editor->completor.filtered.data[0];
+	char *file_name = editor->completor.filtered.len == 0 ? editor->user_input.data : editor->completor.filtered.data[editor->completor.selected];
 	size_t file_name_len = strlen(file_name);
 
 	if (0 == strncmp(file_name, EDITOR_DIR_PREV, EDITOR_DIR_PREV_LEN)) {
@@ -1315,66 +4120,93 @@ bool editor_find_file_complete(Editor *editor)
 		editor->dir_len = full_path_len;
 		editor_find_file(editor, false);
 	} else {
-		editor_read_file(editor, full_path);
+		if (editor_read_file(editor, full_path) != 0) snprintf(notification, notification_len, "Could not read %s", full_path);
 		editor->state = NONE;
 	}
 
 	return true;
 }
 
-void editor_completion_next_match(Editor *editor)
+/**
+ * Completes any file under the project root, the snapshot of the tree is kept and refreshed on the next call
+ */
+void editor_project_find_file(Editor *editor)
 {
-	char *tmp;
-	size_t len;
+	char root[PROJECT_PATH_LEN];
+
+	editor_set_dir_by_current_file(editor);
+	project_find_root(editor->dir, root, PROJECT_PATH_LEN);
+	project_refresh(&editor->project, root, true);
+
+	editor_user_input_clear(editor);
+	editor->state = PROJECT_SEARCH;
+	editor_completor_clean(editor);
 
+	editor->completor.borrowed = true;
+	for (size_t i = 0; i < editor->project.files.len; ++i) {
+		gb_append(&(editor->completor), editor->project.files.data[i]);
+	}
+
+	editor_completion_actualize(editor);
+}
+
+bool editor_project_find_file_complete(Editor *editor, char *notification, size_t notification_len)
+{
+	char path[PROJECT_PATH_LEN];
+
+	if ((editor->state & _PROJECT) == 0) return false;
+	if (editor->completor.filtered.len == 0) return true;
+
+	snprintf(path, PROJECT_PATH_LEN, "%s/%s", editor->project.root, editor->completor.filtered.data[editor->completor.selected]);
+	editor_completor_clean(editor);
+	editor->state = NONE;
+
+	if (editor_read_file(editor, path) != 0) snprintf(notification, notification_len, "Could not read %s", path);
+
+	return true;
+}
+
+void editor_completion_next_match(Editor *editor)
+{
 	if ((editor->state & COMPLETION) == 0) return;
 	if (editor->completor.filtered.len == 0) return;
-	if (editor->completor.filtered.len == 1) return;
-
-	len = editor->completor.filtered.len;
-	tmp = editor->completor.filtered.data[0];
 
-	memmove(&editor->completor.filtered.data[0], &editor->completor.filtered.data[1], (len - 1) * sizeof(void*));
-	editor->completor.filtered.data[len - 1] = tmp;
+	editor->completor.selected = (editor->completor.selected + 1) % editor->completor.filtered.len;
 }
 
 void editor_completion_prev_match(Editor *editor)
 {
-	char *tmp;
 	size_t len;
 
 	if ((editor->state & COMPLETION) == 0) return;
 	if (editor->completor.filtered.len == 0) return;
-	if (editor->completor.filtered.len == 1) return;
 
 	len = editor->completor.filtered.len;
-	tmp = editor->completor.filtered.data[len - 1];
-
-	memmove(&editor->completor.filtered.data[1], &editor->completor.filtered.data[0], (len - 1) * sizeof(void*));
-	editor->completor.filtered.data[0] = tmp;
+	editor->completor.selected = (editor->completor.selected + len - 1) % len;
 }
 
+/**
+ * Inserts the newline and the indentation of the current line
+ */
 void editor_new_line(Editor *editor)
 {
-	size_t pos, i;
-	char ch, *buffer;
-
-	buffer = SDL_GetClipboardText();
+	size_t pos, beg, i;
+	char ch, *data, *indented;
 
 	pos = editor->pane->position;
-	editor_move_begginning_of_line(editor);
-	i = editor->pane->position;
-	editor_set_mark(editor);
-	while (i < pos && ((ch = editor->pane->buffer->content.data[i]) == ' ' || ch == '\t')) {
-		++i;
-	}
-	editor_goto_point(editor, i);
-	editor_copy_to_clipboard(editor);
-	editor->state = NONE;
-	editor_goto_point(editor, pos);
-	editor_insert(editor, "\n");
-	editor_paste(editor);
-	SDL_SetClipboardText(buffer);
+	data = editor->pane->buffer->content.data;
+	beg = editor->pane->buffer->len > 0 ? editor->pane->buffer->data[editor_get_current_line_number(editor->pane)].start : 0;
+
+	for (i = beg; i < pos && ((ch = data[i]) == ' ' || ch == '\t'); ++i);
+
+	indented = calloc(i - beg + 2, sizeof(char));
+	indented[0] = '\n';
+	memcpy(&indented[1], &data[beg], i - beg);
+
+	//the other cursors get the indentation of the main one
+	editor_cursors_insert(editor, indented);
+	editor_recognize_arena(editor);
+	free(indented);
 }
 
 void editor_undo(Editor *editor)
@@ -1397,12 +4229,15 @@ void editor_undo(Editor *editor)
 					event->string.len) == 0) {
 			editor_goto_point(editor, event->point);
 			editor_delete_forward_len(editor, event->string.len);
-			editor_determine_lines(editor);
 		}
 		break;
 	case DELETION:
 		fprintf(stderr, "Not implemented yet");
 		break;
+	case REPLACEMENT:
+		editor_buffer_replace(editor->pane->buffer, &event->replacements, NULL);
+		editor_goto_point(editor, MIN(event->point, editor->pane->buffer->content.len));
+		break;
 	}
 	event->type = EMPTY;
 }
@@ -5,9 +5,27 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "common.h"
-
-#define PANES_MAX_SIZE            3
+#include "search_index.h"
+#include "regexp.h"
+#include "grep.h"
+#include "fuzzy.h"
+#include "hashmap.h"
+#include "project.h"
+#include "watch.h"
+#include "shell.h"
+#include "layout.h"
+
+#define PANES_MAX_SIZE            LAYOUT_PANES_MAX
+//panes of different widths showing one buffer keep a wrap index each
+#define EDITOR_VISUAL_WIDTHS      4
+#define EDITOR_BUFFER_SLAB_LEN    64
+//more or bigger buffers than this are evicted from the least recently shown
+#define EDITOR_RESIDENT_BUFFERS   32
+#define EDITOR_RESIDENT_BYTES     (256 << 20)
 #define CHANGE_EVENT_HISTORY_SIZE 100
+#define EDITOR_KILL_RING_SIZE     32
+//the mini buffer shows only the best completions
+#define COMPLETION_TOP_K          256
 
 typedef struct {
 	size_t start;
@@ -20,6 +38,9 @@ typedef struct {
 	size_t capacity;
 } Content;
 
+/**
+ * start is the first visible row of the pane (see VisualLines)
+ */
 typedef struct {
 	size_t start;
 	size_t show_lines;
@@ -29,12 +50,58 @@ typedef enum {
 	EMPTY,
 	INSERTION,
 	DELETION,
+	REPLACEMENT,
 } ChangeEventType;
 
+/**
+ * [start, end) of the content is replaced by text_len bytes of the text from text_beg
+ */
+typedef struct {
+	size_t start;
+	size_t end;
+	size_t text_beg;
+	size_t text_len;
+} Replacement;
+
+/**
+ * Sorted not overlapping replacements, applied in one pass by editor_buffer_replace
+ */
+typedef struct {
+	Replacement *data;
+	size_t len;
+	size_t cap;
+
+	StringBuilder text;
+} Replacements;
+
+/**
+ * The lines [line_beg, line_end) of the old text [old_beg, old_end] were replaced by
+ * [new_line_beg, new_line_end) of the new lines. The text before them moved by
+ * delta_before bytes, the text of the lines grew by delta.
+ */
+typedef struct {
+	size_t line_beg;
+	size_t line_end;
+	size_t old_beg;
+	size_t old_end;
+	size_t new_line_beg;
+	size_t new_line_end;
+	long delta_before;
+	long delta;
+} LinesChange;
+
+typedef struct {
+	LinesChange *data;
+	size_t len;
+	size_t cap;
+} LinesChanges;
+
 typedef struct {
 	ChangeEventType type;
 	size_t point;
 	StringBuilder string;
+	//restores the content of a REPLACEMENT
+	Replacements replacements;
 } ChangeEvent;
 
 #define printf_change_event(e) \
@@ -46,6 +113,42 @@ typedef struct {
 		printf("EMPTY\n"); \
 	} \
 
+/**
+ * Screen rows of a buffer: logical lines split by soft wrapping.
+ * Rows share the Line semantic, end of the last row of a line is the line end.
+ * The index is built for one wrap width and patched locally on edits.
+ */
+typedef struct {
+	Line *data;
+	size_t len;
+	size_t cap;
+
+	size_t wrap_cols;
+	size_t tab_size;
+	bool valid;
+	size_t used; //the least recently used index is built again for another width
+} VisualLines;
+
+typedef struct {
+	size_t pos;
+	size_t col;
+} ColumnCheckpoint;
+
+/**
+ * Sparse column index of long lines: a checkpoint every EDITOR_COLUMN_CHECKPOINT_STEP
+ * bytes, so a column of a huge line is found without walking it from the start.
+ * Checkpoints are built lazily per line and sorted by position.
+ */
+typedef struct {
+	ColumnCheckpoint *data;
+	size_t len;
+	size_t cap;
+
+	size_t tab_size;
+} ColumnCheckpoints;
+
+#define EDITOR_COLUMN_CHECKPOINT_STEP 4096
+
 typedef struct {
 	bool update_column;
 	size_t column;
@@ -56,11 +159,29 @@ typedef struct {
 	size_t len;
 	size_t cap;
 
+	VisualLines visual[EDITOR_VISUAL_WIDTHS];
+	ColumnCheckpoints columns;
+	size_t version; //changes with the content, caches of the shown text compare it
+
 	char *file_path;
 	size_t file_path_len;
+	char *key; //canonical path, see BufferList
 
 	bool need_to_save;
 
+	//the file as it was read or saved last, a change on the disk is compared with it
+	int watch; //id of the dir of the file, 0 when it is not watched
+	uint64_t disk_size;
+	int64_t disk_mtime_sec;
+	int64_t disk_mtime_nsec;
+	//the file changed on the disk while the buffer had unsaved changes
+	bool disk_changed;
+	//the cursor at the end stays at the end of the growing file
+	bool follow;
+	//the memory is released, the file is read again when the buffer is shown
+	bool evicted;
+	size_t used; //clock of BufferList when it was shown last
+
 	size_t last_position;
 
 	ChangeEvent events[CHANGE_EVENT_HISTORY_SIZE];
@@ -68,20 +189,65 @@ typedef struct {
 } Buffer;
 
 typedef struct {
-	Buffer *data;
+	Buffer **data;
 	size_t len;
 	size_t cap;
+} BufferRefs;
+
+/**
+ * Buffers live in slabs which never move, a Buffer pointer stays valid
+ * until the buffer is killed, then its slot is reused. data keeps the open
+ * buffers in the order they were opened, by_path finds them by canonical path.
+ */
+typedef struct {
+	Buffer **data;
+	size_t len;
+	size_t cap;
+
+	BufferRefs slabs;
+	size_t slab_used; //slots of the last slab
+	BufferRefs free;
+	struct hashmap_s by_path;
+	bool has_by_path;
+	size_t clock;
 } BufferList;
 
+/**
+ * Extra cursor of a pane, the main one is Pane.position with Editor.mark.
+ * Its region is shown and edited when the editor is in SELECTION.
+ */
+typedef struct {
+	size_t position;
+	size_t mark;
+	size_t column; //see Buffer.column
+} Cursor;
+
+/**
+ * Sorted by position, none of them is at the main cursor. Only the edits of
+ * all the cursors move them, after any other edit of the buffer (its version
+ * differs) they point to stale offsets and are dropped.
+ */
+typedef struct {
+	Cursor *data;
+	size_t len;
+	size_t cap;
+	size_t version; //of the buffer when the cursors were placed
+} Cursors;
+
 typedef struct {
 	Buffer *buffer;
 
 	uint32_t x;
+	uint32_t y;
 	uint32_t w;
 	uint32_t h;
 
 	size_t position;
+	Cursors cursors;
 	Arena arena;
+
+	size_t wrap_cols; /* 0 disables wrapping */
+	size_t hscroll; /* first visible column when lines are truncated */
 } Pane;
 
 typedef enum {
@@ -92,8 +258,11 @@ typedef enum {
 	EXTEND_COMMAND  = 0x100,
 	COMPLETION       = 0x200,
 	_FILE          = 0x400,
+	REPLACE         = 0x800,
+	_PROJECT        = 0x1000,
 
 	FILE_SEARCH     = COMPLETION | _FILE,
+	PROJECT_SEARCH  = COMPLETION | _PROJECT,
 	SEARCH          = FORWARD_SEARCH | BACKWARD_SEARCH,
 } EditorState;
 
@@ -103,16 +272,164 @@ typedef struct {
 	size_t cap;
 } CompletorFiltered;
 
+typedef struct {
+	uint64_t mask;
+	size_t len;
+} CompletorKey;
+
+typedef struct {
+	CompletorKey *data;
+	size_t len;
+	size_t cap;
+} CompletorKeys;
+
+typedef struct {
+	size_t *data;
+	size_t len;
+	size_t cap;
+} CompletorMatched;
+
+/**
+ * filtered is the best matches of the user input from the best, the one
+ * at selected is completed. Keys are computed once per candidate and
+ * matched (all the candidates matching matched_query) is refined when the
+ * input only grows.
+ */
 typedef struct {
 	CompletorFiltered filtered;
+	size_t selected;
+
+	CompletorKeys keys;
+	CompletorMatched matched;
+	StringBuilder matched_query;
+	bool matched_valid;
+	FuzzyTop top;
+
+	//the candidates are owned by someone else (the project files)
+	bool borrowed;
 	char **data;
 	size_t len;
 	size_t cap;
 } Completor;
 
+typedef struct {
+	size_t start;
+	size_t end;
+} SearchMatch;
+
+/**
+ * Sorted matches of the search input found in [scanned_beg, scanned_end).
+ * A longer input only narrows the set, the scanned range grows with the view.
+ * Regexp matches do not overlap and are found again for every input.
+ */
+typedef struct {
+	SearchMatch *data;
+	size_t len;
+	size_t cap;
+
+	StringBuilder needle;
+	Buffer *buffer;
+	size_t scanned_beg, scanned_end;
+	//cursor position when the search was started
+	size_t origin;
+
+	bool is_regexp;
+	//the input compiles, the regexp is valid only then
+	bool compiled;
+	Regexp regexp;
+} SearchMatches;
+
+typedef enum {
+	REPLACE_FROM,
+	REPLACE_TO,
+	REPLACE_QUERY,
+} ReplaceStage;
+
+/**
+ * query-replace and replace-regexp: the accepted matches are collected
+ * and the buffer is rebuilt once when the session is finished
+ */
+typedef struct {
+	ReplaceStage stage;
+	bool is_regexp;
+	bool query;
+
+	StringBuilder from;
+	StringBuilder to;
+	Regexp regexp;
+	SearchPattern pattern;
+	bool compiled;
+
+	Buffer *buffer;
+	Replacements accepted;
+	SearchMatch current;
+	//where the next match is looked for, after_match when it is the end of a match
+	size_t next;
+	bool after_match;
+} ReplaceSession;
+
+typedef struct {
+	char **data;
+	size_t len;
+	size_t cap;
+} DirNames;
+
+/**
+ * Names of a watched dir for find-file (dirs end by a slash), kept up to
+ * date by the watch changes instead of reading the dir again
+ */
+typedef struct {
+	char dir[1024];
+	int watch;
+	DirNames names;
+} DirListing;
+
+typedef struct {
+	DirListing *data;
+	size_t len;
+	size_t cap;
+} DirListings;
+
+/**
+ * Killed text, it does not change after the kill and is shared by the
+ * kill ring and the clipboard waiting to be set
+ */
+typedef struct {
+	size_t refs;
+	size_t len;
+	char data[]; //zero terminated
+} KillText;
+
+/**
+ * Kills and yanks stay in the process. Only an explicit copy (M-w, C-w)
+ * goes to the system clipboard, once at the end of the frame. The
+ * clipboard of other programs is read by a yank only after it changed.
+ */
+typedef struct {
+	KillText *entries[EDITOR_KILL_RING_SIZE];
+	size_t len;
+	size_t head; //the latest kill
+
+	KillText *clipboard; //waits to be set to the system clipboard
+	bool clipboard_changed; //by another program after the latest kill
+
+	//a kill right after the previous one at the same place is appended to it
+	Buffer *kill_buffer;
+	size_t kill_version;
+	size_t kill_position;
+
+	//M-y replaces the last yank by an older kill while nothing changed after it
+	Buffer *yank_buffer;
+	size_t yank_version;
+	size_t yank_beg;
+	size_t yank_end;
+	size_t yank_index; //kills back from the latest
+} KillRing;
+
 typedef struct {
 	Pane panes[PANES_MAX_SIZE];
 	size_t panes_len;
+	Layout layout;
 
 	Pane *pane;
 
@@ -123,12 +440,28 @@ typedef struct {
 	BufferList buffer_list;
 
 	Completor completor;
+	SearchMatches matches;
+	SearchIndex search_index;
+	ReplaceSession replace;
+	Grep grep;
+	Shell shell;
+	TrigramBuild trigram_build;
+	Project project;
+	Watch watch;
+	DirListings listings;
+	KillRing kill_ring;
 
 	char dir[1024];
 	size_t dir_len;
+
+	size_t tab_size;
+	bool truncate_lines;
 } Editor;
 
 #define EDITOR_CONTENT_CAP 256
+#define EDITOR_READ_CHUNK  (1 << 16)
+//a search scans at most this around the cursor when the view is bigger (long lines)
+#define EDITOR_MATCHES_VISIBLE_LIMIT (1 << 20)
 #define EDITOR_MINI_BUFFER_CONTENT_LIMIT 1000
 
 #define EDITOR_DIR_CUR     "."
@@ -139,15 +472,45 @@ typedef struct {
 
 #define EDITOR_DIR_SLASH  '/'
 
+//buffers which are not files are named by stars
+#define EDITOR_GREP_BUFFER "*grep*"
+#define EDITOR_SHELL_BUFFER "*Async Shell Command*"
+
+//the least recently read listing is dropped for a new one
+#define EDITOR_DIR_LISTINGS_MAX 16
+//a grown file is tailed when its old end is still the same
+#define EDITOR_TAIL_CHECK 4096
+
 #define editor_mod(a, b) ((a%b + b)%b)
 
 void editor_goto_point(Editor *editor, size_t pos);
 
+void editor_buffer_insert(Buffer *buffer, size_t pos, char *str, size_t len);
+void editor_buffer_delete(Buffer *buffer, size_t pos, size_t len);
+void editor_buffer_replace(Buffer *buffer, Replacements *replacements, Replacements *inverse);
+void editor_buffer_swap(Buffer *buffer, size_t beg, size_t first_end, size_t second_beg, size_t end);
+void editor_buffer_determine_lines(Buffer *buffer);
+size_t editor_line_by_position(Buffer *buffer, size_t pos);
+
+VisualLines *editor_visual_lines(Editor *editor, Pane *pane);
+/**
+ * Wraps the pane by another width, its first visible row stays on the same text
+ */
+void editor_pane_wrap(Editor *editor, Pane *pane, size_t wrap_cols);
+size_t editor_visual_row_by_position(VisualLines *visual, size_t pos);
+
+size_t editor_column_by_position(Editor *editor, Buffer *buffer, size_t pos);
+size_t editor_position_by_column(Editor *editor, Buffer *buffer, Line *line, size_t column, size_t *found_column);
+void editor_hscroll_recognize(Editor *editor, Pane *pane, size_t cols);
+void editor_toggle_truncate_lines(Editor *editor);
+
 void editor_insert(Editor *editor, char *str);
 void editor_delete_backward(Editor *editor);
 void editor_delete_forward(Editor *editor);
 int  editor_save(Editor* editor);
 int  editor_read_file(Editor *editor, char *file_path);
+Buffer *editor_find_buffer(Editor *editor, const char *file_path);
+Buffer *editor_create_buffer(Editor *editor, char *file_path);
 void editor_determine_lines(Editor *editor);
 void editor_recognize_arena(Editor *editor);
 
@@ -177,15 +540,51 @@ void editor_beginning_of_buffer(Editor *editor);
 void editor_end_of_buffer(Editor *editor);
 void editor_mwheel_scroll(Editor *editor, Sint32 y);
 void editor_set_mark(Editor *editor);
+void editor_drag_start(Editor *editor, size_t point);
+void editor_drag_to(Editor *editor, size_t point);
+
+void editor_cursors_clear(Pane *pane);
+/**
+ * Adds a cursor where the main one is and moves the main one to the next (previous) line
+ */
+void editor_cursor_add_line(Editor *editor, bool down);
+/**
+ * Every match of the search gets a cursor with the match as its region, the search ends
+ */
+void editor_cursors_from_matches(Editor *editor);
+/**
+ * Applies the motion to every cursor of the pane, the main one is the last
+ */
+void editor_cursors_motion(Editor *editor, void (*motion)(Editor *editor));
+/**
+ * Inserts at every cursor (replaces their regions) in one pass over the content, it is one undo step
+ */
+void editor_cursors_insert(Editor *editor, char *str);
+/**
+ * Deletes the regions or a char before (after) every cursor in one pass over the content
+ */
+void editor_cursors_delete(Editor *editor, bool forward);
 void editor_copy_to_clipboard(Editor *editor);
 void editor_paste(Editor *editor);
+void editor_yank_pop(Editor *editor);
 void editor_cut(Editor *editor);
+/**
+ * Another program set the system clipboard, the next yank reads it
+ */
+void editor_clipboard_changed(Editor *editor);
+/**
+ * Sets the clipboard to the latest explicit copy, called once a frame
+ */
+void editor_clipboard_flush(Editor *editor);
 void editor_duplicate_line(Editor *editor);
 void editor_move_line_up(Editor *editor);
 void editor_move_line_down(Editor *editor);
+void editor_transpose_lines(Editor *editor);
 
 void editor_user_search_forward(Editor *editor);
 void editor_user_search_backward(Editor *editor);
+void editor_user_search_regexp_forward(Editor *editor);
+void editor_user_search_regexp_backward(Editor *editor);
 void editor_user_extend_command(Editor *editor);
 void editor_user_input_clear(Editor *editor);
 void editor_user_input_insert(Editor *editor, char *text);
@@ -193,6 +592,24 @@ void editor_user_input_delete_backward(Editor *editor);
 void editor_user_input_insert_from_clipboard(Editor *editor);
 
 bool editor_user_search_next(Editor *editor, char *notification, size_t notification_len);
+void editor_search_matches_clear(Editor *editor);
+void editor_search_matches_update(Editor *editor);
+void editor_search_matches_visible(Editor *editor, Pane *pane);
+size_t editor_search_matches_lower_bound(SearchMatches *matches, size_t position);
+
+void editor_user_replace(Editor *editor, bool is_regexp, bool query);
+void editor_user_replace_submit(Editor *editor, char *notification, size_t notification_len);
+void editor_user_replace_answer(Editor *editor, char answer, char *notification, size_t notification_len);
+void editor_user_replace_cancel(Editor *editor);
+
+bool editor_grep(Editor *editor, char *pattern, bool is_regexp, char *notification, size_t notification_len);
+void editor_grep_flush(Editor *editor);
+void editor_grep_cancel(Editor *editor);
+bool editor_grep_visit(Editor *editor, char *notification, size_t notification_len);
+void editor_trigram_index(Editor *editor, char *notification, size_t notification_len);
+bool editor_trigram_index_done(Editor *editor, char *notification, size_t notification_len);
+bool editor_shell_command(Editor *editor, char *command, char *notification, size_t notification_len);
+bool editor_shell_flush(Editor *editor, char *notification, size_t notification_len);
 
 void editor_goto_line(Editor *editor, size_t line);
 void editor_goto_line_forward(Editor *editor, size_t line);
@@ -200,13 +617,22 @@ void editor_goto_line_backward(Editor *editor, size_t line);
 
 bool editor_is_editing_text(Editor *editor);
 void editor_kill_buffer(Editor *editor, size_t buf_index, char *notification, size_t notification_len);
-void editor_switch_buffer(Editor *editor, size_t buf_index);
+/**
+ * False when the buffer is evicted and its file can not be read again, the pane keeps its buffer
+ */
+bool editor_switch_buffer(Editor *editor, Buffer *buffer);
 
-void editor_split_pane(Editor *editor);
+/**
+ * Splits the current pane into two, the new one shows the same buffer
+ */
+void editor_split_pane(Editor *editor, LayoutKind kind);
 
 void editor_wrap_region_in_parens(Editor *editor);
 
 void editor_next_pane(Editor *editor);
+/**
+ * Closes the current pane, the pane next to it takes its place
+ */
 void editor_close_pane(Editor *editor);
 
 void editor_upper(Editor *editor);
@@ -218,10 +644,15 @@ void editor_completion_next_match(Editor *editor);
 void editor_completion_prev_match(Editor *editor);
 
 void editor_buffer_switch(Editor *editor);
-bool editor_buffer_switch_complete(Editor *editor);
+bool editor_buffer_switch_complete(Editor *editor, char *notification, size_t notification_len);
 
+void editor_set_dir_by_current_file(Editor *editor);
 void editor_find_file(Editor *editor, bool refresh_dir);
-bool editor_find_file_complete(Editor *editor);
+bool editor_find_file_complete(Editor *editor, char *notification, size_t notification_len);
+void editor_project_find_file(Editor *editor);
+bool editor_project_find_file_complete(Editor *editor, char *notification, size_t notification_len);
+bool editor_watch_flush(Editor *editor, char *notification, size_t notification_len);
+void editor_toggle_follow(Editor *editor, char *notification, size_t notification_len);
 
 void editor_new_line(Editor *editor);
 void editor_undo(Editor *editor);
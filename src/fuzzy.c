@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <sys/param.h>
+
+#include "common.h"
+#include "fuzzy.h"
+
+static unsigned char fuzzy_fold(unsigned char c)
+{
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static bool fuzzy_is_lower(unsigned char c)
+{
+	return c >= 'a' && c <= 'z';
+}
+
+static bool fuzzy_is_upper(unsigned char c)
+{
+	return c >= 'A' && c <= 'Z';
+}
+
+static int fuzzy_bonus(const char *text, size_t i)
+{
+	unsigned char prev;
+
+	if (i == 0) return FUZZY_BONUS_BOUNDARY;
+
+	prev = (unsigned char) text[i - 1];
+	if (prev == '/') return FUZZY_BONUS_SLASH;
+	if (prev == '_' || prev == '-' || prev == '.' || prev == ' ') return FUZZY_BONUS_BOUNDARY;
+	if (fuzzy_is_lower(prev) && fuzzy_is_upper((unsigned char) text[i])) return FUZZY_BONUS_CAMEL;
+
+	return 0;
+}
+
+uint64_t fuzzy_mask(const char *text, size_t len)
+{
+	uint64_t mask = 0;
+	unsigned char c;
+
+	for (size_t i = 0; i < len; ++i) {
+		c = fuzzy_fold((unsigned char) text[i]);
+
+		if (fuzzy_is_lower(c)) mask |= (uint64_t) 1 << (c - 'a');
+		else if (c >= '0' && c <= '9') mask |= (uint64_t) 1 << (26 + c - '0');
+		else mask |= (uint64_t) 1 << (36 + c % 28);
+	}
+
+	return mask;
+}
+
+bool fuzzy_score(const char *candidate, size_t len, const char *query, size_t query_len, int *score)
+{
+	size_t i, q, start, end;
+	bool consecutive, in_gap;
+	int total, bonus, run_bonus;
+
+	*score = 0;
+	if (query_len == 0) return true;
+
+	//the first match end, then the last start before it gives the shortest window
+	for (i = 0, q = 0; i < len && q < query_len; ++i) {
+		if (fuzzy_fold((unsigned char) candidate[i]) == fuzzy_fold((unsigned char) query[q])) ++q;
+	}
+	if (q < query_len) return false;
+
+	end = i;
+	for (q = query_len; q > 0;) {
+		--i;
+		if (fuzzy_fold((unsigned char) candidate[i]) == fuzzy_fold((unsigned char) query[q - 1])) --q;
+	}
+	start = i;
+
+	total = 0;
+	run_bonus = 0;
+	consecutive = false;
+	in_gap = false;
+	for (i = start, q = 0; i < end && q < query_len; ++i) {
+		if (fuzzy_fold((unsigned char) candidate[i]) == fuzzy_fold((unsigned char) query[q])) {
+			bonus = fuzzy_bonus(candidate, i);
+
+			//a run of matches keeps the bonus of its start, so "smacs" beats "s_m_a_c_s"
+			if (consecutive) {
+				bonus = MAX(bonus, MAX(run_bonus, FUZZY_BONUS_CONSECUTIVE));
+			} else {
+				run_bonus = bonus;
+			}
+			if (q == 0) bonus *= FUZZY_BONUS_FIRST;
+
+			total += FUZZY_SCORE_MATCH + bonus;
+			if (candidate[i] == query[q]) total += FUZZY_BONUS_CASE;
+
+			consecutive = true;
+			in_gap = false;
+			++q;
+		} else {
+			total += in_gap ? FUZZY_SCORE_GAP : FUZZY_SCORE_GAP_START;
+			consecutive = false;
+			in_gap = true;
+		}
+	}
+
+	*score = total;
+	return true;
+}
+
+static bool fuzzy_hit_better(FuzzyHit *a, FuzzyHit *b)
+{
+	return a->score > b->score || (a->score == b->score && a->index < b->index);
+}
+
+static void fuzzy_top_swap(FuzzyTop *top, size_t i, size_t j)
+{
+	FuzzyHit tmp = top->data[i];
+
+	top->data[i] = top->data[j];
+	top->data[j] = tmp;
+}
+
+void fuzzy_top_reset(FuzzyTop *top, size_t k)
+{
+	top->len = 0;
+	top->k = k;
+}
+
+void fuzzy_top_push(FuzzyTop *top, size_t index, int score)
+{
+	FuzzyHit hit = {index, score};
+	size_t i, child;
+
+	if (top->k == 0) return;
+
+	//the worst hit is the root, it is replaced by a better one
+	if (top->len < top->k) {
+		gb_append(top, hit);
+		for (i = top->len - 1; i > 0 && fuzzy_hit_better(&top->data[(i - 1) / 2], &top->data[i]); i = (i - 1) / 2) {
+			fuzzy_top_swap(top, i, (i - 1) / 2);
+		}
+		return;
+	}
+
+	if (!fuzzy_hit_better(&hit, &top->data[0])) return;
+
+	top->data[0] = hit;
+	for (i = 0; (child = 2 * i + 1) < top->len; i = child) {
+		if (child + 1 < top->len && fuzzy_hit_better(&top->data[child], &top->data[child + 1])) ++child;
+		if (!fuzzy_hit_better(&top->data[i], &top->data[child])) break;
+
+		fuzzy_top_swap(top, i, child);
+	}
+}
+
+static int fuzzy_hit_compare(const void *a, const void *b)
+{
+	FuzzyHit *x = (FuzzyHit *) a, *y = (FuzzyHit *) b;
+
+	if (fuzzy_hit_better(x, y)) return -1;
+	return fuzzy_hit_better(y, x);
+}
+
+void fuzzy_top_sort(FuzzyTop *top)
+{
+	if (top->len > 1) qsort(top->data, top->len, sizeof(FuzzyHit), fuzzy_hit_compare);
+}
+
+void fuzzy_top_free(FuzzyTop *top)
+{
+	gb_free(top);
+	top->data = NULL;
+}
@@ -0,0 +1,53 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FUZZY_SCORE_MATCH       16
+#define FUZZY_SCORE_GAP_START   -3
+#define FUZZY_SCORE_GAP         -1
+//a match after a separator or at a camelCase hump
+#define FUZZY_BONUS_BOUNDARY    8
+#define FUZZY_BONUS_SLASH       10
+#define FUZZY_BONUS_CAMEL       7
+#define FUZZY_BONUS_CONSECUTIVE 4
+#define FUZZY_BONUS_FIRST       2 //multiplies the bonus of the first query char
+#define FUZZY_BONUS_CASE        1
+
+typedef struct {
+	size_t index;
+	int score;
+} FuzzyHit;
+
+/**
+ * The best k hits, a min-heap by fuzzy_hit_better until fuzzy_top_sort
+ */
+typedef struct {
+	FuzzyHit *data;
+	size_t len;
+	size_t cap;
+	size_t k;
+} FuzzyTop;
+
+/**
+ * Chars of the text as bits (letters folded), a candidate without all the
+ * bits of the query can not match it
+ */
+uint64_t fuzzy_mask(const char *text, size_t len);
+/**
+ * Matches the query as a case-insensitive subsequence of the candidate,
+ * the score prefers consecutive chars and word starts
+ */
+bool fuzzy_score(const char *candidate, size_t len, const char *query, size_t query_len, int *score);
+
+void fuzzy_top_reset(FuzzyTop *top, size_t k);
+void fuzzy_top_push(FuzzyTop *top, size_t index, int score);
+/**
+ * Sorts the hits from the best, equal scores keep the order of the candidates
+ */
+void fuzzy_top_sort(FuzzyTop *top);
+void fuzzy_top_free(FuzzyTop *top);
+
+#endif
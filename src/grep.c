@@ -0,0 +1,350 @@
+#ifndef _DEFAULT_SOURCE
+//d_type is not in C11
+#define _DEFAULT_SOURCE
+#endif
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "grep.h"
+
+//symbolic links to directories are not followed (like grep -r), the limit is for file systems without d_type
+#define GREP_DEPTH_LIMIT 64
+
+static void grep_notify(void)
+{
+	SDL_Event event = {0};
+
+	event.type = SDL_EVENT_USER;
+	event.user.code = GREP_EVENT_CODE;
+	SDL_PushEvent(&event);
+}
+
+/**
+ * Pushes the entries of the directory as new jobs, hidden ones (.git) are skipped
+ */
+static void grep_dir(Grep *grep, GrepJob *job)
+{
+	GrepJobs found = {0};
+	struct dirent *entry;
+	struct stat entry_stat;
+	char path[GREP_PATH_LEN];
+	DIR *dir;
+	bool is_dir;
+
+	if (job->depth >= GREP_DEPTH_LIMIT) return;
+
+	dir = opendir(job->path);
+	if (dir == NULL) return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (SDL_GetAtomicInt(&grep->cancel)) break;
+		if (entry->d_name[0] == '.') continue;
+
+		if ((size_t) snprintf(path, GREP_PATH_LEN, "%s/%s", job->path, entry->d_name) >= GREP_PATH_LEN) continue;
+
+#ifdef DT_DIR
+		if (entry->d_type == DT_DIR || entry->d_type == DT_REG) {
+			is_dir = entry->d_type == DT_DIR;
+		} else
+#endif
+		{
+			if (stat(path, &entry_stat) != 0) continue;
+			if (!S_ISDIR(entry_stat.st_mode) && !S_ISREG(entry_stat.st_mode)) continue;
+			is_dir = S_ISDIR(entry_stat.st_mode);
+#ifdef DT_LNK
+			//a link can point back to its parent
+			if (is_dir && entry->d_type == DT_LNK) continue;
+#endif
+		}
+
+		gb_append(&found, ((GrepJob) {strdup(path), is_dir, job->depth + 1}));
+	}
+
+	closedir(dir);
+
+	if (found.len > 0) {
+		SDL_LockMutex(grep->lock);
+		for (size_t i = 0; i < found.len; ++i) gb_append(&grep->jobs, found.data[i]);
+		SDL_BroadcastCondition(grep->wake);
+		SDL_UnlockMutex(grep->lock);
+	}
+
+	gb_free(&found);
+}
+
+/**
+ * Appends "path:line:text" for every line with a match to the worker output
+ */
+static void grep_file(GrepWorker *worker, GrepJob *job)
+{
+	Grep *grep = worker->grep;
+	struct stat file_stat;
+	char *data, *next_line, number[32];
+	size_t size, position, start, end, counted, line_start, line_end, line;
+	char *relative = &job->path[grep->root_len + 1];
+	long found;
+	int fd;
+
+	if (grep->index.loaded) {
+		found = trigram_index_find(&grep->index, relative, strlen(relative));
+		if (found < 0) {
+			worker->stale = true;
+		} else {
+			worker->indexed++;
+			if (stat(job->path, &file_stat) != 0) return;
+
+			if ((int64_t) file_stat.st_mtime != grep->index.files.data[found].mtime || (uint64_t) file_stat.st_size != grep->index.files.data[found].size) {
+				worker->stale = true;
+			} else if (grep->candidates != NULL && !grep->candidates[found]) {
+				if (file_stat.st_size > 0) worker->files++;
+				return;
+			}
+		}
+	}
+
+	fd = open(job->path, O_RDONLY);
+	if (fd < 0) return;
+
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+		close(fd);
+		return;
+	}
+
+	size = (size_t) file_stat.st_size;
+	data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return;
+
+	worker->files++;
+
+	if (memchr(data, '\0', MIN(size, GREP_BINARY_CHECK_LEN)) != NULL) {
+		munmap(data, size);
+		return;
+	}
+
+	line = 1;
+	line_start = 0;
+	counted = 0;
+	position = 0;
+	while (position <= size) {
+		if (grep->is_regexp) {
+			if (!regexp_search_forward(&worker->regexp, data, size, position, &start, &end)) break;
+		} else {
+			found = search_forward(&grep->literal, data, size, position);
+			if (found < 0) break;
+			start = (size_t) found;
+		}
+
+		//the lines are counted only up to the matches
+		while ((next_line = memchr(&data[counted], '\n', start - counted)) != NULL) {
+			++line;
+			line_start = (size_t) (next_line - data) + 1;
+			counted = line_start;
+		}
+		counted = start;
+
+		next_line = memchr(&data[start], '\n', size - start);
+		line_end = next_line != NULL ? (size_t) (next_line - data) : size;
+
+		sb_append_many(&worker->out, relative);
+		snprintf(number, sizeof(number), ":%ld:", line);
+		sb_append_many(&worker->out, number);
+		sb_append_manyl(&worker->out, &data[line_start], MIN(line_end - line_start, GREP_LINE_LIMIT));
+		sb_append(&worker->out, '\n');
+		worker->matches++;
+
+		//one result per line
+		position = line_end + 1;
+	}
+
+	munmap(data, size);
+}
+
+static int grep_worker(void *data)
+{
+	GrepWorker *worker = data;
+	Grep *grep = worker->grep;
+	GrepJob job;
+	Uint64 now;
+	bool last;
+
+	SDL_LockMutex(grep->lock);
+	while (true) {
+		while (grep->jobs.len == 0 && grep->busy > 0 && !SDL_GetAtomicInt(&grep->cancel)) {
+			SDL_WaitCondition(grep->wake, grep->lock);
+		}
+		if (grep->jobs.len == 0 || SDL_GetAtomicInt(&grep->cancel)) break;
+
+		job = grep->jobs.data[--grep->jobs.len];
+		++grep->busy;
+		SDL_UnlockMutex(grep->lock);
+
+		if (job.is_dir) grep_dir(grep, &job);
+		else grep_file(worker, &job);
+		free(job.path);
+
+		SDL_LockMutex(grep->lock);
+		--grep->busy;
+
+		if (worker->out.len > 0) {
+			sb_append_manyl(&grep->results, worker->out.data, worker->out.len);
+			worker->out.len = 0;
+
+			now = SDL_GetTicks();
+			if (now - grep->notified_at >= GREP_NOTIFY_MS) {
+				grep->notified_at = now;
+				grep_notify();
+			}
+		}
+
+		if (grep->busy == 0 && grep->jobs.len == 0) SDL_BroadcastCondition(grep->wake);
+	}
+
+	grep->files += worker->files;
+	grep->matches += worker->matches;
+	grep->indexed += worker->indexed;
+	grep->stale = grep->stale || worker->stale;
+	last = ++grep->exited == grep->workers_len;
+	SDL_BroadcastCondition(grep->wake);
+	SDL_UnlockMutex(grep->lock);
+
+	if (last && !SDL_GetAtomicInt(&grep->cancel)) grep_notify();
+
+	return 0;
+}
+
+/**
+ * Waits for the workers and frees everything but the results
+ */
+static void grep_stop(Grep *grep)
+{
+	for (size_t i = 0; i < grep->workers_len; ++i) {
+		if (grep->workers[i].thread != NULL) SDL_WaitThread(grep->workers[i].thread, NULL);
+		grep->workers[i].thread = NULL;
+
+		if (grep->is_regexp) regexp_free(&grep->workers[i].regexp);
+		sb_free(&grep->workers[i].out);
+	}
+	grep->workers_len = 0;
+
+	for (size_t i = 0; i < grep->jobs.len; ++i) free(grep->jobs.data[i].path);
+	grep->jobs.len = 0;
+
+	if (!grep->is_regexp) search_free(&grep->literal);
+	free(grep->pattern);
+	grep->pattern = NULL;
+
+	trigram_index_free(&grep->index);
+	free(grep->candidates);
+	grep->candidates = NULL;
+
+	grep->running = false;
+}
+
+bool grep_start(Grep *grep, const char *root, const char *pattern, size_t pattern_len, bool is_regexp, char *error, size_t error_len)
+{
+	GrepWorker *worker;
+	int cores;
+
+	grep_cancel(grep);
+
+	if (grep->lock == NULL) {
+		grep->lock = SDL_CreateMutex();
+		grep->wake = SDL_CreateCondition();
+	}
+
+	grep->is_regexp = is_regexp;
+	grep->root_len = (size_t) snprintf(grep->root, GREP_PATH_LEN, "%s", root);
+	grep->pattern = strndup(pattern, pattern_len);
+	grep->pattern_len = pattern_len;
+
+	cores = SDL_GetNumLogicalCPUCores();
+	grep->workers_len = (size_t) MAX(1, MIN(cores, GREP_WORKERS_MAX));
+
+	for (size_t i = 0; i < grep->workers_len; ++i) {
+		worker = &grep->workers[i];
+		memset(worker, 0, sizeof(*worker));
+		worker->grep = grep;
+
+		if (is_regexp && !regexp_compile(&worker->regexp, pattern, pattern_len, REGEXP_ICASE)) {
+			snprintf(error, error_len, "Invalid regexp: %s", worker->regexp.error);
+			grep->workers_len = i;
+			grep_stop(grep);
+			return false;
+		}
+	}
+	if (!is_regexp) search_compile(&grep->literal, pattern, pattern_len);
+
+	grep->indexed = 0;
+	grep->stale = false;
+	if (trigram_index_load(&grep->index, grep->root)) {
+		if (!is_regexp) {
+			grep->candidates = trigram_index_candidates(&grep->index, grep->literal.needle, grep->literal.len);
+		} else if (grep->workers[0].regexp.has_literal) {
+			grep->candidates = trigram_index_candidates(&grep->index, grep->workers[0].regexp.literal.needle, grep->workers[0].regexp.literal.len);
+		}
+	}
+
+	sb_clean(&grep->results);
+	grep->busy = 0;
+	grep->exited = 0;
+	grep->files = 0;
+	grep->matches = 0;
+	grep->notified_at = SDL_GetTicks();
+	SDL_SetAtomicInt(&grep->cancel, 0);
+	gb_append(&grep->jobs, ((GrepJob) {strdup(grep->root), true, 0}));
+	grep->running = true;
+
+	for (size_t i = 0; i < grep->workers_len; ++i) {
+		grep->workers[i].thread = SDL_CreateThread(grep_worker, "grep", &grep->workers[i]);
+		if (grep->workers[i].thread == NULL) {
+			fprintf(stderr, "Could not create grep thread: %s\n", SDL_GetError());
+
+			SDL_LockMutex(grep->lock);
+			//the worker is counted as exited so the others can finish the search
+			if (++grep->exited == grep->workers_len) grep_notify();
+			SDL_UnlockMutex(grep->lock);
+		}
+	}
+
+	return true;
+}
+
+void grep_cancel(Grep *grep)
+{
+	if (!grep->running) return;
+
+	SDL_SetAtomicInt(&grep->cancel, 1);
+	SDL_LockMutex(grep->lock);
+	SDL_BroadcastCondition(grep->wake);
+	SDL_UnlockMutex(grep->lock);
+
+	grep_stop(grep);
+	sb_clean(&grep->results);
+}
+
+bool grep_take(Grep *grep, StringBuilder *out)
+{
+	bool done;
+
+	if (!grep->running) return false;
+
+	SDL_LockMutex(grep->lock);
+	sb_append_manyl(out, grep->results.data, grep->results.len);
+	sb_clean(&grep->results);
+	done = grep->exited == grep->workers_len;
+	if (done && grep->index.loaded && grep->indexed < grep->index.files.len) grep->stale = true;
+	SDL_UnlockMutex(grep->lock);
+
+	if (done) grep_stop(grep);
+
+	return done;
+}
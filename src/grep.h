@@ -0,0 +1,103 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "common.h"
+#include "search.h"
+#include "regexp.h"
+#include "trigram.h"
+
+#define GREP_EVENT_CODE 2
+#define GREP_WORKERS_MAX 64
+//the results are pushed to the main thread at most this often
+#define GREP_NOTIFY_MS 50
+//files with a zero byte in the beginning are binary and skipped
+#define GREP_BINARY_CHECK_LEN 8192
+//longer matched lines are cut in the results
+#define GREP_LINE_LIMIT 512
+#define GREP_PATH_LEN 4096
+
+typedef struct {
+	char *path;
+	bool is_dir;
+	size_t depth;
+} GrepJob;
+
+typedef struct {
+	GrepJob *data;
+	size_t len;
+	size_t cap;
+} GrepJobs;
+
+typedef struct Grep Grep;
+
+typedef struct {
+	Grep *grep;
+	SDL_Thread *thread;
+	//a worker has its own regexp because of the work memory
+	Regexp regexp;
+	StringBuilder out;
+	size_t files;
+	size_t matches;
+	size_t indexed;
+	bool stale;
+} GrepWorker;
+
+/**
+ * Walks the directory tree and searches every file by a pool of workers.
+ * Directories and files are jobs of one shared stack, a worker reading a
+ * directory pushes its entries back. Results are "path:line:text" lines
+ * relative to the root, collected under the lock until grep_take.
+ * With a trigram index of the root the unchanged files which can not
+ * contain the pattern are skipped without reading them.
+ */
+struct Grep {
+	GrepWorker workers[GREP_WORKERS_MAX];
+	size_t workers_len;
+
+	SDL_Mutex *lock;
+	SDL_Condition *wake;
+	GrepJobs jobs;
+	//workers processing a job, the walk is over when no job is left and nobody is busy
+	size_t busy;
+	size_t exited;
+	SDL_AtomicInt cancel;
+	bool running;
+
+	bool is_regexp;
+	char *pattern;
+	size_t pattern_len;
+	SearchPattern literal;
+
+	TrigramIndex index;
+	bool *candidates;
+	size_t indexed;
+	//the index misses some changes (the removed files are not walked), it is worth rebuilding
+	bool stale;
+
+	char root[GREP_PATH_LEN];
+	size_t root_len;
+
+	StringBuilder results;
+	Uint64 notified_at;
+	size_t files;
+	size_t matches;
+};
+
+/**
+ * Starts the workers, returns false when the pattern is invalid (see error)
+ */
+bool grep_start(Grep *grep, const char *root, const char *pattern, size_t pattern_len, bool is_regexp, char *error, size_t error_len);
+/**
+ * Stops the workers and waits for them, the results not taken are dropped
+ */
+void grep_cancel(Grep *grep);
+/**
+ * Moves the new results to out, returns true when the search is over and everything is taken
+ */
+bool grep_take(Grep *grep, StringBuilder *out);
+
+#endif
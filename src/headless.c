@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "headless.h"
+#include "smacs.h"
+#include "common.h"
+
+#define HEADLESS_DELIMITERS " \t\r\n"
+
+typedef struct {
+	char *name;
+	SDL_Keycode key;
+} HeadlessKeyName;
+
+static const HeadlessKeyName HeadlessKeyNames[] = {
+	{"RET", SDLK_RETURN},
+	{"TAB", SDLK_TAB},
+	{"DEL", SDLK_BACKSPACE},
+	{"SPC", SDLK_SPACE},
+	{"ESC", SDLK_ESCAPE},
+	{"F11", SDLK_F11},
+};
+
+#define HEADLESS_KEY_NAMES_LEN (sizeof(HeadlessKeyNames) / sizeof(HeadlessKeyNames[0]))
+
+//shifted symbols of the US layout, keys are matched by keycode + shift like SDL reports them
+static const char *HeadlessShifted = "~!@#$%^&*()_+{}|:\"<>?";
+static const char *HeadlessUnshifted = "`1234567890-=[]\\;',./";
+
+bool headless_parse_key(char *token, HeadlessKey *key)
+{
+	SDL_Keymod mod;
+	size_t len;
+
+	memset(key, 0, sizeof(*key));
+	mod = SDL_KMOD_NONE;
+
+	//modifiers are prefixes of a single key: C-x, M-f, C-M-b
+	while (token[0] != '\0' && token[1] == '-' && token[2] != '\0') {
+		if (token[0] == 'C') mod |= SDL_KMOD_CTRL;
+		else if (token[0] == 'M') mod |= SDL_KMOD_ALT;
+		else if (token[0] == 'S') mod |= SDL_KMOD_SHIFT;
+		else break;
+
+		token += 2;
+	}
+
+	//a plain space is a text input like any other printable key
+	if (mod == SDL_KMOD_NONE && 0 == strcmp(token, "SPC")) token = " ";
+
+	for (size_t i = 0; i < HEADLESS_KEY_NAMES_LEN; ++i) {
+		if (0 == strcmp(token, HeadlessKeyNames[i].name)) {
+			key->event.type = SDL_EVENT_KEY_DOWN;
+			key->event.key.key = HeadlessKeyNames[i].key;
+			key->event.key.mod = mod;
+			return true;
+		}
+	}
+
+	len = strlen(token);
+	if (len == 0 || len >= HEADLESS_KEY_LEN) return false;
+
+	if (mod != SDL_KMOD_NONE) {
+		char ch, *shifted;
+
+		if (len != 1) return false;
+
+		ch = token[0];
+		shifted = strchr(HeadlessShifted, ch);
+		if (shifted != NULL) {
+			ch = HeadlessUnshifted[shifted - HeadlessShifted];
+			mod |= SDL_KMOD_SHIFT;
+		} else if (isupper((unsigned char) ch)) {
+			ch = (char) tolower((unsigned char) ch);
+			mod |= SDL_KMOD_SHIFT;
+		}
+
+		key->event.type = SDL_EVENT_KEY_DOWN;
+		key->event.key.key = (SDL_Keycode) ch;
+		key->event.key.mod = mod;
+		return true;
+	}
+
+	memcpy(key->text, token, len);
+	key->event.type = SDL_EVENT_TEXT_INPUT;
+	return true;
+}
+
+/**
+ * Reads the key script, lines starting with # are comments. "-" is stdin.
+ */
+int headless_read_keys(char *keys_path, StringBuilder *keys)
+{
+	FILE *in;
+	int next;
+	bool line_start, comment;
+
+	in = strcmp(keys_path, "-") == 0 ? stdin : fopen(keys_path, "r");
+	if (in == NULL) {
+		fprintf(stderr, "Could not open keys file %s\n", keys_path);
+		return 1;
+	}
+
+	line_start = true;
+	comment = false;
+	while ((next = fgetc(in)) != EOF) {
+		if (line_start && next == '#') comment = true;
+		line_start = next == '\n';
+
+		if (comment) {
+			if (line_start) comment = false;
+			continue;
+		}
+
+		sb_append(keys, (char) next);
+	}
+	sb_append(keys, '\0');
+
+	if (in != stdin) fclose(in);
+
+	return 0;
+}
+
+double headless_elapsed_ms(Uint64 from, Uint64 to)
+{
+	return (double) (to - from) * 1000.0 / (double) SDL_GetPerformanceFrequency();
+}
+
+void headless_frame(Smacs *smacs, SmacsLoop *loop, FrameUpdate update, size_t frame, char *key)
+{
+	Uint64 begin, laid_out, drawn;
+
+	smacs_layout_panes(smacs);
+
+	begin = SDL_GetPerformanceCounter();
+	if (update == FRAME_RELAYOUT) {
+		render_update_glyph(smacs);
+	}
+	laid_out = SDL_GetPerformanceCounter();
+
+	if (update == FRAME_RELAYOUT) {
+		render_draw_smacs(smacs);
+	} else {
+		render_present(smacs);
+	}
+	drawn = SDL_GetPerformanceCounter();
+
+	smacs_frame_end(smacs, loop);
+
+	fprintf(stderr, "%ld\t%s\t%.3f\t%.3f\t%ld\n",
+			frame, key, headless_elapsed_ms(begin, laid_out), headless_elapsed_ms(laid_out, drawn), smacs->glyph.len);
+}
+
+/**
+ * Handles the events pushed by worker threads (search index, grep, shell)
+ * until grep, indexing and the shell command are over. A shell command may
+ * never exit or stop writing (yes, tail -f), so while it runs the wait ends
+ * after HEADLESS_SHELL_WAIT_MS.
+ */
+static void headless_wait(Smacs *smacs, SmacsLoop *loop)
+{
+	Uint64 shell_deadline = SDL_GetTicks() + HEADLESS_SHELL_WAIT_MS;
+	SDL_Event event;
+	bool got;
+
+	while ((got = SDL_WaitEventTimeout(&event, HEADLESS_WAIT_MS)) || smacs->editor.grep.running || smacs->editor.trigram_build.running || smacs->editor.shell.running) {
+		if (got && event.type == SDL_EVENT_USER) smacs_handle_event(smacs, loop, &event);
+		if (smacs->editor.shell.running && SDL_GetTicks() >= shell_deadline) break;
+	}
+}
+
+/**
+ * Opens the file without a display, replays the keys and draws every frame
+ * by the software renderer. Frame timings go to stderr, the glyph list of
+ * the last frame goes to stdout.
+ */
+int headless_launch(char *home_dir, char *fallback_ttf_path, char *file_path, char *keys_path)
+{
+	Smacs smacs = {0};
+	SmacsLoop loop = {0};
+	StringBuilder keys = {0};
+	HeadlessKey key;
+	FrameUpdate update;
+	SDL_Surface *surface;
+	char *token;
+	size_t frame;
+
+	if (headless_read_keys(keys_path, &keys) != 0) return 1;
+
+	surface = SDL_CreateSurface(HEADLESS_WIDTH, HEADLESS_HEIGHT, SDL_PIXELFORMAT_ARGB8888);
+	if (surface == NULL) {
+		fprintf(stderr, "Could not create surface: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	if (smacs_init(&smacs, home_dir, fallback_ttf_path, file_path, surface) != 0) {
+		return 1;
+	}
+
+	fprintf(stderr, "frame\tkey\tlayout_ms\tdraw_ms\tglyphs\n");
+	headless_frame(&smacs, &loop, FRAME_RELAYOUT, 0, "-");
+
+	frame = 1;
+	for (token = strtok(keys.data, HEADLESS_DELIMITERS); token != NULL && !loop.quit; token = strtok(NULL, HEADLESS_DELIMITERS)) {
+		if (0 == strcmp(token, "WAIT")) {
+			headless_wait(&smacs, &loop);
+			headless_frame(&smacs, &loop, FRAME_RELAYOUT, frame++, token);
+			continue;
+		}
+
+		if (!headless_parse_key(token, &key)) {
+			fprintf(stderr, "Unknown key %s\n", token);
+			continue;
+		}
+
+		//text points into the key, set it only when the key is not moved anymore
+		if (key.event.type == SDL_EVENT_TEXT_INPUT) key.event.text.text = key.text;
+
+		update = smacs_handle_event(&smacs, &loop, &key.event);
+		if (update == FRAME_SKIP) continue;
+
+		headless_frame(&smacs, &loop, update, frame++, token);
+	}
+
+	render_dump_glyph(&smacs, stdout);
+
+	smacs_destroy(&smacs);
+	SDL_DestroySurface(surface);
+	sb_free(&keys);
+
+	return 0;
+}
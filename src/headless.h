@@ -0,0 +1,26 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdbool.h>
+#include "render.h"
+
+#define HEADLESS_WIDTH  1000
+#define HEADLESS_HEIGHT 1200
+#define HEADLESS_KEY_LEN 64
+//WAIT handles the events of the background work until it is quiet for this long
+#define HEADLESS_WAIT_MS 200
+#define HEADLESS_SHELL_WAIT_MS 5000
+
+/**
+ * Key in the Emacs notation: C-x, M-f, C-M-b, RET, TAB, DEL, SPC, ESC, F11.
+ * Anything else is typed as a text input.
+ */
+typedef struct {
+	SDL_Event event;
+	char text[HEADLESS_KEY_LEN];
+} HeadlessKey;
+
+bool headless_parse_key(char *token, HeadlessKey *key);
+int headless_launch(char *home_dir, char *fallback_ttf_path, char *file_path, char *keys_path);
+
+#endif
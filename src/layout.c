@@ -0,0 +1,144 @@
+#include "layout.h"
+
+static size_t layout_leaf(Layout *layout, size_t pane)
+{
+	LayoutNode *node;
+
+	for (size_t i = 0; i < LAYOUT_NODES_MAX; ++i) {
+		node = &layout->nodes[i];
+		if (node->used && node->kind == LAYOUT_LEAF && node->pane == pane) return i;
+	}
+
+	return LAYOUT_NODES_MAX;
+}
+
+static size_t layout_alloc(Layout *layout, size_t after)
+{
+	for (size_t i = after; i < LAYOUT_NODES_MAX; ++i) {
+		if (!layout->nodes[i].used) return i;
+	}
+
+	return LAYOUT_NODES_MAX;
+}
+
+static size_t layout_first_pane(Layout *layout, size_t node)
+{
+	while (layout->nodes[node].kind != LAYOUT_LEAF) node = layout->nodes[node].children[0];
+
+	return layout->nodes[node].pane;
+}
+
+static void layout_leaves(Layout *layout, size_t node, size_t *panes, size_t *panes_len)
+{
+	if (layout->nodes[node].kind == LAYOUT_LEAF) {
+		panes[(*panes_len)++] = layout->nodes[node].pane;
+		return;
+	}
+
+	layout_leaves(layout, layout->nodes[node].children[0], panes, panes_len);
+	layout_leaves(layout, layout->nodes[node].children[1], panes, panes_len);
+}
+
+static void layout_node_rects(Layout *layout, size_t node, LayoutRect area, LayoutRect *rects)
+{
+	LayoutNode *split = &layout->nodes[node];
+	LayoutRect first, second;
+
+	if (split->kind == LAYOUT_LEAF) {
+		rects[split->pane] = area;
+		return;
+	}
+
+	first = area;
+	second = area;
+	if (split->kind == LAYOUT_COLUMNS) {
+		first.w = area.w / 2;
+		second.x = area.x + first.w;
+		second.w = area.w - first.w;
+	} else {
+		first.h = area.h / 2;
+		second.y = area.y + first.h;
+		second.h = area.h - first.h;
+	}
+
+	layout_node_rects(layout, split->children[0], first, rects);
+	layout_node_rects(layout, split->children[1], second, rects);
+}
+
+void layout_init(Layout *layout)
+{
+	*layout = (Layout) {0};
+	layout->nodes[0] = (LayoutNode) {.kind = LAYOUT_LEAF, .pane = 0, .used = true};
+	layout->root = 0;
+}
+
+bool layout_split(Layout *layout, size_t pane, size_t new_pane, LayoutKind kind)
+{
+	size_t node, first, second;
+
+	node = layout_leaf(layout, pane);
+	if (node == LAYOUT_NODES_MAX) return false;
+
+	first = layout_alloc(layout, 0);
+	if (first == LAYOUT_NODES_MAX) return false;
+	second = layout_alloc(layout, first + 1);
+	if (second == LAYOUT_NODES_MAX) return false;
+
+	//the leaf becomes the split, so its parent keeps pointing to it
+	layout->nodes[first] = (LayoutNode) {.kind = LAYOUT_LEAF, .pane = pane, .parent = node, .used = true};
+	layout->nodes[second] = (LayoutNode) {.kind = LAYOUT_LEAF, .pane = new_pane, .parent = node, .used = true};
+	layout->nodes[node].kind = kind;
+	layout->nodes[node].children[0] = first;
+	layout->nodes[node].children[1] = second;
+
+	return true;
+}
+
+size_t layout_remove(Layout *layout, size_t pane)
+{
+	size_t node, parent, sibling, parent_of_parent;
+
+	node = layout_leaf(layout, pane);
+	if (node == LAYOUT_NODES_MAX || node == layout->root) return pane;
+
+	parent = layout->nodes[node].parent;
+	sibling = layout->nodes[parent].children[0] == node ? layout->nodes[parent].children[1] : layout->nodes[parent].children[0];
+
+	//the sibling moves into the node of the split, the links to the split stay valid
+	parent_of_parent = layout->nodes[parent].parent;
+	layout->nodes[parent] = layout->nodes[sibling];
+	layout->nodes[parent].parent = parent_of_parent;
+	if (layout->nodes[parent].kind != LAYOUT_LEAF) {
+		layout->nodes[layout->nodes[parent].children[0]].parent = parent;
+		layout->nodes[layout->nodes[parent].children[1]].parent = parent;
+	}
+
+	layout->nodes[node].used = false;
+	layout->nodes[sibling].used = false;
+
+	return layout_first_pane(layout, parent);
+}
+
+void layout_rename(Layout *layout, size_t from, size_t to)
+{
+	size_t node = layout_leaf(layout, from);
+
+	if (node != LAYOUT_NODES_MAX) layout->nodes[node].pane = to;
+}
+
+size_t layout_next(Layout *layout, size_t pane)
+{
+	size_t panes[LAYOUT_PANES_MAX], panes_len = 0;
+
+	layout_leaves(layout, layout->root, panes, &panes_len);
+	for (size_t i = 0; i < panes_len; ++i) {
+		if (panes[i] == pane) return panes[(i + 1) % panes_len];
+	}
+
+	return pane;
+}
+
+void layout_rects(Layout *layout, LayoutRect area, LayoutRect *rects)
+{
+	layout_node_rects(layout, layout->root, area, rects);
+}
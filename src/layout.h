@@ -0,0 +1,71 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define LAYOUT_PANES_MAX 16
+//a tree of n leaves has n - 1 splits
+#define LAYOUT_NODES_MAX (LAYOUT_PANES_MAX * 2 - 1)
+
+typedef enum {
+	LAYOUT_LEAF,
+	LAYOUT_COLUMNS, //children side by side
+	LAYOUT_ROWS,    //children one above the other
+} LayoutKind;
+
+typedef struct {
+	int x;
+	int y;
+	int w;
+	int h;
+} LayoutRect;
+
+/**
+ * A leaf shows the pane, a split shares its rect in halves between its
+ * two children. The parent of the root is not used.
+ */
+typedef struct {
+	LayoutKind kind;
+	size_t pane;
+	size_t parent;
+	size_t children[2];
+	bool used;
+} LayoutNode;
+
+/**
+ * Split tree of the panes, they are identified by their index (see Editor.panes)
+ */
+typedef struct {
+	LayoutNode nodes[LAYOUT_NODES_MAX];
+	size_t root;
+} Layout;
+
+/**
+ * One leaf with the pane 0
+ */
+void layout_init(Layout *layout);
+/**
+ * The leaf of the pane becomes a split of the pane and the new pane (second).
+ * Returns false when there is no room for more nodes.
+ */
+bool layout_split(Layout *layout, size_t pane, size_t new_pane, LayoutKind kind);
+/**
+ * Removes the leaf of the pane, its sibling takes the place of the split.
+ * Returns the pane which takes the place of the removed one, the pane itself when it is the last.
+ */
+size_t layout_remove(Layout *layout, size_t pane);
+/**
+ * The pane got another index
+ */
+void layout_rename(Layout *layout, size_t from, size_t to);
+/**
+ * The next pane from left to right and top to bottom, the first after the last
+ */
+size_t layout_next(Layout *layout, size_t pane);
+/**
+ * Rects of the panes by their index, the root takes the whole area
+ */
+void layout_rects(Layout *layout, LayoutRect area, LayoutRect *rects);
+
+#endif
@@ -0,0 +1,78 @@
+#include <stdlib.h>
+
+#include "macro.h"
+
+static void macro_steps_clean(MacroSteps *steps)
+{
+	steps->len = 0;
+	sb_clean(&steps->text);
+}
+
+void macro_start(Macro *macro)
+{
+	macro_steps_clean(&macro->recording);
+	macro->prompt_start = 0;
+	macro->recording_on = true;
+}
+
+void macro_record(Macro *macro, SDL_Event *event)
+{
+	MacroStep step = {0};
+
+	if (!macro->recording_on || macro->replaying) return;
+
+	step.type = event->type;
+	if (event->type == SDL_EVENT_KEY_DOWN) {
+		step.key = event->key.key;
+		step.mod = event->key.mod;
+	} else if (event->type == SDL_EVENT_TEXT_INPUT) {
+		step.text_beg = macro->recording.text.len;
+		sb_append_many(&macro->recording.text, (char*)event->text.text);
+		sb_append(&macro->recording.text, '\0');
+	} else {
+		return;
+	}
+
+	gb_append(&macro->recording, step);
+}
+
+bool macro_stop(Macro *macro)
+{
+	MacroSteps steps;
+
+	macro->recording_on = false;
+	macro->recording.len = macro->prompt_start;
+	if (macro->recording.len == 0) return false;
+
+	steps = macro->last;
+	macro->last = macro->recording;
+	macro->recording = steps;
+	macro_steps_clean(&macro->recording);
+
+	return true;
+}
+
+SDL_Event macro_event(Macro *macro, size_t step)
+{
+	SDL_Event event = {0};
+	MacroStep *recorded = &macro->last.data[step];
+
+	event.type = recorded->type;
+	if (recorded->type == SDL_EVENT_KEY_DOWN) {
+		event.key.key = recorded->key;
+		event.key.mod = recorded->mod;
+		event.key.down = true;
+	} else {
+		event.text.text = &macro->last.text.data[recorded->text_beg];
+	}
+
+	return event;
+}
+
+void macro_free(Macro *macro)
+{
+	gb_free(&macro->recording);
+	gb_free(&macro->last);
+	sb_free(&macro->recording.text);
+	sb_free(&macro->last.text);
+}
@@ -0,0 +1,56 @@
+#ifndef MACRO_H
+#define MACRO_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "common.h"
+
+/**
+ * A key down or a text input, the text starts at text_beg of MacroSteps.text and ends with zero
+ */
+typedef struct {
+	Uint32 type;
+	SDL_Keycode key;
+	SDL_Keymod mod;
+	size_t text_beg;
+} MacroStep;
+
+typedef struct {
+	MacroStep *data;
+	size_t len;
+	size_t cap;
+	StringBuilder text;
+} MacroSteps;
+
+/**
+ * Keyboard macro. The events are recorded as they are handled, the last
+ * finished recording is replayed by the same dispatch as the keys.
+ */
+typedef struct {
+	MacroSteps recording;
+	MacroSteps last;
+	size_t prompt_start; //length of the recording before the C-x prompt, the prompt which stops it is dropped
+	bool recording_on;
+	bool replaying;
+	bool failed; //a command of the replayed step failed, the replay stops
+} Macro;
+
+void macro_start(Macro *macro);
+/**
+ * Keeps the key downs and the text inputs while the recording is on and nothing is replayed
+ */
+void macro_record(Macro *macro, SDL_Event *event);
+/**
+ * The recording without its last prompt becomes the last macro.
+ * Returns false when it is empty, the last macro stays then.
+ */
+bool macro_stop(Macro *macro);
+/**
+ * The event of the step of the last macro, its text lives until the next recording is stopped
+ */
+SDL_Event macro_event(Macro *macro, size_t step);
+void macro_free(Macro *macro);
+
+#endif
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <SDL3/SDL.h>
+
+#include "profiler.h"
+#include "common.h"
+
+Profiler profiler = {0};
+
+static const char *ProfileZoneNames[PROFILE_ZONES_LEN] = {
+	"event",
+	"determine_lines",
+	"lines_patch",
+	"tokenize",
+	"update_glyph",
+	"glyph_show",
+	"present",
+};
+
+#define PROFILER_AVERAGE_WEIGHT 0.1
+
+void profiler_init(void)
+{
+	profiler.origin_ticks = profiler_ticks();
+	profiler.origin_ns = SDL_GetTicksNS();
+	profiler.frame_end = profiler.origin_ticks;
+}
+
+uint64_t profiler_ticks(void)
+{
+#if defined(OS_LINUX) && (defined(__x86_64__) || defined(__i386__))
+	return rdtsc();
+#else
+	return SDL_GetPerformanceCounter();
+#endif
+}
+
+/**
+ * Tick rate is measured against the SDL clock from the start of the profiler
+ */
+double profiler_ticks_to_ms(uint64_t ticks)
+{
+	uint64_t elapsed_ticks, elapsed_ns;
+
+	elapsed_ticks = profiler_ticks() - profiler.origin_ticks;
+	elapsed_ns = SDL_GetTicksNS() - profiler.origin_ns;
+	if (elapsed_ticks == 0 || elapsed_ns == 0) return 0.0;
+
+	return (double) ticks * ((double) elapsed_ns / (double) elapsed_ticks) / 1000000.0;
+}
+
+ProfileScope profiler_begin(ProfileZone zone)
+{
+	return (ProfileScope) {zone, profiler_ticks()};
+}
+
+void profiler_end(ProfileScope scope)
+{
+	ProfileEvent *event;
+	size_t index;
+
+	index = atomic_fetch_add_explicit(&profiler.head, 1, memory_order_relaxed);
+	event = &profiler.ring[index & (PROFILER_RING_SIZE - 1)];
+
+	atomic_store_explicit(&event->seq, 0, memory_order_relaxed);
+	//the slot is marked as being written before it is
+	atomic_thread_fence(memory_order_release);
+	event->zone = scope.zone;
+	event->frame = atomic_load_explicit(&profiler.frame, memory_order_relaxed);
+	event->thread = (uint64_t) SDL_GetCurrentThreadID();
+	event->begin = scope.begin;
+	event->end = profiler_ticks();
+	atomic_store_explicit(&event->seq, index + 1, memory_order_release);
+}
+
+/**
+ * Copies the event of the index (from 0), false when its slot is being
+ * written or was taken by a later event before the copy was finished
+ */
+static bool profiler_read(size_t index, ProfileEvent *copy)
+{
+	ProfileEvent *event;
+
+	event = &profiler.ring[index & (PROFILER_RING_SIZE - 1)];
+	if (atomic_load_explicit(&event->seq, memory_order_acquire) != index + 1) return false;
+
+	copy->zone = event->zone;
+	copy->frame = event->frame;
+	copy->thread = event->thread;
+	copy->begin = event->begin;
+	copy->end = event->end;
+
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&event->seq, memory_order_relaxed) == index + 1;
+}
+
+void profiler_count(ProfileCounter counter)
+{
+	atomic_fetch_add_explicit(&profiler.counters[counter], 1, memory_order_relaxed);
+}
+
+/**
+ * Sums up the events of the frame which is finished and starts the next one
+ */
+void profiler_frame_end(void)
+{
+	ProfileEvent event;
+	size_t head, index;
+	uint32_t frame;
+	uint64_t now;
+	double ms;
+
+	frame = atomic_load_explicit(&profiler.frame, memory_order_relaxed);
+	head = atomic_load_explicit(&profiler.head, memory_order_acquire);
+
+	for (size_t zone = 0; zone < PROFILE_ZONES_LEN; ++zone) profiler.frame_ticks[zone] = 0;
+
+	for (index = head; index > 0 && head - index < PROFILER_RING_SIZE; --index) {
+		if (!profiler_read(index - 1, &event)) continue;
+		if (event.frame != frame) break;
+
+		profiler.frame_ticks[event.zone] += event.end - event.begin;
+	}
+
+	for (size_t zone = 0; zone < PROFILE_ZONES_LEN; ++zone) {
+		ms = profiler_ticks_to_ms(profiler.frame_ticks[zone]);
+		profiler.average_ms[zone] += (ms - profiler.average_ms[zone]) * PROFILER_AVERAGE_WEIGHT;
+	}
+
+	for (size_t counter = 0; counter < PROFILE_COUNTERS_LEN; ++counter) {
+		profiler.frame_counters[counter] = atomic_exchange_explicit(&profiler.counters[counter], 0, memory_order_relaxed);
+	}
+
+	now = profiler_ticks();
+	profiler.frame_ms = profiler_ticks_to_ms(now - profiler.frame_end);
+	profiler.frame_average_ms += (profiler.frame_ms - profiler.frame_average_ms) * PROFILER_AVERAGE_WEIGHT;
+	profiler.frame_end = now;
+
+	atomic_store_explicit(&profiler.frame, frame + 1, memory_order_relaxed);
+}
+
+const char *profiler_zone_name(ProfileZone zone)
+{
+	return ProfileZoneNames[zone];
+}
+
+/**
+ * Text cache hit rate of the last frame in percents, negative when nothing was drawn
+ */
+double profiler_cache_hit_rate(void)
+{
+	uint64_t hits, total;
+
+	hits = profiler.frame_counters[PROFILE_CACHE_HIT];
+	total = hits + profiler.frame_counters[PROFILE_CACHE_MISS];
+	if (total == 0) return -1.0;
+
+	return (double) hits * 100.0 / (double) total;
+}
+
+/**
+ * Writes the events of the ring buffer in the Chrome trace event format
+ * (chrome://tracing, https://ui.perfetto.dev)
+ */
+int profiler_export_chrome_trace(const char *path)
+{
+	FILE *out;
+	ProfileEvent event;
+	size_t head, index;
+	bool first;
+
+	out = fopen(path, "w");
+	if (out == NULL) {
+		fprintf(stderr, "Could not open trace file %s\n", path);
+		return 1;
+	}
+
+	head = atomic_load_explicit(&profiler.head, memory_order_acquire);
+	index = head > PROFILER_RING_SIZE ? head - PROFILER_RING_SIZE : 0;
+	first = true;
+
+	fprintf(out, "{\"traceEvents\":[\n");
+	for (; index < head; ++index) {
+		if (!profiler_read(index, &event)) continue;
+
+		//every thread is a track of its own
+		fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+				first ? "" : ",\n",
+				ProfileZoneNames[event.zone],
+				(unsigned long long) event.thread,
+				profiler_ticks_to_ms(event.begin - profiler.origin_ticks) * 1000.0,
+				profiler_ticks_to_ms(event.end - event.begin) * 1000.0,
+				event.frame);
+		first = false;
+	}
+	fprintf(out, "\n]}\n");
+
+	fclose(out);
+	return 0;
+}
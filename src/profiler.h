@@ -0,0 +1,88 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define PROFILER_RING_SIZE 8192 /* power of two */
+#define PROFILER_TRACE_FILE "smacs_trace.json"
+
+typedef enum {
+	PROFILE_EVENT,
+	PROFILE_DETERMINE_LINES,
+	PROFILE_LINES_PATCH,
+	PROFILE_TOKENIZE,
+	PROFILE_UPDATE_GLYPH,
+	PROFILE_GLYPH_SHOW,
+	PROFILE_PRESENT,
+	PROFILE_ZONES_LEN,
+} ProfileZone;
+
+typedef enum {
+	PROFILE_CACHE_HIT,
+	PROFILE_CACHE_MISS,
+	PROFILE_PANE_LAID_OUT,
+	PROFILE_PANE_REUSED,
+	PROFILE_COUNTERS_LEN,
+} ProfileCounter;
+
+/**
+ * seq is the index of the event + 1 once the slot is written, 0 while it is
+ * written. A reader copies the slot and drops the copy when seq changed meanwhile.
+ */
+typedef struct {
+	atomic_size_t seq;
+	ProfileZone zone;
+	uint32_t frame;
+	uint64_t thread;
+	uint64_t begin;
+	uint64_t end;
+} ProfileEvent;
+
+typedef struct {
+	ProfileZone zone;
+	uint64_t begin;
+} ProfileScope;
+
+/**
+ * Timings of the hot paths in a lock-free ring buffer: writers claim a slot
+ * by an atomic increment, the oldest events are overwritten.
+ */
+typedef struct {
+	ProfileEvent ring[PROFILER_RING_SIZE];
+	atomic_size_t head;
+	atomic_uint frame;
+	atomic_uint_fast64_t counters[PROFILE_COUNTERS_LEN];
+
+	bool overlay;
+
+	//last finished frame, averages are exponential
+	uint64_t frame_ticks[PROFILE_ZONES_LEN];
+	double average_ms[PROFILE_ZONES_LEN];
+	uint64_t frame_counters[PROFILE_COUNTERS_LEN];
+	uint64_t frame_end;
+	double frame_ms, frame_average_ms;
+
+	//to convert ticks into time
+	uint64_t origin_ticks;
+	uint64_t origin_ns;
+} Profiler;
+
+extern Profiler profiler;
+
+void profiler_init(void);
+uint64_t profiler_ticks(void);
+double profiler_ticks_to_ms(uint64_t ticks);
+
+ProfileScope profiler_begin(ProfileZone zone);
+void profiler_end(ProfileScope scope);
+void profiler_count(ProfileCounter counter);
+void profiler_frame_end(void);
+
+const char *profiler_zone_name(ProfileZone zone);
+double profiler_cache_hit_rate(void);
+int profiler_export_chrome_trace(const char *path);
+
+#endif
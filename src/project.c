@@ -0,0 +1,396 @@
+#ifndef _DEFAULT_SOURCE
+//openat, fdopendir and d_type are not in C11
+#define _DEFAULT_SOURCE
+#endif
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "project.h"
+
+typedef struct {
+	char *path;
+	size_t depth;
+} ProjectJob;
+
+typedef struct {
+	ProjectJob *data;
+	size_t len;
+	size_t cap;
+} ProjectJobs;
+
+/**
+ * Directories are jobs of one shared stack like in grep, a worker publishes
+ * the entries of a directory at once and pushes its subdirectories back
+ */
+typedef struct {
+	Project *previous;
+	Project *out;
+	int root_fd;
+
+	SDL_Mutex *lock;
+	SDL_Condition *wake;
+	ProjectJobs jobs;
+	size_t busy;
+} ProjectWalk;
+
+typedef struct {
+	ProjectWalk *walk;
+	StringBuilder names;
+	ProjectEntries entries;
+} ProjectWorker;
+
+void project_find_root(const char *dir, char *root, size_t root_len)
+{
+	char marker[PROJECT_PATH_LEN];
+	struct stat marker_stat;
+	size_t len;
+
+	snprintf(root, root_len, "%s", dir);
+
+	for (len = strlen(root); len > 0; --len) {
+		if (len != strlen(root) && root[len] != '/') continue;
+
+		if ((size_t) snprintf(marker, PROJECT_PATH_LEN, "%.*s/%s", (int) len, root, PROJECT_ROOT_MARKER) >= PROJECT_PATH_LEN) break;
+		if (stat(marker, &marker_stat) == 0) {
+			root[len] = '\0';
+			return;
+		}
+	}
+
+	snprintf(root, root_len, "%s", dir);
+}
+
+static void project_load_ignores(Project *project)
+{
+	char path[PROJECT_PATH_LEN], line[PROJECT_PATH_LEN];
+	ProjectIgnore ignore;
+	size_t len;
+	FILE *in;
+
+	snprintf(path, PROJECT_PATH_LEN, "%s/%s", project->root, PROJECT_IGNORE_FILE);
+	in = fopen(path, "r");
+	if (in == NULL) return;
+
+	while (fgets(line, PROJECT_PATH_LEN, in) != NULL) {
+		len = strcspn(line, "\r\n");
+		while (len > 0 && line[len - 1] == ' ') --len;
+		line[len] = '\0';
+
+		//negations are not supported, the files stay ignored
+		if (len == 0 || line[0] == '#' || line[0] == '!') continue;
+
+		ignore.dir_only = line[len - 1] == '/';
+		if (ignore.dir_only) line[--len] = '\0';
+		if (len == 0) continue;
+
+		ignore.has_slash = strchr(line, '/') != NULL;
+		ignore.pattern = strdup(line[0] == '/' ? &line[1] : line);
+		gb_append(&project->ignores, ignore);
+	}
+
+	fclose(in);
+}
+
+static bool project_is_ignored(Project *project, const char *path, const char *name, bool is_dir)
+{
+	ProjectIgnore *ignore;
+
+	//hidden entries (.git) are skipped like in grep
+	if (name[0] == '.') return true;
+
+	for (size_t i = 0; i < project->ignores.len; ++i) {
+		ignore = &project->ignores.data[i];
+		if (ignore->dir_only && !is_dir) continue;
+
+		if (ignore->has_slash) {
+			if (fnmatch(ignore->pattern, path, FNM_PATHNAME) == 0) return true;
+		} else if (fnmatch(ignore->pattern, name, 0) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static char *project_join(const char *path, const char *name)
+{
+	size_t path_len = strlen(path), name_len = strlen(name);
+	char *joined = malloc(path_len + name_len + 2);
+
+	if (path_len == 0) {
+		memcpy(joined, name, name_len + 1);
+	} else {
+		memcpy(joined, path, path_len);
+		joined[path_len] = '/';
+		memcpy(&joined[path_len + 1], name, name_len + 1);
+	}
+
+	return joined;
+}
+
+/**
+ * Appends the directory and its entries (names of the entries are in base) to the snapshot
+ */
+static void project_publish(ProjectWalk *walk, ProjectJob *job, struct stat *dir_stat, const char *base, ProjectEntry *entries, size_t entries_len)
+{
+	Project *out = walk->out;
+	ProjectDir dir;
+	const char *name;
+
+	SDL_LockMutex(walk->lock);
+
+	dir.path = out->names.len;
+	sb_append_manyl(&out->names, job->path, strlen(job->path) + 1);
+	dir.mtime_sec = (int64_t) dir_stat->st_mtim.tv_sec;
+	dir.mtime_nsec = (int64_t) dir_stat->st_mtim.tv_nsec;
+	dir.entries_beg = out->entries.len;
+	dir.entries_len = entries_len;
+
+	for (size_t i = 0; i < entries_len; ++i) {
+		name = &base[entries[i].name];
+		gb_append(&out->entries, ((ProjectEntry) {out->names.len, entries[i].is_dir}));
+		sb_append_manyl(&out->names, (char *) name, strlen(name) + 1);
+
+		if (entries[i].is_dir && job->depth + 1 < PROJECT_DEPTH_LIMIT) {
+			gb_append(&walk->jobs, ((ProjectJob) {project_join(job->path, name), job->depth + 1}));
+		}
+	}
+	gb_append(&out->dirs, dir);
+
+	SDL_BroadcastCondition(walk->wake);
+	SDL_UnlockMutex(walk->lock);
+}
+
+/**
+ * Reads the directory by d_type, only the entries of unknown type are stat'ed
+ */
+static void project_read_dir(ProjectWorker *worker, ProjectJob *job)
+{
+	ProjectWalk *walk = worker->walk;
+	Project *previous = walk->previous;
+	ProjectDir *old;
+	struct stat dir_stat, entry_stat;
+	struct dirent *entry;
+	char *path;
+	uintptr_t found;
+	bool is_dir;
+	DIR *dir;
+	int fd;
+
+	path = job->path[0] == '\0' ? "." : job->path;
+	if (fstatat(walk->root_fd, path, &dir_stat, 0) != 0) return;
+
+	if (previous->has_dirs_by_path) {
+		found = (uintptr_t) hashmap_get(&previous->dirs_by_path, job->path, (hashmap_uint32_t) strlen(job->path) + 1);
+		old = found > 0 ? &previous->dirs.data[found - 1] : NULL;
+
+		if (old != NULL && old->mtime_sec == (int64_t) dir_stat.st_mtim.tv_sec && old->mtime_nsec == (int64_t) dir_stat.st_mtim.tv_nsec) {
+			project_publish(walk, job, &dir_stat, previous->names.data, &previous->entries.data[old->entries_beg], old->entries_len);
+			SDL_LockMutex(walk->lock);
+			walk->out->dirs_reused++;
+			SDL_UnlockMutex(walk->lock);
+			return;
+		}
+	}
+
+	fd = openat(walk->root_fd, path, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) return;
+	dir = fdopendir(fd);
+	if (dir == NULL) {
+		close(fd);
+		return;
+	}
+
+	worker->names.len = 0;
+	worker->entries.len = 0;
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_type == DT_DIR || entry->d_type == DT_REG) {
+			is_dir = entry->d_type == DT_DIR;
+		} else {
+			if (fstatat(fd, entry->d_name, &entry_stat, 0) != 0) continue;
+			if (!S_ISDIR(entry_stat.st_mode) && !S_ISREG(entry_stat.st_mode)) continue;
+			is_dir = S_ISDIR(entry_stat.st_mode);
+
+			//a link can point back to its parent
+			if (is_dir && entry->d_type == DT_LNK) continue;
+		}
+
+		path = project_join(job->path, entry->d_name);
+		if (!project_is_ignored(walk->out, path, entry->d_name, is_dir)) {
+			gb_append(&worker->entries, ((ProjectEntry) {worker->names.len, is_dir}));
+			sb_append_manyl(&worker->names, entry->d_name, strlen(entry->d_name) + 1);
+		}
+		free(path);
+	}
+	closedir(dir);
+
+	project_publish(walk, job, &dir_stat, worker->names.data, worker->entries.data, worker->entries.len);
+	SDL_LockMutex(walk->lock);
+	walk->out->dirs_read++;
+	SDL_UnlockMutex(walk->lock);
+}
+
+static int project_worker(void *data)
+{
+	ProjectWorker *worker = data;
+	ProjectWalk *walk = worker->walk;
+	ProjectJob job;
+
+	SDL_LockMutex(walk->lock);
+	while (true) {
+		while (walk->jobs.len == 0 && walk->busy > 0) SDL_WaitCondition(walk->wake, walk->lock);
+		if (walk->jobs.len == 0) break;
+
+		job = walk->jobs.data[--walk->jobs.len];
+		++walk->busy;
+		SDL_UnlockMutex(walk->lock);
+
+		project_read_dir(worker, &job);
+		free(job.path);
+
+		SDL_LockMutex(walk->lock);
+		--walk->busy;
+		if (walk->busy == 0 && walk->jobs.len == 0) SDL_BroadcastCondition(walk->wake);
+	}
+	SDL_UnlockMutex(walk->lock);
+
+	return 0;
+}
+
+static int project_path_compare(const void *a, const void *b)
+{
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/**
+ * Lists the files of the snapshot as sorted relative paths
+ */
+static void project_collect_files(Project *project)
+{
+	ProjectDir *dir;
+	ProjectEntry *entry;
+	char *dir_path;
+	size_t offset;
+
+	for (size_t i = 0; i < project->dirs.len; ++i) {
+		dir = &project->dirs.data[i];
+		dir_path = &project->names.data[dir->path];
+
+		for (size_t j = 0; j < dir->entries_len; ++j) {
+			entry = &project->entries.data[dir->entries_beg + j];
+			if (entry->is_dir) continue;
+
+			if (dir_path[0] != '\0') {
+				sb_append_many(&project->paths, dir_path);
+				sb_append(&project->paths, '/');
+			}
+			sb_append_manyl(&project->paths, &project->names.data[entry->name], strlen(&project->names.data[entry->name]) + 1);
+		}
+	}
+
+	//the arena is complete, the pointers do not move anymore
+	for (offset = 0; offset < project->paths.len; offset += strlen(&project->paths.data[offset]) + 1) {
+		gb_append(&project->files, &project->paths.data[offset]);
+	}
+	if (project->files.len > 0) qsort(project->files.data, project->files.len, sizeof(char *), project_path_compare);
+
+	//the keys include the terminating zero, so the root ("") is a key too
+	hashmap_create(1024, &project->dirs_by_path);
+	project->has_dirs_by_path = true;
+	for (size_t i = 0; i < project->dirs.len; ++i) {
+		dir_path = &project->names.data[project->dirs.data[i].path];
+		hashmap_put(&project->dirs_by_path, dir_path, (hashmap_uint32_t) strlen(dir_path) + 1, (void *) (uintptr_t) (i + 1));
+	}
+}
+
+void project_free(Project *project)
+{
+	sb_free(&project->names);
+	gb_free(&project->dirs);
+	project->dirs.data = NULL;
+	gb_free(&project->entries);
+	project->entries.data = NULL;
+	if (project->has_dirs_by_path) hashmap_destroy(&project->dirs_by_path);
+	project->has_dirs_by_path = false;
+
+	sb_free(&project->paths);
+	gb_free(&project->files);
+	project->files.data = NULL;
+
+	for (size_t i = 0; i < project->ignores.len; ++i) free(project->ignores.data[i].pattern);
+	gb_free(&project->ignores);
+	project->ignores.data = NULL;
+}
+
+static bool project_ignores_equal(ProjectIgnores *a, ProjectIgnores *b)
+{
+	if (a->len != b->len) return false;
+
+	for (size_t i = 0; i < a->len; ++i) {
+		if (strcmp(a->data[i].pattern, b->data[i].pattern) != 0) return false;
+		if (a->data[i].dir_only != b->data[i].dir_only || a->data[i].has_slash != b->data[i].has_slash) return false;
+	}
+
+	return true;
+}
+
+void project_refresh(Project *project, const char *root, bool ignores)
+{
+	ProjectWorker workers[PROJECT_WORKERS_MAX] = {0};
+	SDL_Thread *threads[PROJECT_WORKERS_MAX] = {0};
+	ProjectWalk walk = {0};
+	Project next = {0};
+	size_t workers_len;
+	int cores;
+
+	next.root_len = (size_t) snprintf(next.root, PROJECT_PATH_LEN, "%s", root);
+	if (ignores) project_load_ignores(&next);
+
+	//another root or other ignores have nothing to reuse
+	if (strcmp(project->root, root) != 0 || !project_ignores_equal(&project->ignores, &next.ignores)) project_free(project);
+
+	walk.root_fd = open(root, O_RDONLY | O_DIRECTORY);
+	if (walk.root_fd < 0) {
+		fprintf(stderr, "Could not open project root %s\n", root);
+		project_free(&next);
+		return;
+	}
+
+	walk.previous = project;
+	walk.out = &next;
+	walk.lock = SDL_CreateMutex();
+	walk.wake = SDL_CreateCondition();
+	gb_append(&walk.jobs, ((ProjectJob) {strdup(""), 0}));
+
+	cores = SDL_GetNumLogicalCPUCores();
+	workers_len = (size_t) MAX(1, MIN(cores, PROJECT_WORKERS_MAX));
+	for (size_t i = 0; i < workers_len; ++i) {
+		workers[i].walk = &walk;
+		//the caller waits anyway, so the first worker is the calling thread
+		if (i > 0) threads[i] = SDL_CreateThread(project_worker, "project", &workers[i]);
+	}
+	project_worker(&workers[0]);
+
+	for (size_t i = 0; i < workers_len; ++i) {
+		if (threads[i] != NULL) SDL_WaitThread(threads[i], NULL);
+		sb_free(&workers[i].names);
+		gb_free(&workers[i].entries);
+	}
+
+	close(walk.root_fd);
+	gb_free(&walk.jobs);
+	SDL_DestroyCondition(walk.wake);
+	SDL_DestroyMutex(walk.lock);
+
+	project_collect_files(&next);
+	project_free(project);
+	*project = next;
+}
@@ -0,0 +1,104 @@
+#ifndef PROJECT_H
+#define PROJECT_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "hashmap.h"
+
+#define PROJECT_PATH_LEN 4096
+#define PROJECT_WORKERS_MAX 64
+#define PROJECT_DEPTH_LIMIT 64
+//the root is the closest parent with it, otherwise the editor dir
+#define PROJECT_ROOT_MARKER ".git"
+#define PROJECT_IGNORE_FILE ".gitignore"
+
+typedef struct {
+	size_t name; //offset in names
+	bool is_dir;
+} ProjectEntry;
+
+typedef struct {
+	ProjectEntry *data;
+	size_t len;
+	size_t cap;
+} ProjectEntries;
+
+/**
+ * A directory is read again only when its mtime changes, otherwise its
+ * entries are copied from the previous snapshot
+ */
+typedef struct {
+	size_t path; //offset in names, relative to the root
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	size_t entries_beg;
+	size_t entries_len;
+} ProjectDir;
+
+typedef struct {
+	ProjectDir *data;
+	size_t len;
+	size_t cap;
+} ProjectDirs;
+
+typedef struct {
+	char **data;
+	size_t len;
+	size_t cap;
+} ProjectFiles;
+
+/**
+ * .gitignore lines: "*.o" matches names, "/build" and "a/b" paths from the root, "dir/" only directories
+ */
+typedef struct {
+	char *pattern;
+	bool has_slash;
+	bool dir_only;
+} ProjectIgnore;
+
+typedef struct {
+	ProjectIgnore *data;
+	size_t len;
+	size_t cap;
+} ProjectIgnores;
+
+/**
+ * Snapshot of the files under the root. All the strings live in two
+ * arenas: names (directory paths and entry names) and paths (relative
+ * paths of the files, sorted in files).
+ */
+typedef struct {
+	char root[PROJECT_PATH_LEN];
+	size_t root_len;
+
+	StringBuilder names;
+	ProjectDirs dirs;
+	ProjectEntries entries;
+	struct hashmap_s dirs_by_path;
+	bool has_dirs_by_path;
+
+	StringBuilder paths;
+	ProjectFiles files;
+	ProjectIgnores ignores;
+
+	size_t dirs_read;
+	size_t dirs_reused;
+} Project;
+
+/**
+ * Closest parent of the dir with PROJECT_ROOT_MARKER, the dir itself when there is none
+ */
+void project_find_root(const char *dir, char *root, size_t root_len);
+/**
+ * Walks the root by a pool of threads, a snapshot of the same root is
+ * refreshed by reading only the changed directories. Without ignores the
+ * PROJECT_IGNORE_FILE is not read, only the hidden entries are skipped.
+ */
+void project_refresh(Project *project, const char *root, bool ignores);
+void project_free(Project *project);
+
+#endif
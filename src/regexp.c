@@ -0,0 +1,1032 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "regexp.h"
+#include "common.h"
+#include "utf8.h"
+
+#define REGEXP_END 256
+#define REGEXP_DFA_PREV_NEWLINE 0x1
+#define REGEXP_DFA_PREV_WORD    0x2
+
+typedef enum {
+	NODE_SET,
+	NODE_CONCAT,
+	NODE_ALTERNATE,
+	NODE_REPEAT,
+	NODE_ASSERT,
+	NODE_EMPTY,
+} RegexpNodeKind;
+
+typedef struct {
+	RegexpNodeKind kind;
+	int left, right;
+	int min, max; //max -1 is infinity
+	bool greedy;
+	uint32_t arg;
+} RegexpNode;
+
+typedef struct {
+	Regexp *regexp;
+	const char *pattern;
+	size_t len;
+	size_t pos;
+	int flags;
+
+	struct {
+		RegexpNode *data;
+		size_t len;
+		size_t cap;
+	} nodes;
+} RegexpParser;
+
+static int regexp_parse_alternate(RegexpParser *parser);
+
+static bool regexp_is_word(int ch)
+{
+	return ch != REGEXP_END && (ch >= 0x80 || ch == '_' || (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z'));
+}
+
+static inline bool regexp_set_has(RegexpByteSet *set, int ch)
+{
+	return (set->bits[ch >> 3] >> (ch & 7)) & 1;
+}
+
+static inline void regexp_set_add(RegexpByteSet *set, int ch)
+{
+	set->bits[ch >> 3] |= (uint8_t) (1 << (ch & 7));
+}
+
+static void regexp_set_add_range(RegexpByteSet *set, int lo, int hi)
+{
+	for (int ch = lo; ch <= hi; ++ch) regexp_set_add(set, ch);
+}
+
+/*
+ * Parser, the pattern is parsed into a tree first, repetitions copy subtrees while compiling
+ */
+
+static bool regexp_error(RegexpParser *parser, const char *message)
+{
+	if (parser->regexp->error[0] == '\0') {
+		snprintf(parser->regexp->error, REGEXP_ERROR_LEN, "%s at %ld", message, parser->pos);
+	}
+
+	return false;
+}
+
+static int regexp_node(RegexpParser *parser, RegexpNode node)
+{
+	gb_append(&parser->nodes, node);
+	return (int) parser->nodes.len - 1;
+}
+
+static int regexp_binary(RegexpParser *parser, RegexpNodeKind kind, int left, int right)
+{
+	if (left < 0 || right < 0) return -1;
+	if (kind == NODE_CONCAT && parser->nodes.data[left].kind == NODE_EMPTY) return right;
+
+	return regexp_node(parser, (RegexpNode) {.kind = kind, .left = left, .right = right});
+}
+
+static uint32_t regexp_new_set(Regexp *regexp)
+{
+	gb_append(&regexp->sets, ((RegexpByteSet) {0}));
+	return (uint32_t) regexp->sets.len - 1;
+}
+
+static void regexp_set_fold(RegexpParser *parser, RegexpByteSet *set)
+{
+	if ((parser->flags & REGEXP_ICASE) == 0) return;
+
+	for (int ch = 'a'; ch <= 'z'; ++ch) {
+		if (regexp_set_has(set, ch) || regexp_set_has(set, ch - 'a' + 'A')) {
+			regexp_set_add(set, ch);
+			regexp_set_add(set, ch - 'a' + 'A');
+		}
+	}
+}
+
+static int regexp_set_node(RegexpParser *parser, RegexpByteSet set)
+{
+	uint32_t index;
+
+	regexp_set_fold(parser, &set);
+	index = regexp_new_set(parser->regexp);
+	parser->regexp->sets.data[index] = set;
+
+	return regexp_node(parser, (RegexpNode) {.kind = NODE_SET, .arg = index});
+}
+
+static int regexp_byte_node(RegexpParser *parser, int lo, int hi)
+{
+	RegexpByteSet set = {0};
+
+	regexp_set_add_range(&set, lo, hi);
+	return regexp_set_node(parser, set);
+}
+
+/**
+ * Any multibyte UTF-8 char
+ */
+static int regexp_non_ascii_node(RegexpParser *parser)
+{
+	int two, three, four;
+
+	two = regexp_binary(parser, NODE_CONCAT, regexp_byte_node(parser, 0xC0, 0xDF), regexp_byte_node(parser, 0x80, 0xBF));
+
+	three = regexp_byte_node(parser, 0xE0, 0xEF);
+	for (int i = 0; i < 2; ++i) three = regexp_binary(parser, NODE_CONCAT, three, regexp_byte_node(parser, 0x80, 0xBF));
+
+	four = regexp_byte_node(parser, 0xF0, 0xF7);
+	for (int i = 0; i < 3; ++i) four = regexp_binary(parser, NODE_CONCAT, four, regexp_byte_node(parser, 0x80, 0xBF));
+
+	return regexp_binary(parser, NODE_ALTERNATE, two, regexp_binary(parser, NODE_ALTERNATE, three, four));
+}
+
+static int regexp_char_node(RegexpParser *parser, const char *str, size_t len)
+{
+	RegexpByteSet set = {0};
+	int node;
+
+	regexp_set_add(&set, (unsigned char) str[0]);
+	node = regexp_set_node(parser, set);
+
+	for (size_t i = 1; i < len; ++i) {
+		memset(&set, 0, sizeof(set));
+		regexp_set_add(&set, (unsigned char) str[i]);
+		node = regexp_binary(parser, NODE_CONCAT, node, regexp_set_node(parser, set));
+	}
+
+	return node;
+}
+
+/**
+ * Adds \d \w \s (or their negations in ASCII), tells whether it was such an escape
+ */
+static bool regexp_class_escape(char escape, RegexpByteSet *set, bool *negated)
+{
+	RegexpByteSet class = {0};
+
+	switch (escape) {
+	case 'd': case 'D':
+		regexp_set_add_range(&class, '0', '9');
+		break;
+	case 'w': case 'W':
+		regexp_set_add_range(&class, '0', '9');
+		regexp_set_add_range(&class, 'a', 'z');
+		regexp_set_add_range(&class, 'A', 'Z');
+		regexp_set_add(&class, '_');
+		break;
+	case 's': case 'S':
+		regexp_set_add(&class, ' ');
+		regexp_set_add_range(&class, '\t', '\r');
+		break;
+	default:
+		return false;
+	}
+
+	*negated = escape == 'D' || escape == 'W' || escape == 'S';
+	for (int ch = 0; ch < 0x80; ++ch) {
+		if (regexp_set_has(&class, ch) != *negated) regexp_set_add(set, ch);
+	}
+
+	return true;
+}
+
+static int regexp_escaped_byte(char escape)
+{
+	switch (escape) {
+	case 'n': return '\n';
+	case 't': return '\t';
+	case 'r': return '\r';
+	case 'f': return '\f';
+	case 'v': return '\v';
+	default: return (unsigned char) escape;
+	}
+}
+
+static size_t regexp_char_len(RegexpParser *parser)
+{
+	size_t len = utf8_size_char(parser->pattern[parser->pos]);
+
+	return MIN(MAX(len, 1), parser->len - parser->pos);
+}
+
+static int regexp_parse_class(RegexpParser *parser)
+{
+	RegexpByteSet set = {0};
+	struct {
+		int *data;
+		size_t len;
+		size_t cap;
+	} multibyte = {0};
+	bool negate, first, non_ascii, negated;
+	size_t char_len;
+	int lo, hi, node;
+
+	negate = parser->pos < parser->len && parser->pattern[parser->pos] == '^';
+	if (negate) ++parser->pos;
+
+	non_ascii = false;
+	first = true;
+	while (parser->pos < parser->len && (first || parser->pattern[parser->pos] != ']')) {
+		first = false;
+
+		if (parser->pattern[parser->pos] == '\\' && parser->pos + 1 < parser->len) {
+			parser->pos += 2;
+			if (regexp_class_escape(parser->pattern[parser->pos - 1], &set, &negated)) {
+				non_ascii |= negated;
+				continue;
+			}
+			lo = regexp_escaped_byte(parser->pattern[parser->pos - 1]);
+		} else {
+			char_len = regexp_char_len(parser);
+			if (char_len > 1) {
+				//multibyte chars are alternatives of byte sequences
+				gb_append(&multibyte, (int) parser->pos);
+				parser->pos += char_len;
+				if (parser->pos < parser->len && parser->pattern[parser->pos] == '-' && parser->pos + 1 < parser->len && parser->pattern[parser->pos + 1] != ']') {
+					gb_free(&multibyte);
+					return regexp_error(parser, "Ranges of non-ASCII chars are not supported"), -1;
+				}
+				continue;
+			}
+			lo = (unsigned char) parser->pattern[parser->pos++];
+		}
+
+		hi = lo;
+		if (parser->pos + 1 < parser->len && parser->pattern[parser->pos] == '-' && parser->pattern[parser->pos + 1] != ']') {
+			++parser->pos;
+			if (parser->pattern[parser->pos] == '\\' && parser->pos + 1 < parser->len) {
+				hi = regexp_escaped_byte(parser->pattern[parser->pos + 1]);
+				parser->pos += 2;
+			} else {
+				if (regexp_char_len(parser) > 1) {
+					gb_free(&multibyte);
+					return regexp_error(parser, "Ranges of non-ASCII chars are not supported"), -1;
+				}
+				hi = (unsigned char) parser->pattern[parser->pos++];
+			}
+
+			if (hi < lo) {
+				gb_free(&multibyte);
+				return regexp_error(parser, "Invalid range"), -1;
+			}
+		}
+
+		regexp_set_add_range(&set, lo, hi);
+	}
+
+	if (parser->pos >= parser->len) {
+		gb_free(&multibyte);
+		return regexp_error(parser, "Missing ]"), -1;
+	}
+	++parser->pos;
+
+	if (negate) {
+		if (multibyte.len > 0 || non_ascii) {
+			gb_free(&multibyte);
+			return regexp_error(parser, "Negated classes of non-ASCII chars are not supported"), -1;
+		}
+
+		regexp_set_fold(parser, &set);
+		for (int ch = 0; ch < 0x80; ++ch) {
+			if (regexp_set_has(&set, ch)) set.bits[ch >> 3] &= (uint8_t) ~(1 << (ch & 7));
+			else regexp_set_add(&set, ch);
+		}
+		non_ascii = true;
+	}
+
+	node = regexp_set_node(parser, set);
+	if (non_ascii) node = regexp_binary(parser, NODE_ALTERNATE, node, regexp_non_ascii_node(parser));
+
+	for (size_t i = 0; i < multibyte.len; ++i) {
+		char_len = utf8_size_char(parser->pattern[multibyte.data[i]]);
+		node = regexp_binary(parser, NODE_ALTERNATE, node, regexp_char_node(parser, &parser->pattern[multibyte.data[i]], char_len));
+	}
+
+	gb_free(&multibyte);
+	return node;
+}
+
+static int regexp_parse_atom(RegexpParser *parser)
+{
+	RegexpByteSet set = {0};
+	char ch, escape;
+	bool negated;
+	size_t char_len;
+	int node;
+
+	ch = parser->pattern[parser->pos];
+
+	switch (ch) {
+	case '(':
+		++parser->pos;
+		if (parser->pos + 1 < parser->len && parser->pattern[parser->pos] == '?' && parser->pattern[parser->pos + 1] == ':') {
+			parser->pos += 2;
+		}
+
+		node = regexp_parse_alternate(parser);
+		if (node < 0) return -1;
+		if (parser->pos >= parser->len || parser->pattern[parser->pos] != ')') return regexp_error(parser, "Missing )"), -1;
+		++parser->pos;
+		return node;
+	case '[':
+		++parser->pos;
+		return regexp_parse_class(parser);
+	case '.':
+		++parser->pos;
+		regexp_set_add_range(&set, 0, 0x7F);
+		set.bits['\n' >> 3] &= (uint8_t) ~(1 << ('\n' & 7));
+		return regexp_binary(parser, NODE_ALTERNATE, regexp_set_node(parser, set), regexp_non_ascii_node(parser));
+	case '^':
+		++parser->pos;
+		return regexp_node(parser, (RegexpNode) {.kind = NODE_ASSERT, .arg = REGEXP_BOL});
+	case '$':
+		++parser->pos;
+		return regexp_node(parser, (RegexpNode) {.kind = NODE_ASSERT, .arg = REGEXP_EOL});
+	case '*': case '+': case '?': case '{':
+		return regexp_error(parser, "Nothing to repeat"), -1;
+	case '\\':
+		if (parser->pos + 1 >= parser->len) return regexp_error(parser, "Trailing \\"), -1;
+
+		escape = parser->pattern[parser->pos + 1];
+		parser->pos += 2;
+
+		if (escape == 'b') return regexp_node(parser, (RegexpNode) {.kind = NODE_ASSERT, .arg = REGEXP_WORD_BOUNDARY});
+		if (escape == 'B') return regexp_node(parser, (RegexpNode) {.kind = NODE_ASSERT, .arg = REGEXP_NOT_WORD_BOUNDARY});
+
+		if (regexp_class_escape(escape, &set, &negated)) {
+			node = regexp_set_node(parser, set);
+			return negated ? regexp_binary(parser, NODE_ALTERNATE, node, regexp_non_ascii_node(parser)) : node;
+		}
+
+		if ((unsigned char) escape >= 0x80) {
+			--parser->pos;
+			char_len = regexp_char_len(parser);
+			node = regexp_char_node(parser, &parser->pattern[parser->pos], char_len);
+			parser->pos += char_len;
+			return node;
+		}
+
+		regexp_set_add(&set, regexp_escaped_byte(escape));
+		return regexp_set_node(parser, set);
+	default:
+		char_len = regexp_char_len(parser);
+		node = regexp_char_node(parser, &parser->pattern[parser->pos], char_len);
+		parser->pos += char_len;
+		return node;
+	}
+}
+
+static bool regexp_parse_number(RegexpParser *parser, int *number)
+{
+	size_t beg = parser->pos;
+
+	*number = 0;
+	while (parser->pos < parser->len && parser->pattern[parser->pos] >= '0' && parser->pattern[parser->pos] <= '9') {
+		*number = *number * 10 + parser->pattern[parser->pos++] - '0';
+		if (*number > REGEXP_REPEAT_LIMIT) return regexp_error(parser, "Too big repetition");
+	}
+
+	return parser->pos > beg;
+}
+
+static int regexp_parse_repeat(RegexpParser *parser)
+{
+	RegexpNode repeat;
+	int node;
+	char ch;
+
+	node = regexp_parse_atom(parser);
+
+	while (node >= 0 && parser->pos < parser->len) {
+		ch = parser->pattern[parser->pos];
+		repeat = (RegexpNode) {.kind = NODE_REPEAT, .left = node, .greedy = true};
+
+		if (ch == '*') {
+			repeat.min = 0;
+			repeat.max = -1;
+		} else if (ch == '+') {
+			repeat.min = 1;
+			repeat.max = -1;
+		} else if (ch == '?') {
+			repeat.min = 0;
+			repeat.max = 1;
+		} else if (ch == '{') {
+			++parser->pos;
+			if (!regexp_parse_number(parser, &repeat.min)) return regexp_error(parser, "Invalid repetition"), -1;
+			repeat.max = repeat.min;
+
+			if (parser->pos < parser->len && parser->pattern[parser->pos] == ',') {
+				++parser->pos;
+				if (!regexp_parse_number(parser, &repeat.max)) {
+					if (parser->regexp->error[0] != '\0') return -1;
+					repeat.max = -1;
+				}
+			}
+
+			if (parser->pos >= parser->len || parser->pattern[parser->pos] != '}') return regexp_error(parser, "Missing }"), -1;
+			if (repeat.max >= 0 && repeat.max < repeat.min) return regexp_error(parser, "Invalid repetition"), -1;
+		} else {
+			break;
+		}
+
+		++parser->pos;
+		if (parser->pos < parser->len && parser->pattern[parser->pos] == '?') {
+			repeat.greedy = false;
+			++parser->pos;
+		}
+
+		node = regexp_node(parser, repeat);
+	}
+
+	return node;
+}
+
+static int regexp_parse_concat(RegexpParser *parser)
+{
+	int node;
+
+	node = regexp_node(parser, (RegexpNode) {.kind = NODE_EMPTY});
+
+	while (node >= 0 && parser->pos < parser->len && parser->pattern[parser->pos] != '|' && parser->pattern[parser->pos] != ')') {
+		node = regexp_binary(parser, NODE_CONCAT, node, regexp_parse_repeat(parser));
+	}
+
+	return node;
+}
+
+static int regexp_parse_alternate(RegexpParser *parser)
+{
+	int node;
+
+	node = regexp_parse_concat(parser);
+
+	while (node >= 0 && parser->pos < parser->len && parser->pattern[parser->pos] == '|') {
+		++parser->pos;
+		node = regexp_binary(parser, NODE_ALTERNATE, node, regexp_parse_concat(parser));
+	}
+
+	return node;
+}
+
+/*
+ * Compiler to the program of the Pike VM, the lazy DFA runs the same program
+ */
+
+static int regexp_emit(Regexp *regexp, RegexpInst inst)
+{
+	gb_append(&regexp->program, inst);
+	return (int) regexp->program.len - 1;
+}
+
+static bool regexp_compile_node(RegexpParser *parser, int index)
+{
+	Regexp *regexp = parser->regexp;
+	RegexpNode node = parser->nodes.data[index];
+	int split, jmp, loop;
+
+	if (regexp->program.len > REGEXP_PROGRAM_LIMIT) return regexp_error(parser, "Too big pattern");
+
+	switch (node.kind) {
+	case NODE_SET:
+		regexp_emit(regexp, (RegexpInst) {REGEXP_BYTE, node.arg, (int) regexp->program.len + 1, 0});
+		break;
+	case NODE_CONCAT:
+		return regexp_compile_node(parser, node.left) && regexp_compile_node(parser, node.right);
+	case NODE_ALTERNATE:
+		split = regexp_emit(regexp, (RegexpInst) {REGEXP_SPLIT, 0, (int) regexp->program.len + 1, 0});
+		if (!regexp_compile_node(parser, node.left)) return false;
+		jmp = regexp_emit(regexp, (RegexpInst) {REGEXP_JMP, 0, 0, 0});
+		regexp->program.data[split].y = (int) regexp->program.len;
+		if (!regexp_compile_node(parser, node.right)) return false;
+		regexp->program.data[jmp].x = (int) regexp->program.len;
+		break;
+	case NODE_REPEAT:
+		for (int i = 0; i < node.min; ++i) {
+			if (!regexp_compile_node(parser, node.left)) return false;
+		}
+
+		if (node.max < 0) {
+			loop = regexp_emit(regexp, (RegexpInst) {REGEXP_SPLIT, 0, 0, 0});
+			if (!regexp_compile_node(parser, node.left)) return false;
+			regexp_emit(regexp, (RegexpInst) {REGEXP_JMP, 0, loop, 0});
+			regexp->program.data[loop].x = node.greedy ? loop + 1 : (int) regexp->program.len;
+			regexp->program.data[loop].y = node.greedy ? (int) regexp->program.len : loop + 1;
+			break;
+		}
+
+		for (int i = node.min; i < node.max; ++i) {
+			split = regexp_emit(regexp, (RegexpInst) {REGEXP_SPLIT, 0, 0, 0});
+			if (!regexp_compile_node(parser, node.left)) return false;
+			regexp->program.data[split].x = node.greedy ? split + 1 : (int) regexp->program.len;
+			regexp->program.data[split].y = node.greedy ? (int) regexp->program.len : split + 1;
+		}
+		break;
+	case NODE_ASSERT:
+		regexp_emit(regexp, (RegexpInst) {REGEXP_ASSERT, node.arg, (int) regexp->program.len + 1, 0});
+		break;
+	case NODE_EMPTY:
+		break;
+	}
+
+	return true;
+}
+
+/**
+ * The longest run of single chars every match must contain
+ */
+static void regexp_literal_walk(RegexpParser *parser, int index, StringBuilder *run, StringBuilder *best)
+{
+	RegexpNode *node = &parser->nodes.data[index];
+	RegexpByteSet *set;
+	int chars[2], count;
+
+	switch (node->kind) {
+	case NODE_CONCAT:
+		regexp_literal_walk(parser, node->left, run, best);
+		regexp_literal_walk(parser, node->right, run, best);
+		return;
+	case NODE_SET:
+		set = &parser->regexp->sets.data[node->arg];
+		count = 0;
+		for (int ch = 0; ch < 256 && count <= 2; ++ch) {
+			if (regexp_set_has(set, ch)) {
+				if (count < 2) chars[count] = ch;
+				++count;
+			}
+		}
+
+		//the literal search folds ASCII letters anyway
+		if (count == 1 || (count == 2 && chars[0] >= 'A' && chars[0] <= 'Z' && chars[1] == chars[0] - 'A' + 'a')) {
+			sb_append(run, (char) chars[count - 1]);
+			if (run->len > best->len) {
+				sb_clean(best);
+				sb_append_manyl(best, run->data, run->len);
+			}
+			return;
+		}
+		break;
+	case NODE_REPEAT:
+		if (node->min > 0) {
+			run->len = 0;
+			regexp_literal_walk(parser, node->left, run, best);
+		}
+		break;
+	case NODE_ASSERT:
+	case NODE_EMPTY:
+		//zero width, the run goes on
+		return;
+	case NODE_ALTERNATE:
+		break;
+	}
+
+	run->len = 0;
+}
+
+bool regexp_compile(Regexp *regexp, const char *pattern, size_t len, int flags)
+{
+	RegexpParser parser = {0};
+	StringBuilder run = {0}, best = {0};
+	int root;
+
+	memset(regexp, 0, sizeof(*regexp));
+	parser.regexp = regexp;
+	parser.pattern = pattern;
+	parser.len = len;
+	parser.flags = flags;
+
+	root = regexp_parse_alternate(&parser);
+	if (root >= 0 && parser.pos < len) {
+		regexp_error(&parser, "Unmatched )");
+		root = -1;
+	}
+
+	if (root >= 0 && regexp_compile_node(&parser, root)) {
+		regexp_emit(regexp, (RegexpInst) {REGEXP_MATCH, 0, 0, 0});
+	} else {
+		root = -1;
+	}
+
+	if (root >= 0) {
+		regexp_literal_walk(&parser, root, &run, &best);
+		if (best.len >= REGEXP_LITERAL_MIN_LEN) {
+			regexp->has_literal = true;
+			search_compile(&regexp->literal, best.data, best.len);
+		}
+	}
+
+	gb_free(&parser.nodes);
+	sb_free(&run);
+	sb_free(&best);
+
+	if (root < 0) {
+		regexp_free(regexp);
+		if (regexp->error[0] == '\0') snprintf(regexp->error, REGEXP_ERROR_LEN, "Too big pattern");
+		return false;
+	}
+
+	for (size_t i = 0; i < regexp->program.len; ++i) {
+		if (regexp->program.data[i].op == REGEXP_BYTE && regexp_set_has(&regexp->sets.data[regexp->program.data[i].arg], '\n')) {
+			regexp->multiline = true;
+		}
+	}
+
+	regexp->marks = calloc(regexp->program.len, sizeof(uint32_t));
+	hashmap_create(1024, &regexp->dfa.by_key);
+
+	return true;
+}
+
+static void regexp_dfa_flush(Regexp *regexp)
+{
+	for (size_t i = 0; i < regexp->dfa.len; ++i) {
+		free(regexp->dfa.data[i].pcs);
+		free(regexp->dfa.data[i].key);
+	}
+	regexp->dfa.len = 0;
+
+	hashmap_destroy(&regexp->dfa.by_key);
+	hashmap_create(1024, &regexp->dfa.by_key);
+}
+
+void regexp_free(Regexp *regexp)
+{
+	char error[REGEXP_ERROR_LEN];
+
+	if (regexp->marks != NULL) {
+		regexp_dfa_flush(regexp);
+		hashmap_destroy(&regexp->dfa.by_key);
+	}
+	if (regexp->has_literal) search_free(&regexp->literal);
+
+	gb_free(&regexp->program);
+	gb_free(&regexp->sets);
+	free(regexp->marks);
+	free(regexp->dfa.data);
+	gb_free(&regexp->stack);
+	gb_free(&regexp->threads[0]);
+	gb_free(&regexp->threads[1]);
+	gb_free(&regexp->state_pcs);
+	gb_free(&regexp->next_pcs);
+
+	memcpy(error, regexp->error, REGEXP_ERROR_LEN);
+	memset(regexp, 0, sizeof(*regexp));
+	memcpy(regexp->error, error, REGEXP_ERROR_LEN);
+}
+
+/*
+ * Matching
+ */
+
+static void regexp_next_mark(Regexp *regexp)
+{
+	if (++regexp->mark == 0) {
+		memset(regexp->marks, 0, regexp->program.len * sizeof(uint32_t));
+		regexp->mark = 1;
+	}
+}
+
+static bool regexp_assert(uint32_t kind, int prev, int next)
+{
+	switch (kind) {
+	case REGEXP_BOL:
+		return prev == '\n';
+	case REGEXP_EOL:
+		return next == '\n' || next == REGEXP_END;
+	case REGEXP_WORD_BOUNDARY:
+		return regexp_is_word(prev) != regexp_is_word(next);
+	case REGEXP_NOT_WORD_BOUNDARY:
+		return regexp_is_word(prev) == regexp_is_word(next);
+	default:
+		return false;
+	}
+}
+
+/**
+ * Follows the empty transitions from pc in the priority order, calls back
+ * every BYTE and MATCH instruction reached. prev and next are the bytes
+ * around the position, '\n' before the text and REGEXP_END after it.
+ */
+#define REGEXP_CLOSURE(regexp, start_pc, prev, next, visit) \
+	do { \
+		gb_append(&(regexp)->stack, (start_pc)); \
+		while ((regexp)->stack.len > 0) { \
+			int pc_ = (regexp)->stack.data[--(regexp)->stack.len]; \
+			RegexpInst *inst_ = &(regexp)->program.data[pc_]; \
+			if ((regexp)->marks[pc_] == (regexp)->mark) continue; \
+			(regexp)->marks[pc_] = (regexp)->mark; \
+			switch (inst_->op) { \
+			case REGEXP_JMP: gb_append(&(regexp)->stack, inst_->x); break; \
+			case REGEXP_SPLIT: gb_append(&(regexp)->stack, inst_->y); gb_append(&(regexp)->stack, inst_->x); break; \
+			case REGEXP_ASSERT: if (regexp_assert(inst_->arg, (prev), (next))) gb_append(&(regexp)->stack, inst_->x); break; \
+			case REGEXP_BYTE: case REGEXP_MATCH: { int pc = pc_; visit; } break; \
+			} \
+		} \
+	} while (0)
+
+static int regexp_byte_at(const char *text, size_t text_len, size_t pos)
+{
+	return pos < text_len ? (unsigned char) text[pos] : REGEXP_END;
+}
+
+static int regexp_byte_before(const char *text, size_t pos)
+{
+	return pos > 0 ? (unsigned char) text[pos - 1] : '\n';
+}
+
+/**
+ * Leftmost-first match starting in [from, text_len), linear in the text
+ */
+static bool regexp_pike(Regexp *regexp, const char *text, size_t text_len, size_t from, size_t *start, size_t *end)
+{
+	RegexpThreads *clist, *nlist, *swap;
+	RegexpInst *inst;
+	int prev, next;
+	bool matched;
+
+	clist = &regexp->threads[0];
+	nlist = &regexp->threads[1];
+	clist->len = 0;
+	nlist->len = 0;
+	matched = false;
+
+	regexp_next_mark(regexp);
+	for (size_t pos = from;; ++pos) {
+		prev = regexp_byte_before(text, pos);
+		next = regexp_byte_at(text, text_len, pos);
+
+		//a new thread at every position has the lowest priority until something matches
+		if (!matched) {
+			REGEXP_CLOSURE(regexp, 0, prev, next, gb_append(clist, ((RegexpThread) {pc, pos})));
+		}
+
+		if (clist->len == 0 && (matched || pos >= text_len)) break;
+
+		regexp_next_mark(regexp);
+		for (size_t i = 0; i < clist->len; ++i) {
+			inst = &regexp->program.data[clist->data[i].pc];
+
+			if (inst->op == REGEXP_MATCH) {
+				matched = true;
+				*start = clist->data[i].start;
+				*end = pos;
+				//threads of lower priority are cut off
+				break;
+			}
+
+			if (next != REGEXP_END && regexp_set_has(&regexp->sets.data[inst->arg], next)) {
+				size_t thread_start = clist->data[i].start;
+				REGEXP_CLOSURE(regexp, inst->x, next, regexp_byte_at(text, text_len, pos + 1), gb_append(nlist, ((RegexpThread) {pc, thread_start})));
+			}
+		}
+
+		swap = clist;
+		clist = nlist;
+		nlist = swap;
+		nlist->len = 0;
+
+		if (pos >= text_len) break;
+	}
+
+	return matched;
+}
+
+static int regexp_dfa_state(Regexp *regexp, int *pcs, size_t pcs_len, uint8_t flags)
+{
+	RegexpDfaState state = {0};
+	void *found;
+	size_t key_len;
+
+	key_len = 1 + pcs_len * sizeof(int);
+	state.key = malloc(key_len);
+	state.key[0] = (char) flags;
+	if (pcs_len > 0) memcpy(&state.key[1], pcs, pcs_len * sizeof(int));
+
+	found = hashmap_get(&regexp->dfa.by_key, state.key, (hashmap_uint32_t) key_len);
+	if (found != NULL) {
+		free(state.key);
+		return (int) ((uintptr_t) found - 1);
+	}
+
+	state.key_len = key_len;
+	state.flags = flags;
+	state.pcs_len = pcs_len;
+	state.pcs = malloc(MAX(pcs_len, 1) * sizeof(int));
+	if (pcs_len > 0) memcpy(state.pcs, pcs, pcs_len * sizeof(int));
+	memset(state.next, 0xFF, sizeof(state.next));
+
+	gb_append(&regexp->dfa, state);
+	hashmap_put(&regexp->dfa.by_key, state.key, (hashmap_uint32_t) key_len, (void *) (uintptr_t) regexp->dfa.len);
+
+	return (int) regexp->dfa.len - 1;
+}
+
+static int regexp_compare_int(const void *a, const void *b)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+/**
+ * The state is the set of instructions to be closed before the next byte,
+ * the start is added at every position (unanchored search)
+ */
+static int32_t regexp_dfa_transition(Regexp *regexp, int index, int byte)
+{
+	RegexpPcs *pcs, *next_pcs;
+	RegexpDfaState *state;
+	RegexpInst *inst;
+	size_t len;
+	uint8_t flags;
+	int prev;
+	bool match;
+
+	state = &regexp->dfa.data[index];
+	pcs = &regexp->state_pcs;
+	next_pcs = &regexp->next_pcs;
+
+	if (regexp->dfa.len >= REGEXP_DFA_STATES_LIMIT) {
+		if (++regexp->dfa.flushes > REGEXP_DFA_FLUSH_LIMIT) return -1;
+
+		pcs->len = 0;
+		for (size_t i = 0; i < state->pcs_len; ++i) gb_append(pcs, state->pcs[i]);
+		flags = state->flags;
+
+		regexp_dfa_flush(regexp);
+		index = regexp_dfa_state(regexp, pcs->data, pcs->len, flags);
+		state = &regexp->dfa.data[index];
+	}
+
+	prev = state->flags & REGEXP_DFA_PREV_NEWLINE ? '\n' : (state->flags & REGEXP_DFA_PREV_WORD ? 'a' : ' ');
+	match = false;
+	next_pcs->len = 0;
+
+	regexp_next_mark(regexp);
+	for (size_t i = 0; i <= state->pcs_len; ++i) {
+		REGEXP_CLOSURE(regexp, i < state->pcs_len ? state->pcs[i] : 0, prev, byte, {
+			inst = &regexp->program.data[pc];
+			if (inst->op == REGEXP_MATCH) match = true;
+			else if (byte != REGEXP_END && regexp_set_has(&regexp->sets.data[inst->arg], byte)) gb_append(next_pcs, inst->x);
+		});
+	}
+
+	if (next_pcs->len > 1) qsort(next_pcs->data, next_pcs->len, sizeof(int), regexp_compare_int);
+	len = 0;
+	for (size_t i = 0; i < next_pcs->len; ++i) {
+		if (len == 0 || next_pcs->data[len - 1] != next_pcs->data[i]) next_pcs->data[len++] = next_pcs->data[i];
+	}
+
+	flags = 0;
+	if (byte == '\n') flags |= REGEXP_DFA_PREV_NEWLINE;
+	if (regexp_is_word(byte)) flags |= REGEXP_DFA_PREV_WORD;
+
+	int32_t transition = (int32_t) ((regexp_dfa_state(regexp, next_pcs->data, len, flags) << 1) | match);
+	regexp->dfa.data[index].next[byte] = transition;
+
+	return transition;
+}
+
+/**
+ * End of the match which ends first, 0 when there is none, -1 when the DFA gave up
+ */
+static int regexp_dfa_first_end(Regexp *regexp, const char *text, size_t text_len, size_t from, size_t *end)
+{
+	int32_t transition;
+	uint8_t flags;
+	int state, prev;
+
+	prev = regexp_byte_before(text, from);
+	flags = 0;
+	if (prev == '\n') flags |= REGEXP_DFA_PREV_NEWLINE;
+	if (regexp_is_word(prev)) flags |= REGEXP_DFA_PREV_WORD;
+
+	regexp->dfa.flushes = 0;
+	state = regexp_dfa_state(regexp, NULL, 0, flags);
+
+	for (size_t pos = from; pos <= text_len; ++pos) {
+		int byte = regexp_byte_at(text, text_len, pos);
+
+		transition = regexp->dfa.data[state].next[byte];
+		if (transition < 0) {
+			transition = regexp_dfa_transition(regexp, state, byte);
+			if (transition < 0) return -1;
+		}
+
+		if (transition & 1) {
+			*end = pos;
+			return 1;
+		}
+
+		state = transition >> 1;
+	}
+
+	return 0;
+}
+
+static size_t regexp_line_start(const char *text, size_t pos, size_t floor)
+{
+	while (pos > floor && text[pos - 1] != '\n') --pos;
+	return pos;
+}
+
+static size_t regexp_line_end(const char *text, size_t text_len, size_t pos)
+{
+	const char *found = memchr(&text[pos], '\n', text_len - pos);
+	return found == NULL ? text_len : (size_t) (found - text);
+}
+
+/**
+ * The DFA finds where the first match ends, the Pike VM finds its bounds
+ * from the line of that end (or from the beginning for multiline patterns)
+ */
+static bool regexp_find(Regexp *regexp, const char *text, size_t text_len, size_t from, size_t *start, size_t *end)
+{
+	size_t first_end;
+	int found;
+
+	found = regexp_dfa_first_end(regexp, text, text_len, from, &first_end);
+	if (found == 0) return false;
+
+	if (found == 1 && !regexp->multiline) {
+		from = regexp_line_start(text, first_end, from);
+		text_len = regexp_line_end(text, text_len, first_end);
+	}
+
+	return regexp_pike(regexp, text, text_len, from, start, end);
+}
+
+bool regexp_search_forward(Regexp *regexp, const char *text, size_t text_len, size_t from, size_t *start, size_t *end)
+{
+	size_t pos, line_start, line_end;
+	long literal;
+
+	if (from > text_len) return false;
+	if (!regexp->has_literal || regexp->multiline) return regexp_find(regexp, text, text_len, from, start, end);
+
+	//only lines with the literal may match
+	for (pos = from; pos <= text_len; pos = line_end + 1) {
+		literal = search_forward(&regexp->literal, text, text_len, pos);
+		if (literal < 0) return false;
+
+		line_start = regexp_line_start(text, (size_t) literal, pos);
+		line_end = regexp_line_end(text, text_len, (size_t) literal);
+
+		if (regexp_find(regexp, text, line_end, line_start, start, end)) return true;
+	}
+
+	return false;
+}
+
+/**
+ * The last match of the line [line_start, line_end) starting at from or before
+ */
+static bool regexp_line_last(Regexp *regexp, const char *text, size_t line_start, size_t line_end, size_t from, size_t *start, size_t *end)
+{
+	size_t pos, match_start, match_end;
+	bool found;
+
+	found = false;
+	for (pos = line_start; pos <= MIN(from, line_end) && regexp_find(regexp, text, line_end, pos, &match_start, &match_end) && match_start <= from;) {
+		found = true;
+		*start = match_start;
+		*end = match_end;
+		pos = match_end > match_start ? match_end : match_start + 1;
+	}
+
+	return found;
+}
+
+bool regexp_search_backward(Regexp *regexp, const char *text, size_t text_len, size_t from, size_t *start, size_t *end)
+{
+	size_t line_start, line_end;
+	long literal;
+
+	from = MIN(from, text_len);
+
+	//matches may go through lines, all of them are found from the beginning
+	if (regexp->multiline) return regexp_line_last(regexp, text, 0, text_len, from, start, end);
+
+	line_start = regexp_line_start(text, from, 0);
+	line_end = regexp_line_end(text, text_len, from);
+
+	while (!regexp_line_last(regexp, text, line_start, line_end, from, start, end)) {
+		if (line_start == 0) return false;
+
+		if (regexp->has_literal) {
+			literal = search_backward(&regexp->literal, text, line_start - 1, line_start - 1);
+			if (literal < 0) return false;
+
+			line_start = regexp_line_start(text, (size_t) literal, 0);
+			line_end = regexp_line_end(text, text_len, (size_t) literal);
+		} else {
+			line_end = line_start - 1;
+			line_start = regexp_line_start(text, line_end, 0);
+		}
+	}
+
+	return true;
+}
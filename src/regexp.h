@@ -0,0 +1,136 @@
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "search.h"
+#include "hashmap.h"
+
+#define REGEXP_ICASE 0x1
+
+#define REGEXP_PROGRAM_LIMIT 20000
+#define REGEXP_REPEAT_LIMIT  1000
+#define REGEXP_ERROR_LEN     128
+//the lazy DFA cache is flushed when it is full, too many flushes fall back to the Pike VM
+#define REGEXP_DFA_STATES_LIMIT 2048
+#define REGEXP_DFA_FLUSH_LIMIT  16
+//shorter required literals are not worth the prefilter
+#define REGEXP_LITERAL_MIN_LEN 2
+
+typedef enum {
+	REGEXP_BYTE,
+	REGEXP_SPLIT,
+	REGEXP_JMP,
+	REGEXP_ASSERT,
+	REGEXP_MATCH,
+} RegexpOp;
+
+typedef enum {
+	REGEXP_BOL = 0x1,
+	REGEXP_EOL = 0x2,
+	REGEXP_WORD_BOUNDARY = 0x4,
+	REGEXP_NOT_WORD_BOUNDARY = 0x8,
+} RegexpAssert;
+
+/**
+ * BYTE consumes a byte of the set arg and goes to x, SPLIT prefers x over y
+ */
+typedef struct {
+	RegexpOp op;
+	uint32_t arg;
+	int x, y;
+} RegexpInst;
+
+typedef struct {
+	uint8_t bits[32];
+} RegexpByteSet;
+
+typedef struct {
+	int *pcs;
+	size_t pcs_len;
+	uint8_t flags;
+	char *key;
+	size_t key_len;
+	//(next state << 1) | a match ends before the byte, -1 is not computed yet, 256 is the end of the text
+	int32_t next[257];
+} RegexpDfaState;
+
+typedef struct {
+	RegexpDfaState *data;
+	size_t len;
+	size_t cap;
+	struct hashmap_s by_key;
+	size_t flushes;
+} RegexpDfa;
+
+typedef struct {
+	int *data;
+	size_t len;
+	size_t cap;
+} RegexpPcs;
+
+typedef struct {
+	int pc;
+	size_t start;
+} RegexpThread;
+
+typedef struct {
+	RegexpThread *data;
+	size_t len;
+	size_t cap;
+} RegexpThreads;
+
+typedef struct {
+	RegexpInst *data;
+	size_t len;
+	size_t cap;
+} RegexpProgram;
+
+typedef struct {
+	RegexpByteSet *data;
+	size_t len;
+	size_t cap;
+} RegexpSets;
+
+typedef struct {
+	RegexpProgram program;
+	RegexpSets sets;
+
+	//a match can go through a new line
+	bool multiline;
+
+	//every match contains it, searched by the vectorized search first
+	bool has_literal;
+	SearchPattern literal;
+
+	RegexpDfa dfa;
+
+	//work memory of the closures, the Pike VM and the DFA transitions
+	uint32_t *marks;
+	uint32_t mark;
+	RegexpPcs stack;
+	RegexpThreads threads[2];
+	RegexpPcs state_pcs, next_pcs;
+
+	char error[REGEXP_ERROR_LEN];
+} Regexp;
+
+/**
+ * Compiles the pattern (ERE-like: . [] [^] () (?:) | * + ? {m,n} lazy
+ * quantifiers, ^ $ \b \B \d \w \s and their negations). Returns false and
+ * sets the error for invalid patterns.
+ */
+bool regexp_compile(Regexp *regexp, const char *pattern, size_t len, int flags);
+void regexp_free(Regexp *regexp);
+/**
+ * Leftmost match starting at from or after, the first alternative wins
+ */
+bool regexp_search_forward(Regexp *regexp, const char *text, size_t text_len, size_t from, size_t *start, size_t *end);
+/**
+ * The last match starting at from or before
+ */
+bool regexp_search_backward(Regexp *regexp, const char *text, size_t text_len, size_t from, size_t *start, size_t *end);
+
+#endif
@@ -7,6 +7,7 @@
 #include "tokenize.h"
 #include "render.h"
 #include "utf8.h"
+#include "profiler.h"
 
 #define LINE_BUFFER_LEN 100
 
@@ -18,7 +19,12 @@ void render_draw_text(Smacs *smacs, int x, int y, char *text, size_t text_len, S
 	if (text == NULL) return;
 	if (text_len == 0) return;
 
-	if (no_cache || NULL == (surface = hashmap_get(&smacs->surface_by_string, text, text_len))) {
+	if (!no_cache) {
+		surface = hashmap_get(&smacs->surface_by_string, text, text_len);
+		profiler_count(surface == NULL ? PROFILE_CACHE_MISS : PROFILE_CACHE_HIT);
+	}
+
+	if (surface == NULL) {
 		surface = TTF_RenderText_Blended(smacs->font, text, text_len, foreground_color);
 		if (surface == NULL) {
 			fprintf(stderr, "Render text (x %d y %d txt: %s len: %ld) cause: %s\n", x, y, text, text_len, SDL_GetError());
@@ -123,6 +129,7 @@ void render_format_display_line_number(Smacs *smacs, char *buffer, size_t buffer
 void render_glyph_clean(GlyphList *glyph)
 {
 	gb_clean(&glyph->string_data);
+	gb_clean(&glyph->rows);
 	gb_clean(glyph);
 }
 
@@ -130,9 +137,29 @@ void render_destroy_glyph(GlyphList *glyph)
 {
 	render_glyph_clean(glyph);
 	gb_free(&glyph->string_data);
+	gb_free(&glyph->rows);
 	gb_free(glyph);
 }
 
+void render_row_begin(GlyphList *glyph, size_t pane_index, float y, size_t start)
+{
+	gb_append(&glyph->rows, ((GlyphRow) {
+				.start = start,
+				.end = start,
+				.glyph_beg = glyph->len,
+				.glyph_end = glyph->len,
+				.y = y,
+				.pane_index = pane_index}));
+}
+
+void render_row_end(GlyphList *glyph, size_t end)
+{
+	GlyphRow *row = &glyph->rows.data[glyph->rows.len - 1];
+
+	row->end = end;
+	row->glyph_end = glyph->len;
+}
+
 void render_append_char_to_rendering(Smacs *smacs, StringBuilder *sb, char *data, size_t *index)
 {
 	size_t ci = *index;
@@ -186,7 +213,8 @@ GlyphItem *render_flush_item_sb_and_move_x(Smacs *smacs, GlyphList *glyph, Strin
 		sb_clean(sb);
 		x += w;
 		new_item = &glyph->data[glyph->len-1];
-	} else if (kind & CURSOR) {
+	} else if (kind & TEXT) {
+		//empty item keeps new lines and the end of the buffer clickable and selectable
 		gb_append(glyph, ((GlyphItem) {
 					.beg = string_pointer,
 					.len = 0,
@@ -207,22 +235,89 @@ GlyphItem *render_flush_item_sb_and_move_x(Smacs *smacs, GlyphList *glyph, Strin
 typedef struct {
 	char *data;
 	size_t data_len;
+	size_t pane_index;
 	int x;
 
-	bool selection, is_active_pane, c_like_file;
+	bool selection, is_active_pane, c_like_file, truncate_lines;
 
 	size_t region_beg, region_end;
 	size_t cursor;
 	size_t arena_start_point;
 
-	int content_hight, text_indention, pane_width_threashold;
+	//extra cursors of the pane, cursor_index is the first one which is not before the rendered position
+	Cursors *cursors;
+	size_t cursor_index;
+	bool cursors_selection;
+
+	//search matches, match_index is the first one which does not end before the rendered position
+	SearchMatches *matches;
+	size_t match_index;
+
+	int content_hight, text_indention, text_limit;
 } PaneDrawingInfo;
 
-void render_line_processing(Smacs *smacs, PaneDrawingInfo *info, Line *line, StringBuilder *sb, GlyphList *glyph)
+GlyphItemEnum render_token_kind(Smacs *smacs, PaneDrawingInfo *info, size_t data_index)
+{
+	if (!info->c_like_file || data_index >= info->data_len) return 0;
+
+	switch (smacs->tokenize.data[data_index - info->arena_start_point]) {
+	case TOKEN_STRING:
+		return STRING;
+	case TOKEN_COMMENT:
+		return COMMENT;
+	case TOKEN_NUMBER:
+	case TOKEN_BOOLEAN:
+		return NUMBER;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * CURSOR and REGION of the extra cursors at the position
+ */
+GlyphItemEnum render_cursors_kind(PaneDrawingInfo *info, size_t data_index)
 {
-	GlyphItemEnum kind = TEXT;
+	GlyphItemEnum kind = 0;
+	Cursor *cursor;
+	size_t beg, end;
+
+	if (info->cursors == NULL) return 0;
+
+	for (size_t i = info->cursor_index; i < info->cursors->len; ++i) {
+		cursor = &info->cursors->data[i];
+		beg = info->cursors_selection ? MIN(cursor->position, cursor->mark) : cursor->position;
+		end = info->cursors_selection ? MAX(cursor->position, cursor->mark) : cursor->position;
+
+		if (beg > data_index) break;
+		if (end < data_index && i == info->cursor_index) {
+			++info->cursor_index;
+			continue;
+		}
+
+		if (cursor->position == data_index) kind |= CURSOR;
+		if (beg <= data_index && data_index < end) kind |= REGION;
+	}
+
+	return kind;
+}
+
+/**
+ * Renders one visual row, the row is already wrapped to fit the pane (see editor_visual_lines).
+ * Truncated lines stop at the pane edge. Returns the last rendered position.
+ */
+size_t render_line_processing(Smacs *smacs, PaneDrawingInfo *info, Line *line, StringBuilder *sb, GlyphList *glyph)
+{
+	GlyphItemEnum kind = TEXT, token_kind, cursors_kind;
+	size_t char_start;
+
+	char_start = line->start;
 
 	for (size_t data_index = line->start; data_index <= line->end; ++data_index) {
+		if (info->truncate_lines && info->x >= info->text_limit) break;
+
+		char_start = data_index;
+
 		if (info->selection && (data_index >= info->region_beg)) {
 			kind = kind | REGION;
 		}
@@ -233,109 +328,271 @@ void render_line_processing(Smacs *smacs, PaneDrawingInfo *info, Line *line, Str
 
 		if (info->is_active_pane && data_index == info->cursor) {
 			kind = kind | CURSOR;
-
-			if (info->cursor == info->data_len) {
-				gb_append(glyph, ((GlyphItem) {
-						   .beg = 0,
-						   .len = 0,
-						   .x = info->x,
-						   .y = info->content_hight,
-						   .w = smacs->char_w,
-						   .h = smacs->char_h,
-						   .kind = kind,
-						   .position = data_index}));
-				kind = kind ^ CURSOR;
-			}
 		} else if (kind & CURSOR) {
 			kind = kind ^ CURSOR;
 		}
 
-		if (info->c_like_file) {
-			switch (smacs->tokenize.data[data_index - info->arena_start_point]) {
-			case TOKEN_STRING:
-				kind = kind | STRING;
-				break;
-			case TOKEN_COMMENT:
-				kind = kind | COMMENT;
-				break;
-			case TOKEN_NUMBER:
-				kind = kind | NUMBER;
-				break;
-			case TOKEN_BOOLEAN:
-				kind = kind | NUMBER;
-				break;
-			default:
-				break;
+		if (info->matches != NULL) {
+			while (info->match_index < info->matches->len
+				   && info->matches->data[info->match_index].end <= data_index) {
+				++info->match_index;
 			}
-		}
-
 
-		if (info->x >= info->pane_width_threashold) {
-#if 0
-			//TODO(ivan): huge line without spaces brokes everything
-			for (data_index -= utf8_size_char_backward(info->data, data_index - 1);
-				 data_index > line->start;
-				 data_index -= utf8_size_char_backward(info->data, data_index - 1)) {
-				if (isspace(info->data[data_index])) {
-					break;
-				}
-				--glyph->len;
+			if (info->match_index < info->matches->len && info->matches->data[info->match_index].start <= data_index) {
+				kind = kind | MATCH;
+			} else {
+				kind = kind & ~MATCH;
 			}
-#endif
-			info->content_hight += (smacs->char_h + smacs->leading);
-			info->x = info->text_indention;
-#if 0
-			//It need to force redrowing everything in a new line
-			continue;
-#endif
 		}
 
+		token_kind = render_token_kind(smacs, info, data_index);
+		kind = kind | token_kind;
+		//only the bits which the main cursor has not set are taken back
+		cursors_kind = render_cursors_kind(info, data_index) & ~kind;
+		kind = kind | cursors_kind;
+
 		if (data_index < info->data_len) {
 			render_append_char_to_rendering(smacs, sb, info->data, &data_index);
-			render_flush_item_sb_and_move_x(smacs, glyph, sb, &info->x, info->content_hight, kind, data_index);
 		}
 
-		if (info->c_like_file) {
-			switch (smacs->tokenize.data[data_index - info->arena_start_point]) {
-			case TOKEN_STRING:
-				kind = kind ^ STRING;
-				break;
-			case TOKEN_COMMENT:
-				kind = kind ^ COMMENT;
-				break;
-			case TOKEN_NUMBER:
-				kind = kind ^ NUMBER;
-				break;
-			case TOKEN_BOOLEAN:
-				kind = kind ^ NUMBER;
-				break;
-			default:
-				break;
+		render_flush_item_sb_and_move_x(smacs, glyph, sb, &info->x, info->content_hight, kind, char_start);
+
+		kind = kind & ~(token_kind | cursors_kind);
+	}
+
+	return char_start;
+}
+
+static StringBuilder RenderStringBuilder = {0};
+
+/**
+ * 12408 as 12,408
+ */
+void render_format_thousands(char *buffer, size_t buffer_len, size_t num)
+{
+	char digits[LINE_BUFFER_LEN];
+	size_t digits_len, j;
+
+	digits_len = (size_t) snprintf(digits, sizeof(digits), "%ld", num);
+
+	j = 0;
+	for (size_t i = 0; i < digits_len && j + 1 < buffer_len; ++i) {
+		if (i > 0 && (digits_len - i) % 3 == 0 && j + 2 < buffer_len) buffer[j++] = ',';
+		buffer[j++] = digits[i];
+	}
+	buffer[j] = '\0';
+}
+
+void render_mode_line_search_count(Smacs *smacs, StringBuilder *sb, Pane *pane)
+{
+	char number[LINE_BUFFER_LEN];
+	size_t current, total;
+
+	if (smacs->editor.search_index.owner != pane->buffer) return;
+
+	search_index_count(&smacs->editor.search_index, pane->position, &current, &total);
+
+	sb_append_many(sb, " match ");
+	if (current > 0) {
+		render_format_thousands(number, LINE_BUFFER_LEN, current);
+		sb_append_many(sb, number);
+	} else {
+		sb_append(sb, '-');
+	}
+	sb_append(sb, '/');
+	render_format_thousands(number, LINE_BUFFER_LEN, total);
+	sb_append_many(sb, number);
+
+	//the worker is still counting
+	if (!search_index_is_done(&smacs->editor.search_index)) sb_append(sb, '+');
+}
+
+/**
+ * Query replace regexp foo with: bar
+ */
+void render_mini_buffer_replace_prompt(Smacs *smacs, StringBuilder *sb)
+{
+	ReplaceSession *replace = &smacs->editor.replace;
+
+	sb_append_many(sb, replace->query ? "Query replace" : "Replace");
+	if (replace->is_regexp) sb_append_many(sb, " regexp");
+
+	switch (replace->stage) {
+	case REPLACE_FROM:
+		sb_append_many(sb, ": ");
+		break;
+	case REPLACE_TO:
+		sb_append(sb, ' ');
+		render_append_char_to_rendering_many(smacs, sb, replace->from.data, replace->from.len);
+		sb_append_many(sb, " with: ");
+		break;
+	case REPLACE_QUERY:
+		sb_append(sb, ' ');
+		render_append_char_to_rendering_many(smacs, sb, replace->from.data, replace->from.len);
+		sb_append_many(sb, " with ");
+		render_append_char_to_rendering_many(smacs, sb, replace->to.data, replace->to.len);
+		sb_append_many(sb, "? (y, n, !, ., q)");
+		return;
+	}
+
+	if (smacs->editor.user_input.len > 0) {
+		render_append_char_to_rendering_many(smacs, sb, smacs->editor.user_input.data, smacs->editor.user_input.len);
+	}
+}
+
+void render_mode_line_text(Smacs *smacs, StringBuilder *sb, Pane *pane, bool is_active_pane, size_t current_line)
+{
+	char line_number[LINE_BUFFER_LEN];
+
+	if(pane->buffer->need_to_save) {
+		sb_append(sb, '*');
+	}
+
+	if(pane->buffer->disk_changed) {
+		sb_append(sb, '!');
+	}
+
+	render_append_file_path(sb, pane->buffer->file_path, smacs->home_dir, strlen(smacs->home_dir));
+	sb_append_many(sb, " (");
+	snprintf(line_number, LINE_BUFFER_LEN, "%ld", current_line);
+	sb_append_many(sb, line_number);
+	sb_append(sb, ')');
+
+	if (is_active_pane) {
+		if (smacs->editor.state & SEARCH) {
+			sb_append(sb, ' ');
+			if (smacs->editor.state & BACKWARD_SEARCH) {
+				sb_append_many(sb, "Re-");
+			}
+			if (smacs->editor.matches.is_regexp) {
+				sb_append_many(sb, "Regexp-");
 			}
+
+			sb_append_many(sb, "Search[:enter next :C-g stop]");
+			if (smacs->editor.matches.is_regexp && smacs->editor.matches.needle.len > 0 && !smacs->editor.matches.compiled) {
+				sb_append_many(sb, " invalid regexp");
+			} else {
+				render_mode_line_search_count(smacs, sb, pane);
+			}
+		} else if (smacs->editor.state & EXTEND_COMMAND) {
+			sb_append_many(sb, " C-x");
+		} else if (smacs->editor.state & REPLACE && smacs->editor.replace.stage == REPLACE_QUERY) {
+			snprintf(line_number, LINE_BUFFER_LEN, " Query-Replace[y n ! . q] %ld to replace", smacs->editor.replace.accepted.len);
+			sb_append_many(sb, line_number);
 		}
+
+		if (smacs->macro.recording_on) sb_append_many(sb, " Def");
 	}
 }
 
-static StringBuilder RenderStringBuilder = {0};
+int render_pane_text_limit(Smacs *smacs, Pane *pane)
+{
+	return pane->x + pane->w - (smacs->char_w * 2);
+}
 
-void render_update_glyph(Smacs *smacs)
+/**
+ * Amount of columns fitting into the text area of the pane
+ */
+size_t render_pane_text_cols(Smacs *smacs, Pane *pane, int text_indention)
+{
+	int text_w;
+
+	text_w = render_pane_text_limit(smacs, pane) - text_indention;
+	if (text_w <= smacs->char_w) return 1;
+
+	return (size_t) (text_w / smacs->char_w);
+}
+
+/**
+ * Size of the window, or of the offscreen surface when there is no window (headless)
+ */
+void render_output_size(Smacs *smacs, int *w, int *h)
+{
+	if (smacs->window != NULL) {
+		SDL_GetWindowSize(smacs->window, w, h);
+	} else {
+		SDL_GetCurrentRenderOutputSize(smacs->renderer, w, h);
+	}
+}
+
+RenderPaneKey render_pane_key(Smacs *smacs, Pane *pane, bool is_active_pane, bool mini_buffer_is_active, int win_h)
+{
+	RenderPaneKey key;
+
+	memset(&key, 0, sizeof(key));
+	key.buffer = pane->buffer;
+	key.file_path = pane->buffer->file_path;
+	key.version = pane->buffer->version;
+	key.position = pane->position;
+	key.arena_start = pane->arena.start;
+	key.show_lines = pane->arena.show_lines;
+	key.wrap_cols = pane->wrap_cols;
+	key.hscroll = pane->hscroll;
+	key.x = pane->x;
+	key.y = pane->y;
+	key.w = pane->w;
+	key.h = pane->h;
+	key.char_w = smacs->char_w;
+	key.char_h = smacs->char_h;
+	key.line_number_format = smacs->line_number_format;
+	key.need_to_save = pane->buffer->need_to_save;
+	key.disk_changed = pane->buffer->disk_changed;
+	key.truncate_lines = smacs->editor.truncate_lines;
+	key.mini_buffer = mini_buffer_is_active && (int) (pane->y + pane->h) >= win_h;
+	key.active = is_active_pane;
+
+	return key;
+}
+
+/**
+ * Appends the glyphs of a pane, its items and rows are shifted to their place in the list
+ */
+void render_glyph_append(GlyphList *glyph, GlyphList *pane_glyph)
+{
+	size_t string_offset, item_offset;
+	GlyphItem item;
+	GlyphRow row;
+	register size_t i;
+
+	string_offset = glyph->string_data.len;
+	item_offset = glyph->len;
+
+	while (glyph->string_data.cap < string_offset + pane_glyph->string_data.len) {
+		glyph->string_data.data = gb_append_(glyph->string_data.data, &glyph->string_data.cap, sizeof(*glyph->string_data.data));
+	}
+	if (pane_glyph->string_data.len > 0) {
+		memcpy(&glyph->string_data.data[string_offset], pane_glyph->string_data.data, pane_glyph->string_data.len);
+	}
+	glyph->string_data.len += pane_glyph->string_data.len;
+
+	for (i = 0; i < pane_glyph->len; ++i) {
+		item = pane_glyph->data[i];
+		item.beg += string_offset;
+		gb_append(glyph, item);
+	}
+
+	for (i = 0; i < pane_glyph->rows.len; ++i) {
+		row = pane_glyph->rows.data[i];
+		row.glyph_beg += item_offset;
+		row.glyph_end += item_offset;
+		gb_append(&glyph->rows, row);
+	}
+}
+
+/**
+ * Lays out the rows and the mode line of the pane into its own glyph list
+ */
+void render_pane_glyph(Smacs *smacs, Pane *pane, size_t pane_index, GlyphList *glyph, bool mini_buffer_is_active, int win_h)
 {
 	Arena arena;
 	Line *lines;
 	Line *line;
-	size_t arena_end, cursor, region_beg, region_end, max_line_num, current_line, line_number_len, data_len, pane_index;
-	int win_w, win_h, content_limit, common_indention, text_indention, pane_width_threashold;
+	VisualLines *visual;
+	size_t arena_end, cursor, region_beg, region_end, max_line_num, current_line, line_number_len, data_len, text_cols;
+	int content_limit, common_indention, text_indention, mode_line_h;
 	StringBuilder *sb;
 	char *data, line_number[LINE_BUFFER_LEN];
-	bool is_active_pane, show_line_number, mini_buffer_is_active;
-	Pane *pane;
-	GlyphList *glyph;
-
-	glyph = &smacs->glyph;
-	render_glyph_clean(glyph);
-
-	SDL_GetWindowSize(smacs->window, &win_w, &win_h);
-	content_limit = win_h - (smacs->char_h * 2.5);
+	bool is_active_pane, show_line_number;
 
 	sb = &RenderStringBuilder;
 	sb_clean(sb);
@@ -343,158 +600,231 @@ void render_update_glyph(Smacs *smacs)
 	show_line_number = true;
 	if (smacs->line_number_format == HIDE) show_line_number = false;
 
-	mini_buffer_is_active = editor_is_mini_buffer_active(&smacs->editor);
+	//the panes at the bottom leave a row to the mini buffer
+	if ((int) (pane->y + pane->h) >= win_h) {
+		mode_line_h = win_h - (mini_buffer_is_active ? smacs->char_h*2 : smacs->char_h);
+		content_limit = win_h - (smacs->char_h * 2.5);
+	} else {
+		mode_line_h = pane->y + pane->h - smacs->char_h;
+		content_limit = pane->y + pane->h - (smacs->char_h * 1.5);
+	}
 
-	for (pane_index = 0; pane_index < smacs->editor.panes_len; ++pane_index) {
-		pane = &smacs->editor.panes[pane_index];
+	lines = pane->buffer->data;
+	data = pane->buffer->content.data;
+	data_len = pane->buffer->content.len;
+	is_active_pane = pane == smacs->editor.pane;
 
-		lines = pane->buffer->data;
-		arena = pane->arena;
-		data = pane->buffer->content.data;
-		data_len = pane->buffer->content.len;
-		is_active_pane = pane == smacs->editor.pane;
+	cursor = pane->position;
+	region_beg = MIN(smacs->editor.mark, cursor);
+	region_end = MAX(smacs->editor.mark, cursor);
+	assert(region_beg <= region_end);
 
-		cursor = pane->position;
-		region_beg = MIN(smacs->editor.mark, cursor);
-		region_end = MAX(smacs->editor.mark, cursor);
-		assert(region_beg <= region_end);
+	common_indention = pane->x;
+	//extra pixel is needed to not cover the seporator line
+	text_indention = common_indention + 1;
 
-		common_indention = pane->x;
-		//extra pixel is needed to not cover the seporator line
-		text_indention = common_indention + 1;
-		pane_width_threashold = pane->x + pane->w - (smacs->char_w * 2);
+	current_line = editor_get_current_line_number(pane) + 1;
+	if (show_line_number) {
+		max_line_num = MAX(pane->buffer->len, 1);
+		line_number_len = count_digits(max_line_num);
+		render_format_line_number_padding(line_number, line_number_len, max_line_num);
 
-		current_line = editor_get_current_line_number(pane) + 1;
-		if (show_line_number) {
-			max_line_num = arena.start + arena.show_lines;
-			line_number_len = count_digits(max_line_num);
-			render_format_line_number_padding(line_number, line_number_len, max_line_num);
+		text_indention += (smacs->char_w * line_number_len);
+	}
 
-			text_indention += (smacs->char_w * line_number_len);
-		}
+	text_cols = render_pane_text_cols(smacs, pane, text_indention);
+	editor_pane_wrap(&smacs->editor, pane, smacs->editor.truncate_lines ? 0 : text_cols);
+	visual = editor_visual_lines(&smacs->editor, pane);
+	if (visual->len > 0 && pane->arena.start >= visual->len) {
+		pane->arena.start = visual->len - 1;
+	}
+	editor_hscroll_recognize(&smacs->editor, pane, text_cols);
 
-		arena_end = MIN(arena.start + arena.show_lines, pane->buffer->len);
+	arena = pane->arena;
+	arena_end = MIN(arena.start + arena.show_lines, visual->len);
 
-		//MAIN BUFFERS RENDERING
-		{
-			PaneDrawingInfo *info = &((PaneDrawingInfo) {0});
-			info->x = 0;
-			info->content_hight = 0;
+	//MAIN BUFFERS RENDERING
+	{
+		PaneDrawingInfo *info = &((PaneDrawingInfo) {0});
+		info->x = 0;
+		info->content_hight = pane->y;
+
+		if(data_len == 0) {
+			render_row_begin(glyph, pane_index, info->content_hight, 0);
+			gb_append(glyph, ((GlyphItem) {0, 0, text_indention, info->content_hight, smacs->char_w, smacs->char_h, TEXT | CURSOR, 0}));
+			render_row_end(glyph, 0);
+		} else {
 
-			if(data_len == 0) {
-				gb_append(glyph, ((GlyphItem) {0, 0, text_indention, info->content_hight, smacs->char_w, smacs->char_h, TEXT | CURSOR, 0}));
-			} else {
+			assert(arena.start < arena_end);
+			size_t row_index, line_index, string_pointer, column;
+			bool first_row;
+			Line slice;
+			int w, h;
+
+			//a top row in the middle of a wrapped line has no line number
+			line_index = editor_line_by_position(pane->buffer, visual->data[arena.start].start);
+
+			info->selection = is_active_pane && smacs->editor.state & SELECTION && region_beg != region_end;
+			info->arena_start_point = lines[line_index].start;
+			if (lines[line_index].start != visual->data[arena.start].start) ++line_index;
+			info->data = data;
+			info->data_len = data_len;
+			info->pane_index = pane_index;
+			info->is_active_pane = is_active_pane;
+			info->region_beg = region_beg;
+			info->region_end = region_end;
+			info->cursor = cursor;
+			if (is_active_pane && pane->cursors.len > 0 && pane->cursors.version == pane->buffer->version) {
+				info->cursors = &pane->cursors;
+				info->cursor_index = 0;
+				info->cursors_selection = smacs->editor.state & SELECTION;
+			}
+			info->text_indention = text_indention;
+			info->text_limit = render_pane_text_limit(smacs, pane);
+			info->truncate_lines = smacs->editor.truncate_lines;
+			if (is_active_pane && smacs->editor.state & (SEARCH | REPLACE) && smacs->editor.matches.buffer == pane->buffer) {
+				editor_search_matches_visible(&smacs->editor, pane);
+				info->matches = &smacs->editor.matches;
+				info->match_index = editor_search_matches_lower_bound(info->matches, visual->data[arena.start].start);
+			}
+			if (pane->buffer->file_path_len > 2 && visual->data[arena_end-1].end - info->arena_start_point < RENDER_TOKENIZE_LIMIT) {
+				if (0 == strncmp(&pane->buffer->file_path[pane->buffer->file_path_len-2], ".c", 2) ||
+					0 == strncmp(&pane->buffer->file_path[pane->buffer->file_path_len-2], ".h", 2) ||
+					0 == strncmp(&pane->buffer->file_path[pane->buffer->file_path_len-6], ".scala", 6) ||
+					0 == strncmp(&pane->buffer->file_path[pane->buffer->file_path_len-5], ".java", 5)) {
+					info->c_like_file = true;
+					ProfileScope tokenize_scope = profiler_begin(PROFILE_TOKENIZE);
+					tokenize(&smacs->tokenize, &data[info->arena_start_point], MIN(visual->data[arena_end-1].end + 1, data_len) - info->arena_start_point);
+					profiler_end(tokenize_scope);
+				}
+			}
 
-				assert(arena.start < arena_end);
-				size_t line_index, string_pointer;
-				int w, h;
-
-				info->selection = is_active_pane && smacs->editor.state & SELECTION && region_beg != region_end;
-				info->arena_start_point = lines[arena.start].start;
-				info->data = data;
-				info->data_len = data_len;
-				info->is_active_pane = is_active_pane;
-				info->region_beg = region_beg;
-				info->region_end = region_end;
-				info->cursor = cursor;
-				info->text_indention = text_indention;
-				info->pane_width_threashold = pane_width_threashold;
-				if (pane->buffer->file_path_len > 2) {
-					if (0 == strncmp(&pane->buffer->file_path[pane->buffer->file_path_len-2], ".c", 2) ||
-						0 == strncmp(&pane->buffer->file_path[pane->buffer->file_path_len-2], ".h", 2) ||
-						0 == strncmp(&pane->buffer->file_path[pane->buffer->file_path_len-6], ".scala", 6) ||
-						0 == strncmp(&pane->buffer->file_path[pane->buffer->file_path_len-5], ".java", 5)) {
-						info->c_like_file = true;
-						tokenize(&smacs->tokenize, &data[info->arena_start_point], lines[arena_end-1].end + 1);
-					}
+			for (row_index = arena.start; row_index < arena_end; ++row_index) {
+				line = &visual->data[row_index];
+				info->x = text_indention;
+				if (content_limit <= info->content_hight) break;
+
+				//truncated lines are laid out from the first visible column
+				slice = *line;
+				if (info->truncate_lines && pane->hscroll > 0) {
+					slice.start = editor_position_by_column(&smacs->editor, pane->buffer, line, pane->hscroll, &column);
+					if (column > pane->hscroll) info->x += (int) (column - pane->hscroll) * smacs->char_w;
 				}
 
-				for (line_index = arena.start; line_index < arena_end; ++line_index) {
-					line = &lines[line_index];
-					info->x = text_indention;
-					if (content_limit <= info->content_hight) break;
-
-					if (show_line_number) {
-						render_format_display_line_number(smacs, line_number, line_number_len, line_index + 1, current_line);
-						TTF_GetStringSize(smacs->font, line_number, line_number_len, &w, &h);
-						string_pointer = glyph->string_data.len;
-						sb_append_manyl(&glyph->string_data, line_number, line_number_len);
-
-						gb_append(glyph,
-								  ((GlyphItem) {
-									  string_pointer,
-									  line_number_len,
-									  common_indention,
-									  info->content_hight,
-									  w,
-									  h,
-									  LINE_NUMBER,
-									  -1}));
+				render_row_begin(glyph, pane_index, info->content_hight, slice.start);
 
-					}
+				first_row = line_index < pane->buffer->len && lines[line_index].start == line->start;
+				if (first_row) ++line_index;
+
+				if (show_line_number && first_row) {
+					render_format_display_line_number(smacs, line_number, line_number_len, line_index, current_line);
+					TTF_GetStringSize(smacs->font, line_number, line_number_len, &w, &h);
+					string_pointer = glyph->string_data.len;
+					sb_append_manyl(&glyph->string_data, line_number, line_number_len);
+
+					gb_append(glyph,
+							  ((GlyphItem) {
+								  string_pointer,
+								  line_number_len,
+								  common_indention,
+								  info->content_hight,
+								  w,
+								  h,
+								  LINE_NUMBER,
+								  -1}));
 
-					render_line_processing(smacs, info, line, sb, glyph);
-					info->content_hight += (smacs->char_h + smacs->leading);
 				}
-			}
 
-			gb_append(glyph, ((GlyphItem) {
-					  .beg = 0,
-					  .len = 0,
-					  .x = pane->x+pane->w,
-					  .y = 0,
-					  .w = pane->x+pane->w,
-					  .h = pane->h-smacs->char_h * (mini_buffer_is_active ? 2 : 1),
-					  .kind = LINE,
-					  .position = -1}));
+				render_row_end(glyph, render_line_processing(smacs, info, &slice, sb, glyph));
+				info->content_hight += (smacs->char_h + smacs->leading);
+			}
 		}
 
-		//MODE LINE
-		{
-			int padding;
-			GlyphItem *item;
-			int mode_line_h;
+		gb_append(glyph, ((GlyphItem) {
+				  .beg = 0,
+				  .len = 0,
+				  .x = pane->x+pane->w,
+				  .y = pane->y,
+				  .w = pane->x+pane->w,
+				  .h = mode_line_h,
+				  .kind = LINE,
+				  .position = -1}));
+	}
 
-			padding = common_indention;
+	//MODE LINE
+	{
+		int padding;
+		GlyphItem *item;
 
-			if(pane->buffer->need_to_save) {
-				sb_append(sb, '*');
-			}
+		padding = common_indention;
 
-			render_append_file_path(sb, pane->buffer->file_path, smacs->home_dir, strlen(smacs->home_dir));
-			sb_append_many(sb, " (");
-			snprintf(line_number, LINE_BUFFER_LEN, "%ld", current_line);
-			sb_append_many(sb, line_number);
-			sb_append(sb, ')');
+		render_mode_line_text(smacs, sb, pane, is_active_pane, current_line);
 
-			if (is_active_pane) {
-				if (smacs->editor.state & SEARCH) {
-					sb_append(sb, ' ');
-					if (smacs->editor.state & BACKWARD_SEARCH) {
-						sb_append_many(sb, "Re-");
-					}
+		item = render_flush_item_sb_and_move_x(smacs, glyph, sb, &padding, mode_line_h, is_active_pane ? MODE_LINE_ACTIVE : MODE_LINE, -1);
+		if (item != NULL) {
+			item->w = pane->w;
+		}
+	}
+}
 
-					sb_append_many(sb, "Search[:enter next :C-g stop]");
-				} else if (smacs->editor.state & EXTEND_COMMAND) {
-					sb_append_many(sb, " C-x");
-				}
-			}
+/**
+ * Glyphs of the frame: the panes one after another and the mini buffer.
+ * The active pane is laid out every frame, the others only when their key
+ * changed, otherwise their glyphs of the last layout are copied.
+ */
+void render_update_glyph(Smacs *smacs)
+{
+	RenderPaneKey key;
+	RenderPane *cache;
+	size_t pane_index;
+	int win_w, win_h;
+	StringBuilder *sb;
+	bool is_active_pane, mini_buffer_is_active;
+	Pane *pane;
+	GlyphList *glyph;
 
-			mode_line_h = win_h - (mini_buffer_is_active ? smacs->char_h*2 : smacs->char_h);
+	ProfileScope scope = profiler_begin(PROFILE_UPDATE_GLYPH);
 
-			item = render_flush_item_sb_and_move_x(smacs, glyph, sb, &padding, mode_line_h, is_active_pane ? MODE_LINE_ACTIVE : MODE_LINE, -1);
-			if (item != NULL) {
-				item->w = pane->w;
-			}
+	glyph = &smacs->glyph;
+	render_glyph_clean(glyph);
+
+	render_output_size(smacs, &win_w, &win_h);
+	mini_buffer_is_active = editor_is_mini_buffer_active(&smacs->editor);
+
+	for (pane_index = 0; pane_index < smacs->editor.panes_len; ++pane_index) {
+		pane = &smacs->editor.panes[pane_index];
+		cache = &smacs->pane_glyphs[pane_index];
+		is_active_pane = pane == smacs->editor.pane;
+
+		key = render_pane_key(smacs, pane, is_active_pane, mini_buffer_is_active, win_h);
+		cache->dirty = is_active_pane || !cache->valid || memcmp(&key, &cache->key, sizeof(key)) != 0;
+
+		if (cache->dirty) {
+			render_glyph_clean(&cache->glyph);
+			render_pane_glyph(smacs, pane, pane_index, &cache->glyph, mini_buffer_is_active, win_h);
+			//the layout scrolls and wraps the pane, the key is what the next frame finds
+			cache->key = render_pane_key(smacs, pane, is_active_pane, mini_buffer_is_active, win_h);
+			cache->valid = true;
+			profiler_count(PROFILE_PANE_LAID_OUT);
+		} else {
+			profiler_count(PROFILE_PANE_REUSED);
 		}
+
+		cache->glyph_beg = glyph->len;
+		render_glyph_append(glyph, &cache->glyph);
+		cache->glyph_end = glyph->len;
 	}
 
 	//MINI BUFFER
 
+	sb = &RenderStringBuilder;
+	sb_clean(sb);
+	smacs->mini_buffer_glyph = glyph->len;
+
 	if (mini_buffer_is_active)
 	{
 		int completion_w, padding, complition_width_limit;
-		char *parens;
+		char *parens, *completion;
 
 		size_t home_dir_len = strlen(smacs->home_dir);
 		padding = smacs->char_w;
@@ -507,6 +837,11 @@ void render_update_glyph(Smacs *smacs)
 					render_append_file_path(sb, smacs->editor.dir, smacs->home_dir, home_dir_len);
 					sb_append(sb, '/');
 				}
+				if (smacs->editor.state & _PROJECT) {
+					sb_append_many(sb, "Project file: ");
+					render_append_file_path(sb, smacs->editor.project.root, smacs->home_dir, home_dir_len);
+					sb_append(sb, '/');
+				}
 
 				if (smacs->editor.user_input.len > 0) {
 					render_append_char_to_rendering_many(smacs, sb, smacs->editor.user_input.data, smacs->editor.user_input.len);
@@ -518,8 +853,10 @@ void render_update_glyph(Smacs *smacs)
 				}
 
 				sb_append(sb, parens[0]);
+				//the selected completion goes first, the rest follows around
 				for (size_t i = 0; i < smacs->editor.completor.filtered.len; ++i) {
-					render_append_file_path(sb, smacs->editor.completor.filtered.data[i], smacs->home_dir, home_dir_len);
+					completion = smacs->editor.completor.filtered.data[(smacs->editor.completor.selected + i) % smacs->editor.completor.filtered.len];
+					render_append_file_path(sb, completion, smacs->home_dir, home_dir_len);
 
 					if (i < (smacs->editor.completor.filtered.len-1)) {
 						sb_append_manyl(sb, COMPLETION_DELIMITER, COMPLETION_DELIMITER_LEN);
@@ -528,7 +865,7 @@ void render_update_glyph(Smacs *smacs)
 					TTF_GetStringSize(smacs->font, sb->data, sb->len, &completion_w, NULL);
 
 					if (completion_w >= complition_width_limit) {
-						sb->len = sb->len - strlen(smacs->editor.completor.filtered.data[i]) - COMPLETION_DELIMITER_LEN;
+						sb->len = sb->len - strlen(completion) - COMPLETION_DELIMITER_LEN;
 						memset(&sb->data[sb->len], 0, sb->cap - sb->len);
 						sb_append_many(sb, "...");
 						break;
@@ -543,11 +880,16 @@ void render_update_glyph(Smacs *smacs)
 					render_flush_item_sb_and_move_x(smacs, glyph, sb, &padding, win_h - smacs->char_h, MINI_BUFFER, -1);
 				}
 			}
+		} else if (smacs->editor.state & REPLACE) {
+			render_mini_buffer_replace_prompt(smacs, sb);
+			render_flush_item_sb_and_move_x(smacs, glyph, sb, &padding, win_h - smacs->char_h, MINI_BUFFER, -1);
 		} else if (strlen(smacs->notification) > 0) {
 			sb_append_many(sb, smacs->notification);
 			render_flush_item_sb_and_move_x(smacs, glyph, sb, &padding, win_h - smacs->char_h, MINI_BUFFER, -1);
 		}
 	}
+
+	profiler_end(scope);
 }
 
 void render_draw_batch(Smacs *smacs, GlyphItemEnum kind, char *string, size_t string_len, SDL_FRect *rect)
@@ -557,10 +899,14 @@ void render_draw_batch(Smacs *smacs, GlyphItemEnum kind, char *string, size_t st
 	if (kind & TEXT) {
 		if (kind & REGION) {
 			SDL_SetRenderDrawColor(smacs->renderer, smacs->region_background_color.r, smacs->region_background_color.g, smacs->region_background_color.b, smacs->region_background_color.a);
-			//small hack to fill space between the lines
-			SDL_FRect selection_rectangle = {.x = rect->x, .y = rect->y, .w = rect->w, .h = (rect->h * 1.2)};
+			//fill space between the lines without bleeding into the next row
+			SDL_FRect selection_rectangle = {.x = rect->x, .y = rect->y, .w = rect->w, .h = rect->h + smacs->leading};
 			SDL_RenderFillRect(smacs->renderer, &selection_rectangle);
 			foreground_color = smacs->region_foreground_color;
+		} else if (kind & MATCH) {
+			SDL_SetRenderDrawColor(smacs->renderer, smacs->match_background_color.r, smacs->match_background_color.g, smacs->match_background_color.b, smacs->match_background_color.a);
+			SDL_RenderFillRect(smacs->renderer, rect);
+			foreground_color = smacs->foreground_color;
 		} else if (kind & COMMENT) {
 			foreground_color = smacs->comment_foreground_color;
 		} else if (kind & NUMBER) {
@@ -605,39 +951,32 @@ void render_draw_batch(Smacs *smacs, GlyphItemEnum kind, char *string, size_t st
 	}
 }
 
-void render_glyph_show(Smacs *smacs)
+void render_glyph_show_range(Smacs *smacs, size_t beg, size_t end)
 {
-	GlyphItem *item, *prev_item;
+	GlyphItem *item, *batch;
 	SDL_FRect rect;
 	char *string_beginning;
 	size_t string_len_to_show;
 
 	rect = (SDL_FRect) {0.0, 0.0, 0.0, 0.0};
+	batch = NULL;
 	string_beginning = NULL;
 	string_len_to_show = 0;
 
-
-	for (size_t i = 0; i < smacs->glyph.len; ++i) {
+	for (size_t i = beg; i < end; ++i) {
 		item = &smacs->glyph.data[i];
 
-		if (i == 0) {
-			string_beginning = &smacs->glyph.string_data.data[item->beg];
-			string_len_to_show = item->len;
-		}
-
-		if (i > 0) {
-			prev_item = &smacs->glyph.data[i-1];
-
-			if (prev_item->y == item->y && prev_item->kind == item->kind) {
-				if (item->len > 0) string_len_to_show += item->len;
-
+		if (batch != NULL) {
+			if (batch->y == item->y && batch->kind == item->kind) {
+				string_len_to_show += item->len;
 				rect.w += item->w;
 				continue;
 			}
 
-			render_draw_batch(smacs, prev_item->kind, string_beginning, string_len_to_show, &rect);
+			render_draw_batch(smacs, batch->kind, string_beginning, string_len_to_show, &rect);
 		}
 
+		batch = item;
 		rect.x = item->x;
 		rect.y = item->y;
 		rect.h = item->h;
@@ -645,20 +984,188 @@ void render_glyph_show(Smacs *smacs)
 
 		string_beginning = &smacs->glyph.string_data.data[item->beg];
 		string_len_to_show = item->len;
-		if (i == (smacs->glyph.len-1)) {
-			if (string_len_to_show > 0 || item->kind & CURSOR) {
-				render_draw_batch(smacs, item->kind, string_beginning, string_len_to_show, &rect);
-			}
+	}
+
+	if (batch != NULL) {
+		render_draw_batch(smacs, batch->kind, string_beginning, string_len_to_show, &rect);
+	}
+}
+
+void render_glyph_show(Smacs *smacs)
+{
+	ProfileScope scope = profiler_begin(PROFILE_GLYPH_SHOW);
+	render_glyph_show_range(smacs, 0, smacs->glyph.len);
+	profiler_end(scope);
+}
+
+/**
+ * Draws only the panes laid out in the last frame and the mini buffer,
+ * the rest of the frame texture stays from the previous frames
+ */
+void render_glyph_show_changed(Smacs *smacs)
+{
+	RenderPane *cache;
+	Pane *pane;
+	SDL_FRect rect;
+	SDL_Rect clip;
+	int win_w, win_h, left;
+
+	ProfileScope scope = profiler_begin(PROFILE_GLYPH_SHOW);
+
+	SDL_SetRenderDrawColor(smacs->renderer, smacs->background_color.r, smacs->background_color.g, smacs->background_color.b, smacs->background_color.a);
+
+	for (size_t i = 0; i < smacs->editor.panes_len; ++i) {
+		cache = &smacs->pane_glyphs[i];
+		if (!cache->dirty) continue;
+
+		pane = &smacs->editor.panes[i];
+		//one pixel from the left keeps the separator line of the previous pane
+		left = pane->x > 0 ? 1 : 0;
+		rect = (SDL_FRect) {pane->x + left, pane->y, pane->w - left, pane->h};
+		SDL_RenderFillRect(smacs->renderer, &rect);
+
+		//a long mode line does not run into the next pane, the separator line on the right is kept
+		clip = (SDL_Rect) {pane->x, pane->y, pane->w + 1, pane->h};
+		SDL_SetRenderClipRect(smacs->renderer, &clip);
+		render_glyph_show_range(smacs, cache->glyph_beg, cache->glyph_end);
+		SDL_SetRenderClipRect(smacs->renderer, NULL);
+		SDL_SetRenderDrawColor(smacs->renderer, smacs->background_color.r, smacs->background_color.g, smacs->background_color.b, smacs->background_color.a);
+	}
+
+	if (editor_is_mini_buffer_active(&smacs->editor)) {
+		render_output_size(smacs, &win_w, &win_h);
+		rect = (SDL_FRect) {0, win_h - smacs->char_h, win_w, smacs->char_h};
+		SDL_RenderFillRect(smacs->renderer, &rect);
+		render_glyph_show_range(smacs, smacs->mini_buffer_glyph, smacs->glyph.len);
+	}
+
+	profiler_end(scope);
+}
+
+void render_present(Smacs *smacs)
+{
+	ProfileScope scope;
+
+	if (smacs->frame != NULL) {
+		SDL_RenderTexture(smacs->renderer, smacs->frame, NULL, NULL);
+	}
+
+	scope = profiler_begin(PROFILE_PRESENT);
+	SDL_RenderPresent(smacs->renderer);
+	profiler_end(scope);
+}
+
+void render_profiler_line(Smacs *smacs, int x, int *y, char *line)
+{
+	render_draw_text_no_cache(smacs, x, *y, line, strlen(line), smacs->foreground_color);
+	hashmap_remove(&smacs->surface_by_string, line, strlen(line));
+	*y += smacs->char_h + smacs->leading;
+}
+
+/**
+ * Timings of the last frame and their averages in the top right corner
+ */
+void render_profiler_overlay(Smacs *smacs)
+{
+	char line[LINE_BUFFER_LEN];
+	int win_w, win_h, x, y, overlay_w, overlay_h;
+	double hit_rate;
+	SDL_FRect rect;
+
+	render_output_size(smacs, &win_w, &win_h);
+
+	overlay_w = smacs->char_w * 34;
+	overlay_h = (smacs->char_h + smacs->leading) * (PROFILE_ZONES_LEN + 4);
+	x = win_w - overlay_w;
+	y = 0;
+
+	rect = (SDL_FRect) {x, y, overlay_w, overlay_h};
+	SDL_SetRenderDrawColor(smacs->renderer, smacs->mode_line_background_color.r, smacs->mode_line_background_color.g, smacs->mode_line_background_color.b, smacs->mode_line_background_color.a);
+	SDL_RenderFillRect(smacs->renderer, &rect);
+	x += smacs->char_w;
+
+	snprintf(line, LINE_BUFFER_LEN, "%-15s %6s %6s", "ms", "last", "avg");
+	render_profiler_line(smacs, x, &y, line);
+
+	snprintf(line, LINE_BUFFER_LEN, "%-15s %6.2f %6.2f", "frame", profiler.frame_ms, profiler.frame_average_ms);
+	render_profiler_line(smacs, x, &y, line);
+
+	for (size_t zone = 0; zone < PROFILE_ZONES_LEN; ++zone) {
+		snprintf(line, LINE_BUFFER_LEN, "%-15s %6.2f %6.2f",
+				 profiler_zone_name(zone), profiler_ticks_to_ms(profiler.frame_ticks[zone]), profiler.average_ms[zone]);
+		render_profiler_line(smacs, x, &y, line);
+	}
+
+	hit_rate = profiler_cache_hit_rate();
+	if (hit_rate < 0) {
+		snprintf(line, LINE_BUFFER_LEN, "%-15s %6s", "text cache", "-");
+	} else {
+		snprintf(line, LINE_BUFFER_LEN, "%-15s %5.1f%%", "text cache", hit_rate);
+	}
+	render_profiler_line(smacs, x, &y, line);
+
+	snprintf(line, LINE_BUFFER_LEN, "%-15s %ld/%ld", "panes laid out",
+			 profiler.frame_counters[PROFILE_PANE_LAID_OUT],
+			 profiler.frame_counters[PROFILE_PANE_LAID_OUT] + profiler.frame_counters[PROFILE_PANE_REUSED]);
+	render_profiler_line(smacs, x, &y, line);
+}
+
+/**
+ * Draws the glyph list. Frames are kept in a target texture so that
+ * small changes (e.g. drag selection) can redraw only the rows they touch
+ * and a frame redraws only the panes which were laid out again.
+ */
+void render_draw_smacs(Smacs *smacs)
+{
+	int out_w, out_h;
+	float frame_w, frame_h;
+	bool whole;
+
+	SDL_GetCurrentRenderOutputSize(smacs->renderer, &out_w, &out_h);
+
+	if (smacs->frame != NULL) {
+		SDL_GetTextureSize(smacs->frame, &frame_w, &frame_h);
+		if ((int) frame_w != out_w || (int) frame_h != out_h) {
+			SDL_DestroyTexture(smacs->frame);
+			smacs->frame = NULL;
+		}
+	}
+
+	//the overlay covers the panes, they are drawn whole while it is shown and once after
+	whole = smacs->frame == NULL || profiler.overlay || smacs->overlay_drawn || smacs->panes_drawn != smacs->editor.panes_len;
+
+	if (smacs->frame == NULL) {
+		smacs->frame = SDL_CreateTexture(smacs->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, out_w, out_h);
+		if (smacs->frame != NULL) {
+			SDL_SetTextureBlendMode(smacs->frame, SDL_BLENDMODE_NONE);
 		}
 	}
+
+	SDL_SetRenderTarget(smacs->renderer, smacs->frame);
+	if (whole) {
+		SDL_SetRenderDrawColor(smacs->renderer, smacs->background_color.r, smacs->background_color.g, smacs->background_color.b, smacs->background_color.a);
+		SDL_RenderClear(smacs->renderer);
+		render_glyph_show(smacs);
+	} else {
+		render_glyph_show_changed(smacs);
+	}
+	if (profiler.overlay) render_profiler_overlay(smacs);
+	SDL_SetRenderTarget(smacs->renderer, NULL);
+
+	smacs->overlay_drawn = profiler.overlay;
+	smacs->panes_drawn = smacs->editor.panes_len;
+
+	render_present(smacs);
 }
 
 void render_destroy_smacs(Smacs *smacs)
 {
 	editor_destroy(&smacs->editor);
 	render_destroy_glyph(&smacs->glyph);
+	for (size_t i = 0; i < PANES_MAX_SIZE; ++i) render_destroy_glyph(&smacs->pane_glyphs[i].glyph);
+	if (smacs->frame != NULL) SDL_DestroyTexture(smacs->frame);
 	SDL_DestroyRenderer(smacs->renderer);
-	SDL_DestroyWindow(smacs->window);
+	if (smacs->window != NULL) SDL_DestroyWindow(smacs->window);
 	free(smacs->notification);
 	TTF_CloseFont(smacs->font);
 	TTF_CloseFont(smacs->fallback_font);
@@ -668,24 +1175,239 @@ void render_destroy_smacs(Smacs *smacs)
 	hashmap_destroy(&smacs->surface_by_string);
 }
 
+void render_dump_glyph(Smacs *smacs, FILE *out)
+{
+	GlyphItem *item;
+
+	for (size_t i = 0; i < smacs->glyph.len; ++i) {
+		item = &smacs->glyph.data[i];
+		fprintf(out, "%d %.0f %.0f %.0f %.0f %ld \"%.*s\"\n",
+				item->kind, item->x, item->y, item->w, item->h, item->position,
+				(int) item->len, &smacs->glyph.string_data.data[item->beg]);
+	}
+}
+
+/**
+ * Rows of the pane with the given index are [*rows_beg, *rows_end)
+ */
+void render_pane_rows(GlyphRows *rows, size_t pane_index, size_t *rows_beg, size_t *rows_end)
+{
+	size_t lo, hi, mid;
+
+	lo = 0;
+	hi = rows->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (rows->data[mid].pane_index < pane_index) lo = mid + 1;
+		else hi = mid;
+	}
+	*rows_beg = lo;
+
+	hi = rows->len;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (rows->data[mid].pane_index <= pane_index) lo = mid + 1;
+		else hi = mid;
+	}
+	*rows_end = lo;
+}
+
+/**
+ * First row in [rows_beg, rows_end) which ends at or after the position
+ */
+size_t render_row_by_position(GlyphRows *rows, size_t rows_beg, size_t rows_end, size_t position)
+{
+	size_t mid;
+
+	while (rows_beg < rows_end) {
+		mid = rows_beg + (rows_end - rows_beg) / 2;
+		if (rows->data[mid].end < position) rows_beg = mid + 1;
+		else rows_end = mid;
+	}
+
+	return rows_beg;
+}
+
+size_t render_active_pane_index(Smacs *smacs)
+{
+	return (size_t) (smacs->editor.pane - smacs->editor.panes);
+}
+
 long render_find_position_by_xy(Smacs *smacs, int x, int y)
 {
-	GlyphItem item;
-	long point = -1;
+	GlyphRows *rows;
+	GlyphRow *row;
+	GlyphItem *item;
+	size_t rows_beg, rows_end, lo, hi, mid;
+
+	rows = &smacs->glyph.rows;
+	render_pane_rows(rows, render_active_pane_index(smacs), &rows_beg, &rows_end);
+	if (rows_beg == rows_end) return -1;
+
+	//last row that starts above the point, clicks outside of the text stick to the nearest row
+	lo = rows_beg;
+	hi = rows_end;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (rows->data[mid].y <= y) lo = mid + 1;
+		else hi = mid;
+	}
+	row = &rows->data[lo > rows_beg ? lo - 1 : rows_beg];
 
-	/*
-	fixme(ivan):
-		Now it works fine but if you click to empty space it should found a line (x) first
-		and if in the current line no fitted y char put it in the end of the line
-	*/
+	for (size_t i = row->glyph_beg; i < row->glyph_end; ++i) {
+		item = &smacs->glyph.data[i];
+		if (item->position < 0) continue;
+		if (x < item->x + item->w) return item->position;
+	}
 
-	for (size_t i = 0; i < smacs->glyph.len; ++i) {
-		item = smacs->glyph.data[i];
-		if (item.y >= y && item.x >= x) {
-			point = item.position;
-			break;
+	return (long) row->end;
+}
+
+RenderSelection render_selection_snapshot(Smacs *smacs)
+{
+	Editor *editor = &smacs->editor;
+	Pane *pane = editor->pane;
+
+	return (RenderSelection) {
+		.pane = pane,
+		.cursor = pane->position,
+		.mark = editor->mark,
+		.arena_start = pane->arena.start,
+		.line = editor_get_current_line_number(pane),
+		.selection = editor->state & SELECTION && editor->mark != pane->position,
+	};
+}
+
+/**
+ * Re-applies REGION and CURSOR to items of rows which intersect [beg, end)
+ * and redraws the rows that changed
+ */
+void render_update_selection_rows(Smacs *smacs, RenderSelection *now, size_t rows_beg, size_t rows_end, size_t beg, size_t end)
+{
+	GlyphRow *row;
+	GlyphItem *item;
+	GlyphItemEnum kind;
+	SDL_FRect rect;
+	size_t row_i, region_beg, region_end, position;
+	bool changed;
+
+	if (beg >= end) return;
+
+	region_beg = MIN(now->mark, now->cursor);
+	region_end = MAX(now->mark, now->cursor);
+
+	row_i = render_row_by_position(&smacs->glyph.rows, rows_beg, rows_end, beg);
+	for (; row_i < rows_end; ++row_i) {
+		row = &smacs->glyph.rows.data[row_i];
+		if (row->start >= end) break;
+
+		changed = false;
+		for (size_t i = row->glyph_beg; i < row->glyph_end; ++i) {
+			item = &smacs->glyph.data[i];
+			if (item->position < 0 || !(item->kind & TEXT)) continue;
+
+			position = (size_t) item->position;
+			kind = item->kind & ~(REGION | CURSOR);
+			if (now->selection && region_beg <= position && position < region_end) kind |= REGION;
+			if (position == now->cursor) kind |= CURSOR;
+
+			if (kind != item->kind) {
+				item->kind = kind;
+				changed = true;
+			}
 		}
+
+		if (!changed) continue;
+
+		//one pixel from the left keeps the separator line of the previous pane
+		rect = (SDL_FRect) {
+			.x = now->pane->x + 1,
+			.y = row->y,
+			.w = now->pane->w - 1,
+			.h = smacs->char_h + smacs->leading};
+		SDL_SetRenderDrawColor(smacs->renderer, smacs->background_color.r, smacs->background_color.g, smacs->background_color.b, smacs->background_color.a);
+		SDL_RenderFillRect(smacs->renderer, &rect);
+		render_glyph_show_range(smacs, row->glyph_beg, row->glyph_end);
+	}
+}
+
+void render_update_mode_line(Smacs *smacs, Pane *pane, size_t rows_end, size_t current_line)
+{
+	GlyphItem *item;
+	StringBuilder *sb;
+	size_t i;
+
+	i = smacs->glyph.rows.data[rows_end - 1].glyph_end;
+	for (; i < smacs->glyph.len; ++i) {
+		if (smacs->glyph.data[i].kind & (MODE_LINE | MODE_LINE_ACTIVE)) break;
+	}
+	if (i == smacs->glyph.len) return;
+
+	sb = &RenderStringBuilder;
+	sb_clean(sb);
+	render_mode_line_text(smacs, sb, pane, true, current_line);
+
+	item = &smacs->glyph.data[i];
+	item->beg = smacs->glyph.string_data.len;
+	item->len = sb->len;
+	sb_append_manyl(&smacs->glyph.string_data, sb->data, sb->len);
+	sb_clean(sb);
+
+	render_glyph_show_range(smacs, i, i + 1);
+}
+
+/**
+ * Patches the glyphs of the last layout after the cursor or the mark moved.
+ * Returns false when the change is not local to the visible rows and the
+ * viewport has to be laid out again.
+ */
+bool render_update_selection(Smacs *smacs, RenderSelection *before)
+{
+	RenderSelection now;
+	GlyphRows *rows;
+	GlyphRow *row;
+	size_t rows_beg, rows_end, row_i;
+
+	if (smacs->frame == NULL) return false;
+
+	now = render_selection_snapshot(smacs);
+	if (now.pane != before->pane) return false;
+	if (now.arena_start != before->arena_start) return false;
+	if (now.line != before->line && smacs->line_number_format == RELATIVE) return false;
+
+	rows = &smacs->glyph.rows;
+	render_pane_rows(rows, render_active_pane_index(smacs), &rows_beg, &rows_end);
+	if (rows_beg == rows_end) return false;
+
+	row_i = render_row_by_position(rows, rows_beg, rows_end, now.cursor);
+	if (row_i == rows_end) return false;
+	row = &rows->data[row_i];
+	if (now.cursor < row->start) return false;
+	//a truncated line shorter than the horizontal scroll, the view has to scroll back
+	if (now.pane->hscroll > 0 && row->start == row->end) return false;
+
+	SDL_SetRenderTarget(smacs->renderer, smacs->frame);
+
+	if (before->selection && now.selection) {
+		render_update_selection_rows(smacs, &now, rows_beg, rows_end,
+				MIN(MIN(before->mark, before->cursor), MIN(now.mark, now.cursor)),
+				MAX(MIN(before->mark, before->cursor), MIN(now.mark, now.cursor)));
+		render_update_selection_rows(smacs, &now, rows_beg, rows_end,
+				MIN(MAX(before->mark, before->cursor), MAX(now.mark, now.cursor)),
+				MAX(MAX(before->mark, before->cursor), MAX(now.mark, now.cursor)));
+	} else if (before->selection) {
+		render_update_selection_rows(smacs, &now, rows_beg, rows_end, MIN(before->mark, before->cursor), MAX(before->mark, before->cursor));
+	} else if (now.selection) {
+		render_update_selection_rows(smacs, &now, rows_beg, rows_end, MIN(now.mark, now.cursor), MAX(now.mark, now.cursor));
+	}
+
+	render_update_selection_rows(smacs, &now, rows_beg, rows_end, before->cursor, before->cursor + 1);
+	render_update_selection_rows(smacs, &now, rows_beg, rows_end, now.cursor, now.cursor + 1);
+
+	if (now.line != before->line) {
+		render_update_mode_line(smacs, now.pane, rows_end, now.line + 1);
 	}
 
-	return point;
+	SDL_SetRenderTarget(smacs->renderer, NULL);
+	return true;
 }
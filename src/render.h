@@ -1,14 +1,18 @@
 #ifndef RENDER_H
 #define RENDER_H
 
+#include <stdio.h>
 #include <SDL3/SDL.h>
 #include <SDL3_ttf/SDL_ttf.h>
 #include "editor.h"
 #include "tokenize.h"
 #include "hashmap.h"
+#include "macro.h"
 
 #define RENDER_NOTIFICATION_LEN 256
 #define SURFACE_HASHMAP_LIMIT   10000
+//highlighting is skipped when the visible text is longer (e.g. huge one line files)
+#define RENDER_TOKENIZE_LIMIT   (1 << 20)
 #define COMPLETION_DELIMITER " | "
 #define COMPLETION_DELIMITER_LEN (strlen(COMPLETION_DELIMITER))
 
@@ -24,6 +28,7 @@ typedef enum {
 	NUMBER = 0x100,
 	STRING = 0x200,
 	COMMENT = 0x400,
+	MATCH = 0x800,
 } GlyphItemEnum;
 
 typedef struct {
@@ -42,33 +47,116 @@ typedef struct {
 
 #define fprintf_item(std, it) fprintf(std, "GlyphItem(%ld,%ld,%f,%f,%f,%f,%d)\n", (it)->beg, (it)->len, (it)->x, (it)->y, (it)->w, (it)->h, (it)->kind);
 
+/**
+ * One screen row of a pane: buffer positions [start, end] laid out by
+ * glyph items [glyph_beg, glyph_end). Rows of a pane are stored
+ * contiguously and ordered by y, which makes hit-testing a bisection.
+ */
+typedef struct {
+	size_t start;
+	size_t end;
+
+	size_t glyph_beg;
+	size_t glyph_end;
+
+	float y;
+	size_t pane_index;
+} GlyphRow;
+
+typedef struct {
+	GlyphRow *data;
+	size_t len;
+	size_t cap;
+} GlyphRows;
+
 typedef struct {
 	StringBuilder string_data;
+	GlyphRows rows;
 
 	GlyphItem *data;
 	size_t len;
 	size_t cap;
 } GlyphList;
 
+/**
+ * What the last layout knows about the selection; used to patch glyph kinds
+ * in place instead of laying out the whole viewport again.
+ */
+typedef struct {
+	Pane *pane;
+	size_t cursor;
+	size_t mark;
+	size_t arena_start;
+	size_t line;
+	bool selection;
+} RenderSelection;
+
 enum LineNumberFormat {
 	ABSOLUTE,
 	RELATIVE,
 	HIDE,
 };
 
+/**
+ * What the glyphs of a pane depend on. A pane with the same key as in the
+ * last frame is not laid out again. Keys are compared by memcmp, they are
+ * zeroed before the fields are set.
+ */
+typedef struct {
+	Buffer *buffer;
+	char *file_path;
+	size_t version;
+	size_t position;
+	size_t arena_start;
+	size_t show_lines;
+	size_t wrap_cols;
+	size_t hscroll;
+
+	uint32_t x;
+	uint32_t y;
+	uint32_t w;
+	uint32_t h;
+	int char_w;
+	int char_h;
+
+	enum LineNumberFormat line_number_format;
+	bool need_to_save;
+	bool disk_changed;
+	bool truncate_lines;
+	bool mini_buffer; //only for the panes at the bottom, their mode line moves up
+	bool active;
+} RenderPaneKey;
+
+/**
+ * Glyphs of a pane as it was laid out last, they are copied to
+ * [glyph_beg, glyph_end) of the frame glyph list
+ */
+typedef struct {
+	GlyphList glyph;
+	RenderPaneKey key;
+	bool valid;
+	bool dirty; //laid out in the last frame, its rect is drawn again
+
+	size_t glyph_beg;
+	size_t glyph_end;
+} RenderPane;
+
 typedef struct {
 	SDL_Window *window;
 	SDL_Renderer *renderer;
+	SDL_Texture *frame;
 	TTF_Font *font;
 	TTF_Font *fallback_font;
 	int font_size;
 
 	Editor editor;
+	Macro macro;
 
 	SDL_Color background_color;
 	SDL_Color foreground_color;
 	SDL_Color region_background_color;
 	SDL_Color region_foreground_color;
+	SDL_Color match_background_color;
 	SDL_Color line_number_color;
 	SDL_Color mode_line_background_color;
 	SDL_Color mode_line_foreground_color;
@@ -86,6 +174,10 @@ typedef struct {
 	char *home_dir;
 
 	GlyphList glyph;
+	RenderPane pane_glyphs[PANES_MAX_SIZE];
+	size_t mini_buffer_glyph; //the mini buffer items follow the panes in the glyph list
+	size_t panes_drawn;
+	bool overlay_drawn;
 	Tokens tokenize;
 
 	int char_h, char_w;
@@ -94,10 +186,15 @@ typedef struct {
 } Smacs;
 
 void render_draw_smacs(Smacs *smacs);
+void render_present(Smacs *smacs);
 void render_destroy_smacs(Smacs *smacs);
 void render_update_glyph(Smacs *smacs);
 void render_glyph_show(Smacs *smacs);
 long render_find_position_by_xy(Smacs *smacs, int x, int y);
+RenderSelection render_selection_snapshot(Smacs *smacs);
+bool render_update_selection(Smacs *smacs, RenderSelection *before);
 void render_clean_textures_cache(Smacs *smacs);
+void render_output_size(Smacs *smacs, int *w, int *h);
+void render_dump_glyph(Smacs *smacs, FILE *out);
 
 #endif
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "search.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SEARCH_X86
+#include <immintrin.h>
+#endif
+
+static inline unsigned char search_fold(unsigned char ch)
+{
+	return ch >= 'A' && ch <= 'Z' ? ch + ('a' - 'A') : ch;
+}
+
+static inline unsigned char search_unfold(unsigned char ch)
+{
+	return ch >= 'a' && ch <= 'z' ? ch - ('a' - 'A') : ch;
+}
+
+static inline bool search_equal(const unsigned char *text, const unsigned char *needle, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		if (search_fold(text[i]) != needle[i]) return false;
+	}
+
+	return true;
+}
+
+#ifndef SEARCH_X86
+static uint32_t search_block_mask_scalar(const unsigned char *needle, size_t len, const unsigned char *text)
+{
+	uint32_t mask = 0;
+
+	for (uint32_t i = 0; i < 32; ++i) {
+		if (search_fold(text[i]) == needle[0] && search_fold(text[i + len - 1]) == needle[len - 1]) {
+			mask |= (uint32_t) 1 << i;
+		}
+	}
+
+	return mask;
+}
+#else
+static uint32_t search_block_mask_sse2(const unsigned char *needle, size_t len, const unsigned char *text)
+{
+	__m128i first_lower, first_upper, last_lower, last_upper, first, last, eq_first, eq_last;
+
+	first_lower = _mm_set1_epi8((char) needle[0]);
+	first_upper = _mm_set1_epi8((char) search_unfold(needle[0]));
+	last_lower = _mm_set1_epi8((char) needle[len - 1]);
+	last_upper = _mm_set1_epi8((char) search_unfold(needle[len - 1]));
+
+	first = _mm_loadu_si128((const __m128i *) text);
+	last = _mm_loadu_si128((const __m128i *) (text + len - 1));
+
+	eq_first = _mm_or_si128(_mm_cmpeq_epi8(first, first_lower), _mm_cmpeq_epi8(first, first_upper));
+	eq_last = _mm_or_si128(_mm_cmpeq_epi8(last, last_lower), _mm_cmpeq_epi8(last, last_upper));
+
+	return (uint32_t) _mm_movemask_epi8(_mm_and_si128(eq_first, eq_last));
+}
+
+__attribute__((target("avx2")))
+static uint32_t search_block_mask_avx2(const unsigned char *needle, size_t len, const unsigned char *text)
+{
+	__m256i first_lower, first_upper, last_lower, last_upper, first, last, eq_first, eq_last;
+
+	first_lower = _mm256_set1_epi8((char) needle[0]);
+	first_upper = _mm256_set1_epi8((char) search_unfold(needle[0]));
+	last_lower = _mm256_set1_epi8((char) needle[len - 1]);
+	last_upper = _mm256_set1_epi8((char) search_unfold(needle[len - 1]));
+
+	first = _mm256_loadu_si256((const __m256i *) text);
+	last = _mm256_loadu_si256((const __m256i *) (text + len - 1));
+
+	eq_first = _mm256_or_si256(_mm256_cmpeq_epi8(first, first_lower), _mm256_cmpeq_epi8(first, first_upper));
+	eq_last = _mm256_or_si256(_mm256_cmpeq_epi8(last, last_lower), _mm256_cmpeq_epi8(last, last_upper));
+
+	return (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(eq_first, eq_last));
+}
+#endif
+
+void search_compile(SearchPattern *pattern, const char *needle, size_t len)
+{
+	pattern->needle = malloc(len + 1);
+	pattern->len = len;
+	for (size_t i = 0; i < len; ++i) pattern->needle[i] = search_fold((unsigned char) needle[i]);
+	pattern->needle[len] = '\0';
+
+	pattern->horspool = len >= SEARCH_HORSPOOL_MIN_LEN;
+	if (pattern->horspool) {
+		for (size_t ch = 0; ch < 256; ++ch) {
+			pattern->shift[ch] = len;
+			pattern->shift_backward[ch] = len;
+		}
+
+		//the distance from the last (first) byte of the window to the closest same byte of the needle
+		for (size_t i = 0; i + 1 < len; ++i) pattern->shift[pattern->needle[i]] = len - 1 - i;
+		for (size_t i = len - 1; i > 0; --i) pattern->shift_backward[pattern->needle[i]] = i;
+	}
+
+#ifdef SEARCH_X86
+	if (__builtin_cpu_supports("avx2")) {
+		pattern->block_mask = search_block_mask_avx2;
+		pattern->block = 32;
+	} else {
+		pattern->block_mask = search_block_mask_sse2;
+		pattern->block = 16;
+	}
+#else
+	pattern->block_mask = search_block_mask_scalar;
+	pattern->block = 32;
+#endif
+}
+
+void search_free(SearchPattern *pattern)
+{
+	free(pattern->needle);
+	pattern->needle = NULL;
+	pattern->len = 0;
+}
+
+bool search_match_at(SearchPattern *pattern, const char *text, size_t text_len, size_t position)
+{
+	if (position > text_len || pattern->len > text_len - position) return false;
+
+	return search_equal((const unsigned char *) &text[position], pattern->needle, pattern->len);
+}
+
+static long search_horspool_forward(SearchPattern *pattern, const unsigned char *text, size_t from, size_t last)
+{
+	size_t len = pattern->len;
+
+	for (size_t i = from; i <= last; i += pattern->shift[search_fold(text[i + len - 1])]) {
+		if (search_fold(text[i + len - 1]) == pattern->needle[len - 1]
+			&& search_equal(&text[i], pattern->needle, len - 1)) {
+			return (long) i;
+		}
+	}
+
+	return -1;
+}
+
+static long search_horspool_backward(SearchPattern *pattern, const unsigned char *text, size_t from)
+{
+	size_t len = pattern->len, shift;
+
+	for (size_t i = from;; i -= shift) {
+		if (search_fold(text[i]) == pattern->needle[0]
+			&& search_equal(&text[i + 1], &pattern->needle[1], len - 1)) {
+			return (long) i;
+		}
+
+		shift = pattern->shift_backward[search_fold(text[i])];
+		if (shift > i) break;
+	}
+
+	return -1;
+}
+
+long search_forward(SearchPattern *pattern, const char *data, size_t text_len, size_t from)
+{
+	const unsigned char *text = (const unsigned char *) data;
+	size_t len, last, i, bit;
+	uint32_t mask;
+
+	len = pattern->len;
+	if (len == 0 || len > text_len || from > text_len - len) return -1;
+	last = text_len - len;
+
+	if (pattern->horspool) return search_horspool_forward(pattern, text, from, last);
+
+	//the first and the last byte of the window are checked by blocks, the rest only for candidates
+	for (i = from; i + pattern->block - 1 <= last; i += pattern->block) {
+		mask = pattern->block_mask(pattern->needle, len, &text[i]);
+		while (mask != 0) {
+			bit = (size_t) __builtin_ctz(mask);
+			if (search_equal(&text[i + bit + 1], &pattern->needle[1], len - 1)) return (long) (i + bit);
+			mask &= mask - 1;
+		}
+	}
+
+	for (; i <= last; ++i) {
+		if (search_equal(&text[i], pattern->needle, len)) return (long) i;
+	}
+
+	return -1;
+}
+
+long search_backward(SearchPattern *pattern, const char *data, size_t text_len, size_t from)
+{
+	const unsigned char *text = (const unsigned char *) data;
+	size_t len, end, i, bit;
+	uint32_t mask;
+
+	len = pattern->len;
+	if (len == 0 || len > text_len) return -1;
+	from = MIN(from, text_len - len);
+
+	if (pattern->horspool) return search_horspool_backward(pattern, text, from);
+
+	//blocks go down from the end, end is the exclusive bound of the window starts left
+	for (end = from + 1; end >= pattern->block; end -= pattern->block) {
+		i = end - pattern->block;
+		mask = pattern->block_mask(pattern->needle, len, &text[i]);
+		while (mask != 0) {
+			bit = 31 - (size_t) __builtin_clz(mask);
+			if (search_equal(&text[i + bit + 1], &pattern->needle[1], len - 1)) return (long) (i + bit);
+			mask &= ~((uint32_t) 1 << bit);
+		}
+	}
+
+	while (end > 0) {
+		--end;
+		if (search_equal(&text[end], pattern->needle, len)) return (long) end;
+	}
+
+	return -1;
+}
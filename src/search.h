@@ -0,0 +1,39 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//needles of this length and longer are searched by Boyer-Moore-Horspool
+#define SEARCH_HORSPOOL_MIN_LEN 32
+
+/**
+ * Case-insensitive needle, ASCII letters are folded and any other byte is
+ * compared as is, so a valid UTF-8 needle matches only on char boundaries.
+ */
+typedef struct {
+	unsigned char *needle; //folded
+	size_t len;
+	bool horspool;
+	size_t shift[256];
+	size_t shift_backward[256];
+
+	//candidate positions of a block by the first and the last byte filter
+	uint32_t (*block_mask)(const unsigned char *needle, size_t len, const unsigned char *text);
+	size_t block;
+} SearchPattern;
+
+void search_compile(SearchPattern *pattern, const char *needle, size_t len);
+void search_free(SearchPattern *pattern);
+bool search_match_at(SearchPattern *pattern, const char *text, size_t text_len, size_t position);
+/**
+ * Start of the first match at from or after, -1 when nothing is found
+ */
+long search_forward(SearchPattern *pattern, const char *text, size_t text_len, size_t from);
+/**
+ * Start of the last match at from or before, -1 when nothing is found
+ */
+long search_backward(SearchPattern *pattern, const char *text, size_t text_len, size_t from);
+
+#endif
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "search_index.h"
+#include "common.h"
+
+typedef struct {
+	size_t *data;
+	size_t len;
+	size_t cap;
+} SearchIndexChunk;
+
+static size_t search_index_lower_bound(SearchIndex *index, size_t position)
+{
+	size_t lo = 0, hi = index->len, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->data[mid] < position) lo = mid + 1;
+		else hi = mid;
+	}
+
+	return lo;
+}
+
+static void search_index_notify(void)
+{
+	SDL_Event event = {0};
+
+	event.type = SDL_EVENT_USER;
+	event.user.code = SEARCH_INDEX_EVENT_CODE;
+	SDL_PushEvent(&event);
+}
+
+/**
+ * Regexp matches starting in [from, end), from is moved to where the next chunk continues.
+ * The text is cut at the end of the line, the pattern does not go through new lines.
+ */
+static void search_index_scan_regexp(SearchIndex *index, SearchIndexChunk *chunk, size_t *from, size_t end)
+{
+	const char *line_end;
+	size_t text_len, start, stop;
+
+	line_end = end < index->text_len ? memchr(&index->text[end], '\n', index->text_len - end) : NULL;
+	text_len = line_end != NULL ? (size_t) (line_end - index->text) : index->text_len;
+
+	while (*from <= text_len) {
+		if (!regexp_search_forward(&index->regexp, index->text, text_len, *from, &start, &stop)) {
+			//nothing more on this line
+			*from = text_len + 1;
+			return;
+		}
+
+		if (start >= end) {
+			*from = start;
+			return;
+		}
+
+		if (stop > start) gb_append(chunk, start);
+		*from = stop > start ? stop : start + 1;
+	}
+}
+
+/**
+ * Scans the text by chunks, every chunk is published under the lock
+ */
+static int search_index_worker(void *data)
+{
+	SearchIndex *index = data;
+	SearchIndexChunk chunk = {0};
+	size_t beg, end, text_len, chunks, from;
+	long next;
+
+	chunks = 0;
+	from = 0;
+	for (beg = 0; beg < index->text_len; beg = end) {
+		if (SDL_GetAtomicInt(&index->cancel)) break;
+
+		end = MIN(beg + SEARCH_INDEX_CHUNK, index->text_len);
+
+		chunk.len = 0;
+		if (index->is_regexp) {
+			search_index_scan_regexp(index, &chunk, &from, end);
+		} else {
+			//a match starting in the chunk may end in the next one
+			text_len = MIN(index->text_len, end + index->pattern.len - 1);
+
+			for (next = search_forward(&index->pattern, index->text, text_len, beg); next >= 0; next = search_forward(&index->pattern, index->text, text_len, (size_t) next + 1)) {
+				gb_append(&chunk, (size_t) next);
+			}
+		}
+
+		SDL_LockMutex(index->lock);
+		for (size_t i = 0; i < chunk.len; ++i) gb_append(index, chunk.data[i]);
+		index->scanned = end;
+		SDL_UnlockMutex(index->lock);
+
+		if (index->async && ++chunks % SEARCH_INDEX_NOTIFY_CHUNKS == 0) search_index_notify();
+	}
+
+	if (!SDL_GetAtomicInt(&index->cancel)) {
+		SDL_SetAtomicInt(&index->done, 1);
+		if (index->async) search_index_notify();
+	}
+
+	gb_free(&chunk);
+	return 0;
+}
+
+static void search_index_run(SearchIndex *index, const void *owner, const char *text, size_t text_len)
+{
+	if (index->lock == NULL) index->lock = SDL_CreateMutex();
+
+	index->text = text;
+	index->text_len = text_len;
+	index->owner = owner;
+
+	if (text_len <= SEARCH_INDEX_SYNC_LIMIT) {
+		search_index_worker(index);
+		return;
+	}
+
+	index->async = true;
+	index->thread = SDL_CreateThread(search_index_worker, "search_index", index);
+	if (index->thread == NULL) {
+		fprintf(stderr, "Could not create search index thread: %s\n", SDL_GetError());
+		index->async = false;
+		search_index_worker(index);
+	}
+}
+
+/**
+ * Drops the previous index and indexes the needle, in a worker thread for big texts
+ */
+void search_index_start(SearchIndex *index, const void *owner, const char *text, size_t text_len, const char *needle, size_t needle_len)
+{
+	search_index_cancel(index);
+	search_compile(&index->pattern, needle, needle_len);
+	index->is_regexp = false;
+	search_index_run(index, owner, text, text_len);
+}
+
+void search_index_start_regexp(SearchIndex *index, const void *owner, const char *text, size_t text_len, const char *pattern, size_t pattern_len)
+{
+	search_index_cancel(index);
+
+	if (!regexp_compile(&index->regexp, pattern, pattern_len, REGEXP_ICASE)) return;
+	if (index->regexp.multiline) {
+		regexp_free(&index->regexp);
+		return;
+	}
+
+	index->is_regexp = true;
+	search_index_run(index, owner, text, text_len);
+}
+
+void search_index_cancel(SearchIndex *index)
+{
+	if (index->thread != NULL) {
+		SDL_SetAtomicInt(&index->cancel, 1);
+		SDL_WaitThread(index->thread, NULL);
+		index->thread = NULL;
+	}
+
+	if (index->owner != NULL) {
+		if (index->is_regexp) regexp_free(&index->regexp);
+		else search_free(&index->pattern);
+	}
+
+	index->len = 0;
+	index->scanned = 0;
+	index->text = NULL;
+	index->text_len = 0;
+	index->owner = NULL;
+	index->async = false;
+	SDL_SetAtomicInt(&index->cancel, 0);
+	SDL_SetAtomicInt(&index->done, 0);
+}
+
+bool search_index_is_done(SearchIndex *index)
+{
+	return index->owner != NULL && SDL_GetAtomicInt(&index->done);
+}
+
+bool search_index_next(SearchIndex *index, size_t position, bool forward, long *found)
+{
+	size_t i;
+	bool known;
+
+	if (index->owner == NULL) return false;
+
+	SDL_LockMutex(index->lock);
+
+	known = false;
+	if (forward) {
+		i = search_index_lower_bound(index, position + 1);
+		if (i < index->len) {
+			*found = (long) index->data[i];
+			known = true;
+		} else if (SDL_GetAtomicInt(&index->done)) {
+			*found = -1;
+			known = true;
+		}
+	} else if (position <= index->scanned) {
+		i = search_index_lower_bound(index, position);
+		*found = i > 0 ? (long) index->data[i - 1] : -1;
+		known = true;
+	}
+
+	SDL_UnlockMutex(index->lock);
+
+	return known;
+}
+
+void search_index_count(SearchIndex *index, size_t position, size_t *current, size_t *total)
+{
+	size_t i;
+
+	*current = 0;
+	*total = 0;
+	if (index->owner == NULL) return;
+
+	SDL_LockMutex(index->lock);
+
+	i = search_index_lower_bound(index, position);
+	if (i < index->len && index->data[i] == position) *current = i + 1;
+	*total = index->len;
+
+	SDL_UnlockMutex(index->lock);
+}
@@ -0,0 +1,63 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "search.h"
+#include "regexp.h"
+
+#define SEARCH_INDEX_CHUNK (1 << 20)
+//smaller texts are indexed right away without a thread
+#define SEARCH_INDEX_SYNC_LIMIT (1 << 20)
+//the worker reports the progress by SDL_EVENT_USER once per this many chunks
+#define SEARCH_INDEX_NOTIFY_CHUNKS 64
+#define SEARCH_INDEX_EVENT_CODE 1
+
+/**
+ * Sorted starts of all matches of the text, filled by a worker thread
+ * chunk by chunk from the beginning. Matches starting before scanned are
+ * complete. The text must not change while the worker is running.
+ * Regexp matches do not overlap, empty ones are not indexed.
+ */
+typedef struct {
+	size_t *data;
+	size_t len;
+	size_t cap;
+	size_t scanned;
+	SDL_Mutex *lock;
+
+	SDL_Thread *thread;
+	bool async;
+	SDL_AtomicInt cancel;
+	SDL_AtomicInt done;
+
+	SearchPattern pattern;
+	bool is_regexp;
+	Regexp regexp;
+	const char *text;
+	size_t text_len;
+	//what the text belongs to (a buffer), the index is valid only for it
+	const void *owner;
+} SearchIndex;
+
+void search_index_start(SearchIndex *index, const void *owner, const char *text, size_t text_len, const char *needle, size_t needle_len);
+/**
+ * Patterns which can match a new line are not indexed (owner stays NULL)
+ */
+void search_index_start_regexp(SearchIndex *index, const void *owner, const char *text, size_t text_len, const char *pattern, size_t pattern_len);
+void search_index_cancel(SearchIndex *index);
+bool search_index_is_done(SearchIndex *index);
+/**
+ * Next match after (or before) the position. Returns false when the index
+ * does not know it yet, otherwise found is the match or -1.
+ */
+bool search_index_next(SearchIndex *index, size_t position, bool forward, long *found);
+/**
+ * Number of the match at the position counting from 1 (0 when the position
+ * is not a match) and the number of matches found so far
+ */
+void search_index_count(SearchIndex *index, size_t position, size_t *current, size_t *total);
+
+#endif
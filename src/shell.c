@@ -0,0 +1,224 @@
+#ifndef _DEFAULT_SOURCE
+//poll, pipe and kill are not in C11
+#define _DEFAULT_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shell.h"
+
+extern char **environ;
+
+static void shell_notify(Shell *shell)
+{
+	SDL_Event event = {0};
+
+	if (!SDL_CompareAndSwapAtomicInt(&shell->pending, 0, 1)) return;
+
+	event.type = SDL_EVENT_USER;
+	event.user.code = SHELL_EVENT_CODE;
+	SDL_PushEvent(&event);
+}
+
+static void shell_collect(Shell *shell, char *chunk, size_t len)
+{
+	SDL_LockMutex(shell->lock);
+	sb_append_manyl(&shell->output, chunk, len);
+	SDL_UnlockMutex(shell->lock);
+
+	shell_notify(shell);
+}
+
+static int shell_worker(void *data)
+{
+	Shell *shell = data;
+	char chunk[SHELL_READ_SIZE];
+	struct pollfd fds[3];
+	ssize_t len;
+	int status;
+
+	fds[0] = (struct pollfd) {shell->out, POLLIN, 0};
+	fds[1] = (struct pollfd) {shell->err, POLLIN, 0};
+	fds[2] = (struct pollfd) {shell->stop[0], POLLIN, 0};
+
+	//poll skips a negative fd, it is the pipe which reached its end
+	while (fds[0].fd >= 0 || fds[1].fd >= 0) {
+		if (poll(fds, 3, -1) < 0) continue;
+		if (fds[2].revents != 0) return 0;
+
+		for (size_t i = 0; i < 2; ++i) {
+			if (fds[i].fd < 0 || fds[i].revents == 0) continue;
+
+			len = read(fds[i].fd, chunk, sizeof(chunk));
+			if (len > 0) {
+				shell_collect(shell, chunk, (size_t) len);
+			} else if (len == 0 || (errno != EAGAIN && errno != EINTR)) {
+				fds[i].fd = -1;
+			}
+		}
+	}
+
+	status = 0;
+	while (waitpid(shell->pid, &status, 0) < 0 && errno == EINTR);
+
+	SDL_LockMutex(shell->lock);
+	shell->exited = true;
+	shell->exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+	shell->exit_signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+	SDL_UnlockMutex(shell->lock);
+
+	shell_notify(shell);
+
+	return 0;
+}
+
+/**
+ * Both ends are closed on exec, the ends given to the command are duplicated without the flag
+ */
+static bool shell_pipe(int fds[2])
+{
+	if (pipe(fds) != 0) return false;
+
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	return true;
+}
+
+static void shell_close(int *fds, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		if (fds[i] >= 0) close(fds[i]);
+	}
+}
+
+static void shell_stop(Shell *shell)
+{
+	SDL_WaitThread(shell->thread, NULL);
+	//the worker was stopped before the command was reaped
+	if (!shell->exited) while (waitpid(shell->pid, NULL, 0) < 0 && errno == EINTR);
+
+	close(shell->out);
+	close(shell->err);
+	close(shell->stop[0]);
+	close(shell->stop[1]);
+	SDL_DestroyMutex(shell->lock);
+	sb_free(&shell->output);
+
+	shell->running = false;
+}
+
+bool shell_start(Shell *shell, const char *dir, const char *command, char *error, size_t error_len)
+{
+	//posix_spawn can not change the dir portably, sh does it
+	char *argv[] = {"sh", "-c", "cd \"$1\" && eval \"$2\"", "sh", (char*) dir, (char*) command, NULL};
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	int pipes[6] = {-1, -1, -1, -1, -1, -1};
+	int rc;
+
+	if (!shell_pipe(&pipes[0]) || !shell_pipe(&pipes[2]) || !shell_pipe(&pipes[4])) {
+		snprintf(error, error_len, "Could not create shell pipes");
+		shell_close(pipes, 6);
+		return false;
+	}
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, pipes[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, pipes[3], STDERR_FILENO);
+
+	//its own group is killed at once with the children of sh
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&attr, 0);
+
+	rc = posix_spawn(&shell->pid, "/bin/sh", &actions, &attr, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+
+	//the write ends belong to the command now, the reading ends see their end when it exits
+	close(pipes[1]);
+	close(pipes[3]);
+	pipes[1] = pipes[3] = -1;
+
+	if (rc != 0) {
+		snprintf(error, error_len, "Could not run %s: %s", command, strerror(rc));
+		shell_close(pipes, 6);
+		return false;
+	}
+
+	fcntl(pipes[0], F_SETFL, O_NONBLOCK);
+	fcntl(pipes[2], F_SETFL, O_NONBLOCK);
+
+	shell->out = pipes[0];
+	shell->err = pipes[2];
+	shell->stop[0] = pipes[4];
+	shell->stop[1] = pipes[5];
+	shell->output = (StringBuilder) {0};
+	shell->exited = false;
+	shell->exit_code = 0;
+	shell->exit_signal = 0;
+	shell->lock = SDL_CreateMutex();
+	SDL_SetAtomicInt(&shell->pending, 0);
+
+	shell->thread = SDL_CreateThread(shell_worker, "shell", shell);
+	if (shell->thread == NULL) {
+		snprintf(error, error_len, "Could not create shell thread: %s", SDL_GetError());
+		kill(-shell->pid, SIGKILL);
+		while (waitpid(shell->pid, NULL, 0) < 0 && errno == EINTR);
+		SDL_DestroyMutex(shell->lock);
+		shell_close(pipes, 6);
+		return false;
+	}
+
+	shell->running = true;
+	return true;
+}
+
+bool shell_take(Shell *shell, StringBuilder *out)
+{
+	StringBuilder taken;
+	bool done;
+
+	out->len = 0;
+	if (!shell->running) return false;
+
+	SDL_LockMutex(shell->lock);
+	SDL_SetAtomicInt(&shell->pending, 0);
+	taken = shell->output;
+	shell->output = *out;
+	done = shell->exited;
+	SDL_UnlockMutex(shell->lock);
+
+	*out = taken;
+	if (done) shell_stop(shell);
+
+	return done;
+}
+
+void shell_cancel(Shell *shell)
+{
+	char stop = 1;
+	bool exited;
+
+	if (!shell->running) return;
+
+	SDL_LockMutex(shell->lock);
+	exited = shell->exited;
+	SDL_UnlockMutex(shell->lock);
+
+	//the whole group, the children of sh hold the pipes too
+	if (!exited) kill(-shell->pid, SIGKILL);
+	if (write(shell->stop[1], &stop, 1) != 1) fprintf(stderr, "Could not stop the shell thread\n");
+
+	shell_stop(shell);
+}
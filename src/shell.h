@@ -0,0 +1,51 @@
+#ifndef SHELL_H
+#define SHELL_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "common.h"
+
+#define SHELL_EVENT_CODE 5
+//the pipes are read by this many bytes at once
+#define SHELL_READ_SIZE (64 << 10)
+
+/**
+ * Runs the command by "sh -c" in its own process group. The worker thread
+ * polls the nonblocking stdout and stderr pipes and collects the output
+ * under the lock, SHELL_EVENT_CODE is pushed once until it is taken. So
+ * the output comes in chunks as big as the main thread falls behind.
+ */
+typedef struct {
+	pid_t pid;
+	int out;
+	int err;
+	int stop[2];
+	SDL_Thread *thread;
+	SDL_Mutex *lock;
+	SDL_AtomicInt pending;
+	StringBuilder output;
+	bool running;
+
+	//set by the worker when the command is reaped
+	bool exited;
+	int exit_code;
+	int exit_signal;
+} Shell;
+
+/**
+ * Spawns the command in the dir, returns false when it can not be run (see error)
+ */
+bool shell_start(Shell *shell, const char *dir, const char *command, char *error, size_t error_len);
+/**
+ * Swaps the new output into out, returns true when the command has exited and everything is taken
+ */
+bool shell_take(Shell *shell, StringBuilder *out);
+/**
+ * Kills the process group of the command and waits for the worker, the output not taken is dropped
+ */
+void shell_cancel(Shell *shell);
+
+#endif
@@ -9,29 +9,72 @@
 #include "common.h"
 #include "smacs.h"
 #include "config.h"
+#include "profiler.h"
 
 const enum LineNumberFormat DISPLAY_LINE_FROMAT = HIDE;
 
 //TODO(ivan): Next-line and previous line should work using ui model (x coordnate)
-//TODO(ivan): Replace regexp
 //TODO(ivan): Better undo/redo
-//TODO(ivan): M-& Emacs command
-//TODO(ivan): Multicursor
 
 void initial_hook(Smacs *smacs);
+void smacs_coalesce_mouse_motion(SDL_Event *event, Uint64 last_frame_ticks);
+FrameUpdate smacs_dispatch_event(Smacs *smacs, SmacsLoop *loop, SDL_Event *event);
+void smacs_macro_command(Smacs *smacs, SmacsLoop *loop);
 
 int smacs_launch(char *home_dir, char *fallback_ttf_path, char *file_path)
 {
-	int win_w, win_h, message_timeout, win_w_per_pane;
-	register int i;
-	char config_path[512];
-
 	Smacs smacs = {0};
+	SmacsLoop loop = {0};
+	SDL_Event event = {0};
+	FrameUpdate update;
+
+	if (smacs_init(&smacs, home_dir, fallback_ttf_path, file_path, NULL) != 0) {
+		return 1;
+	}
+
+	//initial_hook();
+
+	while (!loop.quit) {
+		SDL_WaitEvent(&event);
+
+		if (event.type == SDL_EVENT_MOUSE_MOTION) {
+			if (!loop.mouse_selecting || !(event.motion.state & SDL_BUTTON_LMASK)) continue;
+			smacs_coalesce_mouse_motion(&event, loop.last_frame_ticks);
+		}
+
+		update = smacs_handle_event(&smacs, &loop, &event);
+		if (update == FRAME_SKIP) continue;
+
+		smacs_layout_panes(&smacs);
+
+		if (update == FRAME_RELAYOUT) {
+			render_update_glyph(&smacs);
+			render_draw_smacs(&smacs);
+		} else {
+			render_present(&smacs);
+		}
+
+		smacs_frame_end(&smacs, &loop);
+	}
+
+	smacs_destroy(&smacs);
+
+	return 0;
+}
+
+/**
+ * Loads the config, fonts and the file. Renders into the window, or into
+ * the surface by the software renderer when it is given (headless mode).
+ */
+int smacs_init(Smacs *smacs, char *home_dir, char *fallback_ttf_path, char *file_path, SDL_Surface *surface)
+{
+	int win_w, win_h;
+	char config_path[512];
 
 	snprintf(config_path, sizeof(config_path), "%s/.smacsrc", home_dir);
 	Config config = config_load(config_path, fallback_ttf_path);
 
-	if (!SDL_Init(SDL_INIT_VIDEO)) {
+	if (!SDL_Init(surface == NULL ? SDL_INIT_VIDEO : 0)) {
 		fprintf(stderr, "Could not initialize SDL: %s\n", SDL_GetError());
 		return 1;
 	}
@@ -41,179 +84,374 @@ int smacs_launch(char *home_dir, char *fallback_ttf_path, char *file_path)
 		return 1;
 	}
 
-	smacs.font_size = config.font_size;
-	smacs.font = TTF_OpenFont(config.font, smacs.font_size);
-	if (smacs.font == NULL) {
+	profiler_init();
+
+	smacs->font_size = config.font_size;
+	smacs->font = TTF_OpenFont(config.font, smacs->font_size);
+	if (smacs->font == NULL) {
 		fprintf(stderr, "Could not open ttf: %s\n", SDL_GetError());
 		return 1;
 	}
 
-	smacs.fallback_font = TTF_OpenFont(fallback_ttf_path, smacs.font_size);
-	if (smacs.fallback_font == NULL) {
+	smacs->fallback_font = TTF_OpenFont(fallback_ttf_path, smacs->font_size);
+	if (smacs->fallback_font == NULL) {
 		fprintf(stderr, "Could not open fallback ttf: %s\n", SDL_GetError());
 		return 1;
 	}
 
-	if (!TTF_AddFallbackFont(smacs.font, smacs.fallback_font)) {
+	if (!TTF_AddFallbackFont(smacs->font, smacs->fallback_font)) {
 		fprintf(stderr, "Could not open fallback ttf: %s\n", SDL_GetError());
 		return 1;
 	}
 
-	if (!SDL_CreateWindowAndRenderer("smacs", 1000, 1200, SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED, &smacs.window, &smacs.renderer)) {
+	if (surface != NULL) {
+		smacs->renderer = SDL_CreateSoftwareRenderer(surface);
+		if (smacs->renderer == NULL) {
+			fprintf(stderr, "Could not create software renderer: %s\n", SDL_GetError());
+			return 1;
+		}
+	} else if (!SDL_CreateWindowAndRenderer("smacs", 1000, 1200, SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED, &smacs->window, &smacs->renderer)) {
 		fprintf(stderr, "Could not open SDL window: %s\n", SDL_GetError());
 		return 1;
 	}
 
-	if (0 != hashmap_create(100, &smacs.surface_by_string)) {
+	if (0 != hashmap_create(100, &smacs->surface_by_string)) {
 		fprintf(stderr, "Could not initialize texture map\n");
 		return 1;
 	}
 
-	SDL_StartTextInput(smacs.window);
+	if (smacs->window != NULL) {
+		SDL_StartTextInput(smacs->window);
+	}
 
-	bool quit = false;
-	message_timeout = 0;
+	config_apply_theme(smacs, config.theme_name);
 
-	config_apply_theme(&smacs, config.theme_name);
+	smacs->home_dir = home_dir;
+	smacs->line_number_format = config.line_number_format;
+	smacs->message_timeout_duration = config.message_timeout;
 
-	smacs.home_dir = home_dir;
-	smacs.line_number_format = config.line_number_format;
-	smacs.message_timeout_duration = config.message_timeout;
+	smacs->editor = (Editor) {0};
+	watch_start(&smacs->editor.watch);
 
-	smacs.editor = (Editor) {0};
+	smacs->editor.panes_len = 0;
+	smacs->editor.panes[smacs->editor.panes_len] = (Pane) {0};
+	smacs->editor.pane = &smacs->editor.panes[smacs->editor.panes_len];
+	++smacs->editor.panes_len;
+	layout_init(&smacs->editor.layout);
 
-	smacs.editor.panes_len = 0;
-	smacs.editor.panes[smacs.editor.panes_len] = (Pane) {0};
-	smacs.editor.pane = &smacs.editor.panes[smacs.editor.panes_len];
-	++smacs.editor.panes_len;
+	editor_read_file(&smacs->editor, file_path);
 
-	editor_read_file(&smacs.editor, file_path);
+	render_output_size(smacs, &win_w, &win_h);
+	smacs->editor.pane->arena = (Arena) {0, win_h / smacs->font_size};
+	smacs->editor.pane->buffer->events_len = 0;
+	smacs->editor.pane->buffer->update_column = false;
+	smacs->editor.pane->buffer->column = 0;
+	smacs->notification = calloc(RENDER_NOTIFICATION_LEN, sizeof(char));
+	smacs->leading = config.leading;
+	smacs->tab_size = config.tab_size;
+	smacs->editor.tab_size = config.tab_size;
+	smacs->editor.truncate_lines = config.truncate_lines;
 
-	SDL_GetWindowSize(smacs.window, &win_w, &win_h);
-	smacs.editor.pane->arena = (Arena) {0, win_h / smacs.font_size};
-	smacs.editor.pane->buffer->events_len = 0;
-	smacs.editor.pane->buffer->update_column = false;
-	smacs.editor.pane->buffer->column = 0;
-	smacs.notification = calloc(RENDER_NOTIFICATION_LEN, sizeof(char));
-	smacs.leading = config.leading;
-	smacs.tab_size = config.tab_size;
+	return 0;
+}
 
-	//initial_hook();
+void smacs_destroy(Smacs *smacs)
+{
+	search_index_cancel(&smacs->editor.search_index);
+	grep_cancel(&smacs->editor.grep);
+	shell_cancel(&smacs->editor.shell);
+	trigram_build_cancel(&smacs->editor.trigram_build);
+	watch_stop(&smacs->editor.watch);
+	render_destroy_smacs(smacs);
+	macro_free(&smacs->macro);
 
-	SDL_Event event = {0};
+	TTF_Quit();
+	SDL_Quit();
+}
 
-	while (!quit) {
-		SDL_WaitEvent(&event);
+/**
+ * Applies the event to the editor and tells how the next frame has to be drawn
+ */
+FrameUpdate smacs_handle_event(Smacs *smacs, SmacsLoop *loop, SDL_Event *event)
+{
+	ProfileScope scope;
+	FrameUpdate update;
 
-		if (event.type == SDL_EVENT_MOUSE_MOTION) continue;
-
-		switch (event.type) {
-		case SDL_EVENT_TEXT_INPUT: {
-			if (SDL_GetModState() & (SDL_KMOD_CTRL | SDL_KMOD_ALT)) break;
-			if (mini_buffer_event_handle(&smacs, &event)) break;
-			if (completion_event_handle(&smacs, &event)) break;
-
-			editor_insert(&smacs.editor, (char*)event.text.text);
-		} break;
-		case SDL_EVENT_KEY_DOWN: {
-			if (search_mapping(&smacs, &event, &message_timeout)) break;
-			if (extend_command_mapping(&smacs, &event, &message_timeout)) break;
-			if (completion_command_mapping(&smacs, &event)) break;
-			if (ctrl_leader_mapping(&smacs, &event, &message_timeout)) break;
-			if (alt_leader_mapping(&smacs, &event)) break;
-
-			switch (event.key.key) {
-			case SDLK_BACKSPACE:
-				editor_delete_backward(&smacs.editor);
-				break;
-			case SDLK_RETURN:
-				editor_new_line(&smacs.editor);
-				break;
-			case SDLK_TAB:
-				editor_insert(&smacs.editor, TAB);
-				break;
-			case SDLK_F11:
-				if (SDL_GetWindowFlags(smacs.window) & SDL_WINDOW_FULLSCREEN) {
-					SDL_SetWindowFullscreen(smacs.window, 0);
-				} else {
-					SDL_SetWindowFullscreen(smacs.window, SDL_WINDOW_FULLSCREEN);
-				}
-				break;
-			}
-		} break;
-		case SDL_EVENT_QUIT:
-			quit = true;
-			break;
-		case SDL_EVENT_MOUSE_WHEEL:
-			editor_mwheel_scroll(&smacs.editor, event.wheel.y);
-			break;
-		case SDL_EVENT_MOUSE_BUTTON_DOWN: {
-			int click_x = (int)event.button.x;
-			for (i = 0; i < (int)smacs.editor.panes_len; ++i) {
-				if (click_x >= (int)smacs.editor.panes[i].x &&
-					click_x < (int)(smacs.editor.panes[i].x + smacs.editor.panes[i].w)) {
-					smacs.editor.pane = &smacs.editor.panes[i];
-					break;
-				}
-			}
+	scope = profiler_begin(PROFILE_EVENT);
+	//the prompt of C-x ) is not a part of the macro
+	if (!(smacs->editor.state & EXTEND_COMMAND)) smacs->macro.prompt_start = smacs->macro.recording.len;
+	macro_record(&smacs->macro, event);
+	update = smacs_dispatch_event(smacs, loop, event);
+	profiler_end(scope);
+
+	return update;
+}
+
+FrameUpdate smacs_dispatch_event(Smacs *smacs, SmacsLoop *loop, SDL_Event *event)
+{
+	register int i;
+	RenderSelection selection_before;
+
+	switch (event->type) {
+	case SDL_EVENT_TEXT_INPUT: {
+		if (SDL_GetModState() & (SDL_KMOD_CTRL | SDL_KMOD_ALT)) break;
+		if (replace_event_handle(smacs, event, &loop->message_timeout)) break;
+		if (mini_buffer_event_handle(smacs, event)) {
+			smacs_macro_command(smacs, loop);
+			break;
+		}
+		if (completion_event_handle(smacs, event)) break;
+
+		editor_cursors_insert(&smacs->editor, (char*)event->text.text);
+	} break;
+	case SDL_EVENT_KEY_DOWN: {
+		if (search_mapping(smacs, event, &loop->message_timeout)) break;
+		if (replace_mapping(smacs, event, &loop->message_timeout)) break;
+		if (extend_command_mapping(smacs, event, &loop->message_timeout)) break;
+		if (completion_command_mapping(smacs, event)) break;
+		if (ctrl_leader_mapping(smacs, event, &loop->message_timeout)) break;
+		if (alt_leader_mapping(smacs, event)) break;
+
+		switch (event->key.key) {
+		case SDLK_BACKSPACE:
+			editor_cursors_delete(&smacs->editor, false);
+			break;
+		case SDLK_RETURN:
+			if (editor_grep_visit(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN)) break;
+			editor_new_line(&smacs->editor);
+			break;
+		case SDLK_TAB:
+			editor_cursors_insert(&smacs->editor, TAB);
+			break;
+		case SDLK_F11:
+			if (smacs->window == NULL) break;
 
-			long point = render_find_position_by_xy(&smacs, (int)event.button.x, (int)event.button.y - smacs.char_h);
-			if (point > 0) {
-				editor_goto_point(&smacs.editor, point);
-				editor_char_backward(&smacs.editor);
+			if (SDL_GetWindowFlags(smacs->window) & SDL_WINDOW_FULLSCREEN) {
+				SDL_SetWindowFullscreen(smacs->window, 0);
+			} else {
+				SDL_SetWindowFullscreen(smacs->window, SDL_WINDOW_FULLSCREEN);
 			}
 			break;
 		}
+	} break;
+	case SDL_EVENT_QUIT:
+		loop->quit = true;
+		break;
+	case SDL_EVENT_USER:
+		if (event->user.code == GREP_EVENT_CODE) editor_grep_flush(&smacs->editor);
+		if (event->user.code == TRIGRAM_EVENT_CODE && editor_trigram_index_done(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN)) {
+			loop->message_timeout = smacs->message_timeout_duration;
+		}
+		if (event->user.code == WATCH_EVENT_CODE && editor_watch_flush(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN)) {
+			loop->message_timeout = smacs->message_timeout_duration;
+		}
+		if (event->user.code == SHELL_EVENT_CODE && editor_shell_flush(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN)) {
+			loop->message_timeout = smacs->message_timeout_duration;
+		}
+		break;
+	case SDL_EVENT_MOUSE_WHEEL:
+		editor_mwheel_scroll(&smacs->editor, event->wheel.y);
+		break;
+	case SDL_EVENT_CLIPBOARD_UPDATE:
+		//our own copies are in the kill ring already
+		if (!event->clipboard.owner) editor_clipboard_changed(&smacs->editor);
+		return FRAME_SKIP;
+	case SDL_EVENT_MOUSE_BUTTON_DOWN: {
+		int click_x = (int)event->button.x;
+		int click_y = (int)event->button.y;
+		for (i = 0; i < (int)smacs->editor.panes_len; ++i) {
+			if (click_x >= (int)smacs->editor.panes[i].x &&
+				click_x < (int)(smacs->editor.panes[i].x + smacs->editor.panes[i].w) &&
+				click_y >= (int)smacs->editor.panes[i].y &&
+				click_y < (int)(smacs->editor.panes[i].y + smacs->editor.panes[i].h)) {
+				smacs->editor.pane = &smacs->editor.panes[i];
+				break;
+			}
+		}
+
+		long point = render_find_position_by_xy(smacs, (int)event->button.x, (int)event->button.y);
+		if (point >= 0) {
+			if (event->button.button == SDL_BUTTON_LEFT) {
+				editor_drag_start(&smacs->editor, (size_t) point);
+				loop->mouse_selecting = true;
+			} else {
+				editor_goto_point(&smacs->editor, (size_t) point);
+			}
 		}
+		break;
+	}
+	case SDL_EVENT_MOUSE_BUTTON_UP:
+		if (event->button.button == SDL_BUTTON_LEFT) loop->mouse_selecting = false;
+		return FRAME_SKIP;
+	case SDL_EVENT_MOUSE_MOTION: {
+		long point = render_find_position_by_xy(smacs, (int)event->motion.x, (int)event->motion.y);
+		if (point < 0 || (size_t) point == smacs->editor.pane->position) return FRAME_SKIP;
+
+		selection_before = render_selection_snapshot(smacs);
+		editor_drag_to(&smacs->editor, (size_t) point);
+		return render_update_selection(smacs, &selection_before) ? FRAME_PRESENT : FRAME_RELAYOUT;
+	}
+	}
 
-		SDL_GetWindowSize(smacs.window, &win_w, &win_h);
-		TTF_GetStringSize(smacs.font, "|", 1, &smacs.char_w, &smacs.char_h);
+	return FRAME_RELAYOUT;
+}
 
-		win_w_per_pane = win_w / smacs.editor.panes_len;
+/**
+ * Replays the last macro count times inside one event, nothing is laid out or drawn
+ * between the iterations. Stops at a failed search like Emacs does, and when an iteration
+ * changes nothing (a motion is at the end of the buffer). Returns the number of iterations.
+ */
+static size_t smacs_macro_replay(Smacs *smacs, SmacsLoop *loop, size_t count)
+{
+	Macro *macro = &smacs->macro;
+	Pane *pane;
+	Buffer *buffer;
+	SDL_Event event;
+	size_t done, position, version;
+
+	macro->replaying = true;
+	for (done = 0; done < count && !loop->quit; ++done) {
+		pane = smacs->editor.pane;
+		buffer = pane->buffer;
+		position = pane->position;
+		version = buffer->version;
+
+		macro->failed = false;
+		for (size_t i = 0; i < macro->last.len && !macro->failed; ++i) {
+			event = macro_event(macro, i);
+			smacs_dispatch_event(smacs, loop, &event);
+		}
 
-		for (i = 0; i < (int) smacs.editor.panes_len; ++i) {
-			smacs.editor.panes[i].x = win_w_per_pane * i;
-			smacs.editor.panes[i].w = win_w_per_pane;
-			smacs.editor.panes[i].h = win_h;
-			smacs.editor.panes[i].arena.show_lines = (win_h / (smacs.char_h + smacs.leading));
+		if (macro->failed) break;
+		if (smacs->editor.pane == pane && pane->buffer == buffer && pane->position == position && buffer->version == version) {
+			++done;
+			break;
 		}
+	}
+	macro->replaying = false;
 
-		SDL_SetRenderDrawColor(smacs.renderer, smacs.background_color.r, smacs.background_color.g, smacs.background_color.b, smacs.background_color.a);
-		SDL_RenderClear(smacs.renderer);
+	return done;
+}
 
-		render_update_glyph(&smacs);
-		render_glyph_show(&smacs);
+/**
+ * C-x ( starts recording, C-x ) stops it, C-x e replays the last macro and
+ * C-x <N>e replays it N times. They run as soon as the last char is typed.
+ */
+void smacs_macro_command(Smacs *smacs, SmacsLoop *loop)
+{
+	Macro *macro = &smacs->macro;
+	char *data = smacs->editor.user_input.data;
+	size_t data_len = data == NULL ? 0 : strlen(data);
+	size_t count = 1, done;
 
-		SDL_RenderPresent(smacs.renderer);
+	if (!(smacs->editor.state & EXTEND_COMMAND) || data_len == 0) return;
 
-		if (message_timeout > 0) {
-			message_timeout--;
+	if (data_len == 1 && data[0] == '(') {
+		editor_user_input_clear(&smacs->editor);
+		if (macro->replaying) return;
+
+		macro_start(macro);
+		snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "Defining keyboard macro...");
+	} else if (data_len == 1 && data[0] == ')') {
+		editor_user_input_clear(&smacs->editor);
+		if (!macro->recording_on) {
+			snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "Not defining keyboard macro");
+		} else if (macro_stop(macro)) {
+			snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "Keyboard macro defined, %ld steps", macro->last.len);
 		} else {
-			memset(&smacs.notification[0], 0, RENDER_NOTIFICATION_LEN);
+			snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "Keyboard macro is empty");
 		}
-
-		if (SURFACE_HASHMAP_LIMIT < hashmap_num_entries(&smacs.surface_by_string)) {
-			render_clean_textures_cache(&smacs);
+	} else if (data[data_len - 1] == 'e' && strspn(data, "0123456789") == data_len - 1) {
+		if (data_len > 1) count = (size_t) atol(data);
+		editor_user_input_clear(&smacs->editor);
+		//a macro does not replay itself
+		if (macro->replaying) return;
+
+		//C-x e ends the definition and runs it
+		if (macro->recording_on && !macro_stop(macro)) {
+			snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "Keyboard macro is empty");
+		} else if (macro->last.len == 0) {
+			snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "No keyboard macro defined");
+		} else {
+			done = smacs_macro_replay(smacs, loop, count);
+			//the failed command tells why the replay stopped
+			if (!macro->failed) snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "Keyboard macro ran %ld times", done);
 		}
+	} else {
+		return;
 	}
 
-	render_destroy_smacs(&smacs);
+	loop->message_timeout = smacs->message_timeout_duration;
+}
 
-	TTF_Quit();
-	SDL_Quit();
+void smacs_layout_panes(Smacs *smacs)
+{
+	int win_w, win_h;
+	LayoutRect rects[PANES_MAX_SIZE];
+	register size_t i;
 
-	return 0;
+	render_output_size(smacs, &win_w, &win_h);
+	TTF_GetStringSize(smacs->font, "|", 1, &smacs->char_w, &smacs->char_h);
+
+	layout_rects(&smacs->editor.layout, (LayoutRect) {0, 0, win_w, win_h}, rects);
+
+	for (i = 0; i < smacs->editor.panes_len; ++i) {
+		smacs->editor.panes[i].x = rects[i].x;
+		smacs->editor.panes[i].y = rects[i].y;
+		smacs->editor.panes[i].w = rects[i].w;
+		smacs->editor.panes[i].h = rects[i].h;
+		smacs->editor.panes[i].arena.show_lines = (rects[i].h / (smacs->char_h + smacs->leading));
+	}
+}
+
+void smacs_frame_end(Smacs *smacs, SmacsLoop *loop)
+{
+	loop->last_frame_ticks = SDL_GetTicks();
+	profiler_frame_end();
+	editor_clipboard_flush(&smacs->editor);
+
+	if (loop->message_timeout > 0) {
+		loop->message_timeout--;
+	} else {
+		memset(&smacs->notification[0], 0, RENDER_NOTIFICATION_LEN);
+	}
+
+	if (SURFACE_HASHMAP_LIMIT < hashmap_num_entries(&smacs->surface_by_string)) {
+		render_clean_textures_cache(smacs);
+	}
 }
 
 void initial_hook(Smacs *smacs)
 {
-	editor_split_pane(&smacs->editor);
+	editor_split_pane(&smacs->editor, LAYOUT_COLUMNS);
 	editor_next_pane(&smacs->editor);
 	editor_read_file(&smacs->editor, "*scratch*");
 	editor_insert(&smacs->editor, ";; Buffer for your notes\n");
 	editor_next_pane(&smacs->editor);
 }
 
+/**
+ * Holds a drag until the next frame is due and keeps only the latest
+ * mouse position, there is no need to lay out every pixel of the movement
+ */
+void smacs_coalesce_mouse_motion(SDL_Event *event, Uint64 last_frame_ticks)
+{
+	SDL_Event next;
+	Uint64 elapsed;
+
+	elapsed = SDL_GetTicks() - last_frame_ticks;
+	if (elapsed < FRAME_DURATION_MS) {
+		SDL_Delay((Uint32) (FRAME_DURATION_MS - elapsed));
+	}
+
+	while (SDL_PeepEvents(&next, 1, SDL_PEEKEVENT, SDL_EVENT_MOUSE_MOTION, SDL_EVENT_MOUSE_MOTION) == 1) {
+		if (!(next.motion.state & SDL_BUTTON_LMASK)) break;
+
+		SDL_PeepEvents(&next, 1, SDL_GETEVENT, SDL_EVENT_MOUSE_MOTION, SDL_EVENT_MOUSE_MOTION);
+		*event = next;
+	}
+}
+
 bool ctrl_leader_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout)
 {
 	if ((event->key.mod & SDL_KMOD_CTRL) == 0) return false;
@@ -226,6 +464,24 @@ bool ctrl_leader_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout)
 		case SDLK_B:
 			editor_backward_sexp(&smacs->editor);
 			break;
+		case SDLK_S:
+			editor_user_search_regexp_forward(&smacs->editor);
+			break;
+		case SDLK_5: // C-M-%
+			if (event->key.mod & SDL_KMOD_SHIFT) editor_user_replace(&smacs->editor, true, true);
+			break;
+		case SDLK_R:
+			editor_user_search_regexp_backward(&smacs->editor);
+			break;
+		case SDLK_O:
+			editor_project_find_file(&smacs->editor);
+			break;
+		case SDLK_N:
+			editor_cursor_add_line(&smacs->editor, true);
+			break;
+		case SDLK_P:
+			editor_cursor_add_line(&smacs->editor, false);
+			break;
 		}
 
 		return true;
@@ -234,7 +490,7 @@ bool ctrl_leader_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout)
 	if  (event->key.mod & SDL_KMOD_SHIFT) {
 		switch (event->key.key) {
 		case SDLK_2:
-			editor_set_mark(&smacs->editor);
+			editor_cursors_motion(&smacs->editor, editor_set_mark);
 			break;
 		}
 
@@ -243,28 +499,28 @@ bool ctrl_leader_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout)
 
 	switch (event->key.key) {
 	case SDLK_B:
-		editor_char_backward(&smacs->editor);
+		editor_cursors_motion(&smacs->editor, editor_char_backward);
 		break;
 	case SDLK_F:
-		editor_char_forward(&smacs->editor);
+		editor_cursors_motion(&smacs->editor, editor_char_forward);
 		break;
 	case SDLK_P:
-		editor_previous_line(&smacs->editor);
+		editor_cursors_motion(&smacs->editor, editor_previous_line);
 		break;
 	case SDLK_N:
-		editor_next_line(&smacs->editor);
+		editor_cursors_motion(&smacs->editor, editor_next_line);
 		break;
 	case SDLK_A:
-		editor_move_begginning_of_line(&smacs->editor);
+		editor_cursors_motion(&smacs->editor, editor_move_begginning_of_line);
 		break;
 	case SDLK_E:
-		editor_move_end_of_line(&smacs->editor);
+		editor_cursors_motion(&smacs->editor, editor_move_end_of_line);
 		break;
 	case SDLK_K:
 		editor_kill_line(&smacs->editor);
 		break;
 	case SDLK_D:
-		editor_delete_forward(&smacs->editor);
+		editor_cursors_delete(&smacs->editor, true);
 		break;
 	case SDLK_L:
 		editor_recenter_top_bottom(&smacs->editor);
@@ -273,9 +529,13 @@ bool ctrl_leader_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout)
 		editor_scroll_up(&smacs->editor);
 		break;
 	case SDLK_SPACE:
-		editor_set_mark(&smacs->editor);
+		editor_cursors_motion(&smacs->editor, editor_set_mark);
 		break;
 	case SDLK_G:
+		if (smacs->editor.state == NONE) {
+			editor_grep_cancel(&smacs->editor);
+			editor_cursors_clear(smacs->editor.pane);
+		}
 		smacs->editor.state = NONE;
 		editor_user_input_clear(&smacs->editor);
 		break;
@@ -351,6 +611,14 @@ bool alt_leader_mapping(Smacs *smacs, SDL_Event *event)
 		case SDLK_COMMA:
 			editor_beginning_of_buffer(&smacs->editor);
 			break;
+		case SDLK_5: // %
+			editor_user_replace(&smacs->editor, false, true);
+			break;
+		case SDLK_7: // &
+			//the command is typed in the C-x prompt after its prefix
+			editor_user_extend_command(&smacs->editor);
+			editor_user_input_insert(&smacs->editor, "& ");
+			break;
 		}
 	} else {
 		switch (event->key.key) {
@@ -361,17 +629,23 @@ bool alt_leader_mapping(Smacs *smacs, SDL_Event *event)
 			editor_copy_to_clipboard(&smacs->editor);
 			smacs->editor.state = NONE;
 			break;
+		case SDLK_Y:
+			editor_yank_pop(&smacs->editor);
+			break;
 		case SDLK_N:
 			editor_move_line_down(&smacs->editor);
 			break;
 		case SDLK_P:
 			editor_move_line_up(&smacs->editor);
 			break;
+		case SDLK_T:
+			editor_transpose_lines(&smacs->editor);
+			break;
 		case SDLK_F:
-			editor_word_forward(&smacs->editor);
+			editor_cursors_motion(&smacs->editor, editor_word_forward);
 			break;
 		case SDLK_B:
-			editor_word_backward(&smacs->editor);
+			editor_cursors_motion(&smacs->editor, editor_word_backward);
 			break;
 		case SDLK_D:
 			editor_delete_word_forward(&smacs->editor);
@@ -416,18 +690,29 @@ bool extend_command_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout
 	case SDLK_RETURN: {
 		char *data = smacs->editor.user_input.data;
 		size_t data_len = data == NULL ? 0 : strlen(data);
+		bool replace_regexp = false;
 
 		//TODO: need to simplify this shit
 		if (starts_withl(data, "bk", 2) && data_len > 2) {
 			editor_kill_buffer(&smacs->editor, (size_t) atoi(&data[2]), smacs->notification, RENDER_NOTIFICATION_LEN);
 			*message_timeout = smacs->message_timeout_duration;
-		} else if (starts_withl(data, "sp", 2)) {
+		} else if (starts_withl(data, "sp", 2) || starts_withl(data, "sb", 2)) {
+			//sp splits side by side, sb below
 			if (smacs->editor.panes_len < PANES_MAX_SIZE) {
-				editor_split_pane(&smacs->editor);
+				editor_split_pane(&smacs->editor, data[1] == 'p' ? LAYOUT_COLUMNS : LAYOUT_ROWS);
 			} else {
 				snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "Can not create more than %d panes", PANES_MAX_SIZE);
 				*message_timeout = smacs->message_timeout_duration;
 			}
+		} else if (starts_withl(data, "pf", 2)) {
+			profiler.overlay = !profiler.overlay;
+		} else if (starts_withl(data, "pe", 2)) {
+			if (profiler_export_chrome_trace(PROFILER_TRACE_FILE) == 0) {
+				snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "Trace is saved to %s", PROFILER_TRACE_FILE);
+			} else {
+				snprintf(smacs->notification, RENDER_NOTIFICATION_LEN, "Could not save trace to %s", PROFILER_TRACE_FILE);
+			}
+			*message_timeout = smacs->message_timeout_duration;
 		} else if (starts_withl(data, "n", 1) && data_len > 1) {
 			editor_goto_line_forward(&smacs->editor, (size_t) atoi(&data[1]));
 		} else if (starts_withl(data, "p", 1) && data_len > 1) {
@@ -440,11 +725,32 @@ bool extend_command_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout
 			smacs->line_number_format = ABSOLUTE;
 		} else if (starts_withl(data, "dlnon", 5)) {
 			smacs->line_number_format = HIDE;
+		} else if (starts_withl(data, "tl", 2)) {
+			editor_toggle_truncate_lines(&smacs->editor);
+		} else if (starts_withl(data, "rr", 2)) {
+			replace_regexp = true;
+		} else if (starts_withl(data, "grep ", 5)) {
+			if (!editor_grep(&smacs->editor, &data[5], true, smacs->notification, RENDER_NOTIFICATION_LEN)) {
+				*message_timeout = smacs->message_timeout_duration;
+			}
+		} else if (starts_withl(data, "fgrep ", 6)) {
+			editor_grep(&smacs->editor, &data[6], false, smacs->notification, RENDER_NOTIFICATION_LEN);
+		} else if (starts_withl(data, "& ", 2)) {
+			editor_shell_command(&smacs->editor, &data[2], smacs->notification, RENDER_NOTIFICATION_LEN);
+			*message_timeout = smacs->message_timeout_duration;
+		} else if (starts_withl(data, "tf", 2)) {
+			editor_toggle_follow(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN);
+			*message_timeout = smacs->message_timeout_duration;
+		} else if (starts_withl(data, "ix", 2)) {
+			editor_trigram_index(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN);
+			*message_timeout = smacs->message_timeout_duration;
 		} else {
 			//fprintf(stderr, "Unknown cmd %s\n", smacs->editor.user_input.data);
 		}
 
 		editor_user_input_clear(&smacs->editor);
+		//the prompt of replace-regexp takes the mini buffer over
+		if (replace_regexp) editor_user_replace(&smacs->editor, true, false);
 		break;
 	}
 	}
@@ -463,6 +769,7 @@ bool search_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout)
 			break;
 		case SDLK_Y:
 			editor_user_input_insert_from_clipboard(&smacs->editor);
+			editor_search_matches_update(&smacs->editor);
 			break;
 		default:
 			editor_user_input_clear(&smacs->editor);
@@ -470,17 +777,60 @@ bool search_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout)
 		}
 	}
 
+	//M-RET puts a cursor on every match
+	if (event->key.mod & SDL_KMOD_ALT && event->key.key == SDLK_RETURN) {
+		editor_cursors_from_matches(&smacs->editor);
+		return true;
+	}
+
 	switch (event->key.key) {
 	case SDLK_BACKSPACE:
 		editor_user_input_delete_backward(&smacs->editor);
+		editor_search_matches_update(&smacs->editor);
 		break;
 	case SDLK_RETURN:
 		if (!editor_user_search_next(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN)) {
 			*message_timeout = smacs->message_timeout_duration;
+			smacs->macro.failed = true;
+		}
+		break;
+	}
+
+	return true;
+}
+
+bool replace_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout)
+{
+	if ((smacs->editor.state & REPLACE) == 0) return false;
+
+	if (event->key.mod & SDL_KMOD_CTRL) {
+		switch (event->key.key) {
+		case SDLK_G:
+			editor_user_replace_cancel(&smacs->editor);
+			break;
+		case SDLK_Y:
+			if (smacs->editor.replace.stage != REPLACE_QUERY) editor_user_input_insert_from_clipboard(&smacs->editor);
+			break;
 		}
+
+		return true;
+	}
+
+	switch (event->key.key) {
+	case SDLK_BACKSPACE:
+		if (smacs->editor.replace.stage == REPLACE_QUERY) {
+			editor_user_replace_answer(&smacs->editor, 'n', smacs->notification, RENDER_NOTIFICATION_LEN);
+		} else {
+			editor_user_input_delete_backward(&smacs->editor);
+		}
+		break;
+	case SDLK_RETURN:
+		editor_user_replace_submit(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN);
 		break;
 	}
 
+	if (smacs->editor.state == NONE) *message_timeout = smacs->message_timeout_duration;
+
 	return true;
 }
 
@@ -512,8 +862,9 @@ bool completion_command_mapping(Smacs *smacs, SDL_Event *event)
 		editor_completion_actualize(&smacs->editor);
 		break;
 	case SDLK_RETURN:
-		if (editor_buffer_switch_complete(&smacs->editor)) break;
-		if (editor_find_file_complete(&smacs->editor)) break;
+		if (editor_project_find_file_complete(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN)) break;
+		if (editor_buffer_switch_complete(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN)) break;
+		if (editor_find_file_complete(&smacs->editor, smacs->notification, RENDER_NOTIFICATION_LEN)) break;
 		break;
 	}
 
@@ -525,6 +876,23 @@ bool mini_buffer_event_handle(Smacs *smacs, SDL_Event *event)
 	if (!(smacs->editor.state & (SEARCH | EXTEND_COMMAND))) return false;
 
 	editor_user_input_insert(&smacs->editor, (char*)event->text.text);
+	if (smacs->editor.state & SEARCH) editor_search_matches_update(&smacs->editor);
+
+	return true;
+}
+
+bool replace_event_handle(Smacs *smacs, SDL_Event *event, int *message_timeout)
+{
+	if (!(smacs->editor.state & REPLACE)) return false;
+
+	if (smacs->editor.replace.stage != REPLACE_QUERY) {
+		editor_user_input_insert(&smacs->editor, (char*)event->text.text);
+		return true;
+	}
+
+	editor_user_replace_answer(&smacs->editor, event->text.text[0], smacs->notification, RENDER_NOTIFICATION_LEN);
+	if (smacs->editor.state == NONE) *message_timeout = smacs->message_timeout_duration;
+
 	return true;
 }
 
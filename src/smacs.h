@@ -8,18 +8,39 @@
 #define MESSAGE_TIMEOUT 5
 #define TAB_SIZE        8
 #define LEADING         1 /* space between raws */
+#define FRAME_DURATION_MS 16 /* mouse motion is not handled more often */
 
 #define NEWLINE "\n"
 #define SPACE   " "
 #define TAB     "\t"
 
+typedef struct {
+	bool quit;
+	bool mouse_selecting;
+	int message_timeout;
+	Uint64 last_frame_ticks;
+} SmacsLoop;
+
+typedef enum {
+	FRAME_SKIP,
+	FRAME_PRESENT, /* glyphs were patched in place, only present the frame */
+	FRAME_RELAYOUT,
+} FrameUpdate;
+
 int smacs_launch(char *home_dir, char *fallback_ttf_path, char *file_path);
+int smacs_init(Smacs *smacs, char *home_dir, char *fallback_ttf_path, char *file_path, SDL_Surface *surface);
+void smacs_destroy(Smacs *smacs);
+FrameUpdate smacs_handle_event(Smacs *smacs, SmacsLoop *loop, SDL_Event *event);
+void smacs_layout_panes(Smacs *smacs);
+void smacs_frame_end(Smacs *smacs, SmacsLoop *loop);
 bool ctrl_leader_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout);
 bool alt_leader_mapping(Smacs *smacs, SDL_Event *event);
 bool search_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout);
+bool replace_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout);
 bool extend_command_mapping(Smacs *smacs, SDL_Event *event, int *message_timeout);
 bool completion_command_mapping(Smacs *smacs, SDL_Event *event);
 
+bool replace_event_handle(Smacs *smacs, SDL_Event *event, int *message_timeout);
 bool mini_buffer_event_handle(Smacs *smacs, SDL_Event *event);
 bool completion_event_handle(Smacs *smacs, SDL_Event *event);
 
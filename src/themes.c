@@ -23,6 +23,7 @@ void themes_mindre(Smacs *smacs)
 	smacs->foreground_color = themes_as_color(0x2E3331);
 	smacs->region_background_color = themes_as_color(0xCFD8DC);
 	smacs->region_foreground_color = smacs->foreground_color;
+	smacs->match_background_color = themes_as_color(0xFFE082);
 	smacs->line_number_color = smacs->region_background_color;
 	smacs->mode_line_background_color = themes_as_color(0xECEFF1);
 	smacs->mode_line_foreground_color = themes_as_color(0x2E3331);
@@ -39,6 +40,7 @@ void themes_naysayer(Smacs *smacs)
 	smacs->foreground_color = themes_as_color(0xD1B897);
 	smacs->region_background_color = themes_as_color(0x0000FF);
 	smacs->region_foreground_color = smacs->foreground_color;
+	smacs->match_background_color = themes_as_color(0x6E5A1E);
 	smacs->line_number_color = themes_sdl_color_brighter(smacs->background_color, 2);
 	smacs->mode_line_background_color = themes_as_color(0xD1B897);
 	smacs->mode_line_foreground_color = themes_as_color(0x062329);
@@ -55,6 +57,7 @@ void themes_acme(Smacs *smacs)
 	smacs->foreground_color = themes_as_color(0x444444);
 	smacs->region_background_color = themes_as_color(0xE8EB98);
 	smacs->region_foreground_color = smacs->foreground_color;
+	smacs->match_background_color = themes_as_color(0xFFD280);
 	smacs->line_number_color = themes_sdl_color_brighter(smacs->foreground_color, 2);
 	smacs->mode_line_background_color = themes_as_color(0xE1FAFF);
 	smacs->mode_line_foreground_color = smacs->foreground_color;
@@ -71,6 +74,7 @@ void themes_jblow_nastalgia(Smacs *smacs)
 	smacs->foreground_color = themes_as_color(0xD3B58D);
 	smacs->region_background_color = themes_as_color(0x0000FF);
 	smacs->region_foreground_color = smacs->foreground_color;
+	smacs->match_background_color = themes_as_color(0x5A4A1A);
 	smacs->line_number_color = themes_sdl_color_brighter(smacs->foreground_color, 2);
 	smacs->mode_line_background_color = smacs->foreground_color;
 	smacs->mode_line_foreground_color = smacs->background_color;
@@ -87,6 +91,7 @@ void themes_qemacs(Smacs *smacs)
 	smacs->foreground_color = themes_as_color(0xF8D8B0);
 	smacs->region_background_color = themes_as_color(0x80f0f0);
 	smacs->region_foreground_color = smacs->background_color;
+	smacs->match_background_color = themes_as_color(0x505000);
 	smacs->line_number_color = themes_sdl_color_brighter(smacs->foreground_color, 2);
 	smacs->mode_line_background_color = smacs->foreground_color;
 	smacs->mode_line_foreground_color = smacs->background_color;
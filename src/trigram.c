@@ -0,0 +1,696 @@
+#ifndef _DEFAULT_SOURCE
+//openat, fstatat and mkstemp are not in C11
+#define _DEFAULT_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "project.h"
+#include "trigram.h"
+
+//the file is treated as binary like in grep, it has no trigrams
+#define TRIGRAM_BINARY_CHECK_LEN 8192
+#define TRIGRAM_WORKERS_MAX 16
+//pairs a worker keeps before they are sorted into a run file, 4 MiB
+#define TRIGRAM_RUN_LEN (1 << 19)
+//pairs of every run read at once while the runs are merged
+#define TRIGRAM_MERGE_LEN 4096
+#define TRIGRAM_CHUNK_LEN (1 << 16)
+
+typedef struct {
+	uint64_t *data; //key << 32 | file
+	size_t len;
+	size_t cap;
+} TrigramPairs;
+
+typedef struct {
+	uint32_t *data;
+	size_t len;
+	size_t cap;
+} TrigramKeys;
+
+typedef struct {
+	FILE **data;
+	size_t len;
+	size_t cap;
+} TrigramRuns;
+
+/**
+ * Workers take the files one by one by next. The pairs of a worker are
+ * bounded, they are sorted into a run file whenever there are enough.
+ */
+typedef struct {
+	TrigramBuild *build;
+	TrigramIndex *previous;
+	TrigramFiles *files;
+	long *renumber; //new id of a file of the previous index, -1 when it is read again
+	int root_fd;
+
+	SDL_AtomicInt next;
+	SDL_AtomicInt failed;
+	SDL_Mutex *lock;
+	TrigramRuns runs;
+} TrigramRead;
+
+typedef struct {
+	TrigramRead *read;
+	TrigramPairs pairs;
+	TrigramKeys keys;
+	uint8_t *seen;
+	size_t files_read;
+} TrigramWorker;
+
+typedef struct {
+	FILE *run;
+	uint64_t pairs[TRIGRAM_MERGE_LEN];
+	size_t position;
+	size_t len;
+} TrigramMerge;
+
+static unsigned char trigram_fold(unsigned char c)
+{
+	return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+static uint32_t trigram_key(const unsigned char *text)
+{
+	return (uint32_t) trigram_fold(text[0]) << 16 | (uint32_t) trigram_fold(text[1]) << 8 | trigram_fold(text[2]);
+}
+
+static void trigram_put_varint(StringBuilder *sb, uint64_t value)
+{
+	while (value >= 0x80) {
+		sb_append(sb, (char) ((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	sb_append(sb, (char) value);
+}
+
+static bool trigram_get_varint(const char *data, size_t len, size_t *position, uint64_t *value)
+{
+	unsigned char byte;
+
+	*value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (*position >= len) return false;
+
+		byte = (unsigned char) data[(*position)++];
+		*value |= (uint64_t) (byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) return true;
+	}
+
+	return false;
+}
+
+static int trigram_posting_compare(const void *key, const void *posting)
+{
+	uint32_t a = *(const uint32_t *) key, b = ((const TrigramPosting *) posting)->key;
+
+	return a < b ? -1 : a > b;
+}
+
+static TrigramPosting *trigram_index_posting(TrigramIndex *index, uint32_t key)
+{
+	if (index->postings.len == 0) return NULL;
+	return bsearch(&key, index->postings.data, index->postings.len, sizeof(TrigramPosting), trigram_posting_compare);
+}
+
+void trigram_index_free(TrigramIndex *index)
+{
+	for (size_t i = 0; i < index->files.len; ++i) free(index->files.data[i].path);
+	gb_free(&index->files);
+	gb_free(&index->postings);
+	free(index->data);
+	index->data = NULL;
+	index->data_len = 0;
+
+	if (index->loaded) hashmap_destroy(&index->by_path);
+	index->loaded = false;
+}
+
+static bool trigram_index_parse(TrigramIndex *index)
+{
+	size_t position = strlen(TRIGRAM_INDEX_MAGIC);
+	uint64_t files_len, postings_len, path_len, mtime, size, key, len;
+	TrigramFile file;
+
+	if (index->data_len < position || memcmp(index->data, TRIGRAM_INDEX_MAGIC, position) != 0) return false;
+	if (!trigram_get_varint(index->data, index->data_len, &position, &files_len)) return false;
+
+	for (uint64_t i = 0; i < files_len; ++i) {
+		if (!trigram_get_varint(index->data, index->data_len, &position, &path_len)) return false;
+		if (path_len > index->data_len - position) return false;
+
+		file.path = strndup(&index->data[position], path_len);
+		position += path_len;
+		gb_append(&index->files, file);
+
+		if (!trigram_get_varint(index->data, index->data_len, &position, &mtime)) return false;
+		if (!trigram_get_varint(index->data, index->data_len, &position, &size)) return false;
+		if (position >= index->data_len) return false;
+
+		index->files.data[i].mtime = (int64_t) mtime;
+		index->files.data[i].size = size;
+		index->files.data[i].indexed = index->data[position++] != 0;
+	}
+
+	if (!trigram_get_varint(index->data, index->data_len, &position, &postings_len)) return false;
+	for (uint64_t i = 0; i < postings_len; ++i) {
+		if (!trigram_get_varint(index->data, index->data_len, &position, &key)) return false;
+		if (!trigram_get_varint(index->data, index->data_len, &position, &len)) return false;
+		if (len > index->data_len - position) return false;
+
+		gb_append(&index->postings, ((TrigramPosting) {(uint32_t) key, position, len}));
+		position += len;
+	}
+
+	return true;
+}
+
+bool trigram_index_load(TrigramIndex *index, const char *root)
+{
+	char path[TRIGRAM_PATH_LEN];
+	FILE *in;
+	long size;
+
+	trigram_index_free(index);
+
+	if ((size_t) snprintf(path, TRIGRAM_PATH_LEN, "%s/%s", root, TRIGRAM_INDEX_FILE) >= TRIGRAM_PATH_LEN) return false;
+	in = fopen(path, "rb");
+	if (in == NULL) return false;
+
+	if (fseek(in, 0, SEEK_END) != 0 || (size = ftell(in)) <= 0 || fseek(in, 0, SEEK_SET) != 0) {
+		fclose(in);
+		return false;
+	}
+
+	index->data = malloc((size_t) size);
+	index->data_len = fread(index->data, 1, (size_t) size, in);
+	fclose(in);
+
+	hashmap_create(1024, &index->by_path);
+	index->loaded = true;
+
+	if (index->data_len != (size_t) size || !trigram_index_parse(index)) {
+		fprintf(stderr, "Broken trigram index %s\n", path);
+		trigram_index_free(index);
+		return false;
+	}
+
+	for (size_t i = 0; i < index->files.len; ++i) {
+		hashmap_put(&index->by_path, index->files.data[i].path, (hashmap_uint32_t) strlen(index->files.data[i].path), (void *) (uintptr_t) (i + 1));
+	}
+
+	return true;
+}
+
+long trigram_index_find(TrigramIndex *index, const char *path, size_t path_len)
+{
+	uintptr_t found;
+
+	if (!index->loaded) return -1;
+
+	found = (uintptr_t) hashmap_get(&index->by_path, path, (hashmap_uint32_t) path_len);
+	return (long) found - 1;
+}
+
+bool *trigram_index_candidates(TrigramIndex *index, const unsigned char *needle, size_t len)
+{
+	TrigramPosting *posting;
+	uint32_t *hits, round;
+	uint64_t delta;
+	size_t position, file;
+	bool *candidates;
+
+	if (!index->loaded || len < 3) return NULL;
+
+	//a file is a candidate when every trigram of the needle has it, hits count the trigrams so far
+	hits = calloc(index->files.len + 1, sizeof(uint32_t));
+	round = 0;
+	for (size_t i = 0; i + 3 <= len; ++i, ++round) {
+		posting = trigram_index_posting(index, trigram_key(&needle[i]));
+		if (posting == NULL) {
+			++round;
+			break;
+		}
+
+		position = posting->offset;
+		file = 0;
+		while (position < posting->offset + posting->len && trigram_get_varint(index->data, posting->offset + posting->len, &position, &delta)) {
+			file += (size_t) delta;
+			if (file < index->files.len && hits[file] == round) hits[file] = round + 1;
+		}
+	}
+
+	candidates = malloc(index->files.len + 1);
+	for (size_t i = 0; i < index->files.len; ++i) {
+		candidates[i] = !index->files.data[i].indexed || hits[i] == round;
+	}
+
+	free(hits);
+	return candidates;
+}
+
+static void trigram_notify(void)
+{
+	SDL_Event event = {0};
+
+	event.type = SDL_EVENT_USER;
+	event.user.code = TRIGRAM_EVENT_CODE;
+	SDL_PushEvent(&event);
+}
+
+static int trigram_pair_compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/**
+ * Temporary files live next to the index and are unlinked at once, they go away with the build
+ */
+static FILE *trigram_temp_open(TrigramBuild *build)
+{
+	char path[TRIGRAM_PATH_LEN];
+	FILE *file;
+	int fd;
+
+	if ((size_t) snprintf(path, TRIGRAM_PATH_LEN, "%s/%s.XXXXXX", build->root, TRIGRAM_INDEX_FILE) >= TRIGRAM_PATH_LEN) return NULL;
+	fd = mkstemp(path);
+	if (fd < 0) return NULL;
+	unlink(path);
+
+	file = fdopen(fd, "w+b");
+	if (file == NULL) close(fd);
+	return file;
+}
+
+/**
+ * Sorts the pairs into a new run file, the pairs are empty again
+ */
+static bool trigram_spill(TrigramRead *read, TrigramPairs *pairs)
+{
+	FILE *run;
+
+	if (pairs->len == 0) return true;
+
+	qsort(pairs->data, pairs->len, sizeof(uint64_t), trigram_pair_compare);
+	run = trigram_temp_open(read->build);
+	if (run == NULL) return false;
+
+	if (fwrite(pairs->data, sizeof(uint64_t), pairs->len, run) != pairs->len || fflush(run) != 0) {
+		fclose(run);
+		return false;
+	}
+	rewind(run);
+	pairs->len = 0;
+
+	SDL_LockMutex(read->lock);
+	gb_append(&read->runs, run);
+	SDL_UnlockMutex(read->lock);
+
+	return true;
+}
+
+/**
+ * Appends the distinct trigrams of the file, seen is cleared again for the next file
+ */
+static bool trigram_read_file(TrigramWorker *worker, TrigramFile *file, uint32_t id)
+{
+	TrigramRead *read = worker->read;
+	unsigned char *data;
+	uint32_t key;
+	int fd;
+
+	if (file->size > TRIGRAM_FILE_LIMIT) return false;
+	if (file->size == 0) return true;
+
+	fd = openat(read->root_fd, file->path, O_RDONLY);
+	if (fd < 0) return false;
+
+	data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return false;
+
+	worker->files_read++;
+
+	if (memchr(data, '\0', MIN(file->size, TRIGRAM_BINARY_CHECK_LEN)) != NULL) {
+		munmap(data, file->size);
+		return true;
+	}
+
+	worker->keys.len = 0;
+	for (size_t i = 0; i + 3 <= file->size; ++i) {
+		key = trigram_key(&data[i]);
+		if (worker->seen[key >> 3] & (1 << (key & 7))) continue;
+
+		worker->seen[key >> 3] |= (uint8_t) (1 << (key & 7));
+		gb_append(&worker->keys, key);
+	}
+	munmap(data, file->size);
+
+	for (size_t i = 0; i < worker->keys.len; ++i) {
+		worker->seen[worker->keys.data[i] >> 3] = 0;
+		gb_append(&worker->pairs, (uint64_t) worker->keys.data[i] << 32 | id);
+	}
+
+	if (worker->pairs.len >= TRIGRAM_RUN_LEN && !trigram_spill(read, &worker->pairs)) SDL_SetAtomicInt(&read->failed, 1);
+
+	return true;
+}
+
+/**
+ * The trigrams of a file not changed since the previous index are taken from it later
+ */
+static void trigram_index_file(TrigramWorker *worker, size_t id)
+{
+	TrigramRead *read = worker->read;
+	TrigramFile *file = &read->files->data[id], *old;
+	struct stat file_stat;
+	long found;
+
+	if (fstatat(read->root_fd, file->path, &file_stat, 0) != 0) return;
+
+	file->mtime = (int64_t) file_stat.st_mtime;
+	file->size = (uint64_t) file_stat.st_size;
+
+	found = trigram_index_find(read->previous, file->path, strlen(file->path));
+	old = found >= 0 ? &read->previous->files.data[found] : NULL;
+
+	if (old != NULL && old->indexed && old->mtime == file->mtime && old->size == file->size) {
+		read->renumber[found] = (long) id;
+		file->indexed = true;
+	} else {
+		file->indexed = trigram_read_file(worker, file, (uint32_t) id);
+	}
+}
+
+static int trigram_read_worker(void *data)
+{
+	TrigramWorker *worker = data;
+	TrigramRead *read = worker->read;
+	size_t id;
+
+	while (!SDL_GetAtomicInt(&read->build->cancel) && !SDL_GetAtomicInt(&read->failed)) {
+		id = (size_t) SDL_AddAtomicInt(&read->next, 1);
+		if (id >= read->files->len) break;
+
+		trigram_index_file(worker, id);
+	}
+
+	if (!trigram_spill(read, &worker->pairs)) SDL_SetAtomicInt(&read->failed, 1);
+
+	return 0;
+}
+
+/**
+ * Refills the pairs of the run, false at its end
+ */
+static bool trigram_merge_fill(TrigramMerge *merge)
+{
+	if (merge->position < merge->len) return true;
+
+	merge->len = fread(merge->pairs, sizeof(uint64_t), TRIGRAM_MERGE_LEN, merge->run);
+	merge->position = 0;
+
+	return merge->len > 0;
+}
+
+static uint64_t trigram_merge_head(TrigramMerge *merge)
+{
+	return merge->pairs[merge->position];
+}
+
+/**
+ * Moves the run down the min-heap of the runs by their next pairs
+ */
+static void trigram_merge_down(TrigramMerge **heap, size_t len, size_t i)
+{
+	TrigramMerge *swap;
+	size_t child;
+
+	while ((child = 2 * i + 1) < len) {
+		if (child + 1 < len && trigram_merge_head(heap[child + 1]) < trigram_merge_head(heap[child])) ++child;
+		if (trigram_merge_head(heap[i]) <= trigram_merge_head(heap[child])) break;
+
+		swap = heap[i];
+		heap[i] = heap[child];
+		heap[child] = swap;
+		i = child;
+	}
+}
+
+/**
+ * Merges the sorted runs into the postings, written to the file as they are complete
+ */
+static bool trigram_merge(TrigramBuild *build, TrigramRuns *runs, FILE *out, size_t *postings_len)
+{
+	StringBuilder posting = {0}, chunk = {0};
+	TrigramMerge *merges, **heap;
+	size_t heap_len;
+	uint64_t pair;
+	uint32_t key, previous;
+	bool ok;
+
+	merges = calloc(runs->len + 1, sizeof(TrigramMerge));
+	heap = malloc((runs->len + 1) * sizeof(TrigramMerge *));
+	heap_len = 0;
+	for (size_t i = 0; i < runs->len; ++i) {
+		merges[i].run = runs->data[i];
+		if (trigram_merge_fill(&merges[i])) heap[heap_len++] = &merges[i];
+	}
+	for (size_t i = heap_len; i-- > 0;) trigram_merge_down(heap, heap_len, i);
+
+	*postings_len = 0;
+	ok = true;
+	while (heap_len > 0 && ok) {
+		key = (uint32_t) (trigram_merge_head(heap[0]) >> 32);
+		posting.len = 0;
+		previous = 0;
+
+		while (heap_len > 0 && (uint32_t) ((pair = trigram_merge_head(heap[0])) >> 32) == key) {
+			trigram_put_varint(&posting, (uint32_t) pair - previous);
+			previous = (uint32_t) pair;
+
+			heap[0]->position++;
+			if (!trigram_merge_fill(heap[0])) heap[0] = heap[--heap_len];
+			trigram_merge_down(heap, heap_len, 0);
+		}
+
+		trigram_put_varint(&chunk, key);
+		trigram_put_varint(&chunk, posting.len);
+		sb_append_manyl(&chunk, posting.data, posting.len);
+		++*postings_len;
+
+		if (chunk.len >= TRIGRAM_CHUNK_LEN || heap_len == 0) {
+			ok = fwrite(chunk.data, 1, chunk.len, out) == chunk.len;
+			chunk.len = 0;
+		}
+		ok = ok && !SDL_GetAtomicInt(&build->cancel);
+	}
+
+	for (size_t i = 0; i < runs->len; ++i) ok = ok && !ferror(runs->data[i]);
+
+	sb_free(&posting);
+	sb_free(&chunk);
+	free(merges);
+	free(heap);
+	return ok;
+}
+
+static bool trigram_write(TrigramBuild *build, TrigramFiles *files, TrigramRuns *runs)
+{
+	StringBuilder out = {0};
+	char path[TRIGRAM_PATH_LEN], tmp_path[TRIGRAM_PATH_LEN], chunk[TRIGRAM_CHUNK_LEN];
+	size_t postings_len, len;
+	FILE *file, *postings;
+	bool ok;
+
+	//the count of the postings comes first, so they are merged into a temporary file
+	postings = trigram_temp_open(build);
+	ok = postings != NULL && trigram_merge(build, runs, postings, &postings_len) && fflush(postings) == 0;
+	if (SDL_GetAtomicInt(&build->cancel)) {
+		if (postings != NULL) fclose(postings);
+		return false;
+	}
+
+	sb_append_many(&out, TRIGRAM_INDEX_MAGIC);
+	trigram_put_varint(&out, files->len);
+	for (size_t i = 0; i < files->len; ++i) {
+		trigram_put_varint(&out, strlen(files->data[i].path));
+		sb_append_many(&out, files->data[i].path);
+		trigram_put_varint(&out, (uint64_t) files->data[i].mtime);
+		trigram_put_varint(&out, files->data[i].size);
+		sb_append(&out, files->data[i].indexed ? 1 : 0);
+	}
+	if (ok) trigram_put_varint(&out, postings_len);
+
+	//the index is replaced at once, a grep loading it meanwhile sees the old one
+	snprintf(path, TRIGRAM_PATH_LEN, "%s/%s", build->root, TRIGRAM_INDEX_FILE);
+	snprintf(tmp_path, TRIGRAM_PATH_LEN, "%s/%s.tmp", build->root, TRIGRAM_INDEX_FILE);
+
+	file = ok ? fopen(tmp_path, "wb") : NULL;
+	ok = file != NULL;
+	if (ok) {
+		ok = fwrite(out.data, 1, out.len, file) == out.len;
+
+		rewind(postings);
+		while (ok && (len = fread(chunk, 1, TRIGRAM_CHUNK_LEN, postings)) > 0) ok = fwrite(chunk, 1, len, file) == len;
+		ok = ok && !ferror(postings);
+
+		ok = fclose(file) == 0 && ok;
+		ok = ok && rename(tmp_path, path) == 0;
+		if (!ok) remove(tmp_path);
+	}
+	if (!ok) fprintf(stderr, "Could not write trigram index %s\n", path);
+
+	if (postings != NULL) fclose(postings);
+	sb_free(&out);
+	return ok;
+}
+
+static int trigram_build_worker(void *data)
+{
+	TrigramBuild *build = data;
+	TrigramWorker workers[TRIGRAM_WORKERS_MAX] = {0};
+	SDL_Thread *threads[TRIGRAM_WORKERS_MAX] = {0};
+	TrigramIndex previous = {0};
+	TrigramFiles files = {0};
+	TrigramPairs pairs = {0};
+	TrigramRead read = {0};
+	TrigramPosting *posting;
+	Project project = {0};
+	size_t workers_len, position, id;
+	uint64_t delta;
+	int cores;
+
+	trigram_index_load(&previous, build->root);
+
+	//the same files as grep walks through, the ignore file is not followed
+	project_refresh(&project, build->root, false);
+	for (size_t i = 0; i < project.files.len; ++i) {
+		gb_append(&files, ((TrigramFile) {strdup(project.files.data[i]), 0, 0, false}));
+	}
+	project_free(&project);
+
+	read.build = build;
+	read.previous = &previous;
+	read.files = &files;
+	read.root_fd = open(build->root, O_RDONLY | O_DIRECTORY);
+	read.lock = SDL_CreateMutex();
+	if (read.root_fd < 0) SDL_SetAtomicInt(&read.failed, 1);
+
+	//the trigrams of the unchanged files are taken from the previous index
+	read.renumber = malloc((previous.files.len + 1) * sizeof(long));
+	for (size_t i = 0; i < previous.files.len; ++i) read.renumber[i] = -1;
+
+	cores = SDL_GetNumLogicalCPUCores();
+	workers_len = (size_t) MAX(1, MIN(cores, TRIGRAM_WORKERS_MAX));
+	for (size_t i = 0; i < workers_len; ++i) {
+		workers[i].read = &read;
+		workers[i].seen = calloc(1 << 21, 1);
+		//the first worker is the build thread itself
+		if (i > 0) threads[i] = SDL_CreateThread(trigram_read_worker, "trigram", &workers[i]);
+	}
+	trigram_read_worker(&workers[0]);
+
+	for (size_t i = 0; i < workers_len; ++i) {
+		if (threads[i] != NULL) SDL_WaitThread(threads[i], NULL);
+		build->read += workers[i].files_read;
+		gb_free(&workers[i].pairs);
+		gb_free(&workers[i].keys);
+		free(workers[i].seen);
+	}
+
+	//both lists are sorted by path, so the renumbered ids of a posting stay sorted
+	for (size_t i = 0; i < previous.postings.len && !SDL_GetAtomicInt(&read.failed); ++i) {
+		posting = &previous.postings.data[i];
+		position = posting->offset;
+		id = 0;
+		while (position < posting->offset + posting->len && trigram_get_varint(previous.data, posting->offset + posting->len, &position, &delta)) {
+			id += (size_t) delta;
+			if (id < previous.files.len && read.renumber[id] >= 0) gb_append(&pairs, (uint64_t) posting->key << 32 | (uint64_t) read.renumber[id]);
+		}
+
+		if (pairs.len >= TRIGRAM_RUN_LEN && !trigram_spill(&read, &pairs)) SDL_SetAtomicInt(&read.failed, 1);
+	}
+	if (!trigram_spill(&read, &pairs)) SDL_SetAtomicInt(&read.failed, 1);
+
+	if (!SDL_GetAtomicInt(&build->cancel)) {
+		build->files = files.len;
+		if (SDL_GetAtomicInt(&read.failed)) {
+			fprintf(stderr, "Could not read the files of %s for the trigram index\n", build->root);
+		} else {
+			build->ok = trigram_write(build, &files, &read.runs);
+		}
+
+		if (!SDL_GetAtomicInt(&build->cancel)) {
+			SDL_SetAtomicInt(&build->done, 1);
+			trigram_notify();
+		}
+	}
+
+	for (size_t i = 0; i < read.runs.len; ++i) fclose(read.runs.data[i]);
+	gb_free(&read.runs);
+	for (size_t i = 0; i < files.len; ++i) free(files.data[i].path);
+	gb_free(&files);
+	gb_free(&pairs);
+	free(read.renumber);
+	if (read.root_fd >= 0) close(read.root_fd);
+	SDL_DestroyMutex(read.lock);
+	trigram_index_free(&previous);
+
+	return 0;
+}
+
+/**
+ * Updates the index file of the root in a worker thread, TRIGRAM_EVENT_CODE is pushed when it is written
+ */
+void trigram_build_start(TrigramBuild *build, const char *root)
+{
+	trigram_build_cancel(build);
+
+	build->root_len = (size_t) snprintf(build->root, TRIGRAM_PATH_LEN, "%s", root);
+	build->files = 0;
+	build->read = 0;
+	build->ok = false;
+	SDL_SetAtomicInt(&build->cancel, 0);
+	SDL_SetAtomicInt(&build->done, 0);
+
+	build->thread = SDL_CreateThread(trigram_build_worker, "trigram", build);
+	if (build->thread == NULL) {
+		fprintf(stderr, "Could not create trigram index thread: %s\n", SDL_GetError());
+		return;
+	}
+	build->running = true;
+}
+
+bool trigram_build_take(TrigramBuild *build)
+{
+	//the event may come from a build cancelled after it was finished
+	if (!build->running || !SDL_GetAtomicInt(&build->done)) return false;
+
+	SDL_WaitThread(build->thread, NULL);
+	build->thread = NULL;
+	build->running = false;
+
+	return true;
+}
+
+void trigram_build_cancel(TrigramBuild *build)
+{
+	if (!build->running) return;
+
+	SDL_SetAtomicInt(&build->cancel, 1);
+	SDL_WaitThread(build->thread, NULL);
+	build->thread = NULL;
+	build->running = false;
+}
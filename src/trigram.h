@@ -0,0 +1,100 @@
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "hashmap.h"
+
+//hidden, so neither grep nor the index itself reads it
+#define TRIGRAM_INDEX_FILE ".smacs-trigrams"
+#define TRIGRAM_INDEX_MAGIC "SMTRG1\n"
+#define TRIGRAM_EVENT_CODE 3
+//bigger files are not indexed, they are candidates of every query
+#define TRIGRAM_FILE_LIMIT (8 << 20)
+#define TRIGRAM_PATH_LEN 4096
+
+typedef struct {
+	char *path; //relative to the root
+	int64_t mtime;
+	uint64_t size;
+	bool indexed;
+} TrigramFile;
+
+typedef struct {
+	TrigramFile *data;
+	size_t len;
+	size_t cap;
+} TrigramFiles;
+
+/**
+ * Ids of the files containing the trigram, delta and varint encoded at offset of the data
+ */
+typedef struct {
+	uint32_t key;
+	size_t offset;
+	size_t len;
+} TrigramPosting;
+
+typedef struct {
+	TrigramPosting *data;
+	size_t len;
+	size_t cap;
+} TrigramPostings;
+
+/**
+ * Trigrams of ASCII-folded bytes (like the case-insensitive search) of every
+ * file under the root, loaded from the index file of the root
+ */
+typedef struct {
+	TrigramFiles files;
+	struct hashmap_s by_path;
+	TrigramPostings postings; //sorted by key
+	char *data;
+	size_t data_len;
+	bool loaded;
+} TrigramIndex;
+
+/**
+ * Background (re)build of the index file, the files not changed since the
+ * previous index are not read again
+ */
+typedef struct {
+	SDL_Thread *thread;
+	SDL_AtomicInt cancel;
+	SDL_AtomicInt done;
+	bool running;
+	bool ok;
+
+	char root[TRIGRAM_PATH_LEN];
+	size_t root_len;
+	size_t files;
+	size_t read;
+} TrigramBuild;
+
+/**
+ * Reads the index file of the root, false when there is none or it is broken
+ */
+bool trigram_index_load(TrigramIndex *index, const char *root);
+void trigram_index_free(TrigramIndex *index);
+/**
+ * Index of the file by its relative path, -1 when it is not indexed
+ */
+long trigram_index_find(TrigramIndex *index, const char *path, size_t path_len);
+/**
+ * Marks the files which can contain the folded needle. Returns NULL when the
+ * needle is too short to filter anything, otherwise an array of files.len.
+ */
+bool *trigram_index_candidates(TrigramIndex *index, const unsigned char *needle, size_t len);
+
+void trigram_build_start(TrigramBuild *build, const char *root);
+/**
+ * Waits for the finished build, returns false while it is running
+ */
+bool trigram_build_take(TrigramBuild *build);
+void trigram_build_cancel(TrigramBuild *build);
+
+#endif
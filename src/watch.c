@@ -0,0 +1,221 @@
+#ifndef _DEFAULT_SOURCE
+//poll and pipe are not in C11
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "watch.h"
+
+#ifdef OS_LINUX
+
+#include <poll.h>
+#include <sys/inotify.h>
+
+#define WATCH_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+static void watch_notify(Watch *watch)
+{
+	SDL_Event event = {0};
+
+	if (!SDL_CompareAndSwapAtomicInt(&watch->pending, 0, 1)) return;
+
+	event.type = SDL_EVENT_USER;
+	event.user.code = WATCH_EVENT_CODE;
+	SDL_PushEvent(&event);
+}
+
+static uint32_t watch_kind(uint32_t mask)
+{
+	uint32_t kind = 0;
+
+	if (mask & IN_Q_OVERFLOW) return WATCH_OVERFLOW;
+	if (mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) return WATCH_GONE;
+
+	if (mask & (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB)) kind |= WATCH_MODIFIED;
+	if (mask & (IN_CREATE | IN_MOVED_TO)) kind |= WATCH_CREATED;
+	if (mask & (IN_DELETE | IN_MOVED_FROM)) kind |= WATCH_DELETED;
+	if (mask & IN_ISDIR) kind |= WATCH_IS_DIR;
+
+	return kind;
+}
+
+/**
+ * Appends the read events, the repeated writes to one file (a growing log) are one change
+ */
+static void watch_collect(Watch *watch, char *events, size_t len)
+{
+	struct inotify_event *event;
+	WatchChange change, *last;
+
+	SDL_LockMutex(watch->lock);
+	for (size_t offset = 0; offset < len; offset += sizeof(struct inotify_event) + event->len) {
+		event = (struct inotify_event *) &events[offset];
+
+		change.dir = event->wd;
+		change.kind = watch_kind(event->mask);
+		change.name[0] = '\0';
+		if (event->len > 0) snprintf(change.name, WATCH_NAME_LEN, "%s", event->name);
+		if (change.kind == 0) continue;
+
+		last = watch->changes.len > 0 ? &watch->changes.data[watch->changes.len - 1] : NULL;
+		if (last != NULL && last->dir == change.dir && last->kind == change.kind && strcmp(last->name, change.name) == 0) continue;
+
+		gb_append(&watch->changes, change);
+	}
+	SDL_UnlockMutex(watch->lock);
+
+	watch_notify(watch);
+}
+
+static int watch_worker(void *data)
+{
+	Watch *watch = data;
+	_Alignas(struct inotify_event) char events[WATCH_READ_SIZE];
+	struct pollfd fds[2];
+	ssize_t len;
+
+	fds[0] = (struct pollfd) {watch->fd, POLLIN, 0};
+	fds[1] = (struct pollfd) {watch->stop[0], POLLIN, 0};
+
+	for (;;) {
+		if (poll(fds, 2, -1) < 0) continue;
+		if (fds[1].revents != 0) break;
+		if ((fds[0].revents & POLLIN) == 0) continue;
+
+		len = read(watch->fd, events, sizeof(events));
+		if (len <= 0) continue;
+
+		watch_collect(watch, events, (size_t) len);
+	}
+
+	return 0;
+}
+
+bool watch_start(Watch *watch)
+{
+	if (watch->running) return true;
+
+	watch->fd = inotify_init1(IN_CLOEXEC);
+	if (watch->fd < 0) {
+		fprintf(stderr, "Could not init inotify\n");
+		return false;
+	}
+
+	if (pipe(watch->stop) != 0) {
+		fprintf(stderr, "Could not create watch pipe\n");
+		close(watch->fd);
+		return false;
+	}
+
+	watch->lock = SDL_CreateMutex();
+	SDL_SetAtomicInt(&watch->pending, 0);
+
+	watch->thread = SDL_CreateThread(watch_worker, "watch", watch);
+	if (watch->thread == NULL) {
+		fprintf(stderr, "Could not create watch thread: %s\n", SDL_GetError());
+		SDL_DestroyMutex(watch->lock);
+		close(watch->stop[0]);
+		close(watch->stop[1]);
+		close(watch->fd);
+		return false;
+	}
+
+	watch->running = true;
+	return true;
+}
+
+int watch_add(Watch *watch, const char *dir)
+{
+	int wd;
+
+	if (!watch->running) return 0;
+
+	//inotify gives the same descriptor to the same inode, it is the id of the dir
+	wd = inotify_add_watch(watch->fd, dir, WATCH_MASK | IN_ONLYDIR);
+	if (wd < 0) {
+		fprintf(stderr, "Could not watch %s\n", dir);
+		return 0;
+	}
+
+	return wd;
+}
+
+void watch_remove(Watch *watch, int id)
+{
+	if (!watch->running || id == 0) return;
+
+	//fails when the dir is gone, inotify has removed the watch itself
+	inotify_rm_watch(watch->fd, id);
+}
+
+void watch_take(Watch *watch, WatchChanges *changes)
+{
+	WatchChanges taken;
+
+	changes->len = 0;
+	if (!watch->running) return;
+
+	SDL_LockMutex(watch->lock);
+	SDL_SetAtomicInt(&watch->pending, 0);
+	taken = watch->changes;
+	watch->changes = *changes;
+	SDL_UnlockMutex(watch->lock);
+
+	*changes = taken;
+}
+
+void watch_stop(Watch *watch)
+{
+	char stop = 1;
+
+	if (!watch->running) return;
+
+	if (write(watch->stop[1], &stop, 1) != 1) fprintf(stderr, "Could not stop the watch thread\n");
+	SDL_WaitThread(watch->thread, NULL);
+
+	close(watch->stop[0]);
+	close(watch->stop[1]);
+	close(watch->fd);
+	SDL_DestroyMutex(watch->lock);
+	gb_free(&watch->changes);
+
+	*watch = (Watch) {0};
+}
+
+#else
+
+bool watch_start(Watch *watch)
+{
+	(void) watch;
+	return false;
+}
+
+int watch_add(Watch *watch, const char *dir)
+{
+	(void) watch;
+	(void) dir;
+	return 0;
+}
+
+void watch_remove(Watch *watch, int id)
+{
+	(void) watch;
+	(void) id;
+}
+
+void watch_take(Watch *watch, WatchChanges *changes)
+{
+	(void) watch;
+	changes->len = 0;
+}
+
+void watch_stop(Watch *watch)
+{
+	(void) watch;
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <SDL3/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+
+#define WATCH_EVENT_CODE 4
+#define WATCH_NAME_LEN 256
+//inotify events are read by this many bytes at once
+#define WATCH_READ_SIZE (64 << 10)
+
+typedef enum {
+	WATCH_MODIFIED = 0x01,
+	WATCH_CREATED  = 0x02, //created or moved into the dir
+	WATCH_DELETED  = 0x04, //deleted or moved out of the dir
+	WATCH_IS_DIR   = 0x08,
+	WATCH_GONE     = 0x10, //the watched dir itself, its id is not valid anymore
+	WATCH_OVERFLOW = 0x20, //changes are lost, everything has to be checked
+} WatchKind;
+
+/**
+ * Something happened to the name in the dir, dir is what watch_add returned
+ */
+typedef struct {
+	int dir;
+	uint32_t kind;
+	char name[WATCH_NAME_LEN];
+} WatchChange;
+
+typedef struct {
+	WatchChange *data;
+	size_t len;
+	size_t cap;
+} WatchChanges;
+
+/**
+ * Watches directories by inotify in a worker thread. The changes are
+ * collected under the lock and WATCH_EVENT_CODE is pushed once until
+ * they are taken.
+ */
+typedef struct {
+	int fd;
+	int stop[2];
+	SDL_Thread *thread;
+	SDL_Mutex *lock;
+	SDL_AtomicInt pending;
+	WatchChanges changes;
+	bool running;
+} Watch;
+
+bool watch_start(Watch *watch);
+/**
+ * Id of the watched dir, the same dir by any path has the same id. Returns 0 when it can not be watched.
+ */
+int watch_add(Watch *watch, const char *dir);
+/**
+ * Stops watching the dir of the id, every path of the dir shares the id so only its last user removes it
+ */
+void watch_remove(Watch *watch, int id);
+/**
+ * Moves the collected changes to the changes (their previous content is dropped)
+ */
+void watch_take(Watch *watch, WatchChanges *changes);
+void watch_stop(Watch *watch);
+
+#endif
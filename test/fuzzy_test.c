@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ctype.h>
+
+#include "../src/fuzzy.h"
+
+static bool naive_subsequence(char *candidate, char *query)
+{
+	size_t q = 0;
+
+	for (size_t i = 0; candidate[i] != '\0' && query[q] != '\0'; ++i) {
+		if (tolower(candidate[i]) == tolower(query[q])) ++q;
+	}
+
+	return query[q] == '\0';
+}
+
+static int score_of(char *candidate, char *query)
+{
+	int score;
+
+	assert(fuzzy_score(candidate, strlen(candidate), query, strlen(query), &score) && "Candidate should match");
+	return score;
+}
+
+int main(void)
+{
+	char candidate[16], query[4];
+	FuzzyTop top = {0};
+	int score;
+
+	//the mask never rejects a match and the score agrees with a naive subsequence check
+	srand(3);
+	for (size_t round = 0; round < 20000; ++round) {
+		for (size_t i = 0; i < sizeof(candidate) - 1; ++i) candidate[i] = "abcAB_/x1"[rand() % 9];
+		candidate[rand() % sizeof(candidate)] = '\0';
+		candidate[sizeof(candidate) - 1] = '\0';
+		for (size_t i = 0; i < sizeof(query) - 1; ++i) query[i] = "abBx1"[rand() % 5];
+		query[rand() % sizeof(query)] = '\0';
+		query[sizeof(query) - 1] = '\0';
+
+		bool found = fuzzy_score(candidate, strlen(candidate), query, strlen(query), &score);
+		uint64_t query_mask = fuzzy_mask(query, strlen(query));
+
+		assert(found == naive_subsequence(candidate, query) && "Fuzzy match should be a case-insensitive subsequence");
+		if (found) assert((fuzzy_mask(candidate, strlen(candidate)) & query_mask) == query_mask && "Mask should not reject a match");
+	}
+
+	assert(!fuzzy_score("editor.c", 8, "ce", 2, &score) && "Order matters");
+
+	//word starts and consecutive chars win over scattered ones
+	assert(score_of("src/editor.c", "ed") > score_of("src/render.c", "ed"));
+	assert(score_of("smacs.c", "smacs") > score_of("s_m_a_c_s.c", "smacs"));
+	assert(score_of("search_index.c", "si") > score_of("basic.c", "si"));
+	assert(score_of("SearchIndex", "si") > score_of("Searching", "si"));
+
+	//the heap keeps the best k, equal scores in the order of the candidates
+	fuzzy_top_reset(&top, 3);
+	int scores[] = {5, 1, 9, 5, 7, 1, 9};
+	for (size_t i = 0; i < sizeof(scores) / sizeof(scores[0]); ++i) fuzzy_top_push(&top, i, scores[i]);
+	fuzzy_top_sort(&top);
+	assert(top.len == 3);
+	assert(top.data[0].index == 2 && top.data[1].index == 6 && top.data[2].index == 4);
+
+	fuzzy_top_reset(&top, 2);
+	for (size_t i = 0; i < 5; ++i) fuzzy_top_push(&top, i, 0);
+	fuzzy_top_sort(&top);
+	assert(top.data[0].index == 0 && top.data[1].index == 1);
+
+	fuzzy_top_free(&top);
+	return 0;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <assert.h>
+
+#include "../src/layout.h"
+
+static bool rect_is(LayoutRect rect, int x, int y, int w, int h)
+{
+	return rect.x == x && rect.y == y && rect.w == w && rect.h == h;
+}
+
+int main(void)
+{
+	Layout layout;
+	LayoutRect rects[LAYOUT_PANES_MAX];
+	LayoutRect area = {0, 0, 1000, 800};
+	size_t panes_len;
+
+	layout_init(&layout);
+	layout_rects(&layout, area, rects);
+	assert(rect_is(rects[0], 0, 0, 1000, 800));
+	assert(layout_next(&layout, 0) == 0);
+	assert(layout_remove(&layout, 0) == 0 && "The last pane stays");
+
+	//0 | (1 over 2)
+	assert(layout_split(&layout, 0, 1, LAYOUT_COLUMNS));
+	assert(layout_split(&layout, 1, 2, LAYOUT_ROWS));
+	layout_rects(&layout, area, rects);
+	assert(rect_is(rects[0], 0, 0, 500, 800));
+	assert(rect_is(rects[1], 500, 0, 500, 400));
+	assert(rect_is(rects[2], 500, 400, 500, 400));
+
+	//the order is left to right and top to bottom
+	assert(layout_next(&layout, 0) == 1);
+	assert(layout_next(&layout, 1) == 2);
+	assert(layout_next(&layout, 2) == 0);
+
+	//odd sizes give the rest to the second child
+	layout_rects(&layout, (LayoutRect) {10, 20, 101, 51}, rects);
+	assert(rect_is(rects[0], 10, 20, 50, 51));
+	assert(rect_is(rects[1], 60, 20, 51, 25));
+	assert(rect_is(rects[2], 60, 45, 51, 26));
+
+	//the sibling of the removed pane takes the whole split
+	assert(layout_remove(&layout, 1) == 2);
+	layout_rects(&layout, area, rects);
+	assert(rect_is(rects[0], 0, 0, 500, 800));
+	assert(rect_is(rects[2], 500, 0, 500, 800));
+
+	layout_rename(&layout, 2, 1);
+	layout_rects(&layout, area, rects);
+	assert(rect_is(rects[1], 500, 0, 500, 800));
+
+	//a split sibling moves up with its children
+	assert(layout_split(&layout, 1, 2, LAYOUT_ROWS));
+	assert(layout_remove(&layout, 0) == 1);
+	layout_rects(&layout, area, rects);
+	assert(rect_is(rects[1], 0, 0, 1000, 400));
+	assert(rect_is(rects[2], 0, 400, 1000, 400));
+	assert(layout_next(&layout, 2) == 1);
+
+	//the nodes are enough for every pane and are reused after removal
+	layout_init(&layout);
+	for (panes_len = 1; panes_len < LAYOUT_PANES_MAX; ++panes_len) {
+		assert(layout_split(&layout, panes_len - 1, panes_len, panes_len % 2 ? LAYOUT_COLUMNS : LAYOUT_ROWS));
+	}
+	assert(!layout_split(&layout, 0, panes_len, LAYOUT_COLUMNS) && "Nodes are exhausted");
+	assert(layout_remove(&layout, panes_len - 1) == panes_len - 2);
+	assert(layout_split(&layout, 0, panes_len - 1, LAYOUT_ROWS));
+
+	layout_rects(&layout, area, rects);
+	for (size_t i = 0; i < panes_len; ++i) {
+		assert(rects[i].w > 0 && rects[i].h > 0);
+		assert(rects[i].x + rects[i].w <= area.w && rects[i].y + rects[i].h <= area.h);
+	}
+
+	return 0;
+}
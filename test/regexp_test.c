@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <regex.h>
+
+#include "../src/common.h"
+#include "../src/regexp.h"
+
+#define TEXT_LEN 400
+
+static void random_pattern(StringBuilder *sb, int depth)
+{
+	static char *atoms[] = {"a", "b", ".", "[ab]", "[a-b]", "\\w", "A"};
+	int count = 1 + rand() % 3;
+
+	for (int i = 0; i < count; ++i) {
+		int kind = depth > 0 ? rand() % 6 : 0;
+
+		if (kind == 0 || kind == 1) {
+			sb_append_many(sb, atoms[rand() % 7]);
+		} else if (kind == 2) {
+			sb_append(sb, '(');
+			random_pattern(sb, depth - 1);
+			sb_append(sb, '|');
+			random_pattern(sb, depth - 1);
+			sb_append(sb, ')');
+		} else {
+			sb_append(sb, '(');
+			random_pattern(sb, depth - 1);
+			sb_append(sb, ')');
+		}
+
+		switch (rand() % 6) {
+		case 0: sb_append(sb, '*'); break;
+		case 1: sb_append(sb, '+'); break;
+		case 2: sb_append(sb, '?'); break;
+		case 3: sb_append_many(sb, "{1,2}"); break;
+		}
+	}
+}
+
+/**
+ * POSIX finds the same leftmost start, only the length of the match may differ
+ */
+static long posix_forward(regex_t *posix, char *text, size_t from)
+{
+	regmatch_t match;
+	int flags = from > 0 && text[from - 1] != '\n' ? REG_NOTBOL : 0;
+
+	if (regexec(posix, &text[from], 1, &match, flags) != 0) return -1;
+	return (long) from + match.rm_so;
+}
+
+static void check_random(char *text, size_t text_len)
+{
+	StringBuilder pattern = {0};
+	Regexp regexp;
+	regex_t posix;
+	size_t start, end, last_start, last_end, pos;
+	bool found;
+
+	random_pattern(&pattern, 2);
+	if (rand() % 4 == 0) {
+		sb_clean(&pattern);
+		sb_append(&pattern, '^');
+		random_pattern(&pattern, 1);
+	} else if (rand() % 4 == 0) {
+		random_pattern(&pattern, 1);
+		sb_append(&pattern, '$');
+	}
+
+	assert(regexp_compile(&regexp, pattern.data, pattern.len, REGEXP_ICASE) && "Random pattern should compile");
+	assert(regcomp(&posix, pattern.data, REG_EXTENDED | REG_ICASE | REG_NEWLINE) == 0);
+
+	for (size_t from = 0; from <= text_len; from += 13) {
+		found = regexp_search_forward(&regexp, text, text_len, from, &start, &end);
+		if (posix_forward(&posix, text, from) != (found ? (long) start : -1)) {
+			fprintf(stderr, "pattern %s from %ld: %ld != %ld\n", pattern.data, from, found ? (long) start : -1, posix_forward(&posix, text, from));
+			assert(false && "Forward search should find the leftmost start like POSIX");
+		}
+		assert((!found || (start >= from && end >= start)) && "Match should be after from");
+
+		//backward search finds the last of the forward matches
+		found = false;
+		for (pos = 0; pos <= from && regexp_search_forward(&regexp, text, text_len, pos, &start, &end) && start <= from;) {
+			found = true;
+			last_start = start;
+			last_end = end;
+			pos = end > start ? end : start + 1;
+		}
+
+		if (found) {
+			assert(regexp_search_backward(&regexp, text, text_len, from, &start, &end) && "Backward search should find a match");
+			assert(start == last_start && end == last_end && "Backward search should find the last match before from");
+		} else {
+			assert(!regexp_search_backward(&regexp, text, text_len, from, &start, &end) && "Backward search should find nothing");
+		}
+	}
+
+	regfree(&posix);
+	regexp_free(&regexp);
+	sb_free(&pattern);
+}
+
+static void check_match(char *pattern, char *text, long expected_start, long expected_end)
+{
+	Regexp regexp;
+	size_t start, end;
+	bool found;
+
+	assert(regexp_compile(&regexp, pattern, strlen(pattern), REGEXP_ICASE) && "Pattern should compile");
+	found = regexp_search_forward(&regexp, text, strlen(text), 0, &start, &end);
+
+	if (!(found ? (long) start == expected_start && (long) end == expected_end : expected_start < 0)) {
+		fprintf(stderr, "pattern %s on %s: %ld %ld\n", pattern, text, found ? (long) start : -1, found ? (long) end : -1);
+		assert(false && "Unexpected match");
+	}
+
+	regexp_free(&regexp);
+}
+
+int main(void)
+{
+	char *text = malloc(TEXT_LEN + 1);
+	Regexp regexp;
+
+	srand(7);
+	for (size_t round = 0; round < 300; ++round) {
+		for (size_t i = 0; i < TEXT_LEN; ++i) text[i] = "aabB \n"[rand() % 6];
+		text[TEXT_LEN] = '\0';
+
+		check_random(text, TEXT_LEN);
+	}
+
+	//the first alternative wins, quantifiers are greedy unless lazy
+	check_match("a|ab", "xab", 1, 2);
+	check_match("(a|ab)(c|bcd)", "abcd", 0, 4);
+	check_match("x*", "xxx", 0, 3);
+	check_match("x+?", "xxx", 0, 1);
+	check_match("x{2,}", "x xxxx", 2, 6);
+	check_match("\\bfoo\\b", "afoo foo", 5, 8);
+	check_match("^bar$", "foo\nbar\nbaz", 4, 7);
+	check_match("NEEDLE\\d+", "needle needle42", 7, 15);
+	check_match("п.ивет", "ПРИВЕТ привет", 13, 25);
+	check_match("[^\\n]+", "\nabc", 1, 4);
+	check_match("a.c", "a\nc", -1, -1);
+
+	assert(!regexp_compile(&regexp, "(ab", 3, 0) && "Missing ) is an error");
+	assert(!regexp_compile(&regexp, "*a", 2, 0) && "Nothing to repeat is an error");
+	assert(!regexp_compile(&regexp, "a{3,1}", 6, 0) && "Invalid repetition is an error");
+	assert(!regexp_compile(&regexp, "[а-я]", strlen("[а-я]"), 0) && "Non-ASCII ranges are not supported");
+
+	//case-sensitive search still uses the folded literal prefilter
+	assert(regexp_compile(&regexp, "Needle", 6, 0));
+	{
+		size_t start, end;
+		char *haystack = "needle NEEDLE Needle";
+		assert(regexp_search_forward(&regexp, haystack, strlen(haystack), 0, &start, &end) && start == 14);
+	}
+	regexp_free(&regexp);
+
+	free(text);
+	return 0;
+}
@@ -0,0 +1,96 @@
+#ifndef _DEFAULT_SOURCE
+//mkstemp and pwrite are not in C11
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "../src/editor.h"
+
+#define RELOAD_TEST_LINES 1000
+#define RELOAD_TEST_WAIT_MS 2000
+
+/**
+ * Handles the watch changes until the first byte of the buffer is the expected one
+ */
+static bool reload_wait(Editor *editor, Buffer *buffer, char expected)
+{
+	char notification[256];
+
+	for (size_t waited = 0; waited < RELOAD_TEST_WAIT_MS; waited += 10) {
+		SDL_Delay(10);
+		editor_watch_flush(editor, notification, sizeof(notification));
+		if (buffer->content.len > 0 && buffer->content.data[0] == expected) return true;
+	}
+
+	return false;
+}
+
+/**
+ * Writes the byte in place, the size of the file stays the same
+ */
+static void rewrite_first_byte(const char *path, char byte)
+{
+	FILE *out = fopen(path, "r+");
+
+	assert(out != NULL);
+	assert(fputc(byte, out) == byte);
+	assert(fclose(out) == 0);
+}
+
+int main(void)
+{
+	char path[] = "/tmp/smacs_reload_test_XXXXXX";
+	Editor editor = {0};
+	Buffer *buffer;
+	size_t size;
+	FILE *out;
+	int fd;
+
+	fd = mkstemp(path);
+	assert(fd >= 0);
+	out = fdopen(fd, "w");
+	for (size_t i = 0; i < RELOAD_TEST_LINES; ++i) fprintf(out, "line %04zu of the log\n", i);
+	assert(fclose(out) == 0);
+
+	if (!watch_start(&editor.watch)) {
+		fprintf(stderr, "No inotify, the reload test is skipped\n");
+		remove(path);
+		return 0;
+	}
+
+	editor.pane = &editor.panes[0];
+	editor.panes_len = 1;
+	layout_init(&editor.layout);
+
+	editor_read_file(&editor, path);
+	buffer = editor.pane->buffer;
+	size = buffer->content.len;
+	assert(buffer->content.data[0] == 'l');
+	assert(size > 2 * EDITOR_TAIL_CHECK && "The change is before the tail check");
+
+	//the same size with the old end unchanged is not a grown log
+	rewrite_first_byte(path, 'L');
+	assert(reload_wait(&editor, buffer, 'L') && "A rewrite of the same size is read again");
+	assert(buffer->content.len == size);
+	assert(buffer->disk_size == size);
+
+	//follow mode reads it again too, the cursor at the end stays there
+	buffer->follow = true;
+	editor.pane->position = size;
+	rewrite_first_byte(path, 'X');
+	assert(reload_wait(&editor, buffer, 'X') && "A followed file rewritten at the same size is read again");
+	assert(buffer->content.len == size);
+	assert(editor.pane->position == size);
+	assert(memcmp(&buffer->content.data[1], "ine 0000", 8) == 0);
+
+	watch_stop(&editor.watch);
+	editor_destroy(&editor);
+	remove(path);
+
+	return 0;
+}
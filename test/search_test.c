@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <assert.h>
+
+#include "../src/search.h"
+
+#define TEXT_LEN 5000
+
+static long naive_forward(char *text, size_t text_len, char *needle, size_t len, size_t from)
+{
+	for (size_t i = from; i + len <= text_len; ++i) {
+		if (strncasecmp(&text[i], needle, len) == 0) return (long) i;
+	}
+
+	return -1;
+}
+
+static long naive_backward(char *text, size_t text_len, char *needle, size_t len, size_t from)
+{
+	if (len > text_len) return -1;
+
+	for (long i = (long) (from < text_len - len ? from : text_len - len); i >= 0; --i) {
+		if (strncasecmp(&text[i], needle, len) == 0) return i;
+	}
+
+	return -1;
+}
+
+static void check(char *text, size_t text_len, char *needle, size_t len)
+{
+	SearchPattern pattern;
+
+	search_compile(&pattern, needle, len);
+
+	for (size_t from = 0; from <= text_len; from += 7) {
+		assert(search_forward(&pattern, text, text_len, from) == naive_forward(text, text_len, needle, len, from)
+			   && "Forward search should find the same match as the naive one");
+		assert(search_backward(&pattern, text, text_len, from) == naive_backward(text, text_len, needle, len, from)
+			   && "Backward search should find the same match as the naive one");
+	}
+
+	search_free(&pattern);
+}
+
+int main(void)
+{
+	//small alphabet for a lot of partial matches
+	static const char *alphabet = "abAB \n";
+	char *text = malloc(TEXT_LEN + 1);
+	char needle[64];
+	size_t len;
+
+	srand(42);
+	for (size_t i = 0; i < TEXT_LEN; ++i) text[i] = alphabet[rand() % 6];
+	text[TEXT_LEN] = '\0';
+
+	for (size_t round = 0; round < 200; ++round) {
+		len = 1 + (size_t) rand() % (round % 2 ? 8 : 40);
+		for (size_t i = 0; i < len; ++i) needle[i] = alphabet[rand() % 6];
+
+		//half of the needles are taken from the text so they are found
+		if (round % 4 == 0) memcpy(needle, &text[rand() % (TEXT_LEN - len)], len);
+
+		check(text, TEXT_LEN, needle, len);
+		check(text, 33, needle, len);
+	}
+
+	char *utf8 = "Привет, МИР! hello WORLD, мир";
+	SearchPattern pattern;
+
+	search_compile(&pattern, "world", 5);
+	assert(search_forward(&pattern, utf8, strlen(utf8), 0) == (long) strlen("Привет, МИР! hello ") && "ASCII is case-insensitive");
+	search_free(&pattern);
+
+	search_compile(&pattern, "мир", strlen("мир"));
+	assert(search_forward(&pattern, utf8, strlen(utf8), 0) == (long) strlen("Привет, МИР! hello WORLD, ") && "Non-ASCII bytes are compared as is");
+	assert(search_backward(&pattern, utf8, strlen(utf8), 10) == -1 && "No match before");
+	search_free(&pattern);
+
+	char long_text[200] = {0};
+	char *long_needle = "a long needle which goes to the horspool search";
+	memset(long_text, 'x', sizeof(long_text) - 1);
+	memcpy(&long_text[100], "A LONG NEEDLE which goes to the Horspool search", strlen(long_needle));
+
+	search_compile(&pattern, long_needle, strlen(long_needle));
+	assert(pattern.horspool && "Long needle should use horspool");
+	assert(search_forward(&pattern, long_text, strlen(long_text), 0) == 100 && "Forward horspool");
+	assert(search_backward(&pattern, long_text, strlen(long_text), 199) == 100 && "Backward horspool");
+	assert(search_forward(&pattern, long_text, strlen(long_text), 101) == -1 && "No match after");
+	search_free(&pattern);
+
+	free(text);
+	return 0;
+}